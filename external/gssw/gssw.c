@@ -45,6 +45,11 @@
 #include <assert.h>
 #include "gssw.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GSSW_AVX2 1
+#endif
+
 //#define DEBUG_TRACEBACK
 
 #ifdef __GNUC__
@@ -68,6 +73,179 @@
  */
 #define kroundup32(x) (--(x), (x)|=(x)>>1, (x)|=(x)>>2, (x)|=(x)>>4, (x)|=(x)>>8, (x)|=(x)>>16, ++(x))
 
+/* Scratch memory of fills and trace backs: their column buffers, matrices, profiles, seeds, alignments, mappings and
+   cigars. Blocks are 32 byte aligned and follow a header that records their capacity and the arena they came from.
+   While the calling thread uses an arena (gssw_arena_use), blocks come from its chunks; freed ones go to a free list
+   of their capacity, which refills of the same read, needing blocks of the same sizes, take them from.
+   gssw_arena_reset releases them all at once. Without an arena blocks come from the heap. */
+#define GSSW_SCRATCH_ALIGN 32
+#define GSSW_ARENA_MIN_CHUNK (1 << 20)
+#define GSSW_ARENA_FREE_LISTS 64
+
+typedef struct gssw_scratch_header {
+    size_t capacity;
+    gssw_arena* arena;
+    struct gssw_scratch_header* next_free;
+} gssw_scratch_header;
+
+typedef struct gssw_arena_chunk {
+    struct gssw_arena_chunk* next;
+    char* data;
+    size_t size;
+    size_t used;
+} gssw_arena_chunk;
+
+struct gssw_arena {
+    gssw_arena_chunk* chunks; /* newest first, blocks come from the newest */
+    size_t total;             /* bytes in all chunks */
+    gssw_scratch_header* free_blocks[GSSW_ARENA_FREE_LISTS]; /* hashed by capacity */
+};
+
+static __thread gssw_arena* gssw_arena_current = NULL;
+
+static inline size_t gssw_scratch_round (size_t size) {
+    return (size + GSSW_SCRATCH_ALIGN - 1) / GSSW_SCRATCH_ALIGN * GSSW_SCRATCH_ALIGN;
+}
+
+static inline gssw_scratch_header* gssw_scratch_header_of (void* p) {
+    return (gssw_scratch_header*)((char*)p - GSSW_SCRATCH_ALIGN);
+}
+
+static inline gssw_scratch_header** gssw_arena_free_list (gssw_arena* a, size_t capacity) {
+    return &a->free_blocks[(capacity / GSSW_SCRATCH_ALIGN) % GSSW_ARENA_FREE_LISTS];
+}
+
+static gssw_arena_chunk* gssw_arena_chunk_create (size_t size) {
+    gssw_arena_chunk* c = (gssw_arena_chunk*)malloc(sizeof(gssw_arena_chunk));
+    if (!c || posix_memalign((void**)&c->data, GSSW_SCRATCH_ALIGN, size)) {
+        fprintf(stderr, "error:[gssw] Could not allocate memory for scratch arena\n");
+        exit(1);
+    }
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+static gssw_scratch_header* gssw_arena_alloc (gssw_arena* a, size_t capacity) {
+    const size_t need = GSSW_SCRATCH_ALIGN + capacity;
+    gssw_scratch_header** h = gssw_arena_free_list(a, capacity);
+    gssw_arena_chunk* c = a->chunks;
+    gssw_scratch_header* block;
+    for (; *h; h = &(*h)->next_free) {
+        if ((*h)->capacity == capacity) {
+            block = *h;
+            *h = block->next_free;
+            return block;
+        }
+    }
+    if (!c || c->size - c->used < need) {
+        size_t chunk_size = c ? 2*c->size : GSSW_ARENA_MIN_CHUNK;
+        if (chunk_size < need) chunk_size = need;
+        c = gssw_arena_chunk_create(chunk_size);
+        c->next = a->chunks;
+        a->chunks = c;
+        a->total += chunk_size;
+    }
+    block = (gssw_scratch_header*)(c->data + c->used);
+    c->used += need;
+    return block;
+}
+
+static void* gssw_scratch_malloc (size_t size) {
+    const size_t capacity = gssw_scratch_round(size);
+    gssw_scratch_header* h;
+    if (gssw_arena_current) {
+        h = gssw_arena_alloc(gssw_arena_current, capacity);
+    } else if (posix_memalign((void**)&h, GSSW_SCRATCH_ALIGN, GSSW_SCRATCH_ALIGN + capacity)) {
+        fprintf(stderr, "error:[gssw] Could not allocate scratch memory\n");
+        exit(1);
+    }
+    h->capacity = capacity;
+    h->arena = gssw_arena_current;
+    h->next_free = NULL;
+    return (char*)h + GSSW_SCRATCH_ALIGN;
+}
+
+static void* gssw_scratch_calloc (size_t size) {
+    void* p = gssw_scratch_malloc(size);
+    memset(p, 0, size);
+    return p;
+}
+
+static void gssw_scratch_free (void* p) {
+    gssw_scratch_header* h;
+    if (!p) return;
+    h = gssw_scratch_header_of(p);
+    if (h->arena) {
+        gssw_scratch_header** list = gssw_arena_free_list(h->arena, h->capacity);
+        h->next_free = *list;
+        *list = h;
+    } else {
+        free(h);
+    }
+}
+
+static void* gssw_scratch_realloc (void* p, size_t size) {
+    gssw_scratch_header* h;
+    gssw_arena_chunk* c;
+    void* q;
+    if (!p) return gssw_scratch_malloc(size);
+    h = gssw_scratch_header_of(p);
+    if (size <= h->capacity) return p;
+    /* the last block of the newest chunk grows in place */
+    c = h->arena ? h->arena->chunks : NULL;
+    if (c && (char*)p + h->capacity == c->data + c->used &&
+        gssw_scratch_round(size) - h->capacity <= c->size - c->used) {
+        c->used += gssw_scratch_round(size) - h->capacity;
+        h->capacity = gssw_scratch_round(size);
+        return p;
+    }
+    q = gssw_scratch_malloc(size);
+    memcpy(q, p, h->capacity);
+    gssw_scratch_free(p);
+    return q;
+}
+
+gssw_arena* gssw_arena_create (void) {
+    return (gssw_arena*)calloc(1, sizeof(gssw_arena));
+}
+
+void gssw_arena_reset (gssw_arena* a) {
+    gssw_arena_chunk* c = a->chunks;
+    if (c && c->next) {
+        /* one chunk for all that was needed so far */
+        while (c) {
+            gssw_arena_chunk* next = c->next;
+            free(c->data);
+            free(c);
+            c = next;
+        }
+        a->chunks = gssw_arena_chunk_create(a->total);
+    } else if (c) {
+        c->used = 0;
+    }
+    memset(a->free_blocks, 0, sizeof(a->free_blocks));
+}
+
+void gssw_arena_destroy (gssw_arena* a) {
+    if (!a) return;
+    if (gssw_arena_current == a) gssw_arena_current = NULL;
+    while (a->chunks) {
+        gssw_arena_chunk* next = a->chunks->next;
+        free(a->chunks->data);
+        free(a->chunks);
+        a->chunks = next;
+    }
+    free(a);
+}
+
+gssw_arena* gssw_arena_use (gssw_arena* a) {
+    gssw_arena* previous = gssw_arena_current;
+    gssw_arena_current = a;
+    return previous;
+}
+
 /* Generate query profile rearrange query sequence & calculate the weight of match/mismatch. */
 __m128i* gssw_qP_byte (const int8_t* read_num,
                        const int8_t* mat,
@@ -79,7 +257,7 @@ __m128i* gssw_qP_byte (const int8_t* read_num,
 								     Each piece is 8 bit. Split the read into 16 segments.
 								     Calculat 16 segments in parallel.
 								   */
-	__m128i* vProfile = (__m128i*)malloc(n * segLen * sizeof(__m128i));
+	__m128i* vProfile = (__m128i*)gssw_scratch_malloc(n * segLen * sizeof(__m128i));
 	int8_t* t = (int8_t*)vProfile;
 	int32_t nt, i, j, segNum;
 
@@ -108,7 +286,7 @@ __m128i* gssw_adj_qP_byte (const int8_t* read_num,
                                            Each piece is 8 bit. Split the read into 16 segments.
                                            Calculat 16 segments in parallel.
                                            */
-    __m128i* vProfile = (__m128i*)malloc(n * segLen * sizeof(__m128i));
+    __m128i* vProfile = (__m128i*)gssw_scratch_malloc(n * segLen * sizeof(__m128i));
     int8_t* t = (int8_t*)vProfile;
     int32_t nt, i, j, segNum;
     
@@ -182,21 +360,18 @@ gssw_alignment_end* gssw_sw_sse2_byte (const int8_t* ref,
     uint8_t* mH; // used to save matrices for external traceback: overall best score
     uint8_t* mE; // Gap in read best score
     uint8_t* mF; // Gap in ref best score
-    /* Note use of aligned memory.  Return value of 0 means success for posix_memalign. */
-    if (!(!posix_memalign((void**)&pvHStore,     sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvHLoad,      sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvHmax,       sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvE,          sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvEStore,     sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvFStore,     sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&alignment->seed.pvE,      sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&alignment->seed.pvHStore, sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&mH,           sizeof(__m128i), segLen*refLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&mE,           sizeof(__m128i), segLen*refLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&mF,           sizeof(__m128i), segLen*refLen*sizeof(__m128i)))) {
-        fprintf(stderr, "error:[gssw] Could not allocate memory required for alignment buffers.\n");
-        exit(1);
-    }
+    /* Note use of aligned memory. */
+    pvHStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvHLoad = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvHmax = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvE = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvEStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvFStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    alignment->seed.pvE = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    alignment->seed.pvHStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    mH = gssw_scratch_malloc(segLen*refLen*sizeof(__m128i));
+    mE = gssw_scratch_malloc(segLen*refLen*sizeof(__m128i));
+    mF = gssw_scratch_malloc(segLen*refLen*sizeof(__m128i));
 
     /* Workaround: zero memory ourselves because we don't have an aligned calloc */
     memset(pvHStore,                 0, segLen*sizeof(__m128i));
@@ -455,15 +630,15 @@ gssw_alignment_end* gssw_sw_sse2_byte (const int8_t* ref,
 
     //fprintf(stderr, "%p %p %p %p %p %p\n", *pmH, mH, pvHmax, pvE, pvHLoad, pvHStore);
 
-	free(pvE);
-	free(pvHmax);
-	free(pvHLoad);
-    free(pvHStore);
-    free(pvEStore);
-    free(pvFStore);
+	gssw_scratch_free(pvE);
+	gssw_scratch_free(pvHmax);
+	gssw_scratch_free(pvHLoad);
+    gssw_scratch_free(pvHStore);
+    gssw_scratch_free(pvEStore);
+    gssw_scratch_free(pvFStore);
 
 	/* Find the most possible 2nd best alignment. */
-	gssw_alignment_end* bests = (gssw_alignment_end*) calloc(2, sizeof(gssw_alignment_end));
+	gssw_alignment_end* bests = (gssw_alignment_end*) gssw_scratch_calloc(2*sizeof(gssw_alignment_end));
 	bests[0].score = max + bias >= 255 ? 255 : max;
 	bests[0].ref = end_ref;
 	bests[0].read = end_read;
@@ -478,7 +653,7 @@ __m128i* gssw_qP_word (const int8_t* read_num,
 				  const int32_t n) {
 
 	int32_t segLen = (readLen + 7) / 8;
-	__m128i* vProfile = (__m128i*)malloc(n * segLen * sizeof(__m128i));
+	__m128i* vProfile = (__m128i*)gssw_scratch_malloc(n * segLen * sizeof(__m128i));
 	int16_t* t = (int16_t*)vProfile;
 	int32_t nt, i, j;
 	int32_t segNum;
@@ -504,7 +679,7 @@ __m128i* gssw_adj_qP_word (const int8_t* read_num,
                            const int32_t n) {
 
     int32_t segLen = (readLen + 7) / 8;
-    __m128i* vProfile = (__m128i*) malloc(n * segLen * sizeof(__m128i));
+    __m128i* vProfile = (__m128i*) gssw_scratch_malloc(n * segLen * sizeof(__m128i));
     int16_t* t = (int16_t*) vProfile;
     int32_t nt, i, j, segNum;
 
@@ -555,20 +730,17 @@ gssw_alignment_end* gssw_sw_sse2_word (const int8_t* ref,
     uint16_t* mF; // Ref gap
     /* Note use of aligned memory */
 
-    if (!(!posix_memalign((void**)&pvHStore,     sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvHLoad,      sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvHmax,       sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvE,          sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvEStore,     sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&pvFStore,     sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&alignment->seed.pvE,      sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&alignment->seed.pvHStore, sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&mH,           sizeof(__m128i), segLen*refLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&mE,           sizeof(__m128i), segLen*refLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&mF,           sizeof(__m128i), segLen*refLen*sizeof(__m128i)))) {
-        fprintf(stderr, "error:[gssw] Could not allocate memory required for alignment buffers.\n");
-        exit(1);
-    }
+    pvHStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvHLoad = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvHmax = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvE = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvEStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    pvFStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    alignment->seed.pvE = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    alignment->seed.pvHStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    mH = gssw_scratch_malloc(segLen*refLen*sizeof(__m128i));
+    mE = gssw_scratch_malloc(segLen*refLen*sizeof(__m128i));
+    mF = gssw_scratch_malloc(segLen*refLen*sizeof(__m128i));
 
     /* Workaround: zero ourselves because we don't have an aligned calloc */
     memset(pvHStore,                 0, segLen*sizeof(__m128i));
@@ -714,36 +886,33 @@ end:
         
         // H matrix
         for (j = 0; LIKELY(j < segLen); ++j) {
-            uint16_t* t;
+            uint16_t t[8];
             int32_t ti;
-            vTemp = pvHStore[j];
-            for (t = (uint16_t*)&vTemp, ti = 0; ti < 8; ++ti) {
-                //fprintf(stdout, "%d\t", *t++);
-                ((uint16_t*)mH)[i*readLen + ti*segLen + j] = *t++;
+            _mm_storeu_si128((__m128i*)t, pvHStore[j]);
+            for (ti = 0; ti < 8; ++ti) {
+                ((uint16_t*)mH)[i*readLen + ti*segLen + j] = t[ti];
             }
             //fprintf(stdout, "\n");
         }
         
         // E matrix
         for (j = 0; LIKELY(j < segLen); ++j) {
-            uint16_t* t;
+            uint16_t t[8];
             int32_t ti;
-            vTemp = pvEStore[j];
-            for (t = (uint16_t*)&vTemp, ti = 0; ti < 8; ++ti) {
-                //fprintf(stdout, "%d\t", *t++);
-                ((uint16_t*)mE)[i*readLen + ti*segLen + j] = *t++;
+            _mm_storeu_si128((__m128i*)t, pvEStore[j]);
+            for (ti = 0; ti < 8; ++ti) {
+                ((uint16_t*)mE)[i*readLen + ti*segLen + j] = t[ti];
             }
             //fprintf(stdout, "\n");
         }
         
         // F matrix
         for (j = 0; LIKELY(j < segLen); ++j) {
-            uint16_t* t;
+            uint16_t t[8];
             int32_t ti;
-            vTemp = pvFStore[j];
-            for (t = (uint16_t*)&vTemp, ti = 0; ti < 8; ++ti) {
-                //fprintf(stdout, "%d\t", *t++);
-                ((uint16_t*)mF)[i*readLen + ti*segLen + j] = *t++;
+            _mm_storeu_si128((__m128i*)t, pvFStore[j]);
+            for (ti = 0; ti < 8; ++ti) {
+                ((uint16_t*)mF)[i*readLen + ti*segLen + j] = t[ti];
             }
             //fprintf(stdout, "\n");
         }
@@ -769,15 +938,533 @@ end:
 		}
 	}
 
-	free(pvE);
-	free(pvHmax);
-	free(pvHLoad);
-    free(pvHStore);
-    free(pvEStore);
-    free(pvFStore);
+	gssw_scratch_free(pvE);
+	gssw_scratch_free(pvHmax);
+	gssw_scratch_free(pvHLoad);
+    gssw_scratch_free(pvHStore);
+    gssw_scratch_free(pvEStore);
+    gssw_scratch_free(pvFStore);
 
 	/* Find the most possible 2nd best alignment. */
-	gssw_alignment_end* bests = (gssw_alignment_end*) calloc(2, sizeof(gssw_alignment_end));
+	gssw_alignment_end* bests = (gssw_alignment_end*) gssw_scratch_calloc(2*sizeof(gssw_alignment_end));
+	bests[0].score = max;
+	bests[0].ref = end_ref;
+	bests[0].read = end_read;
+
+	return bests;
+}
+
+#ifdef GSSW_AVX2
+
+/* The AVX2 fill kernels below keep the striped layout of the SSE2 ones: the lazy F loop and the seeds passed between
+   nodes depend on it, and so would the scores. They compute two stripes per instruction where the stripes are
+   independent, and use the wider registers to de-stripe the columns into mH, mE and mF, which is where the SSE2
+   kernels spend most of their time. Every matrix cell, seed and score comes out the same as with the SSE2 kernels. */
+
+/* Bit-reversed 4-bit and 3-bit numbers. 4 (3) rounds of unpacking neighbouring registers transpose a block of 16x16
+   bytes (8x8 words) if its rows go in and its columns come out in this order. */
+static const int32_t gssw_bitrev4[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+static const int32_t gssw_bitrev3[8] = {0, 4, 2, 6, 1, 5, 3, 7};
+
+/* Transpose the blocks of 16x16 bytes in both 128-bit halves of x[0..15]. */
+__attribute__((target("avx2")))
+static inline void gssw_transpose_byte_avx2 (__m256i* x) {
+    __m256i y[16];
+    int32_t k, round;
+    for (round = 0; round < 4; ++round) {
+        for (k = 0; k < 8; ++k) {
+            y[k] = _mm256_unpacklo_epi8(x[2*k], x[2*k + 1]);
+            y[k + 8] = _mm256_unpackhi_epi8(x[2*k], x[2*k + 1]);
+        }
+        for (k = 0; k < 16; ++k) x[k] = y[k];
+    }
+}
+
+/* Transpose the blocks of 8x8 words in both 128-bit halves of x[0..7]. */
+__attribute__((target("avx2")))
+static inline void gssw_transpose_word_avx2 (__m256i* x) {
+    __m256i y[8];
+    int32_t k, round;
+    for (round = 0; round < 3; ++round) {
+        for (k = 0; k < 4; ++k) {
+            y[k] = _mm256_unpacklo_epi16(x[2*k], x[2*k + 1]);
+            y[k + 4] = _mm256_unpackhi_epi16(x[2*k], x[2*k + 1]);
+        }
+        for (k = 0; k < 8; ++k) x[k] = y[k];
+    }
+}
+
+/* Save the H, E and F stripes of one column de-striped, as the un-swizzling loops of gssw_sw_sse2_byte do: each
+   row gets all 16 * segLen values, the read padding included. Blocks of 16 stripes are transposed at once. The last,
+   partial, block goes first so that the full blocks overwrite whatever its 16 byte stores put past a segment. */
+__attribute__((target("avx2")))
+static void gssw_unstripe_byte_avx2 (uint8_t* rowH, uint8_t* rowE, uint8_t* rowF,
+                                     const __m128i* pvH, const __m128i* pvE, const __m128i* pvF, int32_t segLen) {
+    const __m128i vZero = _mm_setzero_si128();
+    const int32_t column_len = segLen * 16;
+    const int32_t rest = segLen % 16;
+    const int32_t blocks = (segLen + 15) / 16;
+    int32_t block, r, ti;
+    for (block = 0; block < blocks; ++block) {
+        const int32_t j0 = !rest ? block * 16 : block ? (block - 1) * 16 : segLen - rest;
+        const int32_t count = rest && !block ? rest : 16;
+        __m256i vHE[16], vF[16];
+        for (r = 0; r < 16; ++r) {
+            const __m128i h = r < count ? _mm_load_si128(pvH + j0 + r) : vZero;
+            const __m128i e = r < count ? _mm_load_si128(pvE + j0 + r) : vZero;
+            const __m128i f = r < count ? _mm_load_si128(pvF + j0 + r) : vZero;
+            vHE[gssw_bitrev4[r]] = _mm256_inserti128_si256(_mm256_castsi128_si256(h), e, 1);
+            vF[gssw_bitrev4[r]] = _mm256_inserti128_si256(_mm256_castsi128_si256(f), vZero, 1);
+        }
+        gssw_transpose_byte_avx2(vHE);
+        gssw_transpose_byte_avx2(vF);
+        for (ti = 0; ti < 16; ++ti) {
+            const int32_t offset = ti * segLen + j0;
+            const __m128i h = _mm256_castsi256_si128(vHE[gssw_bitrev4[ti]]);
+            const __m128i e = _mm256_extracti128_si256(vHE[gssw_bitrev4[ti]], 1);
+            const __m128i f = _mm256_castsi256_si128(vF[gssw_bitrev4[ti]]);
+            if (LIKELY(offset + 16 <= column_len)) {
+                _mm_storeu_si128((__m128i*)(rowH + offset), h);
+                _mm_storeu_si128((__m128i*)(rowE + offset), e);
+                _mm_storeu_si128((__m128i*)(rowF + offset), f);
+            } else {
+                // do not write past the column
+                uint8_t t[3][16];
+                _mm_storeu_si128((__m128i*)t[0], h);
+                _mm_storeu_si128((__m128i*)t[1], e);
+                _mm_storeu_si128((__m128i*)t[2], f);
+                memcpy(rowH + offset, t[0], count);
+                memcpy(rowE + offset, t[1], count);
+                memcpy(rowF + offset, t[2], count);
+            }
+        }
+    }
+}
+
+/* Word version of gssw_unstripe_byte_avx2, blocks of 8 stripes. */
+__attribute__((target("avx2")))
+static void gssw_unstripe_word_avx2 (uint16_t* rowH, uint16_t* rowE, uint16_t* rowF,
+                                     const __m128i* pvH, const __m128i* pvE, const __m128i* pvF, int32_t segLen) {
+    const __m128i vZero = _mm_setzero_si128();
+    const int32_t column_len = segLen * 8;
+    const int32_t rest = segLen % 8;
+    const int32_t blocks = (segLen + 7) / 8;
+    int32_t block, r, ti;
+    for (block = 0; block < blocks; ++block) {
+        const int32_t j0 = !rest ? block * 8 : block ? (block - 1) * 8 : segLen - rest;
+        const int32_t count = rest && !block ? rest : 8;
+        __m256i vHE[8], vF[8];
+        for (r = 0; r < 8; ++r) {
+            const __m128i h = r < count ? _mm_load_si128(pvH + j0 + r) : vZero;
+            const __m128i e = r < count ? _mm_load_si128(pvE + j0 + r) : vZero;
+            const __m128i f = r < count ? _mm_load_si128(pvF + j0 + r) : vZero;
+            vHE[gssw_bitrev3[r]] = _mm256_inserti128_si256(_mm256_castsi128_si256(h), e, 1);
+            vF[gssw_bitrev3[r]] = _mm256_inserti128_si256(_mm256_castsi128_si256(f), vZero, 1);
+        }
+        gssw_transpose_word_avx2(vHE);
+        gssw_transpose_word_avx2(vF);
+        for (ti = 0; ti < 8; ++ti) {
+            const int32_t offset = ti * segLen + j0;
+            const __m128i h = _mm256_castsi256_si128(vHE[gssw_bitrev3[ti]]);
+            const __m128i e = _mm256_extracti128_si256(vHE[gssw_bitrev3[ti]], 1);
+            const __m128i f = _mm256_castsi256_si128(vF[gssw_bitrev3[ti]]);
+            if (LIKELY(offset + 8 <= column_len)) {
+                _mm_storeu_si128((__m128i*)(rowH + offset), h);
+                _mm_storeu_si128((__m128i*)(rowE + offset), e);
+                _mm_storeu_si128((__m128i*)(rowF + offset), f);
+            } else {
+                // do not write past the column
+                uint16_t t[3][8];
+                _mm_storeu_si128((__m128i*)t[0], h);
+                _mm_storeu_si128((__m128i*)t[1], e);
+                _mm_storeu_si128((__m128i*)t[2], f);
+                memcpy(rowH + offset, t[0], count * sizeof(uint16_t));
+                memcpy(rowE + offset, t[1], count * sizeof(uint16_t));
+                memcpy(rowF + offset, t[2], count * sizeof(uint16_t));
+            }
+        }
+    }
+}
+
+/* Allocate and clear the column buffers and matrices of a fill with segLen stripes of 16 bytes, seed it and hand the
+   matrices and the seed buffers to alignment. The order of buffers: pvHStore, pvHLoad, pvHmax, pvE, pvEStore,
+   pvFStore. */
+static void gssw_fill_buffers_create (int32_t segLen, int32_t refLen, gssw_align* alignment, const gssw_seed* seed,
+                                      __m128i** buffers) {
+    const size_t size = segLen*sizeof(__m128i);
+    int32_t k;
+    for (k = 0; k < 6; ++k) buffers[k] = gssw_scratch_malloc(size);
+    alignment->seed.pvE      = gssw_scratch_malloc(size);
+    alignment->seed.pvHStore = gssw_scratch_malloc(size);
+    alignment->mH            = gssw_scratch_malloc(size*refLen);
+    alignment->mE            = gssw_scratch_malloc(size*refLen);
+    alignment->mF            = gssw_scratch_malloc(size*refLen);
+    for (k = 0; k < 6; ++k) memset(buffers[k], 0, size);
+    memset(alignment->seed.pvE,      0, size);
+    memset(alignment->seed.pvHStore, 0, size);
+    memset(alignment->mH,            0, size*refLen);
+    memset(alignment->mE,            0, size*refLen);
+    memset(alignment->mF,            0, size*refLen);
+    if (seed) {
+        memcpy(buffers[3], seed->pvE, size);
+        memcpy(buffers[0], seed->pvHStore, size);
+    }
+}
+
+/* AVX2 version of gssw_sw_sse2_byte. */
+__attribute__((target("avx2")))
+gssw_alignment_end* gssw_sw_avx2_byte (const int8_t* ref,
+                                       int8_t ref_dir,	// 0: forward ref; 1: reverse ref
+                                       int32_t refLen,
+                                       int32_t readLen,
+                                       const uint8_t weight_gapO, /* will be used as - */
+                                       const uint8_t weight_gapE, /* will be used as - */
+                                       __m128i* vProfile,
+                                       uint8_t terminate,	/* not used, as in gssw_sw_sse2_byte */
+                                       uint8_t bias,  /* Shift 0 point to a positive value. */
+                                       int32_t maskLen,
+                                       gssw_align* alignment, /* to save seed and matrix */
+                                       const gssw_seed* seed) {     /* to seed the alignment */
+
+	uint8_t max = 0;		                     /* the max alignment score */
+	int32_t end_read = readLen - 1;
+	int32_t end_ref = -1; /* 0_based best alignment ending point; Initialized as isn't aligned -1. */
+	int32_t segLen = (readLen + 15) / 16; /* number of segment */
+
+    __m128i* buffers[6];
+    gssw_fill_buffers_create(segLen, refLen, alignment, seed, buffers);
+	__m128i* pvHStore = buffers[0];
+    __m128i* pvHLoad = buffers[1];
+    __m128i* pvHmax = buffers[2];
+    __m128i* pvE = buffers[3];
+    __m128i* pvEStore = buffers[4];
+    __m128i* pvFStore = buffers[5];
+    uint8_t* mH = (uint8_t*)alignment->mH;
+    uint8_t* mE = (uint8_t*)alignment->mE;
+    uint8_t* mF = (uint8_t*)alignment->mF;
+    alignment->is_byte = 1;
+
+	__m128i vZero = _mm_set1_epi32(0);
+	int32_t i, j;
+	__m128i vGapO = _mm_set1_epi8(weight_gapO);
+	__m128i vGapE = _mm_set1_epi8(weight_gapE);
+	__m128i vBias = _mm_set1_epi8(bias);
+	__m256i vGapO2 = _mm256_set1_epi8(weight_gapO);
+	__m256i vGapE2 = _mm256_set1_epi8(weight_gapE);
+	__m256i vBias2 = _mm256_set1_epi8(bias);
+
+	__m128i vMaxScore = vZero; /* Trace the highest score of the whole SW matrix. */
+	__m128i vMaxMark = vZero; /* Trace the highest score till the previous column. */
+	__m128i vTemp;
+	int32_t begin = 0, end = refLen, step = 1;
+
+	/* outer loop to process the reference sequence */
+	if (ref_dir == 1) {
+		begin = refLen - 1;
+		end = -1;
+		step = -1;
+	}
+	for (i = begin; LIKELY(i != end); i += step) {
+		int32_t cmp;
+		__m128i e, vF = vZero, vMaxColumn;
+		__m256i vMaxColumn2 = _mm256_setzero_si256();
+        __m128i vH = _mm_load_si128 (pvHStore + (segLen - 1));
+		vH = _mm_slli_si128 (vH, 1); /* Shift the 128-bit value in vH left by 1 byte. */
+		__m128i* vP = vProfile + ref[i] * segLen; /* Right part of the vProfile */
+
+		/* Swap the 2 H buffers. */
+		__m128i* pv = pvHLoad;
+		pvHLoad = pvHStore;
+		pvHStore = pv;
+
+		/* inner loop to process the query sequence, two stripes at a time. Only F depends on the stripe before. */
+		for (j = 0; LIKELY(j + 1 < segLen); j += 2) {
+			__m256i vH2 = _mm256_inserti128_si256(_mm256_castsi128_si256(vH), _mm_load_si128(pvHLoad + j), 1);
+			__m256i e2 = _mm256_load_si256((__m256i*)(pvE + j));
+			__m128i vH0, vH1, vF0 = vF;
+			vH2 = _mm256_adds_epu8(vH2, _mm256_loadu_si256((__m256i*)(vP + j)));
+			vH2 = _mm256_subs_epu8(vH2, vBias2);
+			vH2 = _mm256_max_epu8(vH2, e2);
+
+			vH0 = _mm_max_epu8(_mm256_castsi256_si128(vH2), vF);
+			vF = _mm_max_epu8(_mm_subs_epu8(vF, vGapE), _mm_subs_epu8(vH0, vGapO));
+			vH1 = _mm_max_epu8(_mm256_extracti128_si256(vH2, 1), vF);
+			vH2 = _mm256_inserti128_si256(_mm256_castsi128_si256(vH0), vH1, 1);
+			vMaxColumn2 = _mm256_max_epu8(vMaxColumn2, vH2);
+
+			_mm256_store_si256((__m256i*)(pvHStore + j), vH2);
+			_mm256_store_si256((__m256i*)(pvEStore + j), e2);
+			_mm256_store_si256((__m256i*)(pvFStore + j), _mm256_inserti128_si256(_mm256_castsi128_si256(vF0), vF, 1));
+
+			vF = _mm_max_epu8(_mm_subs_epu8(vF, vGapE), _mm_subs_epu8(vH1, vGapO));
+			e2 = _mm256_max_epu8(_mm256_subs_epu8(e2, vGapE2), _mm256_subs_epu8(vH2, vGapO2));
+			_mm256_store_si256((__m256i*)(pvE + j), e2);
+
+			vH = _mm_load_si128(pvHLoad + j + 1);
+		}
+		vMaxColumn = _mm_max_epu8(_mm256_castsi256_si128(vMaxColumn2), _mm256_extracti128_si256(vMaxColumn2, 1));
+		if (j < segLen) {
+			vH = _mm_adds_epu8(vH, _mm_load_si128(vP + j));
+			vH = _mm_subs_epu8(vH, vBias);
+			e = _mm_load_si128(pvE + j);
+			vH = _mm_max_epu8(vH, e);
+			vH = _mm_max_epu8(vH, vF);
+			vMaxColumn = _mm_max_epu8(vMaxColumn, vH);
+			_mm_store_si128(pvHStore + j, vH);
+			_mm_store_si128(pvEStore + j, e);
+			_mm_store_si128(pvFStore + j, vF);
+			vH = _mm_subs_epu8(vH, vGapO);
+			e = _mm_subs_epu8(e, vGapE);
+			e = _mm_max_epu8(e, vH);
+			vF = _mm_subs_epu8(vF, vGapE);
+			vF = _mm_max_epu8(vF, vH);
+			_mm_store_si128(pvE + j, e);
+		}
+
+		/* Lazy_F loop, as in gssw_sw_sse2_byte */
+        j = 0;
+        vH = _mm_load_si128 (pvHStore + j);
+        vF = _mm_slli_si128 (vF, 1);
+        vTemp = _mm_subs_epu8 (vH, vGapO);
+		vTemp = _mm_subs_epu8 (vF, vTemp);
+		vTemp = _mm_cmpeq_epi8 (vTemp, vZero);
+		cmp  = _mm_movemask_epi8 (vTemp);
+        while (cmp != 0xffff)
+        {
+            vH = _mm_max_epu8 (vH, vF);
+			vMaxColumn = _mm_max_epu8(vMaxColumn, vH);
+            _mm_store_si128 (pvHStore + j, vH);
+            vTemp = _mm_load_si128 (pvFStore + j);
+            vTemp = _mm_max_epu8 (vTemp, vF);
+            _mm_store_si128(pvFStore + j, vTemp);
+            vF = _mm_subs_epu8 (vF, vGapE);
+            j++;
+            if (j >= segLen)
+            {
+                j = 0;
+                vF = _mm_slli_si128 (vF, 1);
+            }
+            vH = _mm_load_si128 (pvHStore + j);
+            vTemp = _mm_subs_epu8 (vH, vGapO);
+            vTemp = _mm_subs_epu8 (vF, vTemp);
+            vTemp = _mm_cmpeq_epi8 (vTemp, vZero);
+            cmp  = _mm_movemask_epi8 (vTemp);
+        }
+
+		vMaxScore = _mm_max_epu8(vMaxScore, vMaxColumn);
+		vTemp = _mm_cmpeq_epi8(vMaxMark, vMaxScore);
+		cmp = _mm_movemask_epi8(vTemp);
+		if (cmp != 0xffff) {
+			uint8_t temp;
+			vMaxMark = vMaxScore;
+			m128i_max16(temp, vMaxScore);
+			vMaxScore = vMaxMark;
+
+			if (LIKELY(temp > max)) {
+				max = temp;
+				if (max + bias >= 255) break;	//overflow
+				end_ref = i;
+				memcpy(pvHmax, pvHStore, segLen*sizeof(__m128i));
+			}
+		}
+
+        // save the current column for traceback
+        gssw_unstripe_byte_avx2(mH + i*readLen, mE + i*readLen, mF + i*readLen, pvHStore, pvEStore, pvFStore, segLen);
+	}
+
+    memcpy(alignment->seed.pvE,      pvE,      segLen*sizeof(__m128i));
+    memcpy(alignment->seed.pvHStore, pvHStore, segLen*sizeof(__m128i));
+
+	/* Trace the alignment ending position on read. */
+	uint8_t *t = (uint8_t*)pvHmax;
+	int32_t column_len = segLen * 16;
+	for (i = 0; LIKELY(i < column_len); ++i, ++t) {
+		int32_t temp;
+		if (*t == max) {
+			temp = i / 16 + i % 16 * segLen;
+			if (temp < end_read) end_read = temp;
+		}
+	}
+
+	gssw_scratch_free(pvE);
+	gssw_scratch_free(pvHmax);
+	gssw_scratch_free(pvHLoad);
+    gssw_scratch_free(pvHStore);
+    gssw_scratch_free(pvEStore);
+    gssw_scratch_free(pvFStore);
+
+	gssw_alignment_end* bests = (gssw_alignment_end*) gssw_scratch_calloc(2*sizeof(gssw_alignment_end));
+	bests[0].score = max + bias >= 255 ? 255 : max;
+	bests[0].ref = end_ref;
+	bests[0].read = end_read;
+
+	return bests;
+}
+
+/* AVX2 version of gssw_sw_sse2_word. */
+__attribute__((target("avx2")))
+gssw_alignment_end* gssw_sw_avx2_word (const int8_t* ref,
+                                       int8_t ref_dir,	// 0: forward ref; 1: reverse ref
+                                       int32_t refLen,
+                                       int32_t readLen,
+                                       const uint8_t weight_gapO, /* will be used as - */
+                                       const uint8_t weight_gapE, /* will be used as - */
+                                       __m128i* vProfile,
+                                       uint16_t terminate,	/* not used, as in gssw_sw_sse2_word */
+                                       int32_t maskLen,
+                                       gssw_align* alignment, /* to save seed and matrix */
+                                       const gssw_seed* seed) {     /* to seed the alignment */
+
+	uint16_t max = 0;		                     /* the max alignment score */
+	int32_t end_read = readLen - 1;
+	int32_t end_ref = 0; /* 1_based best alignment ending point; Initialized as isn't aligned - 0. */
+	int32_t segLen = (readLen + 7) / 8; /* number of segment */
+
+    __m128i* buffers[6];
+    gssw_fill_buffers_create(segLen, refLen, alignment, seed, buffers);
+	__m128i* pvHStore = buffers[0];
+    __m128i* pvHLoad = buffers[1];
+    __m128i* pvHmax = buffers[2];
+    __m128i* pvE = buffers[3];
+    __m128i* pvEStore = buffers[4];
+    __m128i* pvFStore = buffers[5];
+    uint16_t* mH = (uint16_t*)alignment->mH;
+    uint16_t* mE = (uint16_t*)alignment->mE;
+    uint16_t* mF = (uint16_t*)alignment->mF;
+    alignment->is_byte = 0;
+
+	__m128i vZero = _mm_set1_epi32(0);
+	int32_t i, j, k;
+	__m128i vGapO = _mm_set1_epi16(weight_gapO);
+	__m128i vGapE = _mm_set1_epi16(weight_gapE);
+	__m256i vGapO2 = _mm256_set1_epi16(weight_gapO);
+	__m256i vGapE2 = _mm256_set1_epi16(weight_gapE);
+
+	__m128i vMaxScore = vZero; /* Trace the highest score of the whole SW matrix. */
+	__m128i vMaxMark = vZero; /* Trace the highest score till the previous column. */
+	__m128i vTemp;
+	int32_t begin = 0, end = refLen, step = 1;
+
+	/* outer loop to process the reference sequence */
+	if (ref_dir == 1) {
+		begin = refLen - 1;
+		end = -1;
+		step = -1;
+	}
+	for (i = begin; LIKELY(i != end); i += step) {
+		int32_t cmp;
+		__m128i e, vF = vZero, vMaxColumn;
+		__m256i vMaxColumn2 = _mm256_setzero_si256();
+		__m128i vH = pvHStore[segLen - 1];
+		vH = _mm_slli_si128 (vH, 2); /* Shift the 128-bit value in vH left by 2 byte. */
+		__m128i* vP = vProfile + ref[i] * segLen; /* Right part of the vProfile */
+
+		/* Swap the 2 H buffers. */
+		__m128i* pv = pvHLoad;
+		pvHLoad = pvHStore;
+		pvHStore = pv;
+
+		/* inner loop to process the query sequence, two stripes at a time. Only F depends on the stripe before. */
+		for (j = 0; LIKELY(j + 1 < segLen); j += 2) {
+			__m256i vH2 = _mm256_inserti128_si256(_mm256_castsi128_si256(vH), _mm_load_si128(pvHLoad + j), 1);
+			__m256i e2 = _mm256_load_si256((__m256i*)(pvE + j));
+			__m128i vH0, vH1, vF0 = vF;
+			vH2 = _mm256_adds_epi16(vH2, _mm256_loadu_si256((__m256i*)(vP + j)));
+			vH2 = _mm256_max_epi16(vH2, e2);
+
+			vH0 = _mm_max_epi16(_mm256_castsi256_si128(vH2), vF);
+			vF = _mm_max_epi16(_mm_subs_epu16(vF, vGapE), _mm_subs_epu16(vH0, vGapO));
+			vH1 = _mm_max_epi16(_mm256_extracti128_si256(vH2, 1), vF);
+			vH2 = _mm256_inserti128_si256(_mm256_castsi128_si256(vH0), vH1, 1);
+			vMaxColumn2 = _mm256_max_epi16(vMaxColumn2, vH2);
+
+			_mm256_store_si256((__m256i*)(pvHStore + j), vH2);
+			_mm256_store_si256((__m256i*)(pvEStore + j), e2);
+			_mm256_store_si256((__m256i*)(pvFStore + j), _mm256_inserti128_si256(_mm256_castsi128_si256(vF0), vF, 1));
+
+			vF = _mm_max_epi16(_mm_subs_epu16(vF, vGapE), _mm_subs_epu16(vH1, vGapO));
+			e2 = _mm256_max_epi16(_mm256_subs_epu16(e2, vGapE2), _mm256_subs_epu16(vH2, vGapO2));
+			_mm256_store_si256((__m256i*)(pvE + j), e2);
+
+			vH = _mm_load_si128(pvHLoad + j + 1);
+		}
+		vMaxColumn = _mm_max_epi16(_mm256_castsi256_si128(vMaxColumn2), _mm256_extracti128_si256(vMaxColumn2, 1));
+		if (j < segLen) {
+			vH = _mm_adds_epi16(vH, _mm_load_si128(vP + j));
+			e = _mm_load_si128(pvE + j);
+			vH = _mm_max_epi16(vH, e);
+			vH = _mm_max_epi16(vH, vF);
+			vMaxColumn = _mm_max_epi16(vMaxColumn, vH);
+			_mm_store_si128(pvHStore + j, vH);
+			_mm_store_si128(pvEStore + j, e);
+			_mm_store_si128(pvFStore + j, vF);
+			vH = _mm_subs_epu16(vH, vGapO);
+			e = _mm_subs_epu16(e, vGapE);
+			e = _mm_max_epi16(e, vH);
+			_mm_store_si128(pvE + j, e);
+			vF = _mm_subs_epu16(vF, vGapE);
+			vF = _mm_max_epi16(vF, vH);
+		}
+
+		/* Lazy_F loop, as in gssw_sw_sse2_word */
+		for (k = 0; LIKELY(k < 8); ++k) {
+			vF = _mm_slli_si128 (vF, 2);
+			for (j = 0; LIKELY(j < segLen); ++j) {
+				vH = _mm_load_si128(pvHStore + j);
+				vH = _mm_max_epi16(vH, vF);
+				_mm_store_si128(pvHStore + j, vH);
+                vTemp = _mm_load_si128 (pvFStore + j);
+                vTemp = _mm_max_epi16 (vTemp, vF);
+                _mm_store_si128(pvFStore + j, vTemp);
+				vH = _mm_subs_epu16(vH, vGapO);
+				vF = _mm_subs_epu16(vF, vGapE);
+				if (UNLIKELY(! _mm_movemask_epi8(_mm_cmpgt_epi16(vF, vH)))) goto end;
+			}
+		}
+
+end:
+		vMaxScore = _mm_max_epi16(vMaxScore, vMaxColumn);
+		vTemp = _mm_cmpeq_epi16(vMaxMark, vMaxScore);
+		cmp = _mm_movemask_epi8(vTemp);
+		if (cmp != 0xffff) {
+			uint16_t temp;
+			vMaxMark = vMaxScore;
+			m128i_max8(temp, vMaxScore);
+			vMaxScore = vMaxMark;
+
+			if (LIKELY(temp > max)) {
+				max = temp;
+				end_ref = i;
+				memcpy(pvHmax, pvHStore, segLen*sizeof(__m128i));
+			}
+		}
+
+        // save the current column for traceback
+        gssw_unstripe_word_avx2(mH + i*readLen, mE + i*readLen, mF + i*readLen, pvHStore, pvEStore, pvFStore, segLen);
+	}
+
+    memcpy(alignment->seed.pvE,      pvE,      segLen*sizeof(__m128i));
+    memcpy(alignment->seed.pvHStore, pvHStore, segLen*sizeof(__m128i));
+
+	/* Trace the alignment ending position on read. */
+	uint16_t *t = (uint16_t*)pvHmax;
+	int32_t column_len = segLen * 8;
+	for (i = 0; LIKELY(i < column_len); ++i, ++t) {
+		int32_t temp;
+		if (*t == max) {
+			temp = i / 8 + i % 8 * segLen;
+			if (temp < end_read) end_read = temp;
+		}
+	}
+
+	gssw_scratch_free(pvE);
+	gssw_scratch_free(pvHmax);
+	gssw_scratch_free(pvHLoad);
+    gssw_scratch_free(pvHStore);
+    gssw_scratch_free(pvEStore);
+    gssw_scratch_free(pvFStore);
+
+	gssw_alignment_end* bests = (gssw_alignment_end*) gssw_scratch_calloc(2*sizeof(gssw_alignment_end));
 	bests[0].score = max;
 	bests[0].ref = end_ref;
 	bests[0].read = end_read;
@@ -785,6 +1472,54 @@ end:
 	return bests;
 }
 
+#endif // GSSW_AVX2
+
+/* The widest vector instruction set the fill kernels may use, see gssw_set_simd. */
+static gssw_simd_t gssw_simd_limit = GSSW_SIMD_AVX2;
+
+static int gssw_use_avx2 (void) {
+#ifdef GSSW_AVX2
+	return gssw_simd_limit >= GSSW_SIMD_AVX2 && __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+gssw_simd_t gssw_set_simd (gssw_simd_t simd) {
+	gssw_simd_limit = simd;
+	return gssw_use_avx2() ? GSSW_SIMD_AVX2 : GSSW_SIMD_SSE2;
+}
+
+/* Byte fill with the widest kernel in use. */
+static gssw_alignment_end* gssw_sw_byte (const int8_t* ref, int8_t ref_dir, int32_t refLen, int32_t readLen,
+                                         const uint8_t weight_gapO, const uint8_t weight_gapE, __m128i* vProfile,
+                                         uint8_t terminate, uint8_t bias, int32_t maskLen, gssw_align* alignment,
+                                         const gssw_seed* seed) {
+#ifdef GSSW_AVX2
+	if (gssw_use_avx2()) {
+		return gssw_sw_avx2_byte(ref, ref_dir, refLen, readLen, weight_gapO, weight_gapE, vProfile, terminate, bias,
+		                         maskLen, alignment, seed);
+	}
+#endif
+	return gssw_sw_sse2_byte(ref, ref_dir, refLen, readLen, weight_gapO, weight_gapE, vProfile, terminate, bias,
+	                         maskLen, alignment, seed);
+}
+
+/* Word fill with the widest kernel in use. */
+static gssw_alignment_end* gssw_sw_word (const int8_t* ref, int8_t ref_dir, int32_t refLen, int32_t readLen,
+                                         const uint8_t weight_gapO, const uint8_t weight_gapE, __m128i* vProfile,
+                                         uint16_t terminate, int32_t maskLen, gssw_align* alignment,
+                                         const gssw_seed* seed) {
+#ifdef GSSW_AVX2
+	if (gssw_use_avx2()) {
+		return gssw_sw_avx2_word(ref, ref_dir, refLen, readLen, weight_gapO, weight_gapE, vProfile, terminate,
+		                         maskLen, alignment, seed);
+	}
+#endif
+	return gssw_sw_sse2_word(ref, ref_dir, refLen, readLen, weight_gapO, weight_gapE, vProfile, terminate, maskLen,
+	                         alignment, seed);
+}
+
 int8_t* gssw_seq_reverse(const int8_t* seq, int32_t end)	/* end is 0-based alignment ending position */
 {
 	int8_t* reverse = (int8_t*)calloc(end + 1, sizeof(int8_t));
@@ -810,7 +1545,7 @@ int8_t gssw_max_qual(const int8_t* qual, const int32_t len) {
 }
 
 gssw_profile* gssw_init (const int8_t* read, const int32_t readLen, const int8_t* mat, const int32_t n, const int8_t score_size) {
-	gssw_profile* p = (gssw_profile*)calloc(1, sizeof(struct gssw_profile));
+	gssw_profile* p = (gssw_profile*)gssw_scratch_calloc(sizeof(struct gssw_profile));
 	p->profile_byte = 0;
 	p->profile_word = 0;
 	p->bias = 0;
@@ -836,7 +1571,7 @@ gssw_profile* gssw_init (const int8_t* read, const int32_t readLen, const int8_t
  * be maximized to increase sensitity. */
 gssw_profile* gssw_qual_adj_init (const int8_t* read, const int8_t* qual, const int32_t readLen, const int8_t* adj_mat,
                                   const int32_t n, const int8_t score_size) {
-    gssw_profile* p = (gssw_profile*)calloc(1, sizeof(struct gssw_profile));
+    gssw_profile* p = (gssw_profile*)gssw_scratch_calloc(sizeof(struct gssw_profile));
     p->profile_byte = 0;
     p->bias = 0;
     if (score_size == 0 || score_size == 2) {
@@ -861,9 +1596,9 @@ gssw_profile* gssw_qual_adj_init (const int8_t* read, const int8_t* qual, const
 }
 
 void gssw_init_destroy (gssw_profile* p) {
-	free(p->profile_byte);
-	free(p->profile_word);
-	free(p);
+	gssw_scratch_free(p->profile_byte);
+	gssw_scratch_free(p->profile_word);
+	gssw_scratch_free(p);
 }
 
 gssw_align* gssw_fill (const gssw_profile* prof,
@@ -884,20 +1619,20 @@ gssw_align* gssw_fill (const gssw_profile* prof,
 
 	// Find the alignment scores and ending positions
 	if (prof->profile_byte) {
-		bests = gssw_sw_sse2_byte(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_byte, -1, prof->bias, maskLen,
+		bests = gssw_sw_byte(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_byte, -1, prof->bias, maskLen,
                              alignment, seed);
 
 		if (prof->profile_word && bests[0].score == 255) {
-			free(bests);
+			gssw_scratch_free(bests);
             gssw_align_clear_matrix_and_seed(alignment);
-            bests = gssw_sw_sse2_word(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_byte, -1, maskLen,
+            bests = gssw_sw_word(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_byte, -1, maskLen,
                                       alignment, seed);
         } else if (bests[0].score == 255) {
 			fprintf(stderr, "Please set 2 to the score_size parameter of the function ssw_init, otherwise the alignment results will be incorrect.\n");
 			return 0;
 		}
 	} else if (prof->profile_word) {
-		bests = gssw_sw_sse2_word(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_word, -1, maskLen,
+		bests = gssw_sw_word(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_word, -1, maskLen,
                                   alignment, seed);
     } else {
 		fprintf(stderr, "Please call the function ssw_init before ssw_align.\n");
@@ -916,14 +1651,14 @@ gssw_align* gssw_fill (const gssw_profile* prof,
 	    alignment->score2 = 0;
 		alignment->ref_end2 = -1;
 	}
-	free(bests);
+	gssw_scratch_free(bests);
     
 
 	return alignment;
 }
 
 gssw_align* gssw_align_create (void) {
-    gssw_align* a = (gssw_align*)calloc(1, sizeof(gssw_align));
+    gssw_align* a = (gssw_align*)gssw_scratch_calloc(sizeof(gssw_align));
     a->seed.pvHStore = NULL;
     a->seed.pvE = NULL;
     a->mH = NULL;
@@ -936,19 +1671,19 @@ gssw_align* gssw_align_create (void) {
 
 void gssw_align_destroy (gssw_align* a) {
     gssw_align_clear_matrix_and_seed(a);
-	free(a);
+	gssw_scratch_free(a);
 }
 
 void gssw_align_clear_matrix_and_seed (gssw_align* a) {
-    free(a->mH);
+    gssw_scratch_free(a->mH);
     a->mH = NULL;
-    free(a->mE);
+    gssw_scratch_free(a->mE);
     a->mE = NULL;
-    free(a->mF);
+    gssw_scratch_free(a->mF);
     a->mF = NULL;
-    free(a->seed.pvHStore);
+    gssw_scratch_free(a->seed.pvHStore);
     a->seed.pvHStore = NULL;
-    free(a->seed.pvE);
+    gssw_scratch_free(a->seed.pvE);
     a->seed.pvE = NULL;
 }
 
@@ -1208,7 +1943,7 @@ gssw_cigar* gssw_alignment_trace_back_byte (gssw_node* node,
     }
     
     // Start a CIGAR to hold the traceback.
-	gssw_cigar* result = (gssw_cigar*)calloc(1, sizeof(gssw_cigar));
+	gssw_cigar* result = (gssw_cigar*)gssw_scratch_calloc(sizeof(gssw_cigar));
     result->length = 0;
 
     while (LIKELY(scoreHere > 0 && i >= 0 && j >= 0)) {
@@ -1920,7 +2655,7 @@ gssw_cigar* gssw_alignment_trace_back_word (gssw_node* node,
     }
     
     // Start a CIGAR to hold the traceback.
-	gssw_cigar* result = (gssw_cigar*)calloc(1, sizeof(gssw_cigar));
+	gssw_cigar* result = (gssw_cigar*)gssw_scratch_calloc(sizeof(gssw_cigar));
     result->length = 0;
 
     while (LIKELY(scoreHere > 0 && i >= 0 && j >= 0)) {
@@ -2529,7 +3264,7 @@ gssw_cigar* gssw_alignment_trace_back_word (gssw_node* node,
 }
 
 gssw_graph_mapping* gssw_graph_mapping_create(void) {
-    gssw_graph_mapping* m = (gssw_graph_mapping*)calloc(1, sizeof(gssw_graph_mapping));
+    gssw_graph_mapping* m = (gssw_graph_mapping*)gssw_scratch_calloc(sizeof(gssw_graph_mapping));
     return m;
 }
 
@@ -2539,8 +3274,8 @@ void gssw_graph_mapping_destroy(gssw_graph_mapping* m) {
     for (i = 0; i < m->cigar.length; ++i) {
         gssw_cigar_destroy(m->cigar.elements[i].cigar);
     }
-    free(m->cigar.elements);
-    free(m);
+    gssw_scratch_free(m->cigar.elements);
+    gssw_scratch_free(m);
 }
 
 gssw_graph_cigar* gssw_graph_cigar_create(void) {
@@ -2552,7 +3287,7 @@ void gssw_graph_cigar_destroy(gssw_graph_cigar* g) {
     for (i = 0; i < g->length; ++i) {
         gssw_cigar_destroy(g->elements[i].cigar);
     }
-    free(g->elements);
+    gssw_scratch_free(g->elements);
 }
 
 void gssw_print_graph_cigar(gssw_graph_cigar* g, FILE* out) {
@@ -2596,9 +3331,9 @@ char* gssw_graph_mapping_to_string(gssw_graph_mapping* gm) {
 */
 
 void gssw_reverse_graph_cigar(gssw_graph_cigar* c) {
-	gssw_graph_cigar* reversed = (gssw_graph_cigar*)malloc(sizeof(gssw_graph_cigar));
+	gssw_graph_cigar* reversed = (gssw_graph_cigar*)gssw_scratch_malloc(sizeof(gssw_graph_cigar));
     reversed->length = c->length;
-	reversed->elements = (gssw_node_cigar*) malloc(c->length * sizeof(gssw_node_cigar));
+	reversed->elements = (gssw_node_cigar*) gssw_scratch_malloc(c->length * sizeof(gssw_node_cigar));
     gssw_node_cigar* c1 = c->elements;
     gssw_node_cigar* c2 = reversed->elements;
 	int32_t s = 0;
@@ -2609,9 +3344,9 @@ void gssw_reverse_graph_cigar(gssw_graph_cigar* c) {
 		++ s;
 		-- e;
 	}
-    free(c->elements);
+    gssw_scratch_free(c->elements);
     c->elements = reversed->elements;
-    free(reversed);
+    gssw_scratch_free(reversed);
 }
 
 // TODO: the suboptimal alignments this produces are all anchored to the end point of the optimal alignment
@@ -2746,7 +3481,7 @@ gssw_graph_mapping** gssw_graph_trace_back_internal (gssw_graph* graph,
         // long is thould be to start.
         uint32_t graph_cigar_bufsiz = 16;
         gc->elements = NULL;
-        gc->elements = realloc((void*) gc->elements, graph_cigar_bufsiz * sizeof(gssw_node_cigar));
+        gc->elements = gssw_scratch_realloc((void*) gc->elements, graph_cigar_bufsiz * sizeof(gssw_node_cigar));
         // And how much of it is used
         gc->length = 0;
         
@@ -2780,7 +3515,7 @@ gssw_graph_mapping** gssw_graph_trace_back_internal (gssw_graph* graph,
             
             if (gc->length == graph_cigar_bufsiz) {
                 graph_cigar_bufsiz *= 2;
-                gc->elements = realloc((void*) gc->elements, graph_cigar_bufsiz * sizeof(gssw_node_cigar));
+                gc->elements = gssw_scratch_realloc((void*) gc->elements, graph_cigar_bufsiz * sizeof(gssw_node_cigar));
             }
             
             // write the cigar to the current node
@@ -3679,14 +4414,14 @@ gssw_graph_mapping** gssw_graph_trace_back_pinned_qual_adj_multi (gssw_graph* gr
 void gssw_cigar_push_back(gssw_cigar* c, char type, uint32_t length) {
     if (c->length == 0) {
         c->length = 1;
-        c->elements = (gssw_cigar_element*) malloc(c->length * sizeof(gssw_cigar_element));
+        c->elements = (gssw_cigar_element*) gssw_scratch_malloc(c->length * sizeof(gssw_cigar_element));
         c->elements[0].type = type;
         c->elements[0].length = length;
     } else if (type != c->elements[c->length - 1].type) {
         c->length++;
         // change to not realloc every single freakin time
         // but e.g. on doubling
-        c->elements = (gssw_cigar_element*) realloc(c->elements, c->length * sizeof(gssw_cigar_element));
+        c->elements = (gssw_cigar_element*) gssw_scratch_realloc(c->elements, c->length * sizeof(gssw_cigar_element));
         c->elements[c->length - 1].type = type;
         c->elements[c->length - 1].length = length;
     } else {
@@ -3701,14 +4436,14 @@ void gssw_cigar_push_front(gssw_cigar* c, char type, uint32_t length) {
     /*
     if (c->length == 0) {
         c->length = 1;
-        c->elements = (gssw_cigar_element*) malloc(c->length * sizeof(gssw_cigar_element));
+        c->elements = (gssw_cigar_element*) gssw_scratch_malloc(c->length * sizeof(gssw_cigar_element));
         c->elements[0].type = type;
         c->elements[0].length = length;
     } else if (type != c->elements[0].type) {
         c->length++;
         // change to not realloc every single freakin time
         // but e.g. on doubling
-        c->elements = (gssw_cigar_element*) realloc(c->elements, c->length * sizeof(gssw_cigar_element));
+        c->elements = (gssw_cigar_element*) gssw_scratch_realloc(c->elements, c->length * sizeof(gssw_cigar_element));
         //gssw_cigar_element* new = (gssw_cigar_element*) malloc(c->length * sizeof(gssw_cigar_element));
         //(gssw_cigar_element*) memcpy(new + sizeof(gssw_cigar_element), c->elements, c->length-1 * sizeof(gssw_cigar_element));
         //free(c->elements);
@@ -3727,9 +4462,9 @@ void gssw_cigar_push_front(gssw_cigar* c, char type, uint32_t length) {
 
 void gssw_reverse_cigar(gssw_cigar* c) {
     if (!c->length) return; // bail out
-	gssw_cigar* reversed = (gssw_cigar*)malloc(sizeof(gssw_cigar));
+	gssw_cigar* reversed = (gssw_cigar*)gssw_scratch_malloc(sizeof(gssw_cigar));
     reversed->length = c->length;
-	reversed->elements = (gssw_cigar_element*) malloc(c->length * sizeof(gssw_cigar_element));
+	reversed->elements = (gssw_cigar_element*) gssw_scratch_malloc(c->length * sizeof(gssw_cigar_element));
     gssw_cigar_element* c1 = c->elements;
     gssw_cigar_element* c2 = reversed->elements;
 	int32_t s = 0;
@@ -3740,9 +4475,9 @@ void gssw_reverse_cigar(gssw_cigar* c) {
 		++ s;
 		-- e;
 	}
-    free(c->elements);
+    gssw_scratch_free(c->elements);
     c->elements = reversed->elements;
-    free(reversed);
+    gssw_scratch_free(reversed);
 }
 
 void gssw_print_cigar(gssw_cigar* c, FILE* out) {
@@ -3755,17 +4490,17 @@ void gssw_print_cigar(gssw_cigar* c, FILE* out) {
 }
 
 void gssw_cigar_destroy(gssw_cigar* c) {
-    free(c->elements);
+    gssw_scratch_free(c->elements);
     c->elements = NULL;
-    free(c);
+    gssw_scratch_free(c);
 }
 
 void gssw_seed_destroy(gssw_seed* s) {
-    free(s->pvE);
+    gssw_scratch_free(s->pvE);
     s->pvE = NULL;
-    free(s->pvHStore);
+    gssw_scratch_free(s->pvHStore);
     s->pvE = NULL;
-    free(s);
+    gssw_scratch_free(s);
 }
 
 //TODO: why is score_matrix even an argument here?
@@ -3790,14 +4525,16 @@ gssw_node* gssw_node_create(void* data,
 
 // for reuse of graph through multiple alignments
 void gssw_node_clear_alignment(gssw_node* n) {
-    gssw_align_destroy(n->alignment);
+    if (n->alignment) {
+        gssw_align_destroy(n->alignment);
+    }
     n->alignment = NULL;
 }
 
 void gssw_profile_destroy(gssw_profile* prof) {
-    free(prof->profile_byte);
-    free(prof->profile_word);
-    free(prof);
+    gssw_scratch_free(prof->profile_byte);
+    gssw_scratch_free(prof->profile_word);
+    gssw_scratch_free(prof);
 }
 
 void gssw_node_destroy(gssw_node* n) {
@@ -3906,12 +4643,9 @@ gssw_seed* gssw_create_seed_byte(int32_t readLen, gssw_node** prev, int32_t coun
 
     __m128i vZero = _mm_set1_epi32(0);
 	int32_t segLen = (readLen + 15) / 16;
-    gssw_seed* seed = (gssw_seed*)calloc(1, sizeof(gssw_seed));
-    if (!(!posix_memalign((void**)&seed->pvE,      sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&seed->pvHStore, sizeof(__m128i), segLen*sizeof(__m128i)))) {
-        fprintf(stderr, "error:[gssw] Could not allocate memory for alignment seed\n"); exit(1);
-        exit(1);
-    }
+    gssw_seed* seed = (gssw_seed*)gssw_scratch_calloc(sizeof(gssw_seed));
+    seed->pvE = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    seed->pvHStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
     memset(seed->pvE,      0, segLen*sizeof(__m128i));
     memset(seed->pvHStore, 0, segLen*sizeof(__m128i));
     // take the max of all inputs
@@ -3934,12 +4668,9 @@ gssw_seed* gssw_create_seed_word(int32_t readLen, gssw_node** prev, int32_t coun
     int32_t j = 0, k = 0;
     __m128i vZero = _mm_set1_epi32(0);
 	int32_t segLen = (readLen + 7) / 8;
-    gssw_seed* seed = (gssw_seed*)calloc(1, sizeof(gssw_seed));
-    if (!(!posix_memalign((void**)&seed->pvE,      sizeof(__m128i), segLen*sizeof(__m128i)) &&
-          !posix_memalign((void**)&seed->pvHStore, sizeof(__m128i), segLen*sizeof(__m128i)))) {
-        fprintf(stderr, "error:[gssw] Could not allocate memory for alignment seed\n"); exit(1);
-        exit(1);
-    }
+    gssw_seed* seed = (gssw_seed*)gssw_scratch_calloc(sizeof(gssw_seed));
+    seed->pvE = gssw_scratch_malloc(segLen*sizeof(__m128i));
+    seed->pvHStore = gssw_scratch_malloc(segLen*sizeof(__m128i));
     memset(seed->pvE,      0, segLen*sizeof(__m128i));
     memset(seed->pvHStore, 0, segLen*sizeof(__m128i));
     // take the max of all inputs
@@ -3999,7 +4730,7 @@ gssw_graph_fill_internal (gssw_graph* graph,
         gssw_seed_destroy(seed); seed = NULL; // cleanup seed
         // test if we have exceeded the score dynamic range
         if (prof->profile_byte && !filled_node) {
-            free(prof->profile_byte);
+            gssw_scratch_free(prof->profile_byte);
             prof->profile_byte = NULL;
             free(read_num);
             free(qual_num);
@@ -4094,14 +4825,14 @@ gssw_node_fill (gssw_node* node,
 
 	// Find the alignment scores and ending positions
 	if (prof->profile_byte) {
-		bests = gssw_sw_sse2_byte((const int8_t*)node->num, 0, node->len, readLen, weight_gapO, weight_gapE, prof->profile_byte, -1, prof->bias, maskLen, alignment, seed);
+		bests = gssw_sw_byte((const int8_t*)node->num, 0, node->len, readLen, weight_gapO, weight_gapE, prof->profile_byte, -1, prof->bias, maskLen, alignment, seed);
 		if (bests[0].score == 255) {
-			free(bests);
+			gssw_scratch_free(bests);
             gssw_align_clear_matrix_and_seed(alignment);
             return 0; // re-run from external context
 		}
 	} else if (prof->profile_word) {
-        bests = gssw_sw_sse2_word((const int8_t*)node->num, 0, node->len, readLen, weight_gapO, weight_gapE, prof->profile_word, -1, maskLen, alignment, seed);
+        bests = gssw_sw_word((const int8_t*)node->num, 0, node->len, readLen, weight_gapO, weight_gapE, prof->profile_word, -1, maskLen, alignment, seed);
     } else {
 		fprintf(stderr, "Please call the function ssw_init before ssw_align.\n");
 		return 0;
@@ -4119,7 +4850,7 @@ gssw_node_fill (gssw_node* node,
 	    alignment->score2 = 0;
 		alignment->ref_end2 = -1;
 	}
-	free(bests);
+	gssw_scratch_free(bests);
 
 	return node;
 
@@ -4555,7 +5286,7 @@ int8_t* gssw_dna_scaled_adjusted_qual_matrix(int8_t max_score, uint8_t max_qual,
 }
 
 gssw_multi_align_stack* gssw_new_multi_align_stack(int32_t capacity) {
-    gssw_multi_align_stack* stack = (gssw_multi_align_stack*) malloc(sizeof(gssw_multi_align_stack));
+    gssw_multi_align_stack* stack = (gssw_multi_align_stack*) gssw_scratch_malloc(sizeof(gssw_multi_align_stack));
     stack->current_size = 0;
     stack->capacity = capacity;
     stack->top_scoring = NULL;
@@ -4571,14 +5302,14 @@ void gssw_delete_multi_align_stack(gssw_multi_align_stack* stack) {
         gssw_delete_multi_align_stack_node(node);
         node = next;
     }
-    free(stack);
+    gssw_scratch_free(stack);
 }
 
 gssw_multi_align_stack_node* gssw_new_multi_align_stack_node(gssw_alternate_alignment_ends* alignment_suffix, int16_t score,
                                                              int32_t read_pos, int32_t ref_pos, gssw_node* from_node,
                                                              gssw_node* to_node, gssw_matrix_t from_matrix, gssw_matrix_t to_matrix) {
     
-    gssw_alternate_alignment_ends* alt_alignment = (gssw_alternate_alignment_ends*) malloc(sizeof(gssw_alternate_alignment_ends));
+    gssw_alternate_alignment_ends* alt_alignment = (gssw_alternate_alignment_ends*) gssw_scratch_malloc(sizeof(gssw_alternate_alignment_ends));
     
     // add score of the alignment
     alt_alignment->score = score;
@@ -4586,7 +5317,7 @@ gssw_multi_align_stack_node* gssw_new_multi_align_stack_node(gssw_alternate_alig
     // initialize list of deflections one longer than suffix
     int32_t num_suffix_deflections = alignment_suffix->num_deflections;
     alt_alignment->num_deflections = num_suffix_deflections + 1;
-    alt_alignment->deflections = (gssw_trace_back_deflection*) malloc(sizeof(gssw_trace_back_deflection) * alt_alignment->num_deflections);
+    alt_alignment->deflections = (gssw_trace_back_deflection*) gssw_scratch_malloc(sizeof(gssw_trace_back_deflection) * alt_alignment->num_deflections);
     
     // copy the preceding deflections
     int i;
@@ -4603,7 +5334,7 @@ gssw_multi_align_stack_node* gssw_new_multi_align_stack_node(gssw_alternate_alig
     alt_alignment->deflections[num_suffix_deflections].to_matrix = to_matrix;
     
     // create stack node for this alignment
-    gssw_multi_align_stack_node* stack_node = (gssw_multi_align_stack_node*) malloc(sizeof(gssw_multi_align_stack_node));
+    gssw_multi_align_stack_node* stack_node = (gssw_multi_align_stack_node*) gssw_scratch_malloc(sizeof(gssw_multi_align_stack_node));
     stack_node->alt_alignment = alt_alignment;
     stack_node->next = NULL;
     stack_node->prev = NULL;
@@ -4618,9 +5349,9 @@ void gssw_delete_multi_align_stack_node(gssw_multi_align_stack_node* stack_node)
     if (stack_node->prev) {
         stack_node->prev->next = NULL;
     }
-    free(stack_node->alt_alignment->deflections);
-    free(stack_node->alt_alignment);
-    free(stack_node);
+    gssw_scratch_free(stack_node->alt_alignment->deflections);
+    gssw_scratch_free(stack_node->alt_alignment);
+    gssw_scratch_free(stack_node);
 }
 
 // check if alignment is better than any of the top recorded alignments
@@ -567,6 +567,37 @@ void gssw_node_replace_prev(gssw_node* n, gssw_node* m, gssw_node* p);
 void gssw_node_replace_next(gssw_node* n, gssw_node* m, gssw_node* p);
 
 
+/*!	@typedef	vector instruction sets of the fill kernels	*/
+typedef enum gssw_simd_t {GSSW_SIMD_SSE2, GSSW_SIMD_AVX2} gssw_simd_t;
+
+/*!	@function	Limit the vector instruction set of the fill kernels; by default they use the widest one the CPU supports.
+	@param	simd	the widest instruction set to use
+	@return	the instruction set the fill kernels use from now on
+	@note	All instruction sets give the same scores, matrices and seeds. Not thread safe, meant for tests.
+*/
+gssw_simd_t gssw_set_simd (gssw_simd_t simd);
+
+/*!	@typedef	scratch memory for the matrices, profiles, seeds, alignments, mappings and cigars of fills and trace backs	*/
+typedef struct gssw_arena gssw_arena;
+
+/*!	@function	Create an empty arena	*/
+gssw_arena* gssw_arena_create (void);
+
+/*!	@function	Destroy an arena and everything allocated from it	*/
+void gssw_arena_destroy (gssw_arena* a);
+
+/*!	@function	Make fills and trace backs of the calling thread allocate from an arena.
+	@param	a	the arena; 0 to allocate from the heap again
+	@return	the arena the thread used before
+	@note	Destroying what was allocated from an arena keeps its memory in the arena for reuse; gssw_arena_reset releases it.
+*/
+gssw_arena* gssw_arena_use (gssw_arena* a);
+
+/*!	@function	Release everything allocated from an arena and keep its memory for the next allocations.
+	@note	Node alignments and mappings allocated from the arena must be destroyed or cleared first.
+*/
+void gssw_arena_reset (gssw_arena* a);
+
 gssw_node*
 gssw_node_fill (gssw_node* node,
                 const gssw_profile* prof,
@@ -600,6 +631,7 @@ gssw_graph* gssw_graph_create(uint32_t size);
 int32_t gssw_graph_add_node(gssw_graph* graph,
                             gssw_node* node);
 void gssw_graph_clear(gssw_graph* graph);
+void gssw_graph_clear_alignment(gssw_graph* graph);
 void gssw_graph_destroy(gssw_graph* graph);
 void gssw_graph_print_score_matrices(gssw_graph* graph,
                                      const char* read,
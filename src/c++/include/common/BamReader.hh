@@ -75,6 +75,16 @@ public:
 
     ~BamReader() override;
 
+    /**
+     * Create the process-wide htslib thread pool which all subsequently opened readers attach to for BGZF / CRAM
+     * decoding. Decoding threads are taken out of the total thread budget so that the pool and CPU_THREADS together
+     * do not oversubscribe the process. Must be called at most once, before any reader is opened.
+     * @param decode_threads number of threads for the htslib pool, 0 disables the pool
+     * @param total_threads number of threads available to the process
+     * @return number of threads left for CPU_THREADS
+     */
+    static unsigned initDecodeThreadPool(unsigned decode_threads, unsigned total_threads);
+
     /**
      * Initialize BAM file for reading at a given region.
      * return true if find the region
@@ -87,12 +97,28 @@ public:
      */
     bool getAlign(Read& align) override;
 
+    /**
+     * Advances to the next alignment and returns its position fields without decoding the record
+     * return false if the region is exhausted.
+     */
+    bool nextAlign(AlignCore& core) override;
+
+    /**
+     * Decodes the alignment last returned by nextAlign / getAlign
+     */
+    void decodeAlign(Read& read) override;
+
     /**
      *  fetch information for the mate of this aligned read
      * return true if found
      */
     bool getAlignedMate(const Read& read, Read& mate) override;
 
+    /**
+     * fetch the mates of a batch of reads in a single pass over the sorted mate positions
+     */
+    void getAlignedMates(std::vector<Read const*> const& reads, std::vector<Read>& mates) override;
+
     /**
      * estimate depth on a given region
      */
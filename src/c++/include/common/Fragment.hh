@@ -30,6 +30,8 @@
 #include <memory>
 #include <string>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "graphcore/GraphCoordinates.hh"
 
@@ -62,8 +64,13 @@ public:
     uint64_t get_bam_fragment_length() const { return bam_fragment_length_; }
     uint64_t get_graph_fragment_length() const { return fragment_length_; }
 
-    std::unordered_set<std::string> const& graph_nodes_supported() const { return graph_nodes_supported_; }
-    std::unordered_set<std::string> const& graph_edges_supported() const { return graph_edges_supported_; }
+    /** sorted ids of nodes supported by any read in the fragment */
+    std::vector<graphtools::NodeId> const& graph_nodes_supported() const { return graph_nodes_supported_; }
+    /** sorted edges supported by any read in the fragment */
+    std::vector<std::pair<graphtools::NodeId, graphtools::NodeId>> const& graph_edges_supported() const
+    {
+        return graph_edges_supported_;
+    }
     std::unordered_set<std::string> const& graph_sequences_supported() const { return graph_sequences_supported_; }
     std::unordered_set<std::string> const& graph_sequences_broken() const { return graph_sequences_broken_; }
 
@@ -73,8 +80,8 @@ private:
     int n_graph_forward_reads = 0;
     int n_graph_reverse_reads = 0;
 
-    std::unordered_set<std::string> graph_nodes_supported_ = {};
-    std::unordered_set<std::string> graph_edges_supported_ = {};
+    std::vector<graphtools::NodeId> graph_nodes_supported_ = {};
+    std::vector<std::pair<graphtools::NodeId, graphtools::NodeId>> graph_edges_supported_ = {};
     std::unordered_set<std::string> graph_sequences_supported_ = {};
     std::unordered_set<std::string> graph_sequences_broken_ = {};
 
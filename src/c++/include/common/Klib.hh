@@ -59,11 +59,34 @@ public:
      */
     void setRef(const char* seq);
 
+    /**
+     * @brief copy the already translated target sequence of another alignment
+     */
+    void setRef(KlibAlignment const& that);
+
+    /**
+     * @brief use the translated target sequence of another alignment without copying it. Keeps the query profile,
+     * so one query can be aligned against many targets. Only for alignments used by the same thread
+     */
+    void shareRef(KlibAlignment const& that);
+
+    /**
+     * @brief as above but only use length bases of the target starting at offset. Reported target positions are
+     * relative to offset
+     */
+    void shareRef(KlibAlignment const& that, int offset, int length);
+
     /*
      * @brief set query sequence
      */
     void setQuery(const char* seq);
 
+    /**
+     * @brief use the score and end positions found for the current query and target elsewhere, e.g. by
+     * KlibBatchAlignment, instead of running the forward pass. The start positions and cigar are computed as usual
+     */
+    void setEnd(int score, int targetEnd, int queryEnd);
+
     /**
      * @brief Get the alignment score
      */
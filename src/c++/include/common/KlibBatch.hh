@@ -0,0 +1,105 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Inter-query vectorized forward pass of the klib Smith Waterman
+ *
+ * \file KlibBatch.hh
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/Alignment.hh"
+
+namespace common
+{
+
+/**
+ * Finds the best local alignment score and end positions for several queries at once, one query per 16-bit vector
+ * lane. All queries are aligned against windows of the same target. The results are exactly those the forward pass of
+ * KlibAlignment produces, so each alignment can be completed with KlibAlignment::setEnd
+ */
+class KlibBatchAlignment
+{
+public:
+    /**
+     * One query and the window of the target to align it to
+     */
+    struct Job
+    {
+        Job(const char* query, int queryLength, int windowStart, int windowEnd)
+            : query_(query)
+            , queryLength_(queryLength)
+            , windowStart_(windowStart)
+            , windowEnd_(windowEnd)
+        {
+        }
+
+        const char* query_;
+        int queryLength_;
+        /// target offsets of the first base and one past the last base of the window
+        int windowStart_;
+        int windowEnd_;
+
+        /// best score. 0 if nothing aligns
+        int score_ = 0;
+        /// last aligned target base relative to windowStart_, -1 if score_ is 0
+        int targetEnd_ = -1;
+        /// last aligned query base
+        int queryEnd_ = -1;
+    };
+
+    explicit KlibBatchAlignment(AlignmentParameters const& ap);
+
+    /**
+     * @return maximum number of jobs aligned at once. Depends on the vector instructions the CPU supports
+     */
+    static std::size_t lanes();
+
+    /**
+     * @brief align up to lanes() queries and store the results in the jobs
+     * @param target target sequence covering the windows of all jobs
+     */
+    void align(const char* target, Job* begin, Job* end);
+
+private:
+    int8_t mat_[25];
+    int gapo_;
+    int gape_;
+
+    std::vector<uint8_t> target_;
+    std::vector<int16_t> profile_;
+    std::vector<int16_t> resetF_;
+    std::vector<int16_t> h_;
+    std::vector<int16_t> e_;
+    std::vector<int16_t> hMax_;
+};
+}
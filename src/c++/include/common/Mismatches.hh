@@ -0,0 +1,57 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Vectorized counting of mismatching bases between two sequences
+ *
+ * \file Mismatches.hh
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace common
+{
+
+/**
+ * Count the positions at which two sequences of equal length differ. Uses the widest byte compare the CPU supports.
+ * Bases are compared as characters, so N matches N only.
+ * @param sequence first sequence, at least length characters
+ * @param reference second sequence, at least length characters
+ * @param length number of characters to compare
+ * @param limit counting stops once the number of mismatches exceeds limit. The returned value is then greater than
+ *              limit but not necessarily the total count
+ * @return number of mismatches
+ */
+unsigned countMismatches(const char* sequence, const char* reference, std::size_t length, unsigned limit = -1U);
+
+/**
+ * Portable implementation of countMismatches. Used when the CPU has no suitable vector instructions
+ */
+unsigned countMismatchesScalar(const char* sequence, const char* reference, std::size_t length, unsigned limit = -1U);
+}
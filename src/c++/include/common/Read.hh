@@ -35,9 +35,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "graphalign/GraphAlignment.hh"
+#include "graphcore/Graph.hh"
 #include "json/json.h"
 
 namespace common
@@ -56,6 +62,9 @@ public:
 
     Read() = default;
     Read(Read const& rhs) = default;
+    Read(Read&& rhs) = default;
+    Read& operator=(Read const& rhs) = default;
+    Read& operator=(Read&& rhs) = default;
 
     Read(std::string const& fragment_id, std::string const& bases, std::string const& quals)
     {
@@ -79,6 +88,12 @@ public:
     void set_bases(std::string const& value) { bases_ = value; };
     std::string const& quals() const { return quals_; };
     void set_quals(std::string const& value) { quals_ = value; };
+    /**
+     * Writable buffers for decoding in place. A Read that is decoded into repeatedly keeps their capacity
+     */
+    std::string& mutable_fragment_id() { return fragment_id_; };
+    std::string& mutable_bases() { return bases_; };
+    std::string& mutable_quals() { return quals_; };
     int32_t chrom_id() const { return chrom_id_; };
     void set_chrom_id(int32_t value) { chrom_id_ = value; };
     int32_t pos() const { return pos_; };
@@ -102,9 +117,27 @@ public:
     void set_mate_pos(int32_t value) { mate_pos_ = value; };
 
     int32_t graph_pos() const { return graph_pos_; };
-    void set_graph_pos(int32_t value) { graph_pos_ = value; };
+    void set_graph_pos(int32_t value)
+    {
+        graph_pos_ = value;
+        graph_alignment_.reset();
+    };
     std::string const& graph_cigar() const { return graph_cigar_; };
-    void set_graph_cigar(std::string value) { graph_cigar_ = value; };
+    void set_graph_cigar(std::string value)
+    {
+        graph_cigar_ = value;
+        graph_alignment_.reset();
+    };
+
+    /**
+     * Decoded graph_pos and graph_cigar. The alignment is decoded on first access and kept until
+     * graph_pos or graph_cigar change, so pipeline stages don't have to re-parse the cigar.
+     * Throws if the cigar does not describe a valid alignment on graph
+     * @param graph graph the read was aligned to
+     */
+    graphtools::GraphAlignment const& graph_alignment(graphtools::Graph const* graph) const;
+    /** drop the decoded alignment, which refers to the graph, before the graph goes away */
+    void clear_graph_alignment() { graph_alignment_.reset(); };
     int32_t graph_mapq() const { return graph_mapq_; };
     void set_graph_mapq(int32_t value) { graph_mapq_ = value; };
     int32_t graph_alignment_score() const { return graph_alignment_score_; };
@@ -114,14 +147,18 @@ public:
     bool is_graph_reverse_strand() const { return is_graph_reverse_strand_; };
     void set_is_graph_reverse_strand(bool value) { is_graph_reverse_strand_ = value; };
 
-    std::vector<std::string> const& graph_nodes_supported() const { return graph_nodes_supported_; };
-    void add_graph_nodes_supported(std::string const& value) { graph_nodes_supported_.push_back(value); };
-    std::string const& graph_nodes_supported(size_t pos) const { return graph_nodes_supported_[pos]; };
+    std::vector<graphtools::NodeId> const& graph_nodes_supported() const { return graph_nodes_supported_; };
+    void add_graph_nodes_supported(graphtools::NodeId value) { graph_nodes_supported_.push_back(value); };
     void clear_graph_nodes_supported() { graph_nodes_supported_.clear(); };
 
-    std::vector<std::string> const& graph_edges_supported() const { return graph_edges_supported_; };
-    std::string const& graph_edges_supported(size_t pos) const { return graph_edges_supported_[pos]; };
-    void add_graph_edges_supported(std::string const& value) { graph_edges_supported_.push_back(value); };
+    std::vector<std::pair<graphtools::NodeId, graphtools::NodeId>> const& graph_edges_supported() const
+    {
+        return graph_edges_supported_;
+    };
+    void add_graph_edges_supported(graphtools::NodeId from, graphtools::NodeId to)
+    {
+        graph_edges_supported_.emplace_back(from, to);
+    };
     void clear_graph_edges_supported() { graph_edges_supported_.clear(); };
 
     std::vector<std::string> const& graph_sequences_supported() const { return graph_sequences_supported_; };
@@ -146,7 +183,11 @@ public:
             && mate_pos() == other.mate_pos();
     }
 
-    Json::Value toJson() const
+    /**
+     * @param graph graph that the supported node and edge ids refer to; supported nodes and edges are only
+     *              written by name when it is given
+     */
+    Json::Value toJson(graphtools::Graph const* graph = nullptr) const
     {
         Json::Value val;
 
@@ -191,20 +232,27 @@ public:
         if (is_graph_reverse_strand_)
             val["isGraphReverseStrand"] = true;
 
-        if (!graph_nodes_supported_.empty())
+        if (graph != nullptr && !graph_nodes_supported_.empty())
         {
             val["graphNodesSupported"] = Json::arrayValue;
-            for (auto const& s : graph_nodes_supported_)
+            for (auto const& n : graph_nodes_supported_)
             {
-                val["graphNodesSupported"].append(s);
+                val["graphNodesSupported"].append(graph->nodeName(n));
             }
         }
-        if (!graph_edges_supported_.empty())
+        if (graph != nullptr && !graph_edges_supported_.empty())
         {
+            // edges are listed by node names
+            std::vector<std::pair<std::string, std::string>> edge_names;
+            for (auto const& e : graph_edges_supported_)
+            {
+                edge_names.emplace_back(graph->nodeName(e.first), graph->nodeName(e.second));
+            }
+            std::sort(edge_names.begin(), edge_names.end());
             val["graphEdgesSupported"] = Json::arrayValue;
-            for (auto const& s : graph_edges_supported_)
+            for (auto const& e : edge_names)
             {
-                val["graphEdgesSupported"].append(s);
+                val["graphEdgesSupported"].append(e.first + "_" + e.second);
             }
         }
         if (!graph_sequences_supported_.empty())
@@ -257,13 +305,15 @@ private:
 
     int32_t graph_pos_ = 0;
     std::string graph_cigar_;
+    /** cache for graph_alignment(), shared between copies of the read */
+    mutable std::shared_ptr<const graphtools::GraphAlignment> graph_alignment_;
     int32_t graph_mapq_ = 0;
     int32_t graph_alignment_score_ = 0;
     bool is_graph_alignment_unique_ = false;
     bool is_graph_reverse_strand_ = false;
 
-    std::vector<std::string> graph_nodes_supported_;
-    std::vector<std::string> graph_edges_supported_;
+    std::vector<graphtools::NodeId> graph_nodes_supported_;
+    std::vector<std::pair<graphtools::NodeId, graphtools::NodeId>> graph_edges_supported_;
     std::vector<std::string> graph_sequences_supported_;
     std::vector<std::string> graph_sequences_broken_;
 
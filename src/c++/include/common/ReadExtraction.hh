@@ -37,6 +37,15 @@
 namespace common
 {
 
+/**
+ * Query window covering the extended windows of one or more target regions
+ */
+struct TargetWindow
+{
+    Region window;
+    std::vector<Region> regions;
+};
+
 /**
  * High-level read extraction interface
  * @param reader An open reader
@@ -46,7 +55,7 @@ namespace common
  * @param avr_fragment_length decides how long to extend beyond target region
  */
 void extractReads(
-    BamReader& reader, std::list<Region> const& target_regions, int max_num_reads, unsigned longest_alt_insertion,
+    ReadReader& reader, std::list<Region> const& target_regions, int max_num_reads, unsigned longest_alt_insertion,
     std::vector<p_Read>& all_reads, int avr_fragment_length = 333);
 
 /**
@@ -77,6 +86,26 @@ std::pair<int, int> extractReadsFromRegion(
     std::vector<p_Read>& all_reads, int max_num_reads, ReadReader& reader, const Region& region,
     unsigned longest_alt_insertion, int avr_fragment_length);
 
+/**
+ * Merges target regions whose extended windows overlap
+ * @param target_regions list of target regions
+ * @param extended_flank length by which each region is extended on both sides
+ * @return windows sorted by position
+ */
+std::vector<TargetWindow> mergeTargetWindows(std::list<Region> const& target_regions, int extended_flank);
+
+/**
+ * Extracts reads which overlap the target regions of a window, using a single query for the whole window
+ * @return <num_original_extracted, num_recovered_mates> when finish
+ * @param read_pairs output ReadPairs structure
+ * @param max_num_reads Max number of reads to load
+ * @param reader Reader that will provide the reads
+ * @param window Window and its target regions
+ */
+std::pair<int, int> extractReadsFromWindow(
+    ReadPairs& read_pairs, int max_num_reads, ReadReader& reader, const TargetWindow& window,
+    unsigned longest_alt_insertion);
+
 /**
  * Low-level read extraction for mapped reads in target region
  * @param read_pairs Container for extracted reads
@@ -86,11 +115,26 @@ std::pair<int, int> extractReadsFromRegion(
  */
 int extractMappedReadsFromRegion(ReadPairs& read_pairs, int max_num_reads, ReadReader& reader, const Region& region);
 
+/**
+ * Low-level read extraction for mapped reads in any of several target regions
+ * @param read_pairs Container for extracted reads
+ * @param reader Reader that will provide the reads
+ * @param regions Regions to check if a read is in
+ * @return average read length
+ */
+int extractMappedReadsFromRegions(
+    ReadPairs& read_pairs, int max_num_reads, ReadReader& reader, std::vector<Region> const& regions);
+
 /**
  * return true if this aligned read or its mate overlaps >= 1 base with the target region
  */
 bool isReadOrItsMateInRegion(Read& read, const Region& region);
 
+/**
+ * return true if the alignment or its mate overlaps >= 1 base with the target region, checked before decoding
+ */
+bool isReadOrItsMateInRegion(AlignCore const& core, const Region& region);
+
 /**
  * Lower-level read extraction interface -- recover mates
  * @param reader ReadReader to find mates in
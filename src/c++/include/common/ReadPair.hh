@@ -34,11 +34,14 @@ namespace common
 class ReadPair
 {
 public:
-    Read first_mate() const { return first_mate_; }
+    Read const& first_mate() const { return first_mate_; }
+    Read& first_mate() { return first_mate_; }
 
-    Read second_mate() const { return second_mate_; }
+    Read const& second_mate() const { return second_mate_; }
+    Read& second_mate() { return second_mate_; }
 
     void add(const Read& read);
+    void add(Read&& read);
 
 private:
     Read first_mate_;
@@ -56,6 +56,12 @@ public:
     void clear();
 
     void add(const Read& read);
+    void add(Read&& read);
+
+    /**
+     * Moves all reads of other into this container, mates already present are replaced
+     */
+    void merge(ReadPairs&& other);
 
     const ReadPair& operator[](const std::string& fragment_id) const;
 
@@ -64,7 +70,14 @@ public:
     void getReads(std::vector<Read>& reads);
     void getReads(std::vector<p_Read>& reads);
 
+    /**
+     * Moves all reads into the output vector, leaves the container empty
+     */
+    void moveReads(std::vector<p_Read>& reads);
+
 private:
+    template <typename ReadT> void addRead(ReadT&& read);
+
     std::map<std::string, ReadPair> read_pairs_;
     int num_reads_ = 0;
 };
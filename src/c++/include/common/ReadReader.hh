@@ -26,11 +26,30 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
 #include "common/Read.hh"
 
 namespace common
 {
 
+/**
+ * Alignment fields that are available before bases, qualities and name are decoded
+ */
+struct AlignCore
+{
+    int32_t chrom_id = -1;
+    int32_t pos = -1;
+    int32_t mate_chrom_id = -1;
+    int32_t mate_pos = -1;
+    int32_t length = 0;
+    // end of the alignment on the reference, exclusive
+    int32_t end = -1;
+};
+
 /**
  * Interface class for retrieving reads
  */
@@ -44,5 +63,50 @@ public:
     virtual bool getAlign(Read& align) = 0;
 
     virtual bool getAlignedMate(const Read& read, Read& mate) = 0;
+
+    /**
+     * Fetch the mates of a batch of reads. The default implementation looks up every mate separately
+     * @param reads reads to find the mates for
+     * @param mates output vector, mates that were found are appended in no particular order
+     */
+    virtual void getAlignedMates(std::vector<Read const*> const& reads, std::vector<Read>& mates)
+    {
+        for (Read const* read : reads)
+        {
+            Read mate;
+            if (getAlignedMate(*read, mate) && mate.is_initialized())
+            {
+                mates.push_back(std::move(mate));
+            }
+        }
+    }
+
+    /**
+     * Advances to the next alignment without decoding it, so that callers can reject it on position alone.
+     * The default implementation decodes the whole read using getAlign
+     * @return false if the region is exhausted
+     */
+    virtual bool nextAlign(AlignCore& core)
+    {
+        if (!getAlign(pending_))
+        {
+            return false;
+        }
+        core.chrom_id = pending_.chrom_id();
+        core.pos = pending_.pos();
+        core.mate_chrom_id = pending_.mate_chrom_id();
+        core.mate_pos = pending_.mate_pos();
+        core.length = static_cast<int32_t>(pending_.bases().length());
+        core.end = core.pos + std::max<int32_t>(core.length, 1);
+        return true;
+    }
+
+    /**
+     * Decodes the alignment last returned by nextAlign into read, reusing its buffers
+     */
+    virtual void decodeAlign(Read& read) { read = std::move(pending_); }
+
+private:
+    Read pending_;
 };
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Streaming read extraction for many targets from one pass over the inputs
+ *
+ * \file ReadStreaming.hh
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <vector>
+
+#include "common/Read.hh"
+#include "common/ReadReader.hh"
+#include "common/Region.hh"
+
+namespace common
+{
+
+/**
+ * Target regions of one graph
+ */
+struct StreamingTarget
+{
+    std::list<Region> target_regions;
+    int max_num_reads = 0;
+    unsigned longest_alt_insertion = 0;
+};
+
+/**
+ * Receives the index of a target and its reads
+ * @return false to stop streaming
+ */
+typedef std::function<bool(std::size_t target, ReadBuffer& reads)> StreamingCallback;
+
+/**
+ * Extracts reads for many targets with one forward sweep over the inputs instead of one query per target.
+ * Target windows are visited in genome order and every record is dispatched to all windows that contain it.
+ * Windows far apart are reached with a seek rather than read through.
+ * Reads of a target are passed to the callback as soon as the sweep is past all its windows. The reads of each
+ * target are the same as common::extractReads returns for each of the readers
+ * @param readers one reader per input file, used for the sweep
+ * @param mate_readers one reader per input file on a separate handle, used to recover mates outside the windows
+ * @param targets target regions and extraction limits per graph
+ * @param callback receives the reads of every target exactly once, in no particular order
+ * @param avr_fragment_length decides how long to extend beyond target region
+ */
+void streamReads(
+    std::vector<ReadReader*> const& readers, std::vector<ReadReader*> const& mate_readers,
+    std::vector<StreamingTarget> const& targets, StreamingCallback const& callback, int avr_fragment_length = 333);
+
+/**
+ * Runs streamReads on one thread of CPU_THREADS and processes targets on all threads as they become ready.
+ * The streaming thread processes targets itself when all other threads are busy, so at most threads targets
+ * are held in memory waiting for processing
+ * @param process called for every target and its reads, concurrently from multiple threads
+ * @param threads number of threads to use
+ */
+void parallelStreamReads(
+    std::vector<ReadReader*> const& readers, std::vector<ReadReader*> const& mate_readers,
+    std::vector<StreamingTarget> const& targets, std::function<void(std::size_t target, ReadBuffer& reads)> const& process,
+    unsigned threads, int avr_fragment_length = 333);
+}
@@ -35,7 +35,10 @@
 #include "common/ReadExtraction.hh"
 #include "graphcore/Graph.hh"
 #include "graphcore/Path.hh"
+#include "grm/AlignmentCache.hh"
 #include "grm/Filter.hh"
+#include "grm/GraphInput.hh"
+#include "grm/StageLimits.hh"
 #include "json/json.h"
 
 namespace grm
@@ -52,9 +55,18 @@ static const Json::Value NO_PATHS = Json::objectValue;
  * @param kmer_sequence_matching enable kmer sequence matching
  * @param validate_alignments enable validation using read ids
  * @param threads number of threads to use for parallel execution
+ * @param cache alignments of read sequences from earlier calls with the same graph and settings. Not used when
+ *              validating alignments
+ * @param node_references reference locations of the graph nodes. Reads matching them exactly at their linear
+ *                        position keep that alignment instead of being realigned. nullptr to realign all reads
+ * @param stage_limits when to skip or reorder the aligner stages before gssw for this graph
+ * @param seeded_graph_alignment fill only the graph around read seeds in gssw, see GraphAligner::AF_SEEDED
+ * @return number of distinct read sequences. Reads with the same bases and strand are aligned once
  */
-void alignReads(
+std::size_t alignReads(
     const graphtools::Graph* graph, std::list<graphtools::Path> const& paths, std::vector<common::p_Read>& reads,
     ReadFilter const& filter, bool path_sequence_matching, bool graph_sequence_matching, bool klib_sequence_matching,
-    bool kmer_sequence_matching, bool validate_alignments, uint32_t threads = 1);
+    bool kmer_sequence_matching, bool validate_alignments, uint32_t threads = 1, AlignmentCache* cache = nullptr,
+    std::vector<NodeReference> const* node_references = nullptr, StageLimits const& stage_limits = StageLimits(),
+    bool seeded_graph_alignment = false);
 }
@@ -0,0 +1,176 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Alignments of read sequences kept across samples
+ *
+ * \file AlignmentCache.hh
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/Read.hh"
+
+namespace grm
+{
+
+/**
+ * Graph alignment fields the aligners set on a read
+ */
+struct ReadAlignment
+{
+    ReadAlignment() = default;
+
+    /**
+     * @param read read to take the alignment from
+     * @param reversed_quals true if the aligners have reversed the quals of read
+     */
+    ReadAlignment(common::Read const& read, bool reversed_quals);
+
+    /**
+     * @param read read to give the alignment
+     * @param quals_reversed tracks whether the quals of read are currently reversed
+     */
+    void apply(common::Read& read, bool& quals_reversed) const;
+
+    std::string bases;
+    bool reversed_quals = false;
+    int32_t graph_pos = 0;
+    std::string graph_cigar;
+    int32_t graph_mapq = 0;
+    int32_t graph_alignment_score = 0;
+    bool is_graph_alignment_unique = false;
+    bool is_graph_reverse_strand = false;
+    common::Read::MappingStatus graph_mapping_status = common::Read::UNMAPPED;
+};
+
+/**
+ * Everything aligning a read sequence does to a read: the alignments the read filter is called with,
+ * in order, and the final alignment
+ */
+struct CachedAlignment
+{
+    std::vector<ReadAlignment> filtered;
+    ReadAlignment alignment;
+
+    /** approximate memory used */
+    std::size_t bytes() const;
+};
+
+/**
+ * Alignments of read sequences to one graph, so that samples aligned to the graph later skip the sequences
+ * seen before. Bounded in memory; the least recently used sequences are dropped first. Thread-safe.
+ *
+ * Entries are only valid for the aligner and read filter settings they were made with.
+ */
+class AlignmentCache
+{
+public:
+    /**
+     * @param max_bytes approximate memory limit
+     */
+    explicit AlignmentCache(std::size_t max_bytes);
+
+    /**
+     * Make a cache for another graph that shares the memory limit of this one. The least recently used sequences
+     * of all sharing caches are dropped first
+     */
+    std::unique_ptr<AlignmentCache> share() const;
+
+    /**
+     * @param sequence key of the read sequence
+     * @param found receives the alignment of the sequence if cached
+     * @return true if the sequence was found
+     */
+    bool find(std::string const& sequence, CachedAlignment& found);
+
+    void insert(std::string const& sequence, CachedAlignment alignment);
+
+    std::size_t lookups() const;
+    std::size_t hits() const;
+    /** sequences of this cache only */
+    std::size_t entries() const;
+    /** memory used by this cache only */
+    std::size_t bytes() const;
+
+private:
+    struct Entry
+    {
+        Entry(std::size_t partition_in, std::string key_in, CachedAlignment alignment_in)
+            : partition(partition_in)
+            , key(std::move(key_in))
+            , alignment(std::move(alignment_in))
+        {
+        }
+        std::size_t partition;
+        std::string key;
+        CachedAlignment alignment;
+    };
+
+    struct Usage
+    {
+        std::size_t lookups = 0;
+        std::size_t hits = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    /**
+     * Memory limit and entries of all caches sharing it. Keys are prefixed with the partition of the cache
+     */
+    struct Store
+    {
+        explicit Store(std::size_t max_bytes_in)
+            : max_bytes(max_bytes_in)
+        {
+        }
+        const std::size_t max_bytes;
+        std::mutex mutex;
+        /// most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        std::size_t bytes = 0;
+        /// per partition
+        std::vector<Usage> usage;
+    };
+
+    explicit AlignmentCache(std::shared_ptr<Store> store);
+    std::string key(std::string const& sequence) const;
+
+    const std::shared_ptr<Store> store_;
+    const std::size_t partition_;
+};
+}
@@ -0,0 +1,105 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Read-only aligner indices for a graph
+ *
+ * \file CompiledGraph.hh
+ *
+ */
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "graphcore/Graph.hh"
+#include "graphcore/Path.hh"
+#include "grm/GraphAligner.hh"
+#include "grm/KlibAligner.hh"
+#include "grm/KmerAligner.hh"
+#include "grm/LinearAligner.hh"
+#include "grm/PathAligner.hh"
+
+namespace grm
+{
+
+/**
+ * Indices of all aligners used by CompositeAligner for a single graph. Built once per
+ * graph and shared read-only by the aligners in all threads, which then only keep their
+ * own scratch buffers.
+ */
+class CompiledGraph
+{
+public:
+    typedef KmerAligner<16> KmerAlignerType;
+
+    /**
+     * Build the indices for the enabled aligners
+     * @param graph graph to align to
+     * @param paths list of paths through graph. Must outlive this object
+     * @param nodeReferences reference locations of the graph nodes for linear alignment projection, nullptr if
+     *                       not used
+     */
+    CompiledGraph(
+        graphtools::Graph const* graph, std::list<graphtools::Path> const& paths, bool pathMatching,
+        bool graphMatching, bool klibMatching, bool kmerMatching,
+        std::vector<NodeReference> const* nodeReferences = nullptr);
+
+    graphtools::Graph const* graph() const { return graph_; }
+    std::list<graphtools::Path> const& paths() const { return paths_; }
+
+    std::shared_ptr<const PathAligner::Index> const& pathIndex() const { return pathIndex_; }
+    std::shared_ptr<const GraphAligner::Index> const& graphIndex() const { return graphIndex_; }
+    std::shared_ptr<const KlibAligner::Index> const& klibIndex() const { return klibIndex_; }
+    std::shared_ptr<const KmerAlignerType::Index> const& kmerIndex() const { return kmerIndex_; }
+    std::shared_ptr<const LinearAligner::Index> const& linearIndex() const { return linearIndex_; }
+
+    /** index build times in milliseconds */
+    double pathBuildTime() const { return pathBuildTime_; }
+    double graphBuildTime() const { return graphBuildTime_; }
+    double klibBuildTime() const { return klibBuildTime_; }
+    double kmerBuildTime() const { return kmerBuildTime_; }
+    double linearBuildTime() const { return linearBuildTime_; }
+
+private:
+    graphtools::Graph const* graph_;
+    std::list<graphtools::Path> const& paths_;
+
+    std::shared_ptr<const PathAligner::Index> pathIndex_;
+    std::shared_ptr<const GraphAligner::Index> graphIndex_;
+    std::shared_ptr<const KlibAligner::Index> klibIndex_;
+    std::shared_ptr<const KmerAlignerType::Index> kmerIndex_;
+    std::shared_ptr<const LinearAligner::Index> linearIndex_;
+
+    double pathBuildTime_ = 0;
+    double graphBuildTime_ = 0;
+    double klibBuildTime_ = 0;
+    double kmerBuildTime_ = 0;
+    double linearBuildTime_ = 0;
+};
+}
@@ -35,12 +35,17 @@
 
 #pragma once
 
+#include <array>
+
 #include "PathAligner.hh"
+#include "grm/CompiledGraph.hh"
 #include "grm/Filter.hh"
 #include "grm/GraphAligner.hh"
 #include "grm/KlibAligner.hh"
 #include "grm/KmerAligner.hh"
+#include "grm/LinearAligner.hh"
 #include "grm/PathAligner.hh"
+#include "grm/StageLimits.hh"
 
 namespace grm
 {
@@ -51,9 +56,38 @@ namespace grm
 class CompositeAligner
 {
 public:
+    /**
+     * Stages after linear projection, in their default order
+     */
+    enum Stage
+    {
+        PATH_STAGE,
+        KMER_STAGE,
+        KLIB_STAGE,
+        GRAPH_STAGE,
+        STAGE_COUNT
+    };
+
+    /**
+     * Reads a stage tried, mapped without being filtered, or skipped, and the time it took
+     */
+    struct StageStats
+    {
+        unsigned attempted = 0;
+        unsigned mapped = 0;
+        unsigned skipped = 0;
+        double milliseconds = 0;
+    };
+
+    /**
+     * @param linearProjection first try LinearAligner. Needs an index built from the node reference locations,
+     *                         see setGraph(CompiledGraph const&)
+     * @param stageLimits when to skip or reorder the stages before gssw
+     */
     CompositeAligner(
         bool pathMatching, bool graphMatching, bool klibMatching, bool kmerMatching,
-        unsigned grapAlignmentflags = GraphAligner::AF_ALL);
+        unsigned grapAlignmentflags = GraphAligner::AF_ALL, bool linearProjection = false,
+        StageLimits const& stageLimits = StageLimits());
 
     virtual ~CompositeAligner();
 
@@ -62,36 +96,90 @@ public:
     CompositeAligner& operator=(CompositeAligner&& rhs) noexcept = delete;
 
     void setGraph(graphtools::Graph const* graph, std::list<graphtools::Path> const& paths);
+    /**
+     * Use prebuilt indices. Indices of the enabled aligners must be present in compiledGraph
+     */
+    void setGraph(CompiledGraph const& compiledGraph);
     void alignRead(common::Read& read, ReadFilter filter);
 
+    /**
+     * Align reads with the same result as alignRead. The reads that reach the klib stage are aligned
+     * together, see KlibAligner::alignReads
+     */
+    void alignReads(std::vector<common::Read*> const& reads, ReadFilter filter);
+
+    /**
+     * Add the alignment counters of another aligner, e.g. one that aligned reads on a different thread
+     */
+    void mergeStats(CompositeAligner const& other);
+
     unsigned attempted() const { return attempted_; }
     unsigned filtered() const { return filtered_; }
+    unsigned mappedLinear() const { return mappedLinear_; }
     unsigned mappedKlib() const { return mappedKlib_; }
     unsigned mappedPath() const { return mappedPath_; }
     unsigned anchoredPath() const { return anchoredPath_; }
     unsigned mappedKmers() const { return mappedKmers_; }
     unsigned mappedSw() const { return mappedSw_; }
 
+    static char const* stageName(Stage stage);
+    StageStats const& stageStats(Stage stage) const { return stageStats_[stage]; }
+    /** @return true if the stage only sees probing reads at the moment */
+    bool skipping(Stage stage) const { return skipping_[stage]; }
+    bool kmersFirst() const { return kmersFirst_; }
+    /** number of times a stage was skipped, resumed or moved */
+    unsigned stageDecisions() const { return stageDecisions_; }
+
+    /**
+     * Charge fixed costs per read to the stages instead of the measured times, so that stage decisions do not
+     * depend on the load of the machine
+     * @param milliseconds cost of one read for each stage, negative to keep measuring the stage
+     */
+    void setStageCosts(std::array<double, STAGE_COUNT> const& milliseconds) { stageCosts_ = milliseconds; }
+
 private:
+    typedef std::array<bool, STAGE_COUNT> StagePlan;
+
+    bool projectLinear(common::Read& read, ReadFilter filter);
+    StagePlan planStages();
+    void updateStages();
+    bool runs(Stage stage, StagePlan const& plan);
+    void countStage(Stage stage, bool mapped, double milliseconds);
+    void alignPathAndKmers(common::Read& read, ReadFilter filter, StagePlan const& plan);
+    void alignPath(common::Read& read, ReadFilter filter, bool lastStage);
+    void alignKmers(common::Read& read, ReadFilter filter, bool lastStage);
+    void filterKlib(common::Read& read, ReadFilter filter, double milliseconds);
+    void alignGraph(common::Read& read, ReadFilter filter);
+
     const bool pathMatching_;
     const bool graphMatching_;
     const bool klibMatching_;
     const bool kmerMatching_;
     const unsigned int grapAlignmentflags_;
+    const bool linearProjection_;
+    const StageLimits stageLimits_;
 
     grm::PathAligner pathAligner_;
     grm::GraphAligner graphAligner_;
     grm::KlibAligner klibAligner_;
-    grm::KmerAligner<16> kmerAligner_;
-    // grm::KmerAligner<32> kmerAligner_;
+    CompiledGraph::KmerAlignerType kmerAligner_;
+    grm::LinearAligner linearAligner_;
 
     unsigned attempted_ = 0;
     unsigned filtered_ = 0;
+    unsigned mappedLinear_ = 0;
     unsigned mappedKlib_ = 0;
     unsigned mappedPath_ = 0;
     unsigned anchoredPath_ = 0;
     unsigned mappedKmers_ = 0;
     unsigned mappedSw_ = 0;
+
+    std::array<StageStats, STAGE_COUNT> stageStats_;
+    std::array<double, STAGE_COUNT> stageCosts_{ { -1, -1, -1, -1 } };
+    std::array<bool, STAGE_COUNT> skipping_{};
+    bool kmersFirst_ = false;
+    unsigned stageDecisions_ = 0;
+    unsigned plannedReads_ = 0;
 #ifdef _DEBUG
     graphtools::Graph const* graph_;
 #endif
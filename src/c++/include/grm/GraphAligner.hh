@@ -51,12 +51,32 @@ public:
 
     GraphAligner& operator=(GraphAligner&& rhs) noexcept;
 
+    /**
+     * Immutable gssw node layout of the forward and reversed graph. Can be shared between
+     * aligners running in different threads
+     */
+    struct Index;
+
+    /**
+     * Build the gssw node layout for a graph
+     * @param g a graph
+     * @return index to pass to setGraph
+     */
+    static std::shared_ptr<const Index> makeIndex(graphtools::Graph const* g);
+
     /**
      * Set the graph to align to
      * @param g a graph
      */
     void setGraph(graphtools::Graph const* g);
 
+    /**
+     * Set the graph to align to using a prebuilt index. gssw keeps the DP state in the
+     * graph nodes, so each aligner still creates its own gssw graph from the index
+     * @param index gssw node layout made by makeIndex
+     */
+    void setGraph(std::shared_ptr<const Index> index);
+
     /**
      * Smith-Waterman align a string to the graph and return a cigar string and
      * mapping score which can be either 0 or 60. Score of 60 means
@@ -75,7 +95,13 @@ public:
     static const unsigned int AF_CIGAR = 0x01;
     static const unsigned int AF_BOTH_STRANDS = 0x02;
     static const unsigned int AF_REVERSE_GRAPH = 0x04;
-    static const unsigned int AF_ALL = (unsigned int)-1;
+    /**
+     * fill only the parts of the graph around the kmer seeds of the read, or the whole graph if there are none.
+     * Not part of AF_ALL: an equally good placement without seeds is not filled, so the alignment can be reported
+     * as unique when it is not
+     */
+    static const unsigned int AF_SEEDED = 0x08;
+    static const unsigned int AF_ALL = AF_CIGAR | AF_BOTH_STRANDS | AF_REVERSE_GRAPH;
 
     /**
      * Align a read to the graph and update the graph_* fields.
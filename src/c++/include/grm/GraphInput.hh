@@ -38,8 +38,10 @@
 #include "graphcore/Graph.hh"
 #include "graphcore/Path.hh"
 
+#include <cstdint>
 #include <list>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -62,4 +64,22 @@ graphtools::Graph graphFromJson(Json::Value const& in, std::string const& refere
  * @param in_paths Input JSON node with paths
  */
 std::list<graphtools::Path> pathsFromJson(graphtools::Graph const* graph, Json::Value const& in_paths);
+
+/**
+ * Reference location of a graph node. Coordinates are 0-based and inclusive like those of common::Region
+ */
+struct NodeReference
+{
+    graphtools::NodeId node;
+    std::string chrom;
+    int64_t start;
+    int64_t end;
+};
+
+/**
+ * Read the reference locations of the graph nodes from JSON
+ * @param in Input JSON node, the same as for graphFromJson
+ * @return one entry for each location of a node, nodes with sequences have none
+ */
+std::vector<NodeReference> referencesFromJson(Json::Value const& in);
 };
@@ -38,6 +38,7 @@
 #include <list>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "common/Read.hh"
 #include "graphcore/Graph.hh"
@@ -62,6 +63,19 @@ public:
 
     KlibAligner& operator=(KlibAligner&& rhs) noexcept;
 
+    /**
+     * Immutable path references. Can be shared between aligners running in different threads
+     */
+    struct Index;
+
+    /**
+     * Build the path references for a graph
+     * @param g a graph
+     * @param paths list of paths. Must outlive the index
+     * @return index to pass to setGraph
+     */
+    static std::shared_ptr<const Index> makeIndex(graphtools::Graph const* g, std::list<graphtools::Path> const& paths);
+
     /**
      * Set the graph to align to
      * @param g a graph
@@ -69,6 +83,12 @@ public:
      */
     void setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const& paths);
 
+    /**
+     * Set the graph to align to using a prebuilt index
+     * @param index path references made by makeIndex
+     */
+    void setGraph(std::shared_ptr<const Index> index);
+
     /**
      * Align a read to the graph and update the graph_* fields.
      *
@@ -80,6 +100,14 @@ public:
      */
     void alignRead(common::Read& read);
 
+    /**
+     * Align a batch of reads with the same result as aligning them one by one. The local alignment
+     * scores of many reads against the same path are computed at once, one read per vector lane
+     *
+     * @param reads reads to align
+     */
+    void alignReads(std::vector<common::Read*> const& reads);
+
     unsigned attempted() const { return attempted_; }
     unsigned mapped() const { return mapped_; }
 
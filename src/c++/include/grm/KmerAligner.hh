@@ -60,6 +60,19 @@ public:
 
     KmerAligner& operator=(KmerAligner&& rhs) noexcept;
 
+    /**
+     * Immutable path kmer tables. Can be shared between aligners running in different threads
+     */
+    struct Index;
+
+    /**
+     * Build the path kmer tables for a graph
+     * @param g a graph
+     * @param paths list of paths. Must outlive the index
+     * @return index to pass to setGraph
+     */
+    static std::shared_ptr<const Index> makeIndex(graphtools::Graph const* g, std::list<graphtools::Path> const& paths);
+
     /**
      * Set the graph to align to
      * @param g a graph
@@ -67,6 +80,12 @@ public:
      */
     void setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const& paths);
 
+    /**
+     * Set the graph to align to using a prebuilt index
+     * @param index path kmer tables made by makeIndex
+     */
+    void setGraph(std::shared_ptr<const Index> index);
+
     /**
      * Align a read to the graph and update the graph_* fields.
      *
@@ -0,0 +1,135 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Kmer to path position table shared by the kmer based aligners
+ *
+ * \file KmerTable.hh
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "oligo/KmerGenerator.hh"
+
+namespace grm
+{
+
+/**
+ * \brief Open addressing table from kmer to its postings on all paths of a graph
+ *
+ * Postings of each kmer are stored contiguously, ordered by path id and position
+ */
+class KmerTable
+{
+public:
+    typedef unsigned KmerType;
+
+    struct Posting
+    {
+        Posting(const int pathId, std::size_t position)
+            : pathId_(pathId)
+            , position_(position)
+        {
+        }
+        int pathId_;
+        std::size_t position_;
+    };
+
+    typedef std::vector<std::pair<KmerType, Posting>> Kmers;
+    typedef std::vector<Posting>::const_iterator PostingIt;
+    static const unsigned NO_ENTRY = -1U;
+
+    KmerTable() = default;
+
+    /**
+     * \param kmers kmer and posting pairs in any order
+     */
+    explicit KmerTable(Kmers kmers);
+
+    /**
+     * \brief append the kmers of a path sequence. Kmers containing N are skipped
+     */
+    template <unsigned KMER_LENGTH> static void addKmers(const std::string& sequence, const int pathId, Kmers& kmers)
+    {
+        if (sequence.size() < KMER_LENGTH)
+        {
+            return;
+        }
+        oligo::KmerGenerator<KMER_LENGTH, KmerType, std::string::const_iterator> kmerGenerator(
+            sequence.begin(), sequence.end());
+        KmerType kmer = 0;
+        std::string::const_iterator position;
+        while (kmerGenerator.next(kmer, position))
+        {
+            kmers.emplace_back(kmer, Posting(pathId, std::distance(sequence.begin(), position)));
+        }
+    }
+
+    /// \return number of distinct kmers
+    std::size_t size() const { return kmers_.size(); }
+
+    /// \return entry of the kmer or NO_ENTRY if the kmer does not occur on any path
+    unsigned find(const KmerType kmer) const
+    {
+        for (std::size_t slot = hash(kmer);; slot = (slot + 1) & slotMask_)
+        {
+            const unsigned entry = slots_[slot];
+            if (NO_ENTRY == entry || kmers_[entry] == kmer)
+            {
+                return entry;
+            }
+        }
+    }
+
+    PostingIt begin(const unsigned entry) const { return postings_.begin() + firstPostings_[entry]; }
+    PostingIt end(const unsigned entry) const { return postings_.begin() + firstPostings_[entry + 1]; }
+
+private:
+    /**
+     * Fibonacci hashing: the top bits of the product depend on every base of the kmer, so kmers sharing a suffix,
+     * as on repeats, don't land in one probe run
+     */
+    std::size_t hash(const KmerType kmer) const
+    {
+        return static_cast<std::size_t>(static_cast<std::uint64_t>(kmer * 0x9E3779B1u) >> slotShift_);
+    }
+
+    std::vector<KmerType> kmers_;
+    std::vector<unsigned> firstPostings_;
+    std::vector<Posting> postings_;
+    std::vector<unsigned> slots_ = std::vector<unsigned>(1, NO_ENTRY);
+    std::size_t slotMask_ = 0;
+    /// 32 - log2 of the number of slots
+    unsigned slotShift_ = 32;
+};
+}
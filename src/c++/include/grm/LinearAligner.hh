@@ -0,0 +1,102 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Aligner which projects the linear alignments of reads onto the reference nodes of a graph
+ *
+ * \file LinearAligner.hh
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common/Read.hh"
+#include "graphcore/Graph.hh"
+#include "grm/GraphInput.hh"
+
+namespace grm
+{
+
+/**
+ * Takes over the alignments of reads that match a reference node exactly at their linear (BAM) position, with no
+ * other full length match anywhere in the graph on either strand. Such reads get the alignment GraphAligner would
+ * produce for them, all other reads are left unmapped for the other aligners.
+ *
+ * The linear position is only a hint: reads do not carry their contig name, so matches are verified against the
+ * node sequences.
+ */
+class LinearAligner
+{
+public:
+    LinearAligner();
+
+    virtual ~LinearAligner();
+
+    LinearAligner(LinearAligner&& rhs) noexcept;
+
+    LinearAligner& operator=(LinearAligner&& rhs) noexcept;
+
+    /**
+     * Immutable reference intervals and graph kmers. Can be shared between aligners running in different threads
+     */
+    struct Index;
+
+    /**
+     * Build the index for a graph
+     * @param g a graph
+     * @param references reference locations of the graph nodes
+     * @return index to pass to setGraph
+     */
+    static std::shared_ptr<const Index>
+    makeIndex(graphtools::Graph const* g, std::vector<NodeReference> const& references);
+
+    /**
+     * Set the graph to align to using a prebuilt index
+     * @param index index made by makeIndex
+     */
+    void setGraph(std::shared_ptr<const Index> index);
+
+    /**
+     * Set the graph_* fields and the MAPPED status of a read if its linear alignment can be projected onto the
+     * graph. The read is not changed otherwise
+     *
+     * @param read read structure
+     */
+    void alignRead(common::Read& read);
+
+    unsigned attempted() const { return attempted_; }
+    unsigned mapped() const { return mapped_; }
+
+private:
+    unsigned attempted_ = 0;
+    unsigned mapped_ = 0;
+
+    std::shared_ptr<const Index> index_;
+};
+}
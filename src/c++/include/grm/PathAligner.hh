@@ -53,6 +53,19 @@ public:
     PathAligner(PathAligner&& rhs) noexcept;
     PathAligner& operator=(PathAligner&& rhs) noexcept;
 
+    /**
+     * Immutable graph kmer index. Can be shared between aligners running in different threads
+     */
+    struct Index;
+
+    /**
+     * Build the kmer index for a graph
+     * @param g a graph
+     * @param kmer_size kmer length to use for seeding
+     * @return index to pass to setGraph
+     */
+    static std::shared_ptr<const Index> makeIndex(graphtools::Graph const* g, int32_t kmer_size = 32);
+
     /**
      * Set the graph to align to
      * @param g a graph
@@ -60,6 +73,12 @@ public:
      */
     void setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const& paths);
 
+    /**
+     * Set the graph to align to using a prebuilt index
+     * @param index graph index made by makeIndex
+     */
+    void setGraph(std::shared_ptr<const Index> index);
+
     /**
      * Align a read to the graph and update the graph_* fields.
      *
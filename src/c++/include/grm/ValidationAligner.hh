@@ -38,6 +38,7 @@
 #include <list>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "common/Read.hh"
 #include "graphcore/Graph.hh"
@@ -60,6 +61,8 @@ public:
     using AlignerT::setGraph;
 
     void alignRead(common::Read& read, ReadFilter filter);
+    void alignReads(std::vector<common::Read*> const& reads, ReadFilter filter);
+    void mergeStats(ValidationAligner const& other) { AlignerT::mergeStats(other.base()); }
     const AlignerT& base() const { return *this; }
     static unsigned mismapped() { return mismapped_; }
     static unsigned repeats() { return repeats_; }
@@ -73,6 +76,7 @@ private:
     static std::atomic<unsigned> aligned_;
     static std::atomic<unsigned> total_;
 
+    void validate(common::Read& read);
     static std::string getNodes(const std::string& cigar);
     static std::string getSimulatedPathId(common::Read& read);
 };
@@ -35,12 +35,31 @@
 #pragma once
 
 #include "common/ReadExtraction.hh"
+#include "grm/AlignmentCache.hh"
 #include "grmpy/Parameters.hh"
+#include "paragraph/Parameters.hh"
 
 namespace grmpy
 {
 
+/**
+ * Set up and load the paragraph parameters for aligning samples to a graph
+ */
+paragraph::Parameters makeParagraphParameters(
+    const Parameters& parameters, const std::string& graphPath, const std::string& referencePath);
+
+/**
+ * Extract and align the reads of a sample in the target regions of the graph
+ * @param alignment_cache alignments of read sequences to the graph from samples aligned before
+ */
 void alignSingleSample(
     const Parameters& parameters, const std::string& graphPath, const std::string& referencePath,
-    common::BamReader& reader, genotyping::SampleInfo& sample);
+    common::BamReader& reader, genotyping::SampleInfo& sample, grm::AlignmentCache* alignment_cache = nullptr);
+
+/**
+ * Align reads that were already extracted for the target regions of the graph
+ */
+void alignSingleSample(
+    const Parameters& parameters, const paragraph::Parameters& paragraph_parameters, const std::string& referencePath,
+    common::ReadBuffer& all_reads, genotyping::SampleInfo& sample, grm::AlignmentCache* alignment_cache = nullptr);
 }
@@ -31,6 +31,7 @@
 #include <string>
 
 #include "genotyping/SampleInfo.hh"
+#include "grm/StageLimits.hh"
 
 namespace grmpy
 {
@@ -41,7 +42,9 @@ public:
         int threads = 1, int max_reads = 10000, float bad_align_frac = 0.8, bool path_sequence_matching = false,
         bool graph_sequence_matching = true, bool klib_sequence_matching = false, bool kmer_sequence_matching = false,
         int bad_align_uniq_kmer_len = 0, std::string const& alignment_output_folder = "",
-        bool infer_read_haplotypes = false)
+        bool infer_read_haplotypes = false, int alignment_cache_mb = 0, bool linear_projection = false,
+        int kmer_genotyping_len = 0, grm::StageLimits const& stage_limits = grm::StageLimits(),
+        bool seeded_graph_alignment = false)
         : threads_(threads)
         , max_reads_(max_reads)
         , bad_align_frac_(bad_align_frac)
@@ -52,6 +55,11 @@ public:
         , bad_align_uniq_kmer_len_(bad_align_uniq_kmer_len)
         , alignment_output_folder_(alignment_output_folder)
         , infer_read_haplotypes_(infer_read_haplotypes)
+        , alignment_cache_mb_(alignment_cache_mb)
+        , linear_projection_(linear_projection)
+        , kmer_genotyping_len_(kmer_genotyping_len)
+        , stage_limits_(stage_limits)
+        , seeded_graph_alignment_(seeded_graph_alignment)
     {
     }
 
@@ -65,6 +73,16 @@ public:
     int bad_align_uniq_kmer_len() const { return bad_align_uniq_kmer_len_; }
     std::string const& alignment_output_folder() const { return alignment_output_folder_; }
     bool infer_read_haplotypes() const { return infer_read_haplotypes_; }
+    /** memory for alignments of read sequences kept across samples, split evenly between the graphs */
+    int alignment_cache_mb() const { return alignment_cache_mb_; }
+    /** keep linear alignments of reads that match reference nodes exactly, see grm::LinearAligner */
+    bool linear_projection() const { return linear_projection_; }
+    /** length of graph-unique kmers to count in reads instead of aligning them, 0 aligns, negative auto-detects */
+    int kmer_genotyping_len() const { return kmer_genotyping_len_; }
+    /** when to skip or reorder the aligner stages before gssw, see grm::CompositeAligner */
+    grm::StageLimits const& stage_limits() const { return stage_limits_; }
+    /** fill only the graph around read seeds in gssw, see grm::GraphAligner::AF_SEEDED */
+    bool seeded_graph_alignment() const { return seeded_graph_alignment_; }
 
 private:
     int threads_ = 1;
@@ -77,5 +95,10 @@ private:
     int bad_align_uniq_kmer_len_ = 0;
     std::string alignment_output_folder_;
     bool infer_read_haplotypes_ = false;
+    int alignment_cache_mb_ = 0;
+    bool linear_projection_ = false;
+    int kmer_genotyping_len_ = 0;
+    grm::StageLimits stage_limits_;
+    bool seeded_graph_alignment_ = false;
 };
 }
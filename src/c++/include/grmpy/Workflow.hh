@@ -35,9 +35,11 @@
 
 #pragma once
 
+#include <memory>
 #include <mutex>
 
 #include "common/ReadExtraction.hh"
+#include "grm/AlignmentCache.hh"
 #include "grmpy/Parameters.hh"
 
 namespace grmpy
@@ -68,6 +70,8 @@ class Workflow
     std::vector<UnalignedSample> unalignedSamples_;
     // [graphs][samples]
     std::vector<genotyping::Samples> alignedSamples_;
+    // [graphs], empty if disabled
+    std::vector<std::unique_ptr<grm::AlignmentCache>> alignmentCaches_;
 
     mutable std::mutex mutex_;
     bool terminate_ = false;
@@ -75,17 +79,25 @@ class Workflow
     bool firstPrinted_ = false;
 
     bool progress_ = true;
+    const bool streaming_ = false;
 
     void genotypeGraphs(
         std::ostream& outputFileStream, std::vector<genotyping::Samples>::const_iterator& ungenotypedSamples);
     void alignSamples();
+    /**
+     * Align each sample to all graphs with one sweep over its input instead of one query per graph and region
+     */
+    void streamSamples();
     void makeOutputFile(const Json::Value& output, const std::string& graphSpecPath) const;
+    grm::AlignmentCache* alignmentCache(std::size_t graph) const;
+    void logAlignmentCacheStats() const;
 
 public:
     Workflow(
         const std::vector<std::string>& graphSpecPaths, const std::string& genotypingParameterPath,
         const genotyping::Samples& mainfest, const std::string& outputFilePath, const std::string& outputFolderPath,
-        bool gzipOutput, const Parameters& parameters, const std::string& referencePath, bool progress);
+        bool gzipOutput, const Parameters& parameters, const std::string& referencePath, bool progress,
+        bool streaming = false);
     void run();
 };
 
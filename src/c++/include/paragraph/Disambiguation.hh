@@ -37,8 +37,10 @@
 
 #include "Parameters.hh"
 #include "common/Read.hh"
+#include "graphalign/KmerIndex.hh"
 #include "graphcore/Graph.hh"
 #include "graphcore/PathFamily.hh"
+#include "grm/AlignmentCache.hh"
 
 #include <vector>
 
@@ -51,15 +53,17 @@ namespace paragraph
  *
  * @param parameters Graph alignment parameters
  * @param all_reads pass read bufer with all reads to be aligned and disambiguated
+ * @param alignment_cache alignments of read sequences from samples aligned before with the same parameters
  * @return results as JSON value
  */
-Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffer& all_reads);
+Json::Value alignAndDisambiguate(
+    const Parameters& parameters, common::ReadBuffer& all_reads, grm::AlignmentCache* alignment_cache = nullptr);
 
 /**
  * Node and edge filters / return True to indicate a node or edge is supported by a read
  */
-typedef std::function<bool(common::Read&, std::string const& node)> ReadSupportsNode;
-typedef std::function<bool(common::Read&, std::string const& node1, std::string const& node2)> ReadSupportsEdge;
+typedef std::function<bool(common::Read&, graphtools::NodeId node)> ReadSupportsNode;
+typedef std::function<bool(common::Read&, graphtools::NodeId node1, graphtools::NodeId node2)> ReadSupportsEdge;
 
 /**
  * Update sequence labels in read according to nodes the read has traversed
@@ -73,4 +77,27 @@ typedef std::function<bool(common::Read&, std::string const& node1, std::string
 void disambiguateReads(
     graphtools::Graph* g, std::vector<common::p_Read>& reads, ReadSupportsNode nodefilter = nullptr,
     ReadSupportsEdge edgefilter = nullptr);
+
+/**
+ * Receives a read that was removed and the read filter name to count it under
+ */
+typedef std::function<void(common::Read&, std::string const& reason)> ReadFiltered;
+
+/**
+ * Update sequence labels in reads from their graph-unique kmers instead of graph alignments.
+ *
+ * A read supports the nodes and edges on the paths of its unique kmers (using the strand with more of them), and the
+ * sequence labels of these edges when the nodes form one chain through the graph. Edges need the same minimum overlap
+ * on both nodes as in alignment mode. Reads whose unique kmers support nodes that cannot lie on one path are ambiguous,
+ * reads with too few kmers in the graph are filtered like bad alignments.
+ *
+ * @param g graph, passed by reference
+ * @param reads list of unaligned reads. Reads that support no node are removed
+ * @param kmer_index index of the graph kmers
+ * @param bad_align_frac fraction of read kmers that must be in the graph, like the minimum alignment score fraction
+ * @param filtered receives the removed reads as "bad_align" or "kmer_ambiguous"
+ */
+void disambiguateReadsByKmers(
+    graphtools::Graph* g, std::vector<common::p_Read>& reads, graphtools::KmerIndex const& kmer_index,
+    double bad_align_frac = 0, ReadFiltered const& filtered = nullptr);
 }
@@ -44,6 +44,7 @@
 
 #include "common/Region.hh"
 #include "grm/GraphInput.hh"
+#include "grm/StageLimits.hh"
 
 namespace paragraph
 {
@@ -55,7 +56,7 @@ public:
         int max_reads_in = 10000, int min_reads_for_variant = 1, float min_frac_for_variant = 0.0f,
         float bad_align_frac = 0.8, int outputs = output_options::ALL, bool path_sequence_matching = false,
         bool graph_sequence_matching = true, bool klib_sequence_matching = false, bool kmer_sequence_matching = false,
-        bool validate_alignments = false)
+        bool validate_alignments = false, bool linear_projection = false)
         : max_reads_(static_cast<size_t>(max_reads_in))
         , min_reads_for_variant_(min_reads_for_variant)
         , min_frac_for_variant_(min_frac_for_variant)
@@ -65,7 +66,8 @@ public:
         , graph_sequence_matching_(graph_sequence_matching)
         , klib_sequence_matching_(klib_sequence_matching)
         , kmer_sequence_matching_(kmer_sequence_matching)
-        , validate_alignments_(validate_alignments){};
+        , validate_alignments_(validate_alignments)
+        , linear_projection_(linear_projection){};
 
     enum output_options
     {
@@ -86,6 +88,12 @@ public:
         const std::string& graph_path, const std::string& reference_path,
         const std::string& override_target_regions = "");
 
+    /**
+     * Load only what read extraction needs: target regions, max_reads and the longest node sequence.
+     * The graph description is not kept
+     */
+    void load_targets(const std::string& graph_path, const std::string& override_target_regions = "");
+
     const std::string& reference_path() const { return reference_path_; }
 
     size_t max_reads() const { return max_reads_; }
@@ -107,6 +115,7 @@ public:
     bool klib_sequence_matching() const { return klib_sequence_matching_; }
     bool kmer_sequence_matching() const { return kmer_sequence_matching_; }
     bool validate_alignments() const { return validate_alignments_; }
+    bool linear_projection() const { return linear_projection_; }
     unsigned longest_alt_insertion() const { return longest_alt_insertion_; }
 
     uint32_t threads() const { return threads_; }
@@ -115,10 +124,21 @@ public:
     int kmer_len() const { return kmer_len_; }
     void set_kmer_len(int kmer_len) { kmer_len_ = kmer_len; }
 
+    int kmer_genotyping_len() const { return kmer_genotyping_len_; }
+    void set_kmer_genotyping_len(int kmer_genotyping_len) { kmer_genotyping_len_ = kmer_genotyping_len; }
+
+    grm::StageLimits const& stage_limits() const { return stage_limits_; }
+    void set_stage_limits(grm::StageLimits const& stage_limits) { stage_limits_ = stage_limits; }
+
+    bool seeded_graph_alignment() const { return seeded_graph_alignment_; }
+    void set_seeded_graph_alignment(bool seeded_graph_alignment) { seeded_graph_alignment_ = seeded_graph_alignment; }
+
     bool remove_nonuniq_reads() const { return remove_nonuniq_reads_; }
     void set_remove_nonuniq_reads(bool remove_nonuniq_reads) { remove_nonuniq_reads_ = remove_nonuniq_reads; }
 
 private:
+    void loadTargets(const Json::Value& root, const std::string& override_target_regions);
+
     std::string reference_path_;
 
     size_t max_reads_; ///< maximum number of reads to process per locus
@@ -134,6 +154,7 @@ private:
     bool klib_sequence_matching_; ///< enable use of KlibAligner
     bool kmer_sequence_matching_; ///< enable use of KmerAligner
     bool validate_alignments_;
+    bool linear_projection_; ///< keep linear alignments that match reference nodes exactly, see LinearAligner
 
     Json::Value description_; ///< graph description
     /// if graph contains long insertions, we might want to read mates that are not in the target region.
@@ -145,6 +166,13 @@ private:
 
     int kmer_len_{ 0 }; ///< kmer length for validation
 
+    /// kmer length for counting graph-unique kmers instead of aligning reads. 0 aligns, negative values auto-detect
+    int kmer_genotyping_len_{ 0 };
+
+    grm::StageLimits stage_limits_; ///< when to skip or reorder the aligner stages before gssw
+
+    bool seeded_graph_alignment_{ false }; ///< fill only the graph around read seeds, see grm::GraphAligner::AF_SEEDED
+
     bool remove_nonuniq_reads_{ true }; // remove reads with no unique alignment
 };
 }
@@ -67,6 +67,7 @@ class Workflow
     const Parameters& parameters_;
     const std::string& referencePath_;
     const std::string& targetRegions_;
+    const bool streaming_;
 
     mutable std::mutex mutex_;
     bool terminate_ = false;
@@ -76,7 +77,21 @@ class Workflow
     std::string processGraph(
         const std::string& graphSpecPath, const Parameters& parameters, const InputPaths& inputPaths,
         std::vector<common::BamReader>& readers);
+    std::string
+    processGraphReads(const Parameters& parameters, const InputPaths& inputPaths, common::ReadBuffer& allReads) const;
+    /**
+     * Write the output of one graph to the joint output file. Requires mutex_ to be locked
+     */
+    void writeOutput(const std::string& output, std::ostream& outputFileStream);
+    /**
+     * Open a reader for each file of the input
+     */
+    void openReaders(const Input& input, std::vector<common::BamReader>& readers) const;
     void processGraphs(std::ostream& outputFileStream);
+    /**
+     * Process all graphs with one sweep over each input instead of one query per graph and region
+     */
+    void streamGraphs(std::ostream& outputFileStream);
     void makeOutputFile(const std::string& output, const std::string& graphSpecPath);
 
 public:
@@ -84,7 +99,7 @@ public:
         bool jointInputs, const std::vector<std::string>& inpuPaths, const InputPaths& inputIndexPaths,
         const std::vector<std::string>& graphSpecPaths, const std::string& outputFilePath,
         const std::string& outputFolderPath, bool gzipOutput, const Parameters& parameters,
-        const std::string& referencePath, const std::string& targetRegions);
+        const std::string& referencePath, const std::string& targetRegions, bool streaming = false);
     void run();
 };
 
@@ -26,8 +26,12 @@
 
 #include "common/BamReader.hh"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/accumulators/accumulators.hpp>
@@ -37,6 +41,10 @@
 extern "C" {
 #include <htslib/hts.h>
 #include <htslib/sam.h>
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wredundant-decls"
+#include <htslib/thread_pool.h>
+#pragma GCC diagnostic pop
 };
 
 #include "common/Error.hh"
@@ -54,6 +62,31 @@ using std::vector;
 namespace common
 {
 
+/**
+ * Process-wide htslib thread pool shared by all readers. Destroyed at exit after all readers are gone.
+ */
+struct DecodeThreadPool
+{
+    DecodeThreadPool() = default;
+    DecodeThreadPool(DecodeThreadPool const&) = delete;
+    DecodeThreadPool& operator=(DecodeThreadPool const&) = delete;
+    ~DecodeThreadPool()
+    {
+        if (pool.pool != nullptr)
+        {
+            hts_tpool_destroy(pool.pool);
+        }
+    }
+
+    htsThreadPool pool = { nullptr, 0 };
+};
+
+static DecodeThreadPool& decodeThreadPool()
+{
+    static DecodeThreadPool decodePool;
+    return decodePool;
+}
+
 static inline void decodeHtsBases(bam1_t* hts_align_ptr, string& bases)
 {
     uint8_t* hts_seq_ptr = bam_get_seq(hts_align_ptr);
@@ -85,19 +118,16 @@ static inline void decodeHtsQuals(bam1_t* hts_align_ptr, string& quals)
  *
  * @param hts_align_ptr a bam1_t * to initialize from.
  * Passed as void* to avoid dependency on htslib headers
+ * @param read read to decode into. Name, bases and qualities are written into its existing buffers
  *
  * TODO we could make this a constructor
  */
 static inline void decodeHtsAlign(void* _hts_align_ptr, Read& read)
 {
     auto* hts_align_ptr = (bam1_t*)_hts_align_ptr;
-    const string fragment_id = bam_get_qname(hts_align_ptr);
-    string bases, quals;
-    decodeHtsBases(hts_align_ptr, bases);
-    decodeHtsQuals(hts_align_ptr, quals);
-    read.set_fragment_id(fragment_id);
-    read.set_bases(bases);
-    read.set_quals(quals);
+    read.mutable_fragment_id().assign(bam_get_qname(hts_align_ptr));
+    decodeHtsBases(hts_align_ptr, read.mutable_bases());
+    decodeHtsQuals(hts_align_ptr, read.mutable_quals());
 
     const auto& flag = hts_align_ptr->core.flag;
     read.set_is_mapped((flag & BamReader::kIsMapped) == 0);
@@ -152,6 +182,12 @@ struct BamReader::BamReaderImpl
             error("ERROR: Unknown alignment file format.");
         }
 
+        htsThreadPool& pool = decodeThreadPool().pool;
+        if (pool.pool != nullptr && hts_set_thread_pool(hts_file_ptr_, &pool) != 0)
+        {
+            error("ERROR: Failed to attach decoding thread pool to %s", path.c_str());
+        }
+
         assert(hts_set_fai_filename(hts_file_ptr_, (reference + ".fai").c_str()) == 0);
 
         // Read BAM header
@@ -227,6 +263,8 @@ struct BamReader::BamReaderImpl
     // A pointer to an alignment in the BAM file.
     bam1_t* hts_bam_align_ptr_ = nullptr;
     bool at_file_end_ = false;
+    // position fields of the current alignment when reading through getAlign
+    AlignCore core_;
 
     std::unordered_map<std::string, int> header_contig_map;
 };
@@ -247,6 +285,27 @@ BamReader::BamReader(const std::string& path, const std::string& index_path, con
     _impl->open(_impl->file_path, _impl->reference_path);
 }
 
+unsigned BamReader::initDecodeThreadPool(unsigned decode_threads, unsigned total_threads)
+{
+    htsThreadPool& pool = decodeThreadPool().pool;
+    assert(pool.pool == nullptr);
+    if (!decode_threads)
+    {
+        return total_threads;
+    }
+
+    // keep at least one thread for the work that consumes the reads
+    const unsigned cpu_threads = total_threads > decode_threads ? total_threads - decode_threads : 1;
+    decode_threads = total_threads > cpu_threads ? total_threads - cpu_threads : 1;
+    pool.pool = hts_tpool_init(static_cast<int>(decode_threads));
+    if (pool.pool == nullptr)
+    {
+        error("ERROR: Failed to create decoding thread pool with %u threads", decode_threads);
+    }
+    LOG()->info("Using {} threads for BAM/CRAM decoding and {} threads for processing", decode_threads, cpu_threads);
+    return cpu_threads;
+}
+
 BamReader::BamReader(BamReader&& rhs) noexcept
     : _impl(std::move(rhs._impl))
 {
@@ -275,6 +334,16 @@ void BamReader::setRegion(const std::string& region_encoding)
 }
 
 bool BamReader::getAlign(Read& read)
+{
+    if (!nextAlign(_impl->core_))
+    {
+        return false;
+    }
+    decodeAlign(read);
+    return true;
+}
+
+bool BamReader::nextAlign(AlignCore& core)
 {
     if (_impl->hts_file_ptr_ == nullptr)
     {
@@ -306,11 +375,18 @@ bool BamReader::getAlign(Read& read)
         error("ERROR: Failed to extract read from BAM.");
     }
 
-    decodeHtsAlign(_impl->hts_bam_align_ptr_, read);
-
+    const bam1_core_t& hts_core = _impl->hts_bam_align_ptr_->core;
+    core.chrom_id = hts_core.tid;
+    core.pos = hts_core.pos;
+    core.mate_chrom_id = hts_core.mtid;
+    core.mate_pos = hts_core.mpos;
+    core.length = hts_core.l_qseq;
+    core.end = bam_endpos(_impl->hts_bam_align_ptr_);
     return true;
 }
 
+void BamReader::decodeAlign(Read& read) { decodeHtsAlign(_impl->hts_bam_align_ptr_, read); }
+
 int BamReader::SkipToNextGoodAlign()
 {
     bool is_primary_align = false;
@@ -359,9 +435,12 @@ bool BamReader::getAlignedMate(const Read& read, Read& mate)
     }
     while (sam_itr_next(_impl->hts_file_ptr_, iter, _impl->hts_bam_align_ptr_) >= 0)
     {
-        decodeHtsAlign(_impl->hts_bam_align_ptr_, mate);
-        if ((mate.fragment_id() == read.fragment_id()) && (mate.is_first_mate() != read.is_first_mate()))
+        // only decode the record once name and mate flag match
+        const bool is_first_mate = (_impl->hts_bam_align_ptr_->core.flag & kIsFirstMate) != 0;
+        if ((is_first_mate != read.is_first_mate())
+            && (read.fragment_id() == bam_get_qname(_impl->hts_bam_align_ptr_)))
         {
+            decodeHtsAlign(_impl->hts_bam_align_ptr_, mate);
             hts_itr_destroy(iter);
             return true;
         }
@@ -370,6 +449,160 @@ bool BamReader::getAlignedMate(const Read& read, Read& mate)
     return false;
 }
 
+/**
+ * Position at which the mate of a read is expected: the mate position, or the position of the read itself
+ * when the mate is unmapped
+ */
+static inline std::pair<int32_t, int32_t> mateLocus(const Read& read)
+{
+    return read.is_mate_mapped() ? std::make_pair(read.mate_chrom_id(), read.mate_pos())
+                                 : std::make_pair(read.chrom_id(), read.pos());
+}
+
+static inline uint64_t locusKey(int32_t tid, int32_t pos)
+{
+    return (static_cast<uint64_t>(tid) << 32) | static_cast<uint32_t>(pos);
+}
+
+typedef std::unordered_multimap<uint64_t, Read const*> WantedMates;
+
+/**
+ * Decodes the record into mates if it is the mate of one of the wanted reads. Position, flags and name
+ * are compared on the raw record so that records which are not wanted are never decoded
+ */
+static void collectWantedMate(bam1_t* hts_align_ptr, WantedMates& wanted, std::vector<Read>& mates)
+{
+    const bam1_core_t& core = hts_align_ptr->core;
+    if ((core.flag & (BamReader::kSecondaryAlign | BamReader::kSupplementaryAlign)) != 0)
+    {
+        return;
+    }
+    const bool is_first_mate = (core.flag & BamReader::kIsFirstMate) != 0;
+    const auto candidates = wanted.equal_range(locusKey(core.tid, core.pos));
+    for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+    {
+        Read const& read = *candidate->second;
+        if ((is_first_mate != read.is_first_mate())
+            && (0 == strcmp(read.fragment_id().c_str(), bam_get_qname(hts_align_ptr))))
+        {
+            mates.emplace_back();
+            decodeHtsAlign(hts_align_ptr, mates.back());
+            wanted.erase(candidate);
+            return;
+        }
+    }
+}
+
+void BamReader::getAlignedMates(std::vector<Read const*> const& reads, std::vector<Read>& mates)
+{
+    // CRAM loci closer than this are fetched with one query
+    static const int32_t kMaxCramLocusGap = 1000;
+
+    WantedMates wanted;
+    std::vector<std::pair<int32_t, int32_t>> loci;
+    for (Read const* read : reads)
+    {
+        const auto locus = mateLocus(*read);
+        if (locus.first < 0 || locus.second < 0)
+        {
+            continue;
+        }
+        wanted.emplace(locusKey(locus.first, locus.second), read);
+        loci.push_back(locus);
+    }
+    if (loci.empty())
+    {
+        return;
+    }
+    std::sort(loci.begin(), loci.end());
+    loci.erase(std::unique(loci.begin(), loci.end()), loci.end());
+
+    if (_impl->hts_bam_align_ptr_ == nullptr)
+    {
+        _impl->hts_bam_align_ptr_ = bam_init1();
+    }
+    bam1_t* hts_align_ptr = _impl->hts_bam_align_ptr_;
+
+    if (_impl->hts_file_ptr_->format.format == cram)
+    {
+        // the multi-region iterator of our htslib version drops CRAM records, so visit windows of nearby
+        // loci in genome order instead
+        size_t window_start = 0;
+        while (window_start != loci.size() && !wanted.empty())
+        {
+            size_t window_end = window_start + 1;
+            while (window_end != loci.size() && loci[window_end].first == loci[window_start].first
+                   && loci[window_end].second - loci[window_end - 1].second < kMaxCramLocusGap)
+            {
+                ++window_end;
+            }
+            hts_itr_t* iter = sam_itr_queryi(
+                _impl->hts_idx_ptr_, loci[window_start].first, loci[window_start].second,
+                loci[window_end - 1].second + 1);
+            if (iter != nullptr)
+            {
+                while (!wanted.empty() && sam_itr_next(_impl->hts_file_ptr_, iter, hts_align_ptr) >= 0)
+                {
+                    collectWantedMate(hts_align_ptr, wanted, mates);
+                }
+                hts_itr_destroy(iter);
+            }
+            window_start = window_end;
+        }
+        return;
+    }
+
+    // one region list entry per contig with one interval per locus. The iterator takes ownership of the
+    // malloc'ed lists and merges the index chunks so that each block is read once
+    std::vector<std::pair<int32_t, std::vector<hts_pair32_t>>> contigs;
+    for (const auto& locus : loci)
+    {
+        if (contigs.empty() || contigs.back().first != locus.first)
+        {
+            contigs.emplace_back(locus.first, std::vector<hts_pair32_t>());
+        }
+        hts_pair32_t interval;
+        interval.beg = static_cast<uint32_t>(locus.second);
+        interval.end = static_cast<uint32_t>(locus.second) + 1;
+        contigs.back().second.push_back(interval);
+    }
+
+    auto* reglist = static_cast<hts_reglist_t*>(calloc(contigs.size(), sizeof(hts_reglist_t)));
+    if (reglist == nullptr)
+    {
+        error("ERROR: Failed to allocate region list for %zu mate loci", loci.size());
+    }
+    for (size_t i = 0; i != contigs.size(); ++i)
+    {
+        const std::vector<hts_pair32_t>& intervals = contigs[i].second;
+        reglist[i].reg = _impl->hts_bam_hdr_ptr_->target_name[contigs[i].first];
+        reglist[i].tid = contigs[i].first;
+        reglist[i].count = static_cast<uint32_t>(intervals.size());
+        reglist[i].min_beg = intervals.front().beg;
+        reglist[i].max_end = intervals.back().end;
+        reglist[i].intervals = static_cast<hts_pair32_t*>(malloc(intervals.size() * sizeof(hts_pair32_t)));
+        if (reglist[i].intervals == nullptr)
+        {
+            hts_reglist_free(reglist, static_cast<int>(contigs.size()));
+            error("ERROR: Failed to allocate region list for %zu mate loci", loci.size());
+        }
+        std::copy(intervals.begin(), intervals.end(), reglist[i].intervals);
+    }
+
+    hts_itr_multi_t* iter = sam_itr_regions(
+        _impl->hts_idx_ptr_, _impl->hts_bam_hdr_ptr_, reglist, static_cast<unsigned>(contigs.size()));
+    if (iter == nullptr)
+    {
+        hts_reglist_free(reglist, static_cast<int>(contigs.size()));
+        return;
+    }
+    while (!wanted.empty() && sam_itr_multi_next(_impl->hts_file_ptr_, iter, hts_align_ptr) >= 0)
+    {
+        collectWantedMate(hts_align_ptr, wanted, mates);
+    }
+    hts_itr_multi_destroy(iter);
+}
+
 std::unique_ptr<DepthInfo> BamReader::estimateDepth(std::string const& region)
 {
     auto logger = LOG();
@@ -26,6 +26,8 @@
 
 #include "common/Fragment.hh"
 
+#include <algorithm>
+
 #include "graphalign/GraphAlignmentOperations.hh"
 
 #include "common/Error.hh"
@@ -33,6 +35,22 @@
 namespace common
 {
 
+/**
+ * Add elements to a sorted list of unique elements
+ * @param elements elements to add
+ * @param target sorted list to add to
+ */
+template <typename T> static void mergeSorted(std::vector<T> const& elements, std::vector<T>& target)
+{
+    if (elements.empty())
+    {
+        return;
+    }
+    target.insert(target.end(), elements.begin(), elements.end());
+    std::sort(target.begin(), target.end());
+    target.erase(std::unique(target.begin(), target.end()), target.end());
+}
+
 /**
  * add read and update length estimate
  * @param coordinates coordinates and graph for length calculation
@@ -63,7 +81,8 @@ void Fragment::addRead(graphtools::GraphCoordinates const& coordinates, Read con
         bam_fragment_length_ = abs(read.mate_pos() - read.pos()) + read.bases().size();
     }
 
-    if (read.graph_mapping_status() == common::Read::MAPPED)
+    // reads that were not aligned can still support graph nodes through their kmers
+    if (read.graph_mapping_status() == common::Read::MAPPED || !read.graph_nodes_supported().empty())
     {
         if (read.is_graph_reverse_strand())
         {
@@ -73,9 +92,11 @@ void Fragment::addRead(graphtools::GraphCoordinates const& coordinates, Read con
         {
             ++n_graph_forward_reads;
         }
+    }
 
-        graphtools::GraphAlignment mapping
-            = graphtools::decodeGraphAlignment(read.graph_pos(), read.graph_cigar(), &coordinates.getGraph());
+    if (read.graph_mapping_status() == common::Read::MAPPED)
+    {
+        graphtools::GraphAlignment const& mapping = read.graph_alignment(&coordinates.getGraph());
         read_positions_.emplace_back(coordinates.canonicalStartAndEnd(mapping.path()));
         read_lengths_.emplace_back(mapping.queryLength());
         if (read_positions_.size() == 1)
@@ -145,14 +166,8 @@ void Fragment::addRead(graphtools::GraphCoordinates const& coordinates, Read con
         }
     }
 
-    for (auto const& n : read.graph_nodes_supported())
-    {
-        graph_nodes_supported_.insert(n);
-    }
-    for (auto const& n : read.graph_edges_supported())
-    {
-        graph_edges_supported_.insert(n);
-    }
+    mergeSorted(read.graph_nodes_supported(), graph_nodes_supported_);
+    mergeSorted(read.graph_edges_supported(), graph_edges_supported_);
     for (auto const& n : read.graph_sequences_supported())
     {
         graph_sequences_supported_.insert(n);
@@ -35,6 +35,9 @@
 
 #include "common/Klib.hh"
 #include "KlibImpl.hh"
+#include "common/Error.hh"
+
+#include <algorithm>
 
 namespace common
 {
@@ -79,11 +82,46 @@ void KlibAlignment::getParameters(AlignmentParameters& ap)
 void KlibAlignment::setRef(const char* seq)
 {
     _impl->valid_result = false;
+    _impl->known_end = false;
     _impl->reflen = static_cast<int>(strlen(seq));
     _impl->ref = std::shared_ptr<uint8_t>(new uint8_t[_impl->reflen], [](uint8_t* p) { delete[] p; });
     translate(seq, _impl->ref.get(), _impl->reflen);
 }
 
+/**
+ * @brief copy the already translated target sequence of another alignment.
+ * Note ksw_align temporarily reverses the target in place, so it cannot be shared
+ */
+void KlibAlignment::setRef(KlibAlignment const& that)
+{
+    _impl->valid_result = false;
+    _impl->known_end = false;
+    _impl->reflen = that._impl->reflen;
+    _impl->ref = std::shared_ptr<uint8_t>(new uint8_t[_impl->reflen], [](uint8_t* p) { delete[] p; });
+    std::copy(that._impl->ref.get(), that._impl->ref.get() + _impl->reflen, _impl->ref.get());
+}
+
+/**
+ * @brief use the translated target sequence of another alignment without copying it.
+ * ksw_align reverses the target in place and restores it before returning, so sharing is safe within one thread
+ */
+void KlibAlignment::shareRef(KlibAlignment const& that)
+{
+    _impl->valid_result = false;
+    _impl->known_end = false;
+    _impl->reflen = that._impl->reflen;
+    _impl->ref = that._impl->ref;
+}
+
+void KlibAlignment::shareRef(KlibAlignment const& that, int offset, int length)
+{
+    assert(0 <= offset && 0 < length && offset + length <= that._impl->reflen);
+    _impl->valid_result = false;
+    _impl->known_end = false;
+    _impl->reflen = length;
+    _impl->ref = std::shared_ptr<uint8_t>(that._impl->ref, that._impl->ref.get() + offset);
+}
+
 /*
  * @brief set query sequence
  */
@@ -95,11 +133,24 @@ void KlibAlignment::setQuery(const char* seq)
         _impl->qprofile = nullptr;
     }
     _impl->valid_result = false;
+    _impl->known_end = false;
     _impl->altlen = static_cast<int>(strlen(seq));
     _impl->alt = std::shared_ptr<uint8_t>(new uint8_t[_impl->altlen], [](uint8_t* p) { delete[] p; });
     translate(seq, _impl->alt.get(), _impl->altlen);
 }
 
+void KlibAlignment::setEnd(int score, int targetEnd, int queryEnd)
+{
+    assert(targetEnd < _impl->reflen && queryEnd < _impl->altlen);
+    _impl->valid_result = false;
+    _impl->known_end = true;
+    _impl->result.score = score;
+    _impl->result.te = targetEnd;
+    _impl->result.qe = queryEnd;
+    _impl->result.score2 = _impl->result.te2 = -1;
+    _impl->result.tb = _impl->result.qb = -1;
+}
+
 /**
  * @brief Get the alignment score
  */
@@ -150,10 +201,32 @@ void KlibAlignment::getCigar(int& r0, int& r1, int& a0, int& a1, int& n_cigar, u
  */
 void KlibAlignment::update()
 {
-    _impl->result = ksw_align(
-        _impl->altlen, _impl->alt.get(), _impl->reflen, _impl->ref.get(), 5, _impl->mat, _impl->gapo, _impl->gape,
-        KSW_XSTART, // add flags here
-        &(_impl->qprofile));
+    if (_impl->known_end)
+    {
+        // the start search of ksw_align: align the reversed sequences up to the end positions until the score is
+        // reached again
+        kswr_t& r = _impl->result;
+        std::reverse(_impl->alt.get(), _impl->alt.get() + r.qe + 1);
+        std::reverse(_impl->ref.get(), _impl->ref.get() + r.te + 1);
+        const kswr_t rr = ksw_align(
+            r.qe + 1, _impl->alt.get(), _impl->reflen, _impl->ref.get(), 5, _impl->mat, _impl->gapo, _impl->gape,
+            KSW_XSTOP | r.score, nullptr);
+        std::reverse(_impl->alt.get(), _impl->alt.get() + r.qe + 1);
+        std::reverse(_impl->ref.get(), _impl->ref.get() + r.te + 1);
+        if (r.score == rr.score)
+        {
+            r.tb = r.te - rr.te;
+            r.qb = r.qe - rr.qe;
+        }
+    }
+    else
+    {
+        _impl->result = ksw_align(
+            _impl->altlen, _impl->alt.get(), _impl->reflen, _impl->ref.get(), 5, _impl->mat, _impl->gapo,
+            _impl->gape,
+            KSW_XSTART, // add flags here
+            &(_impl->qprofile));
+    }
 
     if (_impl->cigar)
     {
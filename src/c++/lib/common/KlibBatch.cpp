@@ -0,0 +1,338 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Inter-query vectorized forward pass of the klib Smith Waterman
+ *
+ * \file KlibBatch.cpp
+ *
+ */
+
+#include "common/KlibBatch.hh"
+#include "KlibImpl.hh"
+#include "common/Error.hh"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+namespace common
+{
+
+namespace
+{
+    /// substitution score of the query positions past the end of a shorter query. Low enough to never score
+    const int16_t PADDING_SCORE = -0x4000;
+    /// subtracted from the vertical gap score to drop the gap. Low enough for the gap to never score
+    const int16_t RESET_SCORE = 0x4000;
+
+    typedef int16_t Vector8 __attribute__((vector_size(16)));
+    typedef int16_t Vector16 __attribute__((vector_size(32)));
+
+    /**
+     * \return size elements of buffer set to value, starting at a boundary suitable for any of the vector types
+     */
+    int16_t* alignedBuffer(std::vector<int16_t>& buffer, std::size_t size, int16_t value)
+    {
+        static const std::size_t ALIGNMENT = sizeof(Vector16);
+        buffer.resize(size + ALIGNMENT / sizeof(int16_t));
+        const std::size_t misalignment = reinterpret_cast<std::uintptr_t>(buffer.data()) % ALIGNMENT;
+        int16_t* const ret = buffer.data() + (ALIGNMENT - misalignment) % ALIGNMENT / sizeof(int16_t);
+        std::fill(ret, ret + size, value);
+        return ret;
+    }
+
+    /**
+     * Inputs and outputs of the forward pass. The int16_t buffers hold queryLength_ vectors, one element per lane
+     */
+    struct ForwardPass
+    {
+        const uint8_t* target_;
+        int targetLength_;
+        int queryLength_;
+        int16_t gapoe_;
+        int16_t gape_;
+        /// queryLength_ substitution score vectors for each of the 5 target bases
+        const int16_t* profile_;
+        /// RESET_SCORE in the lanes where ksw_i16 starts a new query segment and so drops the vertical gap it carries
+        const int16_t* resetF_;
+        /// window of each lane relative to target_
+        const int* windowStarts_;
+        const int* windowEnds_;
+        int16_t* h_;
+        int16_t* e_;
+        /// matrix column of the best score of each lane
+        int16_t* hMax_;
+        int* scores_;
+        int* targetEnds_;
+    };
+
+    /**
+     * One matrix column of Smith Waterman with one query per lane of VectorT. Follows ksw_i16 rather than the
+     * textbook recursion: the column maximum and the horizontal gaps only see the vertical gaps that do not cross the
+     * query segments of its striped layout.
+     * Unlike in ksw_i16 the gap scores do not saturate at 0. Negative values stand for 0 and stay small, so only the
+     * stored H needs clamping
+     * \tparam MASKED zero the diagonal moves in the lanes outside of active, which keeps them at 0 before their
+     *                window and below their best score after it
+     * \param max receives the column maximum
+     */
+    template <typename VectorT, bool MASKED>
+    inline __attribute__((always_inline)) void
+    alignColumn(const ForwardPass& pass, const VectorT* S, const VectorT& active, VectorT& max)
+    {
+        const VectorT zero = {};
+        const VectorT gapoe = zero + pass.gapoe_;
+        const VectorT gape = zero + pass.gape_;
+        const VectorT* const resetF = reinterpret_cast<const VectorT*>(pass.resetF_);
+        VectorT* const H = reinterpret_cast<VectorT*>(pass.h_);
+        VectorT* const E = reinterpret_cast<VectorT*>(pass.e_);
+
+        // f carries vertical gaps within a query segment, F across the whole query
+        VectorT hDiag = zero, f = zero, F = zero;
+        max = zero;
+        for (int k = 0; k < pass.queryLength_; ++k)
+        {
+            const VectorT e = E[k];
+            VectorT m = hDiag + S[k];
+            if (MASKED)
+            {
+                m &= active;
+            }
+            m = m > e ? m : e;
+            hDiag = H[k];
+            const VectorT fIn = f - resetF[k];
+            const VectorT h = m > fIn ? m : fIn;
+            max = max > h ? max : h;
+            const VectorT hF = h > F ? h : F;
+            H[k] = hF > zero ? hF : zero;
+
+            const VectorT hGap = h - gapoe;
+            const VectorT eOut = e - gape;
+            E[k] = eOut > hGap ? eOut : hGap;
+            // a vertical gap opened after another one never beats extending that one, so only m opens vertical gaps.
+            // This keeps the dependency between consecutive k short
+            const VectorT mGap = m - gapoe;
+            f = fIn - gape;
+            f = f > mGap ? f : mGap;
+            F -= gape;
+            F = F > mGap ? F : mGap;
+        }
+    }
+
+    /**
+     * Forward pass over the target for all lanes of VectorT
+     */
+    template <typename VectorT> inline __attribute__((always_inline)) void forwardPass(const ForwardPass& pass)
+    {
+        static const int LANES = sizeof(VectorT) / sizeof(int16_t);
+        const VectorT* const profile = reinterpret_cast<const VectorT*>(pass.profile_);
+        const VectorT* const H = reinterpret_cast<const VectorT*>(pass.h_);
+        VectorT* const Hmax = reinterpret_cast<VectorT*>(pass.hMax_);
+
+        // columns in which all the lanes with a query are inside their window
+        int allActiveStart = 0, allActiveEnd = pass.targetLength_;
+        for (int lane = 0; lane < LANES; ++lane)
+        {
+            if (pass.windowStarts_[lane] != pass.windowEnds_[lane])
+            {
+                allActiveStart = std::max(allActiveStart, pass.windowStarts_[lane]);
+                allActiveEnd = std::min(allActiveEnd, pass.windowEnds_[lane]);
+            }
+        }
+
+        VectorT gmax = {}, active = {}, max;
+        int16_t lanes[LANES];
+        for (int i = 0; i < pass.targetLength_; ++i)
+        {
+            const VectorT* S = profile + pass.target_[i] * pass.queryLength_;
+            if (allActiveStart <= i && i < allActiveEnd)
+            {
+                alignColumn<VectorT, false>(pass, S, active, max);
+            }
+            else
+            {
+                for (int lane = 0; lane < LANES; ++lane)
+                {
+                    lanes[lane] = pass.windowStarts_[lane] <= i && i < pass.windowEnds_[lane] ? -1 : 0;
+                }
+                std::copy(lanes, lanes + LANES, reinterpret_cast<int16_t*>(&active));
+                alignColumn<VectorT, true>(pass, S, active, max);
+            }
+
+            const VectorT improved = max > gmax;
+            std::copy(
+                reinterpret_cast<const int16_t*>(&improved), reinterpret_cast<const int16_t*>(&improved) + LANES,
+                lanes);
+            if (std::any_of(lanes, lanes + LANES, [](int16_t lane) { return lane; }))
+            {
+                gmax = improved ? max : gmax;
+                for (int k = 0; k < pass.queryLength_; ++k)
+                {
+                    Hmax[k] = improved ? H[k] : Hmax[k];
+                }
+                for (int lane = 0; lane < LANES; ++lane)
+                {
+                    if (lanes[lane])
+                    {
+                        pass.targetEnds_[lane] = i;
+                    }
+                }
+            }
+        }
+
+        std::copy(reinterpret_cast<const int16_t*>(&gmax), reinterpret_cast<const int16_t*>(&gmax) + LANES, lanes);
+        std::copy(lanes, lanes + LANES, pass.scores_);
+    }
+
+    void forwardPass8(const ForwardPass& pass) { forwardPass<Vector8>(pass); }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define KLIB_BATCH_AVX2 1
+    __attribute__((target("avx2"))) void forwardPass16(const ForwardPass& pass) { forwardPass<Vector16>(pass); }
+#endif
+
+    struct Kernel
+    {
+        std::size_t lanes_;
+        void (*forwardPass_)(const ForwardPass&);
+    };
+
+    Kernel selectKernel()
+    {
+#if defined(KLIB_BATCH_AVX2)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return Kernel{ 16, &forwardPass16 };
+        }
+#endif
+        return Kernel{ 8, &forwardPass8 };
+    }
+
+    const Kernel& kernel()
+    {
+        static const Kernel selected = selectKernel();
+        return selected;
+    }
+}
+
+KlibBatchAlignment::KlibBatchAlignment(AlignmentParameters const& ap)
+    : gapo_(ap.gapo)
+    , gape_(ap.gape)
+{
+    std::copy(ap.subs_mat, ap.subs_mat + 25, mat_);
+}
+
+std::size_t KlibBatchAlignment::lanes() { return kernel().lanes_; }
+
+void KlibBatchAlignment::align(const char* target, Job* begin, Job* end)
+{
+    const Kernel& batchKernel = kernel();
+    const int lanes = batchKernel.lanes_;
+    assert(begin <= end && end - begin <= lanes);
+    if (begin == end)
+    {
+        return;
+    }
+
+    int windowStart = INT_MAX, windowEnd = 0, queryLength = 0;
+    for (const Job* job = begin; end != job; ++job)
+    {
+        assert(job->windowStart_ <= job->windowEnd_);
+        windowStart = std::min(windowStart, job->windowStart_);
+        windowEnd = std::max(windowEnd, job->windowEnd_);
+        queryLength = std::max(queryLength, job->queryLength_);
+    }
+    windowEnd = std::max(windowStart, windowEnd);
+    target_.resize(windowEnd - windowStart);
+    translate(target + windowStart, target_.data(), target_.size());
+
+    // unused lanes have an empty window and a query of padding
+    std::vector<int> windowStarts(lanes, 0), windowEnds(lanes, 0);
+    int16_t* const profile = alignedBuffer(profile_, 5 * queryLength * lanes, PADDING_SCORE);
+    int16_t* const resetF = alignedBuffer(resetF_, queryLength * lanes, 0);
+    std::vector<uint8_t> query(queryLength);
+    for (const Job* job = begin; end != job; ++job)
+    {
+        const int lane = job - begin;
+        windowStarts[lane] = job->windowStart_ - windowStart;
+        windowEnds[lane] = job->windowEnd_ - windowStart;
+        translate(job->query_, query.data(), job->queryLength_);
+        for (int base = 0; base < 5; ++base)
+        {
+            for (int k = 0; k < job->queryLength_; ++k)
+            {
+                profile[(base * queryLength + k) * lanes + lane] = mat_[base * 5 + query[k]];
+            }
+        }
+        // ksw_i16 splits the query into 8 segments
+        const int segmentLength = (job->queryLength_ + 7) / 8;
+        for (int k = 0; k < job->queryLength_; ++k)
+        {
+            resetF[k * lanes + lane] = k % segmentLength ? 0 : RESET_SCORE;
+        }
+    }
+    int16_t* const hMax = alignedBuffer(hMax_, queryLength * lanes, 0);
+
+    std::vector<int> scores(lanes, 0), targetEnds(lanes, -1);
+    const ForwardPass pass = { target_.data(),
+                               int(target_.size()),
+                               queryLength,
+                               int16_t(gapo_ + gape_),
+                               int16_t(gape_),
+                               profile,
+                               resetF,
+                               windowStarts.data(),
+                               windowEnds.data(),
+                               alignedBuffer(h_, queryLength * lanes, 0),
+                               alignedBuffer(e_, queryLength * lanes, 0),
+                               hMax,
+                               scores.data(),
+                               targetEnds.data() };
+    batchKernel.forwardPass_(pass);
+
+    for (Job* job = begin; end != job; ++job)
+    {
+        const int lane = job - begin;
+        job->score_ = scores[lane];
+        job->targetEnd_ = scores[lane] ? targetEnds[lane] - windowStarts[lane] : -1;
+        // ksw_i16 reports the first best cell in the order of its striped layout
+        const int segmentLength = (job->queryLength_ + 7) / 8;
+        int bestOrder = INT_MAX;
+        job->queryEnd_ = 0;
+        for (int k = 0; scores[lane] && k < job->queryLength_; ++k)
+        {
+            const int order = k % segmentLength * 8 + k / segmentLength;
+            if (scores[lane] == hMax[k * lanes + lane] && order < bestOrder)
+            {
+                bestOrder = order;
+                job->queryEnd_ = k;
+            }
+        }
+    }
+}
+}
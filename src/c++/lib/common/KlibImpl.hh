@@ -109,6 +109,7 @@ struct KlibAlignmentImpl : boost::noncopyable
         , reflen(0)
         , altlen(0)
         , valid_result(false)
+        , known_end(false)
         , cigar_len(0)
         , cigar(NULL)
         , qprofile(NULL)
@@ -141,6 +142,8 @@ struct KlibAlignmentImpl : boost::noncopyable
     int altlen;
 
     bool valid_result;
+    /// result holds the score and end positions, only the start and cigar are missing
+    bool known_end;
 
     kswr_t result;
     int cigar_len;
@@ -0,0 +1,128 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Vectorized counting of mismatching bases between two sequences
+ *
+ * \file Mismatches.cpp
+ *
+ */
+
+#include "common/Mismatches.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MISMATCHES_AVX2 1
+#endif
+
+namespace common
+{
+
+namespace
+{
+    /// number of bases compared between checks of the limit
+    const std::size_t SCALAR_BLOCK = 32;
+
+    unsigned countTail(const char* sequence, const char* reference, std::size_t length, unsigned mismatches)
+    {
+        for (std::size_t i = 0; i != length; ++i)
+        {
+            mismatches += sequence[i] != reference[i];
+        }
+        return mismatches;
+    }
+
+#if defined(__SSE2__)
+    unsigned countMismatchesSse2(const char* sequence, const char* reference, std::size_t length, unsigned limit)
+    {
+        unsigned mismatches = 0;
+        for (; length >= 16 && mismatches <= limit; length -= 16, sequence += 16, reference += 16)
+        {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sequence));
+            const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(reference));
+            const unsigned equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(s, r)));
+            mismatches += __builtin_popcount(~equal & 0xffffu);
+        }
+        return mismatches <= limit ? countTail(sequence, reference, length, mismatches) : mismatches;
+    }
+#endif
+
+#if defined(MISMATCHES_AVX2)
+    __attribute__((target("avx2,popcnt"))) unsigned
+    countMismatchesAvx2(const char* sequence, const char* reference, std::size_t length, unsigned limit)
+    {
+        unsigned mismatches = 0;
+        for (; length >= 32 && mismatches <= limit; length -= 32, sequence += 32, reference += 32)
+        {
+            const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sequence));
+            const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(reference));
+            const unsigned equal = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(s, r)));
+            mismatches += _mm_popcnt_u32(~equal);
+        }
+        return mismatches <= limit ? countTail(sequence, reference, length, mismatches) : mismatches;
+    }
+#endif
+
+    typedef unsigned (*CountMismatchesFunction)(const char*, const char*, std::size_t, unsigned);
+
+    CountMismatchesFunction selectCountMismatches()
+    {
+#if defined(MISMATCHES_AVX2)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        {
+            return &countMismatchesAvx2;
+        }
+#endif
+#if defined(__SSE2__)
+        return &countMismatchesSse2;
+#else
+        return &countMismatchesScalar;
+#endif
+    }
+}
+
+unsigned countMismatchesScalar(const char* sequence, const char* reference, std::size_t length, unsigned limit)
+{
+    unsigned mismatches = 0;
+    for (; length >= SCALAR_BLOCK && mismatches <= limit;
+         length -= SCALAR_BLOCK, sequence += SCALAR_BLOCK, reference += SCALAR_BLOCK)
+    {
+        mismatches = countTail(sequence, reference, SCALAR_BLOCK, mismatches);
+    }
+    return mismatches <= limit ? countTail(sequence, reference, length, mismatches) : mismatches;
+}
+
+unsigned countMismatches(const char* sequence, const char* reference, std::size_t length, unsigned limit)
+{
+    static const CountMismatchesFunction countMismatchesImpl = selectCountMismatches();
+    return countMismatchesImpl(sequence, reference, length, limit);
+}
+}
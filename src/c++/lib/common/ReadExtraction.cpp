@@ -26,8 +26,10 @@
 
 #include "common/ReadExtraction.hh"
 #include "common/Error.hh"
+#include <algorithm>
 #include <cstdlib>
 #include <list>
+#include <utility>
 
 namespace common
 {
@@ -43,25 +45,50 @@ namespace common
  * @param avr_fragment_length decides how long to extend beyond target region
  */
 void extractReads(
-    BamReader& reader, std::list<Region> const& target_regions, int max_num_reads, unsigned longest_alt_insertion,
+    ReadReader& reader, std::list<Region> const& target_regions, int max_num_reads, unsigned longest_alt_insertion,
     std::vector<p_Read>& all_reads, int avr_fragment_length)
 {
     auto logger = LOG();
+    const std::vector<TargetWindow> windows = mergeTargetWindows(target_regions, avr_fragment_length * 3);
+
+    int64_t extended_length = 0;
+    int64_t window_length = 0;
     for (const auto& region : target_regions)
     {
-        logger->info("[Retrieving for region {}.]", (std::string)region);
-        std::pair<int, int> num_extracted_reads = extractReadsFromRegion(
-            all_reads, max_num_reads, reader, region, longest_alt_insertion, avr_fragment_length);
+        extended_length += region.getExtendedRegion(static_cast<int64_t>(avr_fragment_length * 3)).length();
+    }
+    for (const auto& window : windows)
+    {
+        window_length += window.window.length();
+    }
+    if (windows.size() != target_regions.size())
+    {
+        logger->info(
+            "[Merged {} target regions into {} windows, {} bp of overlapping windows are read once]",
+            target_regions.size(), windows.size(), extended_length - window_length);
+    }
+
+    // fragments found through more than one window are only reported once
+    ReadPairs all_read_pairs;
+    for (const auto& window : windows)
+    {
+        logger->info("[Retrieving for region {}.]", (std::string)window.window);
+        const int max_window_reads = max_num_reads * static_cast<int>(window.regions.size());
+        ReadPairs read_pairs;
+        std::pair<int, int> num_extracted_reads
+            = extractReadsFromWindow(read_pairs, max_window_reads, reader, window, longest_alt_insertion);
+        all_read_pairs.merge(std::move(read_pairs));
 
-        if (max_num_reads == num_extracted_reads.first)
+        if (max_window_reads == num_extracted_reads.first)
         {
-            logger->warn("Reached maximum number of reads ({}).", max_num_reads);
+            logger->warn("Reached maximum number of reads ({}).", max_window_reads);
         }
         else
         {
             logger->info("[Retrieved {} + {} additional reads]", num_extracted_reads.first, num_extracted_reads.second);
         }
     }
+    all_read_pairs.moveReads(all_reads);
 }
 
 /**
@@ -103,13 +130,66 @@ std::pair<int, int> extractReadsFromRegion(
     std::vector<p_Read>& all_reads, int max_num_reads, ReadReader& reader, const Region& region,
     unsigned longest_alt_insertion, int avr_fragment_length)
 {
-
-    int extended_flank = avr_fragment_length * 3;
-    const auto extended_region = region.getExtendedRegion(static_cast<int64_t>(extended_flank));
-    reader.setRegion(extended_region);
+    TargetWindow window;
+    window.window = region.getExtendedRegion(static_cast<int64_t>(avr_fragment_length * 3));
+    window.regions.push_back(region);
 
     ReadPairs read_pairs;
-    unsigned read_length = extractMappedReadsFromRegion(read_pairs, max_num_reads, reader, region);
+    std::pair<int, int> num_extracted_reads
+        = extractReadsFromWindow(read_pairs, max_num_reads, reader, window, longest_alt_insertion);
+    read_pairs.moveReads(all_reads);
+    return num_extracted_reads;
+}
+
+/**
+ * Merges target regions whose extended windows overlap
+ * @param target_regions list of target regions
+ * @param extended_flank length by which each region is extended on both sides
+ * @return windows sorted by position
+ */
+std::vector<TargetWindow> mergeTargetWindows(std::list<Region> const& target_regions, int extended_flank)
+{
+    std::vector<Region> regions(target_regions.begin(), target_regions.end());
+    std::stable_sort(regions.begin(), regions.end(), [](Region const& lhs, Region const& rhs) {
+        return lhs.chrom < rhs.chrom || (lhs.chrom == rhs.chrom && lhs.start < rhs.start);
+    });
+
+    std::vector<TargetWindow> windows;
+    for (const auto& region : regions)
+    {
+        const Region extended_region = region.getExtendedRegion(static_cast<int64_t>(extended_flank));
+        if (!windows.empty() && windows.back().window.chrom == extended_region.chrom
+            && extended_region.start <= windows.back().window.end)
+        {
+            windows.back().window.end = std::max(windows.back().window.end, extended_region.end);
+        }
+        else
+        {
+            windows.emplace_back();
+            windows.back().window = extended_region;
+        }
+        windows.back().regions.push_back(region);
+    }
+    return windows;
+}
+
+/**
+ * Extracts reads which overlap the target regions of a window, using a single query for the whole window
+ * @return <num_original_extracted, num_recovered_mates> when finish
+ * @param read_pairs output ReadPairs structure
+ * @param max_num_reads maximum number of reads to load
+ * @param reader Reader that will provide the reads
+ * @param window window and its target regions
+ * @param longest_alt_insertion If graph has long enough insertions recoverMissingMates is used to find mates that
+ * possibly support it and happen to be aligned outside of target region
+ */
+std::pair<int, int> extractReadsFromWindow(
+    ReadPairs& read_pairs, int max_num_reads, ReadReader& reader, const TargetWindow& window,
+    unsigned longest_alt_insertion)
+{
+    reader.setRegion(window.window);
+
+    unsigned read_length = extractMappedReadsFromRegions(read_pairs, max_num_reads, reader, window.regions);
 
     std::pair<int, int> num_extracted_reads;
     if (max_num_reads == read_pairs.num_reads() || read_length > longest_alt_insertion * 2)
@@ -123,8 +203,6 @@ std::pair<int, int> extractReadsFromRegion(
         const int num_reads_recovered = read_pairs.num_reads() - num_reads_original;
         num_extracted_reads = std::make_pair(num_reads_original, num_reads_recovered);
     }
-
-    read_pairs.getReads(all_reads);
     return num_extracted_reads;
 }
 
@@ -138,20 +216,39 @@ std::pair<int, int> extractReadsFromRegion(
  */
 int extractMappedReadsFromRegion(ReadPairs& read_pairs, int max_num_reads, ReadReader& reader, const Region& region)
 {
-    Read read;
+    return extractMappedReadsFromRegions(read_pairs, max_num_reads, reader, std::vector<Region>{ region });
+}
+
+/**
+ * Low-level read extraction for mapped reads in any of several target regions
+ * @param read_pairs Container for extracted reads
+ * @param reader Reader that will provide the reads
+ * @param max_reads Maximum number of reads to load
+ * @param regions Regions to check if a read is in
+ * @return average read length
+ */
+int extractMappedReadsFromRegions(
+    ReadPairs& read_pairs, int max_num_reads, ReadReader& reader, std::vector<Region> const& regions)
+{
+    AlignCore core;
     unsigned total_read_length = 0;
     unsigned reads = 0;
-    while ((read_pairs.num_reads() != max_num_reads) && reader.getAlign(read))
+    while ((read_pairs.num_reads() != max_num_reads) && reader.nextAlign(core))
     {
         // don't count empty reads. There should not be empty reads, but don't count them anyway.
-        if (read.bases().length())
+        if (core.length)
         {
-            total_read_length += read.bases().length();
+            total_read_length += core.length;
             ++reads;
         }
-        if (isReadOrItsMateInRegion(read, region))
+        // only decode reads we keep
+        if (std::any_of(regions.begin(), regions.end(), [&core](Region const& region) {
+                return isReadOrItsMateInRegion(core, region);
+            }))
         {
-            read_pairs.add(read);
+            Read read;
+            reader.decodeAlign(read);
+            read_pairs.add(std::move(read));
         }
     }
 
@@ -165,16 +262,30 @@ int extractMappedReadsFromRegion(ReadPairs& read_pairs, int max_num_reads, ReadR
  * @param region Region to check if a read is in
  */
 bool isReadOrItsMateInRegion(Read& read, const Region& region)
+{
+    AlignCore core;
+    core.chrom_id = read.chrom_id();
+    core.pos = read.pos();
+    core.mate_chrom_id = read.mate_chrom_id();
+    core.mate_pos = read.mate_pos();
+    core.length = static_cast<int32_t>(read.bases().length());
+    return isReadOrItsMateInRegion(core, region);
+}
+
+/**
+ * return true if the alignment or its mate overlaps >= 1 base with the target region
+ * @param core Position fields of the alignment to be checked
+ * @param region Region to check if a read is in
+ */
+bool isReadOrItsMateInRegion(AlignCore const& core, const Region& region)
 {
     bool in_region;
-    std::string bases = read.bases();
-    if (read.pos() > region.end || read.pos() + static_cast<int64_t>(bases.length()) < region.start)
+    if (core.pos > region.end || core.pos + static_cast<int64_t>(core.length) < region.start)
     {
         in_region = false;
-        if (read.chrom_id() == read.mate_chrom_id())
+        if (core.chrom_id == core.mate_chrom_id)
         {
-            if (!(read.mate_pos() > region.end
-                  || read.mate_pos() + static_cast<int64_t>(bases.length()) < region.start))
+            if (!(core.mate_pos > region.end || core.mate_pos + static_cast<int64_t>(core.length) < region.start))
             {
                 in_region = true;
             }
@@ -195,6 +306,7 @@ bool isReadOrItsMateInRegion(Read& read, const Region& region)
  */
 void recoverMissingMates(ReadReader& reader, ReadPairs& read_pairs)
 {
+    std::vector<Read const*> reads_with_missing_mates;
     for (const auto& kv : read_pairs)
     {
         const ReadPair& read_pair = kv.second;
@@ -202,8 +314,6 @@ void recoverMissingMates(ReadReader& reader, ReadPairs& read_pairs)
         // If a mate is missing, try to recover it.
         if (!read_pair.first_mate().is_initialized() || !read_pair.second_mate().is_initialized())
         {
-            // Get references for existing Align and the one that needs to be filled in and then process
-            // This is done to avoid code duplication.
             const Read& initialized_read
                 = read_pair.first_mate().is_initialized() ? read_pair.first_mate() : read_pair.second_mate();
 
@@ -215,13 +325,16 @@ void recoverMissingMates(ReadReader& reader, ReadPairs& read_pairs)
                 continue;
             }
 
-            Read missing_read;
-            reader.getAlignedMate(initialized_read, missing_read);
-            if (missing_read.is_initialized())
-            {
-                read_pairs.add(missing_read);
-            }
+            reads_with_missing_mates.push_back(&initialized_read);
         }
     }
+
+    // look all mates up in one go so that the reader can visit their loci in order
+    std::vector<Read> missing_reads;
+    reader.getAlignedMates(reads_with_missing_mates, missing_reads);
+    for (Read& missing_read : missing_reads)
+    {
+        read_pairs.add(std::move(missing_read));
+    }
 }
 }
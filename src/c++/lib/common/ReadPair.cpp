@@ -26,6 +26,8 @@
 
 #include "common/ReadPair.hh"
 
+#include <utility>
+
 namespace common
 {
 
@@ -40,4 +42,16 @@ void ReadPair::add(const Read& read)
         second_mate_ = read;
     }
 }
+
+void ReadPair::add(Read&& read)
+{
+    if (read.is_first_mate())
+    {
+        first_mate_ = std::move(read);
+    }
+    else
+    {
+        second_mate_ = std::move(read);
+    }
+}
 }
@@ -29,24 +29,47 @@
 #include "common/Read.hh"
 #include "common/ReadPair.hh"
 
+#include <utility>
+
 using std::string;
 using std::vector;
 
 namespace common
 {
 
-void ReadPairs::add(const Read& read)
+template <typename ReadT> void ReadPairs::addRead(ReadT&& read)
 {
     ReadPair& mates = read_pairs_[read.fragment_id()];
     const int num_initialized_mates_original
         = (int)mates.first_mate().is_initialized() + (int)mates.second_mate().is_initialized();
-    mates.add(read);
+    mates.add(std::forward<ReadT>(read));
     const int num_initialized_mates_after_add
         = (int)mates.first_mate().is_initialized() + (int)mates.second_mate().is_initialized();
 
     num_reads_ += num_initialized_mates_after_add - num_initialized_mates_original;
 }
 
+void ReadPairs::add(const Read& read) { addRead(read); }
+
+void ReadPairs::add(Read&& read) { addRead(std::move(read)); }
+
+void ReadPairs::merge(ReadPairs&& other)
+{
+    for (auto& kv : other.read_pairs_)
+    {
+        ReadPair& mates = kv.second;
+        if (mates.first_mate().is_initialized())
+        {
+            add(std::move(mates.first_mate()));
+        }
+        if (mates.second_mate().is_initialized())
+        {
+            add(std::move(mates.second_mate()));
+        }
+    }
+    other.clear();
+}
+
 const ReadPair& ReadPairs::operator[](const string& fragment_id) const
 {
     if (read_pairs_.find(fragment_id) == read_pairs_.end())
@@ -60,7 +83,7 @@ void ReadPairs::getReads(vector<Read>& reads)
 {
     for (const auto& kv : read_pairs_)
     {
-        ReadPair mates = kv.second;
+        const ReadPair& mates = kv.second;
         if (mates.first_mate().is_initialized())
         {
             reads.emplace_back(mates.first_mate());
@@ -76,7 +99,7 @@ void ReadPairs::getReads(vector<p_Read>& reads)
 {
     for (const auto& kv : read_pairs_)
     {
-        ReadPair mates = kv.second;
+        const ReadPair& mates = kv.second;
         if (mates.first_mate().is_initialized())
         {
             reads.emplace_back(new Read(mates.first_mate()));
@@ -88,6 +111,23 @@ void ReadPairs::getReads(vector<p_Read>& reads)
     }
 }
 
+void ReadPairs::moveReads(vector<p_Read>& reads)
+{
+    for (auto& kv : read_pairs_)
+    {
+        ReadPair& mates = kv.second;
+        if (mates.first_mate().is_initialized())
+        {
+            reads.emplace_back(new Read(std::move(mates.first_mate())));
+        }
+        if (mates.second_mate().is_initialized())
+        {
+            reads.emplace_back(new Read(std::move(mates.second_mate())));
+        }
+    }
+    clear();
+}
+
 void ReadPairs::clear()
 {
     read_pairs_.clear();
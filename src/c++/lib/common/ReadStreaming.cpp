@@ -0,0 +1,396 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Streaming read extraction implementation
+ *
+ * \file ReadStreaming.cpp
+ *
+ */
+
+#include "common/ReadStreaming.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "common/Error.hh"
+#include "common/ReadExtraction.hh"
+#include "common/ReadPairs.hh"
+#include "common/Threads.hh"
+
+namespace common
+{
+
+/**
+ * windows further apart than this are reached by seeking rather than reading through the gap
+ */
+static const int64_t MAX_STREAMING_GAP = 1000000;
+
+namespace
+{
+
+/**
+ * Extraction state of one window of a target, per input
+ */
+struct StreamingWindow
+{
+    StreamingWindow(std::size_t target_, TargetWindow window_, int max_num_reads_, std::size_t inputs)
+        : target(target_)
+        , window(std::move(window_))
+        , max_num_reads(max_num_reads_)
+        , read_pairs(inputs)
+        , total_read_length(inputs, 0)
+        , reads(inputs, 0)
+    {
+    }
+
+    std::size_t target;
+    TargetWindow window;
+    int max_num_reads;
+    std::vector<ReadPairs> read_pairs;
+    std::vector<unsigned> total_read_length;
+    std::vector<unsigned> reads;
+};
+
+/**
+ * Reads of a target collected from the windows closed so far
+ */
+struct StreamingTargetState
+{
+    std::size_t open_windows = 0;
+    std::vector<ReadPairs> read_pairs;
+};
+
+class ReadStreamer
+{
+public:
+    ReadStreamer(
+        std::vector<ReadReader*> const& readers, std::vector<ReadReader*> const& mate_readers,
+        std::vector<StreamingTarget> const& targets, StreamingCallback const& callback)
+        : readers_(readers)
+        , mate_readers_(mate_readers)
+        , targets_(targets)
+        , callback_(callback)
+        , target_states_(targets.size())
+    {
+        assert(readers_.size() == mate_readers_.size());
+    }
+
+    /**
+     * @return false if the callback asked to stop
+     */
+    bool run(int avr_fragment_length)
+    {
+        // windows by contig, in order of their start
+        std::map<std::string, std::vector<StreamingWindow>> contig_windows;
+        for (std::size_t target = 0; target != targets_.size(); ++target)
+        {
+            const StreamingTarget& streaming_target = targets_[target];
+            const std::vector<TargetWindow> windows
+                = mergeTargetWindows(streaming_target.target_regions, avr_fragment_length * 3);
+            target_states_[target].open_windows = windows.size();
+            target_states_[target].read_pairs.resize(readers_.size());
+            for (const auto& window : windows)
+            {
+                const int max_window_reads = streaming_target.max_num_reads * static_cast<int>(window.regions.size());
+                contig_windows[window.window.chrom].emplace_back(target, window, max_window_reads, readers_.size());
+            }
+            if (windows.empty() && !finishTarget(target))
+            {
+                return false;
+            }
+        }
+
+        for (auto& contig : contig_windows)
+        {
+            std::vector<StreamingWindow>& windows = contig.second;
+            std::stable_sort(
+                windows.begin(), windows.end(), [](StreamingWindow const& lhs, StreamingWindow const& rhs) {
+                    return lhs.window.window.start < rhs.window.window.start;
+                });
+
+            // sweep each cluster of nearby windows with one query
+            auto cluster_begin = windows.begin();
+            while (cluster_begin != windows.end())
+            {
+                auto cluster_end = cluster_begin + 1;
+                int64_t cluster_last = cluster_begin->window.window.end;
+                while (cluster_end != windows.end() && cluster_end->window.window.start - cluster_last < MAX_STREAMING_GAP)
+                {
+                    cluster_last = std::max(cluster_last, cluster_end->window.window.end);
+                    ++cluster_end;
+                }
+                if (!sweep(
+                        Region(contig.first, cluster_begin->window.window.start, cluster_last), cluster_begin,
+                        cluster_end))
+                {
+                    return false;
+                }
+                cluster_begin = cluster_end;
+            }
+        }
+        return true;
+    }
+
+private:
+    typedef std::vector<StreamingWindow>::iterator WindowIterator;
+
+    bool sweep(Region const& span, WindowIterator begin, WindowIterator end)
+    {
+        LOG()->debug("[Streaming {} for {} windows]", (std::string)span, std::distance(begin, end));
+        std::vector<AlignCore> cores(readers_.size());
+        std::vector<bool> has_core(readers_.size());
+        for (std::size_t input = 0; input != readers_.size(); ++input)
+        {
+            readers_[input]->setRegion(span);
+            has_core[input] = readers_[input]->nextAlign(cores[input]);
+        }
+
+        std::vector<StreamingWindow*> active;
+        std::vector<StreamingWindow*> matching;
+        WindowIterator next_window = begin;
+        while (true)
+        {
+            // merge the inputs by position
+            std::size_t input = readers_.size();
+            for (std::size_t candidate = 0; candidate != readers_.size(); ++candidate)
+            {
+                if (has_core[candidate] && (input == readers_.size() || cores[candidate].pos < cores[input].pos))
+                {
+                    input = candidate;
+                }
+            }
+            if (input == readers_.size())
+            {
+                break;
+            }
+            const AlignCore& core = cores[input];
+
+            // no later record can overlap windows that end before this one starts
+            if (!closeWindows(active, [&core](StreamingWindow const& window) {
+                    return window.window.window.end < core.pos;
+                }))
+            {
+                return false;
+            }
+            while (next_window != end && next_window->window.window.start < core.end)
+            {
+                active.push_back(&*next_window++);
+            }
+
+            matching.clear();
+            for (StreamingWindow* window : active)
+            {
+                if (core.pos > window->window.window.end || core.end <= window->window.window.start)
+                {
+                    continue;
+                }
+                if (core.length)
+                {
+                    window->total_read_length[input] += core.length;
+                    ++window->reads[input];
+                }
+                if (window->read_pairs[input].num_reads() != window->max_num_reads
+                    && std::any_of(
+                           window->window.regions.begin(), window->window.regions.end(),
+                           [&core](Region const& region) { return isReadOrItsMateInRegion(core, region); }))
+                {
+                    matching.push_back(window);
+                }
+            }
+
+            if (!matching.empty())
+            {
+                Read read;
+                readers_[input]->decodeAlign(read);
+                for (std::size_t i = 0; i + 1 < matching.size(); ++i)
+                {
+                    matching[i]->read_pairs[input].add(read);
+                }
+                matching.back()->read_pairs[input].add(std::move(read));
+            }
+
+            has_core[input] = readers_[input]->nextAlign(cores[input]);
+        }
+
+        while (next_window != end)
+        {
+            active.push_back(&*next_window++);
+        }
+        return closeWindows(active, [](StreamingWindow const&) { return true; });
+    }
+
+    /**
+     * Recovers mates for the windows matching the predicate and moves their reads to their target
+     */
+    template <typename PredicateT> bool closeWindows(std::vector<StreamingWindow*>& active, PredicateT predicate)
+    {
+        auto closed = std::stable_partition(
+            active.begin(), active.end(), [&predicate](StreamingWindow* window) { return !predicate(*window); });
+        for (auto window = closed; window != active.end(); ++window)
+        {
+            if (!closeWindow(**window))
+            {
+                return false;
+            }
+        }
+        active.erase(closed, active.end());
+        return true;
+    }
+
+    bool closeWindow(StreamingWindow& window)
+    {
+        const StreamingTarget& target = targets_[window.target];
+        StreamingTargetState& target_state = target_states_[window.target];
+        for (std::size_t input = 0; input != readers_.size(); ++input)
+        {
+            ReadPairs& read_pairs = window.read_pairs[input];
+            const unsigned read_length
+                = window.reads[input] ? window.total_read_length[input] / window.reads[input] : 0;
+            if (window.max_num_reads == read_pairs.num_reads())
+            {
+                LOG()->warn(
+                    "Reached maximum number of reads ({}) in {}.", window.max_num_reads,
+                    (std::string)window.window.window);
+            }
+            else if (read_length <= target.longest_alt_insertion * 2)
+            {
+                recoverMissingMates(*mate_readers_[input], read_pairs);
+            }
+            target_state.read_pairs[input].merge(std::move(read_pairs));
+        }
+
+        assert(target_state.open_windows);
+        return --target_state.open_windows || finishTarget(window.target);
+    }
+
+    bool finishTarget(std::size_t target)
+    {
+        ReadBuffer reads;
+        for (ReadPairs& read_pairs : target_states_[target].read_pairs)
+        {
+            read_pairs.moveReads(reads);
+        }
+        target_states_[target].read_pairs.clear();
+        return callback_(target, reads);
+    }
+
+    std::vector<ReadReader*> const& readers_;
+    std::vector<ReadReader*> const& mate_readers_;
+    std::vector<StreamingTarget> const& targets_;
+    StreamingCallback const& callback_;
+    std::vector<StreamingTargetState> target_states_;
+};
+}
+
+void streamReads(
+    std::vector<ReadReader*> const& readers, std::vector<ReadReader*> const& mate_readers,
+    std::vector<StreamingTarget> const& targets, StreamingCallback const& callback, int avr_fragment_length)
+{
+    ReadStreamer streamer(readers, mate_readers, targets, callback);
+    if (!streamer.run(avr_fragment_length))
+    {
+        LOG()->warn("Streaming stopped before all targets were extracted");
+    }
+}
+
+void parallelStreamReads(
+    std::vector<ReadReader*> const& readers, std::vector<ReadReader*> const& mate_readers,
+    std::vector<StreamingTarget> const& targets, std::function<void(std::size_t target, ReadBuffer& reads)> const& process,
+    unsigned threads, int avr_fragment_length)
+{
+    typedef std::unique_lock<std::mutex> Lock;
+    std::mutex mutex;
+    std::condition_variable ready_condition;
+    std::deque<std::pair<std::size_t, ReadBuffer>> ready;
+    // keep at most one waiting target per thread that could pick it up
+    const std::size_t max_ready = threads ? threads - 1 : 0;
+    bool streaming = false;
+    bool done = false;
+    bool terminate = false;
+
+    const auto processNext = [&](Lock& lock) {
+        std::pair<std::size_t, ReadBuffer> target = std::move(ready.front());
+        ready.pop_front();
+        common::unlock_guard<Lock> unlock(lock);
+        process(target.first, target.second);
+    };
+
+    CPU_THREADS(threads).execute(
+        [&]() {
+            Lock lock(mutex);
+            ASYNC_BLOCK_WITH_CLEANUP([&](bool failure) {
+                // the lock is held again when the block is left
+                terminate = terminate || failure;
+                ready_condition.notify_all();
+            })
+            {
+                if (!streaming)
+                {
+                    streaming = true;
+                    {
+                        common::unlock_guard<Lock> unlock(lock);
+                        streamReads(
+                            readers, mate_readers, targets,
+                            [&](std::size_t target, ReadBuffer& reads) {
+                                Lock callback_lock(mutex);
+                                ready.emplace_back(target, std::move(reads));
+                                ready_condition.notify_one();
+                                while (!terminate && ready.size() > max_ready)
+                                {
+                                    processNext(callback_lock);
+                                }
+                                return !terminate;
+                            },
+                            avr_fragment_length);
+                    }
+                    done = true;
+                    ready_condition.notify_all();
+                }
+
+                while (!terminate)
+                {
+                    ready_condition.wait(lock, [&]() { return terminate || done || !ready.empty(); });
+                    if (terminate || ready.empty())
+                    {
+                        break;
+                    }
+                    processNext(lock);
+                }
+                if (terminate)
+                {
+                    LOG()->warn("terminating");
+                }
+            }
+        },
+        threads);
+}
+}
@@ -24,12 +24,21 @@
 // OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+
 #include <boost/range.hpp>
 
 #include "common/Error.hh"
 #include "common/Threads.hh"
 #include "graphalign/GraphAlignmentOperations.hh"
 #include "grm/Align.hh"
+#include "grm/AlignmentCache.hh"
+#include "grm/CompiledGraph.hh"
 #include "grm/CompositeAligner.hh"
 #include "grm/ValidationAligner.hh"
 
@@ -40,10 +49,24 @@ using common::Read;
 void logAlignerStats(const CompositeAligner& aligner)
 {
     LOG()->info(
-        "[Done with alignment step {} total aligned (path: {} [{} anchored] kmers: {} / ksw: {} / gssw: {}) ; {} were "
-        "filtered]",
-        aligner.attempted(), aligner.mappedPath(), aligner.anchoredPath(), aligner.mappedKlib(), aligner.mappedKmers(),
-        aligner.mappedSw(), aligner.filtered());
+        "[Done with alignment step {} total aligned (linear: {} / path: {} [{} anchored] kmers: {} / ksw: {} / gssw: "
+        "{}) ; {} were filtered]",
+        aligner.attempted(), aligner.mappedLinear(), aligner.mappedPath(), aligner.anchoredPath(), aligner.mappedKlib(),
+        aligner.mappedKmers(), aligner.mappedSw(), aligner.filtered());
+
+    std::string stages;
+    for (int stage = 0; stage != CompositeAligner::STAGE_COUNT; ++stage)
+    {
+        CompositeAligner::StageStats const& stats = aligner.stageStats(CompositeAligner::Stage(stage));
+        if (stats.attempted || stats.skipped)
+        {
+            stages += fmt::format(
+                "{}{}: {} of {} in {:.1f} ms, {} skipped", stages.empty() ? "" : " / ",
+                CompositeAligner::stageName(CompositeAligner::Stage(stage)), stats.mapped, stats.attempted,
+                stats.milliseconds, stats.skipped);
+        }
+    }
+    LOG()->info("[Aligner stages ({}) ; {} stage decisions]", stages, aligner.stageDecisions());
 }
 
 template <typename AlignerT> void logAlignerStats(const ValidationAligner<AlignerT>& aligner)
@@ -61,103 +84,423 @@ template <typename AlignerT> void logAlignerStats(const ValidationAligner<Aligne
         aligner.mismapped(), aligner.aligned());
 }
 
+/**
+ * Reads with the same bases and strand get the same alignment, so each group of such reads is aligned once through
+ * a stand-in read. Filter calls on the stand-in are passed on to the first read of its group as they happen and
+ * replayed on the other reads once the stand-in is aligned. Every read sees the same filter calls as when aligned
+ * on its own, which keeps filter side effects and read counts unchanged.
+ *
+ * With an alignment cache, every sequence gets a stand-in. Stand-ins of sequences found in the cache are not
+ * aligned again, and the reads of the other ones are added to the cache once aligned.
+ *
+ * Some aligners reverse the quals of reverse strand alignments. Stand-in quals change when reversed, so this can
+ * be told apart for reads of any quals.
+ */
+class DuplicateReads
+{
+public:
+    /**
+     * @param reads reads to align. The reads of each group are replaced by their stand-in
+     * @param filter filter function to discard reads if alignment isn't good
+     * @param cache alignments of sequences seen before, if any
+     */
+    DuplicateReads(std::vector<common::p_Read>& reads, ReadFilter filter, AlignmentCache* cache)
+        : filter_(std::move(filter))
+        , cache_(cache)
+    {
+        std::unordered_map<std::string, std::size_t> group_of_sequence;
+        std::vector<std::size_t> position_of_group;
+        std::vector<std::vector<common::p_Read>> reads_of_group;
+        std::vector<common::p_Read> remaining;
+        for (auto& read : reads)
+        {
+            if (read->bases().empty())
+            {
+                remaining.emplace_back(std::move(read));
+                continue;
+            }
+            const auto inserted = group_of_sequence.emplace(sequenceKey(*read), reads_of_group.size());
+            if (inserted.second)
+            {
+                position_of_group.push_back(remaining.size());
+                reads_of_group.emplace_back();
+                remaining.emplace_back();
+            }
+            reads_of_group[inserted.first->second].emplace_back(std::move(read));
+        }
+        group_of_sequence.clear();
+
+        for (std::size_t group = 0; group != reads_of_group.size(); ++group)
+        {
+            common::p_Read& position = remaining[position_of_group[group]];
+            if (reads_of_group[group].size() == 1 && !cache_)
+            {
+                position = std::move(reads_of_group[group].front());
+                continue;
+            }
+            position.reset(new Read(*reads_of_group[group].front()));
+            std::string quals(position->bases().size(), REVERSED_MARK);
+            quals.front() = FORWARD_MARK;
+            position->set_quals(quals);
+            group_of_stand_in_[position.get()] = groups_.size();
+            groups_.emplace_back();
+            Group& added = groups_.back();
+            added.reads = std::move(reads_of_group[group]);
+            if (cache_)
+            {
+                added.sequence = sequenceKey(*position);
+                added.cached = cache_->find(added.sequence, added.alignment);
+            }
+            cached_ += added.cached;
+        }
+        reads.swap(remaining);
+    }
+
+    /**
+     * @return number of read sequences found in the cache
+     */
+    std::size_t cached() const { return cached_; }
+
+    /**
+     * @return filter to align the reads with
+     */
+    ReadFilter filter()
+    {
+        if (!filter_)
+        {
+            return filter_;
+        }
+        return [this](Read& read) -> bool {
+            const auto stand_in = group_of_stand_in_.find(&read);
+            if (stand_in == group_of_stand_in_.end())
+            {
+                return filter_(read);
+            }
+            Group& group = groups_[stand_in->second];
+            group.alignment.filtered.emplace_back(read, reversedQuals(read));
+            group.alignment.filtered.back().apply(*group.reads.front(), group.first_quals_reversed);
+            return filter_(*group.reads.front());
+        };
+    }
+
+    /**
+     * @return false if read is a stand-in with a cached alignment
+     */
+    bool needsAlignment(Read const& read) const
+    {
+        const auto stand_in = group_of_stand_in_.find(&read);
+        return stand_in == group_of_stand_in_.end() || !groups_[stand_in->second].cached;
+    }
+
+    /**
+     * @param read aligned read
+     * @param filtered_reads receives the reads of the group of read if it is a stand-in and they passed the filter
+     * @return false if read is not a stand-in
+     */
+    bool collect(Read const& read, std::vector<common::p_Read>& filtered_reads)
+    {
+        const auto stand_in = group_of_stand_in_.find(&read);
+        if (stand_in == group_of_stand_in_.end())
+        {
+            return false;
+        }
+        Group& group = groups_[stand_in->second];
+        if (!group.cached)
+        {
+            group.alignment.alignment = ReadAlignment(read, reversedQuals(read));
+        }
+        for (std::size_t i = 0; i != group.reads.size(); ++i)
+        {
+            bool quals_reversed = false;
+            bool& reads_quals_reversed = i ? quals_reversed : group.first_quals_reversed;
+            // the first read has seen the filter calls while the stand-in was aligned
+            if ((i || group.cached) && filter_)
+            {
+                for (auto const& filtered : group.alignment.filtered)
+                {
+                    filtered.apply(*group.reads[i], reads_quals_reversed);
+                    filter_(*group.reads[i]);
+                }
+            }
+            group.alignment.alignment.apply(*group.reads[i], reads_quals_reversed);
+            if (Read::MAPPED == group.reads[i]->graph_mapping_status())
+            {
+                filtered_reads.emplace_back(std::move(group.reads[i]));
+            }
+        }
+        if (cache_ && !group.cached)
+        {
+            cache_->insert(group.sequence, std::move(group.alignment));
+        }
+        group.reads.clear();
+        group.alignment = CachedAlignment();
+        return true;
+    }
+
+private:
+    static const char FORWARD_MARK = 'F';
+    static const char REVERSED_MARK = 'R';
+
+    static std::string sequenceKey(Read const& read)
+    {
+        return read.bases() + (read.is_reverse_strand() ? '-' : '+');
+    }
+
+    static bool reversedQuals(Read const& stand_in)
+    {
+        return stand_in.quals().size() > 1 && stand_in.quals().front() != FORWARD_MARK;
+    }
+
+    struct Group
+    {
+        std::vector<common::p_Read> reads;
+        /// cache key, the bases of the stand-in change when aligned to the reverse strand
+        std::string sequence;
+        /// alignments the filter was called with for the stand-in and the final alignment
+        CachedAlignment alignment;
+        bool cached = false;
+        bool first_quals_reversed = false;
+    };
+
+    ReadFilter filter_;
+    AlignmentCache* cache_;
+    /// fixed once constructed, the aligning threads only look up their stand-ins
+    std::unordered_map<Read const*, std::size_t> group_of_stand_in_;
+    std::vector<Group> groups_;
+    std::size_t cached_ = 0;
+};
+
 /**
  * Sequential helper to produce read alignments
- * @param graph graph to align to
- * @param paths list of paths through graph for exact matching; pass NO_PATHS for none
- * @param reads vector of reads that will be updated with graph alignment information
+ * @param begin first read to align
+ * @param end end of reads to align
  * @param filter filter function to discard reads if alignment isn't good
+ * @param filtered_reads receives the reads that were aligned and passed the filter
+ * @param aligner aligner to use
+ * @param duplicates stand-ins among the reads, if any
  */
 template <typename IteratorT, typename AlignerT>
 static void sequentialAlignReads(
-    const IteratorT begin, IteratorT end, const graphtools::Graph* graph, std::list<graphtools::Path> const& paths,
-    ReadFilter filter, std::vector<common::p_Read>& filtered_reads, AlignerT& aligner)
+    const IteratorT begin, IteratorT end, ReadFilter filter, std::vector<common::p_Read>& filtered_reads,
+    AlignerT& aligner, DuplicateReads* duplicates)
 {
-    auto logger = LOG();
-    logger->info("[Aligning {} reads]", std::distance(begin, end));
+    // aligning the whole batch at once lets the aligner vectorize across reads
+    std::vector<Read*> batch;
+    for (auto& read : boost::make_iterator_range(begin, end))
+    {
+        if (!read->bases().empty() && (!duplicates || duplicates->needsAlignment(*read)))
+        {
+            read->set_graph_mapping_status(Read::UNMAPPED);
+            batch.push_back(read.get());
+        }
+    }
+    aligner.alignReads(batch, filter);
 
     for (auto& read : boost::make_iterator_range(begin, end))
     {
-        if (read->bases().empty())
+        if (duplicates && duplicates->collect(*read, filtered_reads))
         {
             continue;
         }
-        read->set_graph_mapping_status(Read::UNMAPPED);
-        aligner.alignRead(*read, filter);
-
-        if (Read::MAPPED == read->graph_mapping_status())
+        if (!read->bases().empty() && Read::MAPPED == read->graph_mapping_status())
         {
             filtered_reads.emplace_back(std::move(read));
         }
     }
-
-    logAlignerStats(aligner);
 }
 
-template <typename IteratorT>
-static void sequentialAlignReads(
-    const IteratorT begin, IteratorT end, const graphtools::Graph* graph, std::list<graphtools::Path> const& paths,
-    ReadFilter filter, bool path_sequence_matching, bool graph_sequence_matching, bool klib_sequence_matching,
-    bool kmer_sequence_matching, bool validate_alignments, std::vector<common::p_Read>& filtered_reads)
+/**
+ * smallest number of reads aligned in one go by a worker thread
+ */
+static const std::size_t MIN_ALIGNMENT_BATCH_SIZE = 16;
+
+/**
+ * Batches of reads owned by one worker thread. The owner takes batches from the front,
+ * other workers steal from the back once their own queue is empty
+ */
+template <typename IteratorT> class ReadBatchQueue
 {
-    if (validate_alignments)
+public:
+    typedef std::pair<IteratorT, IteratorT> Batch;
+
+    /**
+     * Split a range of reads into batches of decreasing size, so that the batches left for
+     * stealing towards the end are small
+     */
+    void fill(IteratorT begin, IteratorT end, std::size_t shares)
     {
-        grm::ValidationAligner<grm::CompositeAligner> aligner(
-            grm::CompositeAligner(
-                path_sequence_matching, graph_sequence_matching, klib_sequence_matching, kmer_sequence_matching),
-            graph, paths);
-        aligner.setGraph(graph, paths);
-        sequentialAlignReads(begin, end, graph, paths, filter, filtered_reads, aligner);
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (begin != end)
+        {
+            const auto remaining = static_cast<std::size_t>(std::distance(begin, end));
+            const std::size_t size = std::min(remaining, std::max(remaining / shares, MIN_ALIGNMENT_BATCH_SIZE));
+            batches_.emplace_back(begin, begin + size);
+            begin += size;
+        }
     }
-    else
+
+    bool pop(Batch& batch)
     {
-        grm::CompositeAligner aligner(
-            path_sequence_matching, graph_sequence_matching, klib_sequence_matching, kmer_sequence_matching);
-        aligner.setGraph(graph, paths);
-        sequentialAlignReads(begin, end, graph, paths, filter, filtered_reads, aligner);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (batches_.empty())
+        {
+            return false;
+        }
+        batch = batches_.front();
+        batches_.pop_front();
+        return true;
     }
-}
 
-void grm::alignReads(
-    const graphtools::Graph* graph, std::list<graphtools::Path> const& paths, std::vector<common::p_Read>& reads,
-    ReadFilter const& filter, bool path_sequence_matching, bool graph_sequence_matching, bool klib_sequence_matching,
-    bool kmer_sequence_matching, bool validate_alignments, uint32_t threads)
+    bool steal(Batch& batch)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (batches_.empty())
+        {
+            return false;
+        }
+        batch = batches_.back();
+        batches_.pop_back();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<Batch> batches_;
+};
+
+/**
+ * Align reads on multiple threads. Each thread uses its own aligner and starts on its own share of
+ * the reads. Threads that run out of work steal batches from the others
+ * @param reads reads to align. Receives the reads that were aligned and passed the filter
+ * @param filter filter function to discard reads if alignment isn't good
+ * @param threads number of threads to use
+ * @param makeAligner creates an aligner for a thread
+ * @param duplicates stand-ins among the reads, if any
+ */
+template <typename MakeAlignerT>
+static void parallelAlignReads(
+    std::vector<common::p_Read>& reads, ReadFilter filter, uint32_t threads, MakeAlignerT makeAligner,
+    DuplicateReads* duplicates)
 {
-    auto next = reads.begin();
-    const std::size_t step = std::max((reads.size() + threads - 1) / threads, std::size_t(1));
-    std::mutex m;
-    std::vector<common::p_Read> allFilteredReads;
-    bool terminate = false;
+    typedef std::vector<common::p_Read>::iterator IteratorT;
+    typedef typename std::result_of<MakeAlignerT()>::type AlignerPtrT;
+
+    LOG()->info("[Aligning {} reads]", reads.size());
+
+    const std::size_t workers = std::max<std::size_t>(std::min<std::size_t>(threads, reads.size()), 1);
+    const std::size_t share = (reads.size() + workers - 1) / workers;
+    std::vector<ReadBatchQueue<IteratorT>> queues(workers);
+    for (std::size_t worker = 0; worker != workers; ++worker)
+    {
+        const std::size_t begin = std::min(worker * share, reads.size());
+        const std::size_t end = std::min(begin + share, reads.size());
+        // a few more batches than threads leaves something to steal towards the end
+        queues[worker].fill(reads.begin() + begin, reads.begin() + end, 4);
+    }
+
+    std::vector<AlignerPtrT> aligners(workers);
+    std::vector<std::vector<common::p_Read>> filteredReads(workers);
+    std::atomic<std::size_t> nextWorker(0);
+    std::atomic<bool> terminate(false);
     common::CPU_THREADS(threads).execute(
         [&]() {
-            std::unique_lock<std::mutex> lock(m);
-            while (reads.end() != next)
+            const std::size_t worker = nextWorker++;
+            assert(worker < workers);
+            ASYNC_BLOCK_WITH_CLEANUP([&](bool failure) { terminate = terminate || failure; })
             {
-                const std::size_t ourStep
-                    = std::min<std::size_t>(step, static_cast<const size_t>(std::distance(next, reads.end())));
-                if (ourStep)
+                aligners[worker] = makeAligner();
+                typename ReadBatchQueue<IteratorT>::Batch batch;
+                while (!terminate)
                 {
-                    auto begin = next;
-                    next += ourStep;
-                    auto end = next;
-                    std::vector<common::p_Read> filteredReads;
-                    ASYNC_BLOCK_WITH_CLEANUP([&](bool failure) { terminate |= failure; })
+                    bool found = queues[worker].pop(batch);
+                    for (std::size_t victim = (worker + 1) % workers; !found && victim != worker;
+                         victim = (victim + 1) % workers)
+                    {
+                        found = queues[victim].steal(batch);
+                    }
+                    if (!found)
                     {
-                        if (terminate)
-                        {
-                            LOG()->warn("terminating");
-                            break;
-                        }
-                        common::unlock_guard<std::unique_lock<std::mutex>> unlock(lock);
-                        sequentialAlignReads(
-                            begin, end, graph, paths, filter, path_sequence_matching, graph_sequence_matching,
-                            klib_sequence_matching, kmer_sequence_matching, validate_alignments, filteredReads);
+                        break;
                     }
-                    std::move(filteredReads.begin(), filteredReads.end(), std::back_inserter(allFilteredReads));
+                    sequentialAlignReads(batch.first, batch.second, filter, filteredReads[worker], *aligners[worker],
+                        duplicates);
+                }
+                if (terminate)
+                {
+                    LOG()->warn("terminating");
                 }
             }
         },
-        std::max(reads.size() / step, std::size_t(1)));
+        static_cast<unsigned>(workers));
+
+    // threads that joined after all work was taken have not created an aligner
+    for (std::size_t worker = 1; worker != workers && aligners[worker]; ++worker)
+    {
+        aligners.front()->mergeStats(*aligners[worker]);
+    }
+    logAlignerStats(*aligners.front());
 
+    std::vector<common::p_Read> allFilteredReads;
+    for (auto& workerReads : filteredReads)
+    {
+        std::move(workerReads.begin(), workerReads.end(), std::back_inserter(allFilteredReads));
+    }
     reads.swap(allFilteredReads);
 }
+
+std::size_t grm::alignReads(
+    const graphtools::Graph* graph, std::list<graphtools::Path> const& paths, std::vector<common::p_Read>& reads,
+    ReadFilter const& filter, bool path_sequence_matching, bool graph_sequence_matching, bool klib_sequence_matching,
+    bool kmer_sequence_matching, bool validate_alignments, uint32_t threads, AlignmentCache* cache,
+    std::vector<NodeReference> const* node_references, StageLimits const& stage_limits,
+    bool seeded_graph_alignment)
+{
+    // indices are built once and shared by the aligners of all threads
+    const CompiledGraph compiledGraph(
+        graph, paths, path_sequence_matching, graph_sequence_matching, klib_sequence_matching, kmer_sequence_matching,
+        node_references);
+    const bool linear_projection = node_references != nullptr;
+    const unsigned graph_alignment_flags
+        = GraphAligner::AF_ALL | (seeded_graph_alignment ? GraphAligner::AF_SEEDED : 0u);
+
+    const std::size_t total_reads = reads.size();
+    if (validate_alignments)
+    {
+        // validation goes by read ids, so every read is aligned on its own
+        parallelAlignReads(
+            reads, filter, threads,
+            [&]() {
+                std::unique_ptr<ValidationAligner<CompositeAligner>> aligner(new ValidationAligner<CompositeAligner>(
+                    CompositeAligner(
+                        path_sequence_matching, graph_sequence_matching, klib_sequence_matching,
+                        kmer_sequence_matching, graph_alignment_flags, linear_projection, stage_limits),
+                    graph, paths));
+                aligner->setGraph(compiledGraph);
+                return aligner;
+            },
+            nullptr);
+        return total_reads;
+    }
+
+    DuplicateReads duplicates(reads, filter, cache);
+    const std::size_t distinct_sequences = reads.size();
+    LOG()->info("[{} reads have {} distinct sequences]", total_reads, distinct_sequences);
+    if (cache)
+    {
+        LOG()->info(
+            "[Alignment cache: {} of {} sequences found, {:.1f}% overall, {} sequences in {} KB]", duplicates.cached(),
+            distinct_sequences, cache->lookups() ? 100.0 * cache->hits() / cache->lookups() : 0.0, cache->entries(),
+            cache->bytes() / 1024);
+    }
+    parallelAlignReads(
+        reads, duplicates.filter(), threads,
+        [&]() {
+            std::unique_ptr<CompositeAligner> aligner(new CompositeAligner(
+                path_sequence_matching, graph_sequence_matching, klib_sequence_matching, kmer_sequence_matching,
+                graph_alignment_flags, linear_projection, stage_limits));
+            aligner->setGraph(compiledGraph);
+            return aligner;
+        },
+        &duplicates);
+    return distinct_sequences;
+}
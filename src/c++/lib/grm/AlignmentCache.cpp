@@ -0,0 +1,186 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Alignments of read sequences kept across samples
+ *
+ * \file AlignmentCache.cpp
+ *
+ */
+
+#include <algorithm>
+
+#include "grm/AlignmentCache.hh"
+
+using common::Read;
+
+namespace grm
+{
+
+ReadAlignment::ReadAlignment(Read const& read, bool reversed_quals)
+    : bases(read.bases())
+    , reversed_quals(reversed_quals)
+    , graph_pos(read.graph_pos())
+    , graph_cigar(read.graph_cigar())
+    , graph_mapq(read.graph_mapq())
+    , graph_alignment_score(read.graph_alignment_score())
+    , is_graph_alignment_unique(read.is_graph_alignment_unique())
+    , is_graph_reverse_strand(read.is_graph_reverse_strand())
+    , graph_mapping_status(read.graph_mapping_status())
+{
+}
+
+void ReadAlignment::apply(Read& read, bool& quals_reversed) const
+{
+    read.set_bases(bases);
+    if (reversed_quals != quals_reversed)
+    {
+        std::reverse(read.mutable_quals().begin(), read.mutable_quals().end());
+        quals_reversed = reversed_quals;
+    }
+    read.set_graph_pos(graph_pos);
+    read.set_graph_cigar(graph_cigar);
+    read.set_graph_mapq(graph_mapq);
+    read.set_graph_alignment_score(graph_alignment_score);
+    read.set_is_graph_alignment_unique(is_graph_alignment_unique);
+    read.set_is_graph_reverse_strand(is_graph_reverse_strand);
+    read.set_graph_mapping_status(graph_mapping_status);
+}
+
+std::size_t CachedAlignment::bytes() const
+{
+    const auto read_alignment_bytes = [](ReadAlignment const& read_alignment) {
+        return sizeof(ReadAlignment) + read_alignment.bases.size() + read_alignment.graph_cigar.size();
+    };
+    std::size_t result = sizeof(CachedAlignment) - sizeof(ReadAlignment) + read_alignment_bytes(alignment);
+    for (auto const& read_alignment : filtered)
+    {
+        result += read_alignment_bytes(read_alignment);
+    }
+    return result;
+}
+
+/**
+ * Memory used by a cache entry, including the key in the index and the list and index nodes
+ */
+static std::size_t entryBytes(std::string const& key, CachedAlignment const& alignment)
+{
+    return 2 * key.size() + alignment.bytes() + sizeof(std::size_t) + sizeof(std::pair<std::string, CachedAlignment>)
+        + sizeof(std::string) + 6 * sizeof(void*);
+}
+
+AlignmentCache::AlignmentCache(std::size_t max_bytes)
+    : AlignmentCache(std::make_shared<Store>(max_bytes))
+{
+}
+
+AlignmentCache::AlignmentCache(std::shared_ptr<Store> store)
+    : store_(std::move(store))
+    , partition_(store_->usage.size())
+{
+    store_->usage.emplace_back();
+}
+
+std::unique_ptr<AlignmentCache> AlignmentCache::share() const
+{
+    std::lock_guard<std::mutex> lock(store_->mutex);
+    return std::unique_ptr<AlignmentCache>(new AlignmentCache(store_));
+}
+
+std::string AlignmentCache::key(std::string const& sequence) const
+{
+    return std::to_string(partition_) + ':' + sequence;
+}
+
+bool AlignmentCache::find(std::string const& sequence, CachedAlignment& found)
+{
+    const std::string sequence_key = key(sequence);
+    std::lock_guard<std::mutex> lock(store_->mutex);
+    Usage& usage = store_->usage[partition_];
+    ++usage.lookups;
+    const auto entry = store_->index.find(sequence_key);
+    if (entry == store_->index.end())
+    {
+        return false;
+    }
+    ++usage.hits;
+    store_->entries.splice(store_->entries.begin(), store_->entries, entry->second);
+    found = entry->second->alignment;
+    return true;
+}
+
+void AlignmentCache::insert(std::string const& sequence, CachedAlignment alignment)
+{
+    std::string sequence_key = key(sequence);
+    const std::size_t entry_bytes = entryBytes(sequence_key, alignment);
+    std::lock_guard<std::mutex> lock(store_->mutex);
+    if (entry_bytes > store_->max_bytes || store_->index.count(sequence_key))
+    {
+        return;
+    }
+    while (store_->bytes + entry_bytes > store_->max_bytes)
+    {
+        Entry const& oldest = store_->entries.back();
+        const std::size_t oldest_bytes = entryBytes(oldest.key, oldest.alignment);
+        Usage& oldest_usage = store_->usage[oldest.partition];
+        --oldest_usage.entries;
+        oldest_usage.bytes -= oldest_bytes;
+        store_->bytes -= oldest_bytes;
+        store_->index.erase(oldest.key);
+        store_->entries.pop_back();
+    }
+    store_->entries.emplace_front(partition_, sequence_key, std::move(alignment));
+    store_->index.emplace(std::move(sequence_key), store_->entries.begin());
+    Usage& usage = store_->usage[partition_];
+    ++usage.entries;
+    usage.bytes += entry_bytes;
+    store_->bytes += entry_bytes;
+}
+
+std::size_t AlignmentCache::lookups() const
+{
+    std::lock_guard<std::mutex> lock(store_->mutex);
+    return store_->usage[partition_].lookups;
+}
+
+std::size_t AlignmentCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(store_->mutex);
+    return store_->usage[partition_].hits;
+}
+
+std::size_t AlignmentCache::entries() const
+{
+    std::lock_guard<std::mutex> lock(store_->mutex);
+    return store_->usage[partition_].entries;
+}
+
+std::size_t AlignmentCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(store_->mutex);
+    return store_->usage[partition_].bytes;
+}
+}
@@ -0,0 +1,92 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Read-only aligner indices for a graph
+ *
+ * \file CompiledGraph.cpp
+ *
+ */
+
+#include "grm/CompiledGraph.hh"
+
+#include <chrono>
+
+#include "common/Error.hh"
+
+namespace grm
+{
+
+typedef std::chrono::duration<double, typename std::chrono::milliseconds::period> Milliseconds;
+
+/**
+ * @return time in milliseconds it took to run f
+ */
+template <typename F> static double timeIt(F f)
+{
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    f();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    return Milliseconds(t1 - t0).count();
+}
+
+CompiledGraph::CompiledGraph(
+    graphtools::Graph const* graph, std::list<graphtools::Path> const& paths, bool pathMatching, bool graphMatching,
+    bool klibMatching, bool kmerMatching, std::vector<NodeReference> const* nodeReferences)
+    : graph_(graph)
+    , paths_(paths)
+{
+    if (pathMatching)
+    {
+        pathBuildTime_ = timeIt([&]() { pathIndex_ = PathAligner::makeIndex(graph); });
+    }
+
+    if (kmerMatching)
+    {
+        kmerBuildTime_ = timeIt([&]() { kmerIndex_ = KmerAlignerType::makeIndex(graph, paths); });
+    }
+
+    if (klibMatching)
+    {
+        klibBuildTime_ = timeIt([&]() { klibIndex_ = KlibAligner::makeIndex(graph, paths); });
+    }
+
+    if (graphMatching)
+    {
+        graphBuildTime_ = timeIt([&]() { graphIndex_ = GraphAligner::makeIndex(graph); });
+    }
+
+    if (nodeReferences)
+    {
+        linearBuildTime_ = timeIt([&]() { linearIndex_ = LinearAligner::makeIndex(graph, *nodeReferences); });
+    }
+
+    LOG()->info(
+        "[Built graph indices in {} ms (linear: {} / path: {} / kmers: {} / ksw: {} / gssw: {})]",
+        linearBuildTime_ + pathBuildTime_ + kmerBuildTime_ + klibBuildTime_ + graphBuildTime_, linearBuildTime_,
+        pathBuildTime_, kmerBuildTime_, klibBuildTime_, graphBuildTime_);
+}
+}
@@ -35,20 +35,41 @@
 
 #include "grm/CompositeAligner.hh"
 
+#include <algorithm>
+#include <chrono>
+
 #ifdef _DEBUG
 #include "graphalign/GraphAlignment.hh"
 #include "graphalign/GraphAlignmentOperations.hh"
 #endif
 
+#include "common/Error.hh"
+
 using namespace grm;
 
+typedef std::chrono::duration<double, typename std::chrono::milliseconds::period> Milliseconds;
+
+/**
+ * @return time in milliseconds it took to run f
+ */
+template <typename F> static double timeIt(F f)
+{
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    f();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    return Milliseconds(t1 - t0).count();
+}
+
 CompositeAligner::CompositeAligner(
-    bool pathMatching, bool graphMatching, bool klibMatching, bool kmerMatching, unsigned grapAlignmentflags)
+    bool pathMatching, bool graphMatching, bool klibMatching, bool kmerMatching, unsigned grapAlignmentflags,
+    bool linearProjection, StageLimits const& stageLimits)
     : pathMatching_(pathMatching)
     , graphMatching_(graphMatching)
     , klibMatching_(klibMatching)
     , kmerMatching_(kmerMatching)
     , grapAlignmentflags_(grapAlignmentflags)
+    , linearProjection_(linearProjection)
+    , stageLimits_(stageLimits)
 {
 }
 
@@ -58,107 +79,365 @@ CompositeAligner::CompositeAligner(CompositeAligner&& rhs) noexcept = default;
 
 void CompositeAligner::setGraph(graphtools::Graph const* graph, std::list<graphtools::Path> const& paths)
 {
+    setGraph(CompiledGraph(graph, paths, pathMatching_, graphMatching_, klibMatching_, kmerMatching_));
+}
+
+void CompositeAligner::setGraph(CompiledGraph const& compiledGraph)
+{
+    if (linearProjection_)
+    {
+        assert(compiledGraph.linearIndex());
+        linearAligner_.setGraph(compiledGraph.linearIndex());
+    }
+
     if (pathMatching_)
     {
-        pathAligner_.setGraph(graph, paths);
+        assert(compiledGraph.pathIndex());
+        pathAligner_.setGraph(compiledGraph.pathIndex());
     }
 
     if (graphMatching_)
     {
-        graphAligner_.setGraph(graph);
+        assert(compiledGraph.graphIndex());
+        graphAligner_.setGraph(compiledGraph.graphIndex());
     }
 
     if (klibMatching_)
     {
-        klibAligner_.setGraph(graph, paths);
+        assert(compiledGraph.klibIndex());
+        klibAligner_.setGraph(compiledGraph.klibIndex());
     }
 
     if (kmerMatching_)
     {
-        kmerAligner_.setGraph(graph, paths);
+        assert(compiledGraph.kmerIndex());
+        kmerAligner_.setGraph(compiledGraph.kmerIndex());
     }
 #ifdef _DEBUG
-    graph_ = graph;
+    graph_ = compiledGraph.graph();
 #endif
 }
 
+void CompositeAligner::mergeStats(CompositeAligner const& other)
+{
+    attempted_ += other.attempted_;
+    filtered_ += other.filtered_;
+    mappedLinear_ += other.mappedLinear_;
+    mappedKlib_ += other.mappedKlib_;
+    mappedPath_ += other.mappedPath_;
+    anchoredPath_ += other.anchoredPath_;
+    mappedKmers_ += other.mappedKmers_;
+    mappedSw_ += other.mappedSw_;
+    for (std::size_t stage = 0; stage != STAGE_COUNT; ++stage)
+    {
+        stageStats_[stage].attempted += other.stageStats_[stage].attempted;
+        stageStats_[stage].mapped += other.stageStats_[stage].mapped;
+        stageStats_[stage].skipped += other.stageStats_[stage].skipped;
+        stageStats_[stage].milliseconds += other.stageStats_[stage].milliseconds;
+    }
+    stageDecisions_ += other.stageDecisions_;
+}
+
+char const* CompositeAligner::stageName(Stage stage)
+{
+    static char const* const names[STAGE_COUNT] = { "path", "kmers", "ksw", "gssw" };
+    return names[stage];
+}
+
 void CompositeAligner::alignRead(common::Read& read, ReadFilter filter)
 {
     ++attempted_;
+    if (projectLinear(read, filter))
+    {
+        return;
+    }
+    const StagePlan plan = planStages();
+    alignPathAndKmers(read, filter, plan);
 
-    if (pathMatching_)
+    if (read.graph_mapping_status() != common::Read::MAPPED && runs(KLIB_STAGE, plan))
     {
-        pathAligner_.alignRead(read);
-        if (read.graph_mapping_status() == common::Read::MAPPED)
+        const double milliseconds = timeIt([&]() { klibAligner_.alignRead(read); });
+        filterKlib(read, filter, milliseconds);
+    }
+
+    alignGraph(read, filter);
+}
+
+void CompositeAligner::alignReads(std::vector<common::Read*> const& reads, ReadFilter filter)
+{
+    attempted_ += reads.size();
+    std::vector<common::Read*> remaining;
+    std::vector<common::Read*> unmapped;
+    for (common::Read* read : reads)
+    {
+        if (projectLinear(*read, filter))
         {
-#ifdef _DEBUG
-            // check a valid alignment was produced
-            graphtools::GraphAlignment mapping
-                = graphtools::decodeGraphAlignment(read.graph_pos(), read.graph_cigar(), graph_);
-#endif
-            ++mappedPath_;
+            continue;
+        }
+        remaining.push_back(read);
+        const StagePlan plan = planStages();
+        alignPathAndKmers(*read, filter, plan);
+        if (read->graph_mapping_status() != common::Read::MAPPED && runs(KLIB_STAGE, plan))
+        {
+            unmapped.push_back(read);
         }
-        anchoredPath_ = pathAligner_.anchored();
     }
 
-    // Filter here if filter is set. This allows second-chance alignment with kmer + graph aligner
-    if (read.graph_mapping_status() == common::Read::MAPPED && filter && filter(read))
+    if (!unmapped.empty())
     {
-        read.set_graph_mapping_status(common::Read::BAD_ALIGN);
-        // increment filtered count if we are not using graph aligner
-        filtered_ += !kmerMatching_ && !klibMatching_ && !graphMatching_;
+        // the reads share the time of the batch
+        const double milliseconds = timeIt([&]() { klibAligner_.alignReads(unmapped); }) / unmapped.size();
+        for (common::Read* read : unmapped)
+        {
+            filterKlib(*read, filter, milliseconds);
+        }
     }
 
-    if (read.graph_mapping_status() != common::Read::MAPPED && kmerMatching_)
+    for (common::Read* read : remaining)
     {
-        kmerAligner_.alignRead(read);
-        if (read.graph_mapping_status() == common::Read::MAPPED)
-        {
+        alignGraph(*read, filter);
+    }
+}
+
+/**
+ * Take over the linear alignment of a read if it projects onto the graph. Projected reads are not aligned any
+ * further: GraphAligner would make the same alignment
+ * @return true if the read was projected
+ */
+bool CompositeAligner::projectLinear(common::Read& read, ReadFilter filter)
+{
+    if (!linearProjection_)
+    {
+        return false;
+    }
+
+    linearAligner_.alignRead(read);
+    if (read.graph_mapping_status() != common::Read::MAPPED)
+    {
+        return false;
+    }
 #ifdef _DEBUG
-            // check a valid alignment was produced
-            graphtools::GraphAlignment mapping
-                = graphtools::decodeGraphAlignment(read.graph_pos(), read.graph_cigar(), graph_);
+    // check a valid alignment was produced
+    read.graph_alignment(graph_);
 #endif
-            if (filter && filter(read))
+    if (filter && filter(read))
+    {
+        read.set_graph_mapping_status(common::Read::BAD_ALIGN);
+        ++filtered_;
+    }
+    else
+    {
+        ++mappedLinear_;
+    }
+    return true;
+}
+
+/**
+ * Decide which stages try the next read. Skipped stages still try every probeInterval-th read
+ */
+CompositeAligner::StagePlan CompositeAligner::planStages()
+{
+    ++plannedReads_;
+    if (stageLimits_.window && 0 == plannedReads_ % stageLimits_.window)
+    {
+        updateStages();
+    }
+
+    const bool probe = stageLimits_.probeInterval && 0 == plannedReads_ % stageLimits_.probeInterval;
+    StagePlan plan = { { pathMatching_, kmerMatching_, klibMatching_, graphMatching_ } };
+    for (std::size_t stage = 0; stage != STAGE_COUNT; ++stage)
+    {
+        plan[stage] = plan[stage] && (!skipping_[stage] || probe);
+    }
+    return plan;
+}
+
+/**
+ * Skip the stages before gssw when they cost more than the gssw alignments they save, unless they map at least
+ * minSuccessRate of their reads. Try the kmer aligner before the path aligner when it maps more reads per time.
+ * Stages are judged on all reads they tried for the graph, skipped stages on the reads they probed
+ */
+void CompositeAligner::updateStages()
+{
+    // gssw aligns the reads that the other stages do not map
+    StageStats const& graph = stageStats_[GRAPH_STAGE];
+    if (graph.attempted)
+    {
+        const double graphMilliseconds = graph.milliseconds / graph.attempted;
+        for (const Stage stage : { PATH_STAGE, KMER_STAGE, KLIB_STAGE })
+        {
+            StageStats const& stats = stageStats_[stage];
+            if (!stats.attempted)
             {
-                read.set_graph_mapping_status(common::Read::BAD_ALIGN);
-                // increment filtered count if we are not trying to align further
-                filtered_ += !klibMatching_ && !graphMatching_;
+                continue;
             }
-            else
+            const double successRate = double(stats.mapped) / stats.attempted;
+            const double milliseconds = stats.milliseconds / stats.attempted;
+            // rule of three: a stage that mapped none of n reads may still map up to 3 / n of them
+            const double optimisticSuccessRate = std::min(1.0, (stats.mapped + 3.0) / stats.attempted);
+            const bool paysOff = successRate >= stageLimits_.minSuccessRate
+                || optimisticSuccessRate * graphMilliseconds >= milliseconds;
+            if (skipping_[stage] == paysOff)
             {
-                ++mappedKmers_;
+                skipping_[stage] = !paysOff;
+                ++stageDecisions_;
+                LOG()->debug(
+                    "[{} {} stage: {:.1f}% mapped in {:.4f} ms per read, gssw takes {:.4f} ms]",
+                    paysOff ? "Resuming" : "Skipping", stageName(stage), 100 * successRate, milliseconds,
+                    graphMilliseconds);
             }
         }
     }
 
-    if (read.graph_mapping_status() != common::Read::MAPPED && klibMatching_)
+    // mapped reads per time, each measured on the reads that reached the stage
+    StageStats const& path = stageStats_[PATH_STAGE];
+    StageStats const& kmers = stageStats_[KMER_STAGE];
+    if (!skipping_[PATH_STAGE] && !skipping_[KMER_STAGE] && 0 < path.milliseconds && 0 < kmers.milliseconds)
     {
-        klibAligner_.alignRead(read);
-        // Filter here if filter is set. This allows second-chance alignment with graph aligner
-        if (read.graph_mapping_status() == common::Read::MAPPED)
+        const bool kmersFirst = kmers.mapped / kmers.milliseconds > path.mapped / path.milliseconds;
+        if (kmersFirst != kmersFirst_)
+        {
+            kmersFirst_ = kmersFirst;
+            ++stageDecisions_;
+            LOG()->debug("[Trying {} stage first]", stageName(kmersFirst ? KMER_STAGE : PATH_STAGE));
+        }
+    }
+}
+
+/**
+ * @return true if the stage tries the read. Counts the read as skipped if the stage is enabled but not in the plan
+ */
+bool CompositeAligner::runs(Stage stage, StagePlan const& plan)
+{
+    if (!plan[stage] && skipping_[stage])
+    {
+        ++stageStats_[stage].skipped;
+    }
+    return plan[stage];
+}
+
+void CompositeAligner::countStage(Stage stage, bool mapped, double milliseconds)
+{
+    StageStats& stats = stageStats_[stage];
+    ++stats.attempted;
+    stats.mapped += mapped;
+    stats.milliseconds += 0 <= stageCosts_[stage] ? stageCosts_[stage] : milliseconds;
+}
+
+void CompositeAligner::alignPathAndKmers(common::Read& read, ReadFilter filter, StagePlan const& plan)
+{
+    const bool laterStages = plan[KLIB_STAGE] || plan[GRAPH_STAGE];
+    if (kmersFirst_)
+    {
+        if (runs(KMER_STAGE, plan))
+        {
+            alignKmers(read, filter, !plan[PATH_STAGE] && !laterStages);
+        }
+        if (read.graph_mapping_status() != common::Read::MAPPED && runs(PATH_STAGE, plan))
+        {
+            alignPath(read, filter, !laterStages);
+        }
+    }
+    else
+    {
+        if (runs(PATH_STAGE, plan))
+        {
+            alignPath(read, filter, !plan[KMER_STAGE] && !laterStages);
+        }
+        if (read.graph_mapping_status() != common::Read::MAPPED && runs(KMER_STAGE, plan))
         {
+            alignKmers(read, filter, !laterStages);
+        }
+    }
+}
+
+/**
+ * @param lastStage true if no other stage tries the read when it is filtered
+ */
+void CompositeAligner::alignPath(common::Read& read, ReadFilter filter, bool lastStage)
+{
+    const double milliseconds = timeIt([&]() { pathAligner_.alignRead(read); });
+    anchoredPath_ = pathAligner_.anchored();
+    bool mapped = read.graph_mapping_status() == common::Read::MAPPED;
+    if (mapped)
+    {
 #ifdef _DEBUG
-            // check a valid alignment was produced
-            graphtools::GraphAlignment mapping
-                = graphtools::decodeGraphAlignment(read.graph_pos(), read.graph_cigar(), graph_);
+        // check a valid alignment was produced
+        read.graph_alignment(graph_);
 #endif
-            if (filter && filter(read))
-            {
-                read.set_graph_mapping_status(common::Read::BAD_ALIGN);
-                // increment filtered count if we are not using graph aligner
-                filtered_ += !graphMatching_;
-            }
-            else
-            {
-                ++mappedKlib_;
-            }
+        ++mappedPath_;
+
+        // Filter here if filter is set. This allows second-chance alignment with kmer + graph aligner
+        if (filter && filter(read))
+        {
+            read.set_graph_mapping_status(common::Read::BAD_ALIGN);
+            filtered_ += lastStage;
+            mapped = false;
         }
     }
+    countStage(PATH_STAGE, mapped, milliseconds);
+}
 
+/**
+ * @param lastStage true if no other stage tries the read when it is filtered
+ */
+void CompositeAligner::alignKmers(common::Read& read, ReadFilter filter, bool lastStage)
+{
+    const double milliseconds = timeIt([&]() { kmerAligner_.alignRead(read); });
+    bool mapped = read.graph_mapping_status() == common::Read::MAPPED;
+    if (mapped)
+    {
+#ifdef _DEBUG
+        // check a valid alignment was produced
+        read.graph_alignment(graph_);
+#endif
+        if (filter && filter(read))
+        {
+            read.set_graph_mapping_status(common::Read::BAD_ALIGN);
+            filtered_ += lastStage;
+            mapped = false;
+        }
+        else
+        {
+            ++mappedKmers_;
+        }
+    }
+    countStage(KMER_STAGE, mapped, milliseconds);
+}
+
+/**
+ * Count the klib alignment of a read. Filter here if filter is set. This allows second-chance alignment with graph
+ * aligner
+ */
+void CompositeAligner::filterKlib(common::Read& read, ReadFilter filter, double milliseconds)
+{
+    bool mapped = read.graph_mapping_status() == common::Read::MAPPED;
+    if (mapped)
+    {
+#ifdef _DEBUG
+        // check a valid alignment was produced
+        read.graph_alignment(graph_);
+#endif
+        if (filter && filter(read))
+        {
+            read.set_graph_mapping_status(common::Read::BAD_ALIGN);
+            // increment filtered count if we are not using graph aligner
+            filtered_ += !graphMatching_;
+            mapped = false;
+        }
+        else
+        {
+            ++mappedKlib_;
+        }
+    }
+    countStage(KLIB_STAGE, mapped, milliseconds);
+}
+
+void CompositeAligner::alignGraph(common::Read& read, ReadFilter filter)
+{
     if (read.graph_mapping_status() != common::Read::MAPPED && graphMatching_)
     {
-        graphAligner_.alignRead(read);
+        const double milliseconds = timeIt([&]() { graphAligner_.alignRead(read); });
         // graph aligner always produces a mapping, It just does not set the status for some reason
         read.set_graph_mapping_status(common::Read::MAPPED);
 
@@ -166,8 +445,7 @@ void CompositeAligner::alignRead(common::Read& read, ReadFilter filter)
         {
 #ifdef _DEBUG
             // check a valid alignment was produced
-            graphtools::GraphAlignment mapping
-                = graphtools::decodeGraphAlignment(read.graph_pos(), read.graph_cigar(), graph_);
+            read.graph_alignment(graph_);
 #endif
             if (filter && filter(read))
             {
@@ -179,5 +457,6 @@ void CompositeAligner::alignRead(common::Read& read, ReadFilter filter)
                 ++mappedSw_;
             }
         }
+        countStage(GRAPH_STAGE, read.graph_mapping_status() == common::Read::MAPPED, milliseconds);
     }
 }
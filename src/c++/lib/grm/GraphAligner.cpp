@@ -26,6 +26,7 @@
 
 #include "grm/GraphAligner.hh"
 
+#include <algorithm>
 #include <cstdlib>
 #include <gssw.h>
 #include <iostream>
@@ -37,6 +38,7 @@
 #include "common/StringUtil.hh"
 #include "graphcore/GraphOperations.hh"
 #include "graphutils/SequenceOperations.hh"
+#include "grm/KmerTable.hh"
 
 using namespace grm;
 using namespace common;
@@ -68,20 +70,110 @@ static inline void safe_gssw_graph_mapping_destroy(gssw_graph_mapping* g)
     }
 }
 
+struct GraphAligner::Index
+{
+    /**
+     * gssw nodes and edges for one graph orientation
+     */
+    struct Layout
+    {
+        /** upper-case sequence of each gssw node */
+        std::vector<std::string> sequences;
+        /** each node in the input graph may create more than one gssw node */
+        std::vector<NodeId> node_map;
+        /** stores the first gssw node for each graph node */
+        std::vector<uint32_t> first_gssw_node;
+        /** gssw edges in the order they are added to the nodes */
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+        /** kmers of the gssw node sequences. Postings are gssw node id and offset in the node sequence */
+        KmerTable kmers;
+    };
+
+    /// kmer length used to find the part of the graph a read can align to
+    static const unsigned SEED_KMER_LENGTH = 16;
+    /// kmers occurring more often than this in the graph are too repetitive to restrict the alignment
+    static const unsigned MAX_SEED_POSTINGS = 16;
+
+    explicit Index(Graph const* graph)
+        : original_graph(graph)
+    {
+        layoutGraph(*graph, forward);
+        layoutGraph(reverseGraph(*graph), reversed);
+    }
+
+    static void layoutGraph(Graph const& graph, Layout& layout)
+    {
+        layout.first_gssw_node.resize(graph.numNodes());
+
+        uint32_t gssw_node_id = 0;
+        for (NodeId node_id = 0; node_id != graph.numNodes(); ++node_id)
+        {
+            layout.first_gssw_node[node_id] = gssw_node_id;
+            if (node_id != 0 && node_id != graph.numNodes() - 1)
+            {
+                for (auto sequence : graph.nodeSeqExpansion(node_id))
+                {
+                    stringutil::toUpper(sequence);
+                    layout.sequences.push_back(sequence);
+                    layout.node_map.push_back(node_id);
+                    ++gssw_node_id;
+                }
+            }
+            else
+            {
+                std::string sequence = graph.nodeSeq(node_id);
+                stringutil::toUpper(sequence);
+                layout.sequences.push_back(sequence);
+                layout.node_map.push_back(node_id);
+                ++gssw_node_id;
+            }
+
+            for (auto to_gssw_node = layout.first_gssw_node[node_id]; to_gssw_node < gssw_node_id; ++to_gssw_node)
+            {
+                for (auto pred : graph.predecessors(node_id))
+                {
+                    // topological ordering
+                    assert(pred < node_id);
+                    auto from_gssw_node = layout.first_gssw_node[pred];
+                    while (from_gssw_node < layout.node_map.size() && layout.node_map[from_gssw_node] == pred)
+                    {
+                        layout.edges.emplace_back(from_gssw_node, to_gssw_node);
+                        ++from_gssw_node;
+                    }
+                }
+            }
+        }
+
+        KmerTable::Kmers kmers;
+        for (uint32_t gssw_node_id = 0; gssw_node_id != layout.sequences.size(); ++gssw_node_id)
+        {
+            KmerTable::addKmers<SEED_KMER_LENGTH>(layout.sequences[gssw_node_id], gssw_node_id, kmers);
+        }
+        layout.kmers = KmerTable(std::move(kmers));
+    }
+
+    Layout forward;
+    Layout reversed;
+
+    /** keep original graphtools graph */
+    Graph const* original_graph;
+};
+
 struct GraphAligner::GraphAlignerImpl
 {
     typedef std::unique_ptr<int8_t, decltype(&free)> p_int8_t;
     typedef std::unique_ptr<gssw_graph, decltype(&safe_gssw_graph_destroy)> p_gssw_graph;
     typedef std::unique_ptr<gssw_graph_mapping, decltype(&safe_gssw_graph_mapping_destroy)> p_gssw_graph_mapping;
+    typedef std::unique_ptr<gssw_arena, decltype(&gssw_arena_destroy)> p_gssw_arena;
 
     GraphAlignerImpl()
         : nt_table_(p_int8_t(gssw_create_nt_table(), free))
         , mat_(p_int8_t(gssw_create_score_matrix(match_, mismatch_), free))
+        , arena_(gssw_arena_create(), gssw_arena_destroy)
         ,
         /* graph_ owns all nodes_[] elements. There probably is a better way to keep track of this */
         graph_(nullptr, safe_gssw_graph_destroy)
         , graph_reversed_(nullptr, safe_gssw_graph_destroy)
-        , original_graph_(nullptr)
     {
     }
 
@@ -114,125 +206,342 @@ struct GraphAligner::GraphAlignerImpl
         return cigar.str();
     }
 
-    void initializeGraph(
-        Graph const& graph, p_gssw_graph& gssw_graph, std::vector<gssw_node*>& nodes, std::vector<NodeId>& node_map,
-        std::vector<uint32_t>& first_gssw_node)
+    void initializeGraph(Index::Layout const& layout, p_gssw_graph& gssw_graph, std::vector<gssw_node*>& nodes)
     {
         nodes.clear();
-        node_map.clear();
-        first_gssw_node.clear();
-        first_gssw_node.resize(graph.numNodes());
+        for (uint32_t gssw_node_id = 0; gssw_node_id != layout.sequences.size(); ++gssw_node_id)
+        {
+            nodes.push_back(gssw_node_create(
+                nullptr, gssw_node_id, layout.sequences[gssw_node_id].c_str(), nt_table_.get(), mat_.get()));
+        }
 
-        uint32_t gssw_node_id = 0;
-        for (NodeId node_id = 0; node_id != graph.numNodes(); ++node_id)
+        for (auto const& edge : layout.edges)
         {
-            first_gssw_node[node_id] = gssw_node_id;
-            if (node_id != 0 && node_id != graph.numNodes() - 1)
+            gssw_nodes_add_edge(nodes[edge.first], nodes[edge.second]);
+        }
+
+        // Make the graph itself.
+        gssw_graph.reset(gssw_graph_create((uint32_t)nodes.size()));
+        for (gssw_node* node : nodes)
+        {
+            gssw_graph_add_node(gssw_graph.get(), node);
+        }
+    }
+
+    /** gssw node id and diagonal, the node offset minus the read offset, of a read kmer found in a layout */
+    typedef std::pair<uint32_t, int32_t> Seed;
+
+    /**
+     * Graph filled by alignString: either the gssw graph of a whole layout or a subgraph made of the parts of the
+     * layout nodes around the read seeds
+     */
+    struct Target
+    {
+        Target()
+            : subgraph(nullptr, safe_gssw_graph_destroy)
+            , mapping(nullptr, safe_gssw_graph_mapping_destroy)
+        {
+        }
+
+        /** start of the alignment in the sequence of its first graph node */
+        int32_t position() const
+        {
+            int32_t position = mapping->position;
+            if (subgraph && mapping->cigar.length)
             {
-                for (auto sequence : graph.nodeSeqExpansion(node_id))
-                {
-                    stringutil::toUpper(sequence);
+                position += offsets[mapping->cigar.elements->node->id];
+            }
+            return position;
+        }
 
-                    gssw_node* nd
-                        = gssw_node_create(nullptr, gssw_node_id++, sequence.c_str(), nt_table_.get(), mat_.get());
-                    nodes.push_back(nd);
-                    node_map.push_back(node_id);
-                }
+        std::vector<Seed> seeds;
+
+        /** graph node of each gssw node of the filled graph */
+        std::vector<NodeId> const* node_map = nullptr;
+        /** subgraph nodes and their offsets in the layout node sequences they were cut from */
+        p_gssw_graph subgraph;
+        std::vector<NodeId> subgraph_node_map;
+        std::vector<int32_t> offsets;
+
+        p_gssw_graph_mapping mapping;
+    };
+
+    /**
+     * Find the read kmers in the layout nodes. Kmers that are too repetitive in the graph are ignored
+     */
+    static void findSeeds(Index::Layout const& layout, std::string const& str, std::vector<Seed>& seeds)
+    {
+        seeds.clear();
+        if (str.size() < Index::SEED_KMER_LENGTH)
+        {
+            return;
+        }
+
+        oligo::KmerGenerator<Index::SEED_KMER_LENGTH, KmerTable::KmerType, std::string::const_iterator> kmerGenerator(
+            str.begin(), str.end());
+        KmerTable::KmerType kmer = 0;
+        std::string::const_iterator position;
+        while (kmerGenerator.next(kmer, position))
+        {
+            const unsigned entry = layout.kmers.find(kmer);
+            if (KmerTable::NO_ENTRY == entry
+                || std::size_t(layout.kmers.end(entry) - layout.kmers.begin(entry)) > Index::MAX_SEED_POSTINGS)
+            {
+                continue;
             }
-            else
+            const int32_t read_pos = (int32_t)std::distance(str.begin(), position);
+            for (auto posting = layout.kmers.begin(entry); layout.kmers.end(entry) != posting; ++posting)
             {
-                std::string sequence = graph.nodeSeq(node_id);
-                stringutil::toUpper(sequence);
-                gssw_node* nd
-                    = gssw_node_create(nullptr, gssw_node_id++, sequence.c_str(), nt_table_.get(), mat_.get());
-                nodes.push_back(nd);
-                node_map.push_back(node_id);
+                seeds.emplace_back(posting->pathId_, (int32_t)posting->position_ - read_pos);
             }
+        }
+        std::sort(seeds.begin(), seeds.end());
+        seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+    }
 
-            for (auto to_gssw_node = first_gssw_node[node_id]; to_gssw_node < gssw_node_id; ++to_gssw_node)
+    /**
+     * Cut the parts of the layout nodes that the read can align to: each seed diagonal with a read length on either
+     * side to allow for indels and clipped ends. Where these run past the end or start of a node, the
+     * successors or predecessors contribute the remaining bases
+     * @return false if there are no seeds or the subgraph would not be smaller than the layout
+     */
+    bool makeSubgraph(Index::Layout const& layout, int32_t read_len, Target& target)
+    {
+        if (target.seeds.empty())
+        {
+            return false;
+        }
+
+        // bases each node needs from its predecessors and successors for the seeds inside it
+        const std::size_t node_count = layout.sequences.size();
+        before_.assign(node_count, 0);
+        after_.assign(node_count, 0);
+        for (auto const& seed : target.seeds)
+        {
+            const int32_t len = (int32_t)layout.sequences[seed.first].size();
+            before_[seed.first] = std::max(before_[seed.first], read_len - seed.second);
+            after_[seed.first] = std::max(after_[seed.first], seed.second + read_len * 2 - len);
+        }
+
+        // prefix and suffix of each node needed by the seeds in other nodes. Edges are ordered by their
+        // destination node, which is after the source node in the layout
+        prefix_.assign(node_count, 0);
+        suffix_.assign(node_count, 0);
+        for (auto const& edge : layout.edges)
+        {
+            const int32_t len = (int32_t)layout.sequences[edge.first].size();
+            prefix_[edge.second]
+                = std::max(prefix_[edge.second], std::max(after_[edge.first], prefix_[edge.first] - len));
+        }
+        for (auto edge = layout.edges.rbegin(); layout.edges.rend() != edge; ++edge)
+        {
+            const int32_t len = (int32_t)layout.sequences[edge->second].size();
+            suffix_[edge->first]
+                = std::max(suffix_[edge->first], std::max(before_[edge->second], suffix_[edge->second] - len));
+        }
+
+        target.subgraph_node_map.clear();
+        target.offsets.clear();
+        segment_nodes_.clear();
+        segment_ends_.clear();
+        first_segment_.assign(node_count, -1);
+        last_segment_.assign(node_count, -1);
+        std::size_t layout_bases = 0;
+        std::size_t subgraph_bases = 0;
+        auto seed = target.seeds.begin();
+        for (uint32_t node = 0; node != node_count; ++node)
+        {
+            const int32_t len = (int32_t)layout.sequences[node].size();
+            layout_bases += len;
+
+            intervals_.clear();
+            for (; target.seeds.end() != seed && seed->first == node; ++seed)
             {
-                for (auto pred : graph.predecessors(node_id))
+                intervals_.emplace_back(
+                    std::max(0, seed->second - read_len), std::min(len, seed->second + read_len * 2));
+            }
+            if (prefix_[node] > 0)
+            {
+                intervals_.emplace_back(0, std::min(len, prefix_[node]));
+            }
+            if (suffix_[node] > 0)
+            {
+                intervals_.emplace_back(std::max(0, len - suffix_[node]), len);
+            }
+            std::sort(intervals_.begin(), intervals_.end());
+
+            for (auto interval = intervals_.begin(); intervals_.end() != interval;)
+            {
+                int32_t segment_end = interval->second;
+                auto next = interval + 1;
+                for (; intervals_.end() != next && next->first <= segment_end; ++next)
                 {
-                    // topological ordering
-                    assert(pred < node_id);
-                    auto from_gssw_node = first_gssw_node[pred];
-                    while (from_gssw_node < node_map.size() && node_map[from_gssw_node] == pred)
-                    {
-                        gssw_nodes_add_edge(nodes[from_gssw_node], nodes[to_gssw_node]);
-                        ++from_gssw_node;
-                    }
+                    segment_end = std::max(segment_end, next->second);
+                }
+                if (0 == interval->first)
+                {
+                    first_segment_[node] = (int32_t)target.offsets.size();
                 }
+                if (len == segment_end)
+                {
+                    last_segment_[node] = (int32_t)target.offsets.size();
+                }
+                target.subgraph_node_map.push_back(layout.node_map[node]);
+                target.offsets.push_back(interval->first);
+                segment_nodes_.push_back(node);
+                segment_ends_.push_back(segment_end);
+                subgraph_bases += segment_end - interval->first;
+                interval = next;
             }
         }
 
-        // Make the graph itself.
-        gssw_graph.reset(gssw_graph_create((uint32_t)nodes.size()));
+        if (subgraph_bases >= layout_bases)
+        {
+            return false;
+        }
+
+        std::vector<gssw_node*>& nodes = subgraph_nodes_;
+        nodes.clear();
+        for (uint32_t segment = 0; segment != target.offsets.size(); ++segment)
+        {
+            const int32_t offset = target.offsets[segment];
+            segment_sequence_.assign(
+                layout.sequences[segment_nodes_[segment]], offset, segment_ends_[segment] - offset);
+            nodes.push_back(
+                gssw_node_create(nullptr, segment, segment_sequence_.c_str(), nt_table_.get(), mat_.get()));
+        }
+
+        for (auto const& edge : layout.edges)
+        {
+            if (-1 != last_segment_[edge.first] && -1 != first_segment_[edge.second])
+            {
+                gssw_nodes_add_edge(nodes[last_segment_[edge.first]], nodes[first_segment_[edge.second]]);
+            }
+        }
+
+        target.subgraph.reset(gssw_graph_create((uint32_t)nodes.size()));
         for (gssw_node* node : nodes)
         {
-            gssw_graph_add_node(gssw_graph.get(), node);
+            gssw_graph_add_node(target.subgraph.get(), node);
         }
+        return true;
     }
 
-    /** Assumes that DP matrix has been filled out. */
-    static bool alignsEndAtMultNodes(
-        gssw_graph* graph, std::vector<gssw_node*> const& nodes, std::vector<NodeId> const& node_map, int32_t read_len)
+    /**
+     * The node score tracked by gssw is the maximum over all cells of its DP matrix, including the cells of the
+     * query padding, so it is only a bound for the read cells. None of the columns before the one where the node
+     * first reached its score can contain it
+     * @return true if the DP matrix of the node has a read cell with the score
+     */
+    template <typename ScoreT> static bool hasCellWithScore(gssw_node const* node, int32_t read_len, uint16_t score)
     {
-        /** Top local-alignment score. */
-        uint16_t top_score = graph->max_node->alignment->score1;
-
-        std::set<NodeId> nodes_where_top_aligns_end;
-
-        for (size_t i = 0; i < nodes.size(); ++i)
+        auto const* mH = (ScoreT const*)node->alignment->mH;
+        /** Rows correspond to reference and columns to read bases. */
+        for (int32_t row = std::max(0, node->alignment->ref_end1); row < node->len; ++row)
         {
-            auto* mH = (uint8_t*)nodes[i]->alignment->mH;
-            bool top_align_ends_at_node = false;
-            /** Rows correspond to reference and columns to read bases. */
-            for (int32_t row = 0; row < nodes[i]->len; ++row)
+            for (int32_t col = 0; col < read_len; ++col)
             {
-                for (int32_t col = 0; col < read_len; ++col)
+                if (mH[read_len * row + col] == score)
                 {
-                    uint8_t score = mH[read_len * row + col];
-                    if (score == top_score)
-                    {
-                        top_align_ends_at_node = true;
-                        break;
-                    }
-                }
-                if (top_align_ends_at_node)
-                {
-                    break;
+                    return true;
                 }
             }
+        }
+        return false;
+    }
+
+    /** Assumes that DP matrix has been filled out. */
+    static bool alignsEndAtMultNodes(gssw_graph const* graph, std::vector<NodeId> const& node_map, int32_t read_len)
+    {
+        /** Top local-alignment score. */
+        uint16_t top_score = graph->max_node->alignment->score1;
 
-            if (top_align_ends_at_node)
+        bool top_align_ends = false;
+        NodeId node_where_top_aligns_end = 0;
+        for (uint32_t i = 0; i < graph->size; ++i)
+        {
+            gssw_node const* node = graph->nodes[i];
+            if (node->alignment->score1 != top_score
+                || (top_align_ends && node_map[i] == node_where_top_aligns_end))
             {
-                nodes_where_top_aligns_end.insert(node_map[i]);
+                continue;
             }
-
-            if (nodes_where_top_aligns_end.size() > 1)
+            if (node->alignment->is_byte ? hasCellWithScore<uint8_t>(node, read_len, top_score)
+                                         : hasCellWithScore<uint16_t>(node, read_len, top_score))
             {
-                return true;
+                if (top_align_ends)
+                {
+                    return true;
+                }
+                top_align_ends = true;
+                node_where_top_aligns_end = node_map[i];
             }
         }
 
         return false;
     }
 
-    bool alignString(
-        gssw_graph* g, std::vector<gssw_node*> const& nodes, std::vector<NodeId> const& node_map, std::string str,
-        p_gssw_graph_mapping& output)
+    /**
+     * @param graph gssw graph of the layout
+     * @param seeded fill only a subgraph around the target seeds, see makeSubgraph
+     * @param target receives the filled graph and the alignment
+     * @return true if top-scoring alignments end at more than one graph node
+     */
+    bool alignString(Index::Layout const& layout, gssw_graph* graph, std::string str, bool seeded, Target& target)
     {
         stringutil::toUpper(str);
+        target.mapping.reset();
+        target.subgraph.reset();
+        target.node_map = &layout.node_map;
+        if (seeded && makeSubgraph(layout, (int32_t)str.size(), target))
+        {
+            graph = target.subgraph.get();
+            target.node_map = &target.subgraph_node_map;
+        }
+
         // Compute dynamic programming matrix.
-        gssw_graph_fill(g, str.c_str(), nt_table_.get(), mat_.get(), gap_open_, gap_extension_, 15, 2);
+        gssw_graph_fill(graph, str.c_str(), nt_table_.get(), mat_.get(), gap_open_, gap_extension_, 15, 2);
 
         // Compute optimal local alignment.
-        gssw_graph_mapping* gm = gssw_graph_trace_back(
-            g, str.c_str(), (int32_t)str.length(), nt_table_.get(), mat_.get(), gap_open_, gap_extension_);
-        output = p_gssw_graph_mapping(gm, gssw_graph_mapping_destroy);
-        return alignsEndAtMultNodes(g, nodes, node_map, (int32_t)str.size());
+        target.mapping.reset(gssw_graph_trace_back(
+            graph, str.c_str(), (int32_t)str.length(), nt_table_.get(), mat_.get(), gap_open_, gap_extension_));
+        return alignsEndAtMultNodes(graph, *target.node_map, (int32_t)str.size());
     }
 
+    /**
+     * Release the gssw fills and trace backs of the previous read all at once: the alignments of the layout graph
+     * nodes are cleared, mappings and subgraphs belong to the alignRead call that made them
+     */
+    void startRead()
+    {
+        for (gssw_graph* graph : { graph_.get(), graph_reversed_.get() })
+        {
+            if (graph)
+            {
+                gssw_graph_clear_alignment(graph);
+            }
+        }
+        gssw_arena_reset(arena_.get());
+    }
+
+    /**
+     * Makes gssw allocate from the arena of an aligner on the calling thread while in scope
+     */
+    class ArenaScope
+    {
+    public:
+        explicit ArenaScope(gssw_arena* arena)
+            : previous_(gssw_arena_use(arena))
+        {
+        }
+        ~ArenaScope() { gssw_arena_use(previous_); }
+        ArenaScope(ArenaScope const&) = delete;
+        ArenaScope& operator=(ArenaScope const&) = delete;
+
+    private:
+        gssw_arena* previous_;
+    };
+
     /** Default alignment parameters. */
     int8_t match_ = 1;
     int8_t mismatch_ = 4;
@@ -242,25 +551,31 @@ struct GraphAligner::GraphAlignerImpl
     p_int8_t nt_table_;
     p_int8_t mat_;
 
+    /** scratch memory of the gssw fills and trace backs of one read. Outlives the graphs that point into it */
+    p_gssw_arena arena_;
+
+    std::shared_ptr<const Index> index_;
+
     p_gssw_graph graph_;
     /** nodes are owned by graph */
     std::vector<gssw_node*> nodes_;
 
-    /** each node in the input graph may create more than one gssw node */
-    std::vector<NodeId> node_map_;
-    /** stores the first gssw node for each graph node */
-    std::vector<uint32_t> first_gssw_node_;
-
     p_gssw_graph graph_reversed_;
     /** nodes are owned by graph */
     std::vector<gssw_node*> nodes_reversed_;
-    /** each node in the input graph may create more than one gssw node */
-    std::vector<NodeId> node_map_reversed_;
-    /** stores the first gssw node for each graph node */
-    std::vector<uint32_t> first_gssw_node_reversed_;
 
-    /** keep original graphtools graph */
-    Graph const* original_graph_;
+    /** makeSubgraph buffers. Intervals and segments are offsets in the layout node sequences */
+    std::vector<int32_t> before_;
+    std::vector<int32_t> after_;
+    std::vector<int32_t> prefix_;
+    std::vector<int32_t> suffix_;
+    std::vector<std::pair<int32_t, int32_t>> intervals_;
+    std::vector<uint32_t> segment_nodes_;
+    std::vector<int32_t> segment_ends_;
+    std::vector<int32_t> first_segment_;
+    std::vector<int32_t> last_segment_;
+    std::string segment_sequence_;
+    std::vector<gssw_node*> subgraph_nodes_;
 };
 
 GraphAligner::GraphAligner()
@@ -281,14 +596,18 @@ GraphAligner& GraphAligner::operator=(GraphAligner&& rhs) noexcept
     return *this;
 }
 
-void GraphAligner::setGraph(Graph const* graph)
+std::shared_ptr<const GraphAligner::Index> GraphAligner::makeIndex(Graph const* graph)
 {
-    _impl->original_graph_ = graph;
-    _impl->initializeGraph(*graph, _impl->graph_, _impl->nodes_, _impl->node_map_, _impl->first_gssw_node_);
-    Graph graph_reverse = reverseGraph(*graph);
-    _impl->initializeGraph(
-        graph_reverse, _impl->graph_reversed_, _impl->nodes_reversed_, _impl->node_map_reversed_,
-        _impl->first_gssw_node_reversed_);
+    return std::make_shared<const Index>(graph);
+}
+
+void GraphAligner::setGraph(Graph const* graph) { setGraph(makeIndex(graph)); }
+
+void GraphAligner::setGraph(std::shared_ptr<const Index> index)
+{
+    _impl->index_ = std::move(index);
+    _impl->initializeGraph(_impl->index_->forward, _impl->graph_, _impl->nodes_);
+    _impl->initializeGraph(_impl->index_->reversed, _impl->graph_reversed_, _impl->nodes_reversed_);
 }
 
 string GraphAligner::align(const string& read, int& mapq, int& position, int& score) const
@@ -314,42 +633,79 @@ string GraphAligner::align(const string& read, int& mapq, int& position, int& sc
  */
 void GraphAligner::alignRead(Read& read, unsigned int alignment_flags) const
 {
-    GraphAlignerImpl::p_gssw_graph_mapping gm_fwd_strand{ nullptr, safe_gssw_graph_mapping_destroy };
-    GraphAlignerImpl::p_gssw_graph_mapping gm_reverse_strand{ nullptr, safe_gssw_graph_mapping_destroy };
-    GraphAlignerImpl::p_gssw_graph_mapping rgm_fwd_strand{ nullptr, safe_gssw_graph_mapping_destroy };
-    GraphAlignerImpl::p_gssw_graph_mapping rgm_reverse_strand{ nullptr, safe_gssw_graph_mapping_destroy };
+    _impl->startRead();
+    const GraphAlignerImpl::ArenaScope arena_scope(_impl->arena_.get());
+    GraphAlignerImpl::Target fwd_strand;
+    GraphAlignerImpl::Target reverse_strand;
+    GraphAlignerImpl::Target rfwd_strand;
+    GraphAlignerImpl::Target rreverse_strand;
 
     const std::string rev_cmp_bases = reverseComplement(read.bases());
+    const bool both_strands = (alignment_flags & AF_BOTH_STRANDS) != 0u;
 
-    const bool fwd_strand_multi_align
-        = _impl->alignString(_impl->graph_.get(), _impl->nodes_, _impl->node_map_, read.bases(), gm_fwd_strand);
-    const bool reverse_strand_multi_align = (alignment_flags & AF_BOTH_STRANDS) != 0u
-        ? _impl->alignString(_impl->graph_.get(), _impl->nodes_, _impl->node_map_, rev_cmp_bases, gm_reverse_strand)
-        : false;
+    Index::Layout const& layout = _impl->index_->forward;
+    Index::Layout const& layout_reversed = _impl->index_->reversed;
 
-    bool rfwd_strand_multi_align = false;
-    bool rreverse_strand_multi_align = false;
+    // align bases to the graph and, if requested, reversed bases to the reversed graph. Returns true if the
+    // alignment is unique in both
+    auto align_strand = [&](std::string const& bases, bool seeded, GraphAlignerImpl::Target& target,
+                            GraphAlignerImpl::Target& rtarget) -> bool {
+        bool multi_align = _impl->alignString(layout, _impl->graph_.get(), bases, seeded, target);
+        if ((alignment_flags & AF_REVERSE_GRAPH) != 0u)
+        {
+            const string bases_rev(bases.rbegin(), bases.rend());
+            if (seeded)
+            {
+                _impl->findSeeds(layout_reversed, bases_rev, rtarget.seeds);
+            }
+            multi_align = _impl->alignString(
+                              layout_reversed, _impl->graph_reversed_.get(), bases_rev, seeded, rtarget)
+                || multi_align;
+        }
+        return !multi_align;
+    };
 
-    if ((alignment_flags & AF_REVERSE_GRAPH) != 0u)
+    bool seeded = false;
+    if ((alignment_flags & AF_SEEDED) != 0u)
     {
-        string bases_rev = read.bases();
-        std::reverse(bases_rev.begin(), bases_rev.end());
-
-        rfwd_strand_multi_align = _impl->alignString(
-            _impl->graph_reversed_.get(), _impl->nodes_reversed_, _impl->node_map_reversed_, bases_rev, rgm_fwd_strand);
-        rreverse_strand_multi_align = (alignment_flags & AF_BOTH_STRANDS) != 0u
-            ? _impl->alignString(
-                  _impl->graph_reversed_.get(), _impl->nodes_reversed_, _impl->node_map_reversed_,
-                  reverseComplement(bases_rev), rgm_reverse_strand)
-            : false;
+        _impl->findSeeds(layout, read.bases(), fwd_strand.seeds);
+        if (both_strands)
+        {
+            _impl->findSeeds(layout, rev_cmp_bases, reverse_strand.seeds);
+        }
+        seeded = !fwd_strand.seeds.empty() || !reverse_strand.seeds.empty();
     }
 
-    bool fwd_strand_is_unique = (!fwd_strand_multi_align) && (!rfwd_strand_multi_align);
-    bool reverse_strand_is_unique = (!reverse_strand_multi_align) && (!rreverse_strand_multi_align);
+    // with seeds on one strand only, the other strand can only change the result if the alignment of the seeded
+    // one is not unique. Then it is aligned to the whole graph
+    bool fwd_strand_is_unique = false;
+    bool reverse_strand_is_unique = false;
+    if (!seeded || !fwd_strand.seeds.empty())
+    {
+        fwd_strand_is_unique = align_strand(read.bases(), seeded, fwd_strand, rfwd_strand);
+    }
+    if (both_strands && (!seeded || !reverse_strand.seeds.empty()))
+    {
+        reverse_strand_is_unique = align_strand(rev_cmp_bases, seeded, reverse_strand, rreverse_strand);
+    }
+    if (!fwd_strand.mapping && !reverse_strand_is_unique)
+    {
+        fwd_strand_is_unique = align_strand(read.bases(), false, fwd_strand, rfwd_strand);
+    }
+    if (both_strands && !reverse_strand.mapping && !fwd_strand_is_unique)
+    {
+        reverse_strand_is_unique = align_strand(rev_cmp_bases, false, reverse_strand, rreverse_strand);
+    }
+    auto const& gm_fwd_strand = fwd_strand.mapping;
+    auto const& gm_reverse_strand = reverse_strand.mapping;
 
     // prefer unique alignment. if not unique, or if both unique, prefer alignment with better score
     bool return_reverse = false;
-    if ((!fwd_strand_is_unique) && reverse_strand_is_unique && gm_reverse_strand)
+    if (!gm_fwd_strand)
+    {
+        return_reverse = true;
+    }
+    else if ((!fwd_strand_is_unique) && reverse_strand_is_unique && gm_reverse_strand)
     {
         return_reverse = true;
     }
@@ -365,13 +721,13 @@ void GraphAligner::alignRead(Read& read, unsigned int alignment_flags) const
     const bool resulting_strand_is_reverse = read.is_reverse_strand() != return_reverse;
     read.set_is_graph_reverse_strand(resulting_strand_is_reverse);
 
-    auto make_node_list = [this](gssw_graph_mapping* gm) -> std::list<int> {
+    auto make_node_list = [](GraphAlignerImpl::Target const& target) -> std::list<int> {
         std::list<int> result;
-        auto const& g = gm->cigar;
+        auto const& g = target.mapping->cigar;
         auto nc = g.elements;
         for (uint32_t i = 0; i < g.length; ++i, ++nc)
         {
-            result.push_back(_impl->node_map_[nc->node->id]);
+            result.push_back((*target.node_map)[nc->node->id]);
         }
         return result;
     };
@@ -384,27 +740,27 @@ void GraphAligner::alignRead(Read& read, unsigned int alignment_flags) const
         std::reverse(rev_quals.begin(), rev_quals.end());
         read.set_quals(rev_quals);
 
-        read.set_graph_pos(gm_reverse_strand->position);
+        read.set_graph_pos(reverse_strand.position());
         read.set_graph_alignment_score(gm_reverse_strand->score);
         read.set_is_graph_alignment_unique(reverse_strand_is_unique);
         read.set_graph_mapq(reverse_strand_is_unique ? 60 : 0);
         if (alignment_flags & AF_CIGAR)
         {
-            read.set_graph_cigar(_impl->extractCigar(gm_reverse_strand.get(), _impl->node_map_));
+            read.set_graph_cigar(_impl->extractCigar(gm_reverse_strand.get(), *reverse_strand.node_map));
         }
-        nodes_passed = make_node_list(gm_reverse_strand.get());
+        nodes_passed = make_node_list(reverse_strand);
     }
     else
     {
-        read.set_graph_pos(gm_fwd_strand->position);
+        read.set_graph_pos(fwd_strand.position());
         read.set_graph_alignment_score(gm_fwd_strand->score);
         read.set_is_graph_alignment_unique(fwd_strand_is_unique);
         read.set_graph_mapq(fwd_strand_is_unique ? 60 : 0);
         if (alignment_flags & AF_CIGAR)
         {
-            read.set_graph_cigar(_impl->extractCigar(gm_fwd_strand.get(), _impl->node_map_));
+            read.set_graph_cigar(_impl->extractCigar(gm_fwd_strand.get(), *fwd_strand.node_map));
         }
-        nodes_passed = make_node_list(gm_fwd_strand.get());
+        nodes_passed = make_node_list(fwd_strand);
     }
 
     LOG()->trace("GraphAligner::alignRead read.cigar={}", read.graph_cigar());
@@ -201,4 +201,39 @@ std::list<graphtools::Path> pathsFromJson(graphtools::Graph const* graph, Json::
     }
     return paths;
 }
+
+/**
+ * Read the reference locations of the graph nodes from JSON
+ * @param in Input JSON node, the same as for graphFromJson
+ * @return one entry for each location of a node, nodes with sequences have none
+ */
+std::vector<NodeReference> referencesFromJson(Json::Value const& in)
+{
+    Json::Value const& in_nodes = in.isMember("graph") ? in["graph"]["nodes"] : in["nodes"];
+    assert(in_nodes.type() == Json::ValueType::arrayValue);
+
+    std::vector<NodeReference> references;
+    for (NodeId i = 0; i < in_nodes.size(); ++i)
+    {
+        auto const& in_n = in_nodes[(int)i];
+        if (in_n.isMember("sequence") || !in_n.isMember("reference"))
+        {
+            continue;
+        }
+
+        Json::Value locations = in_n["reference"];
+        if (locations.type() == Json::ValueType::stringValue)
+        {
+            locations = Json::Value(Json::arrayValue);
+            locations.append(in_n["reference"]);
+        }
+        for (const auto& location : locations)
+        {
+            NodeReference reference{ i, "", -1, -1 };
+            common::stringutil::parsePos(location.asString(), reference.chrom, reference.start, reference.end);
+            references.push_back(reference);
+        }
+    }
+    return references;
+}
 }
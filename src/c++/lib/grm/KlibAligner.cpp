@@ -34,13 +34,16 @@
  */
 
 #include "grm/KlibAligner.hh"
+#include "grm/KmerTable.hh"
 #include "common/Alignment.hh"
 #include "common/Error.hh"
 #include "common/Klib.hh"
+#include "common/KlibBatch.hh"
 #include "oligo/KmerGenerator.hh"
 
 #include "graphutils/SequenceOperations.hh"
 
+#include <climits>
 #include <iterator>
 #include <numeric>
 
@@ -93,45 +96,49 @@ namespace klibAligner
 
     struct BasicPath
     {
-        typedef std::map<size_t, graphtools::NodeId> NodeStarts;
+        /// path offset of the first base of each node, in path order
+        typedef std::vector<std::pair<std::size_t, graphtools::NodeId>> NodeStarts;
 
         int pathId_;
         NodeStarts starts;
+        /// path sequence including flanks. graphtools::Path::seq() concatenates node sequences on every call
+        std::string sequence_;
 
         const graphtools::Path& path_;
 
         BasicPath(const int pathId, const graphtools::Path& p, const graphtools::Graph* g)
             : pathId_(pathId)
+            , sequence_(p.seq())
             , path_(p)
         {
             std::size_t nodeStart = 0;
+            starts.reserve(p.nodeIds().size());
             for (const auto& node_id : p.nodeIds())
             {
-                starts.emplace(nodeStart, node_id);
+                starts.emplace_back(nodeStart, node_id);
                 nodeStart += g->nodeSeq(node_id).length();
             }
         }
 
-        typename NodeStarts::const_iterator findStartNode(std::size_t pos) const
+        NodeStarts::const_iterator findStartNode(std::size_t pos) const
         {
-            // lower bound returns first node after start unless pos matches exactly, make sure path is not empty
+            // upper bound returns first node after pos, make sure path is not empty
             assert(starts.size() >= 1);
-            typename NodeStarts::const_iterator ret = starts.lower_bound(pos);
-            if (ret == starts.end())
-            {
-                ret = std::prev(starts.end());
-            }
-            else if (ret->first > pos)
-            {
-                ret = std::prev(ret);
-            }
+            NodeStarts::const_iterator ret = std::upper_bound(
+                starts.begin(), starts.end(), pos,
+                [](std::size_t p, const NodeStarts::value_type& start) { return p < start.first; });
+            return ret == starts.begin() ? ret : std::prev(ret);
+        }
 
-            return ret;
+        std::size_t nodeLength(NodeStarts::const_iterator node) const
+        {
+            const auto next = std::next(node);
+            return (starts.end() == next ? sequence_.size() : next->first) - node->first;
         }
 
         friend std::ostream& operator<<(std::ostream& os, const BasicPath& p)
         {
-            return os << "Path(" << p.pathId_ << "id " << p.path_.seq() << ")";
+            return os << "Path(" << p.pathId_ << "id " << p.sequence_ << ")";
         }
     };
 
@@ -139,6 +146,33 @@ namespace klibAligner
 
 using namespace klibAligner;
 
+struct KlibAligner::Index
+{
+    /// kmer length used to find the part of each path the read can align to
+    static const unsigned SEED_KMER_LENGTH = 16;
+
+    Index(graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
+        : graph_(g)
+    {
+        KmerTable::Kmers kmers;
+        for (const graphtools::Path& p : paths)
+        {
+            paths_.emplace_back(BasicPath(paths_.size(), p, g));
+
+            references_.push_back(common::KlibAlignment());
+            references_.back().setRef(paths_.back().sequence_.c_str());
+            KmerTable::addKmers<SEED_KMER_LENGTH>(paths_.back().sequence_, paths_.back().pathId_, kmers);
+        }
+        kmerTable_ = KmerTable(std::move(kmers));
+    }
+
+    graphtools::Graph const* graph_;
+    std::vector<BasicPath> paths_;
+    /** path sequences translated for ksw, one per path. Aligners take copies as ksw_align modifies the target */
+    std::vector<common::KlibAlignment> references_;
+    KmerTable kmerTable_;
+};
+
 struct KlibAlignerImpl
 {
     // The defaults are here to match those in GraphAligner.cpp
@@ -153,7 +187,7 @@ struct KlibAlignerImpl
     typedef std::vector<Candidate> Candidates;
 
     typedef BasicPath Path;
-    std::vector<Path> paths_;
+    std::shared_ptr<const KlibAligner::Index> index_;
 
     // NOTE, these transient buffers make the class thread-unsafe but allow avoiding dynamic
     // memory allocations
@@ -165,13 +199,40 @@ struct KlibAlignerImpl
     // this is just a transient buffer for single sequence/path seed alignments before
     // the duplicates are removed
     mutable std::vector<Candidate> seedCandidates_;
-    mutable std::vector<common::KlibAlignment> klibAligners_;
+    // per path copies of the translated references, private to this aligner as ksw_align modifies the target
+    mutable std::vector<common::KlibAlignment> klibReferences_;
+    // one per read strand. The query profile is built once per read and reused for all the paths
+    mutable common::KlibAlignment forwardAligner_;
+    mutable common::KlibAlignment reverseAligner_;
+    // lowest and highest path offset implied by the read seeds, forward strand at 2 * pathId, reverse at
+    // 2 * pathId + 1. first_ > last_ if there are no seeds
+    struct SeedSpan
+    {
+        int first_ = INT_MAX;
+        int last_ = INT_MIN;
+    };
+    mutable std::vector<SeedSpan> seedSpans_;
+
+    // batch alignment buffers. Forward and reverse bases of each read, and one job per read, path and strand in
+    // the order of seedSpans_
+    mutable std::vector<std::string> batchBases_;
+    mutable std::vector<SeedSpan> batchSeedSpans_;
+    mutable std::vector<common::KlibBatchAlignment::Job> batchJobs_;
+    mutable std::vector<std::size_t> batchOrder_;
+    mutable std::vector<common::KlibBatchAlignment::Job> batch_;
+    mutable common::KlibBatchAlignment batchAligner_{ common::AlignmentParameters(
+        match_, mismatch_, gapOpen_, gapExtension_) };
 
-    graphtools::Graph const* graph_ = 0;
     void alignRead(common::Read& read) const;
-    template <bool reverse> void align(const std::string& sequence, const Path& path, Candidates& candidates) const;
+    void alignReads(std::vector<common::Read*> const& reads) const;
+    template <bool reverse> void seed(const std::string& sequence, std::vector<SeedSpan>::iterator spans) const;
+    void getWindow(int sequenceLength, const Path& path, const SeedSpan& span, int& start, int& end) const;
+    template <bool reverse>
+    void align(
+        const std::string& sequence, const Path& path, const SeedSpan& span,
+        const common::KlibBatchAlignment::Job* end, Candidates& candidates) const;
 
-    void setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const& paths);
+    void setGraph(std::shared_ptr<const KlibAligner::Index> index);
 
 private:
     template <typename CigarIT>
@@ -190,25 +251,24 @@ private:
  */
 inline bool isMatch(const char readBase, const char referenceBase) { return readBase == referenceBase; }
 
-void KlibAlignerImpl::setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
+void KlibAlignerImpl::setGraph(std::shared_ptr<const KlibAligner::Index> index)
 {
-    paths_.clear();
-    klibAligners_.clear();
-    graph_ = g;
-    const common::AlignmentParameters ap(match_, mismatch_, gapOpen_, gapExtension_);
-    for (const graphtools::Path& p : paths)
+    index_ = std::move(index);
+    klibReferences_.clear();
+    for (const common::KlibAlignment& reference : index_->references_)
     {
-        paths_.emplace_back(Path(paths_.size(), p, g));
-
-        klibAligners_.push_back(common::KlibAlignment());
-        klibAligners_.back().setParameters(ap);
-        klibAligners_.back().setRef(paths_.back().path_.seq().c_str());
+        klibReferences_.push_back(common::KlibAlignment());
+        klibReferences_.back().setRef(reference);
     }
+    const common::AlignmentParameters ap(match_, mismatch_, gapOpen_, gapExtension_);
+    forwardAligner_.setParameters(ap);
+    reverseAligner_.setParameters(ap);
+    seedSpans_.resize(index_->paths_.size() * 2);
 
     // This has to be number of paths + 1 because we want to know if any of the paths
     // have more than 1 candidate for the best alignment
     // + 1 for heap push/pop
-    candidates_.reserve(paths_.size() + 1 + 1);
+    candidates_.reserve(index_->paths_.size() + 1 + 1);
 }
 
 template <typename CigarIT>
@@ -231,12 +291,11 @@ int KlibAlignerImpl::buildGraphCigar(
             while (alignLength)
             {
                 const std::size_t nodeAlignLength
-                    = std::min<uint32_t>(alignLength, graph_->nodeSeq(node->second).size() - nodePos);
-                assert(nodePos + nodeAlignLength <= graph_->nodeSeq(node->second).size());
-                assert(nodePos + node->first <= path.path_.seq().size());
+                    = std::min<uint32_t>(alignLength, path.nodeLength(node) - nodePos);
+                assert(nodePos + nodeAlignLength <= path.nodeLength(node));
+                assert(nodePos + node->first <= path.sequence_.size());
 
-                const std::string& path_sequence = path.path_.seq();
-                std::string::const_iterator itRef = path_sequence.begin() + nodePos + node->first;
+                std::string::const_iterator itRef = path.sequence_.begin() + nodePos + node->first;
                 cigar += common::makeCigarBit(itRef, itSeq, nodeAlignLength, matches);
 
                 alignLength -= nodeAlignLength;
@@ -261,9 +320,9 @@ int KlibAlignerImpl::buildGraphCigar(
             while (delLength)
             {
                 const std::size_t nodeAlignLength
-                    = std::min<std::size_t>(delLength, graph_->nodeSeq(node->second).size() - nodePos);
-                assert(nodePos + nodeAlignLength <= graph_->nodeSeq(node->second).size());
-                assert(nodePos + node->first <= path.path_.seq().size());
+                    = std::min<std::size_t>(delLength, path.nodeLength(node) - nodePos);
+                assert(nodePos + nodeAlignLength <= path.nodeLength(node));
+                assert(nodePos + node->first <= path.sequence_.size());
 
                 if (nodeAlignLength)
                 {
@@ -359,7 +418,7 @@ void KlibAlignerImpl::pickBest(
     assert(!candidates.empty());
     const auto bestIt = std::min_element(candidates.begin(), candidates.end(), Candidate::betterScore);
     const Candidate& best = *bestIt;
-    const Path& path = paths_[best.pathId_];
+    const Path& path = index_->paths_[best.pathId_];
 
     updateAlignment(best, rvBases, bases, path, read);
 
@@ -372,7 +431,7 @@ void KlibAlignerImpl::pickBest(
         if (secondBest.score_ == best.score_)
         {
             common::Read secondBestRead = read;
-            const Path& secondBestPath = paths_[secondBest.pathId_];
+            const Path& secondBestPath = index_->paths_[secondBest.pathId_];
 
             updateAlignment(secondBest, rvBases, bases, secondBestPath, secondBestRead);
 
@@ -392,11 +451,88 @@ void KlibAlignerImpl::pickBest(
     }
 }
 
+/**
+ * \brief find the range of path offsets at which the read kmers occur on each path
+ * \param spans receives the spans of the read, indexed like seedSpans_
+ */
+template <bool reverse>
+void KlibAlignerImpl::seed(const std::string& sequence, std::vector<SeedSpan>::iterator spans) const
+{
+    for (std::size_t pathId = 0; pathId != index_->paths_.size(); ++pathId)
+    {
+        spans[pathId * 2 + reverse] = SeedSpan();
+    }
+
+    static const unsigned kmerLength = KlibAligner::Index::SEED_KMER_LENGTH;
+    if (sequence.size() < kmerLength)
+    {
+        return;
+    }
+
+    const KmerTable& kmerTable = index_->kmerTable_;
+    oligo::KmerGenerator<kmerLength, KmerTable::KmerType, std::string::const_iterator> kmerGenerator(
+        sequence.begin(), sequence.end());
+    KmerTable::KmerType kmer = 0;
+    std::string::const_iterator position;
+    while (kmerGenerator.next(kmer, position))
+    {
+        const unsigned entry = kmerTable.find(kmer);
+        if (KmerTable::NO_ENTRY == entry)
+        {
+            continue;
+        }
+        const int sequencePosition = std::distance(sequence.begin(), position);
+        for (auto postingIt = kmerTable.begin(entry); kmerTable.end(entry) != postingIt; ++postingIt)
+        {
+            const int offset = int(postingIt->position_) - sequencePosition;
+            SeedSpan& span = spans[postingIt->pathId_ * 2 + reverse];
+            span.first_ = std::min(span.first_, offset);
+            span.last_ = std::max(span.last_, offset);
+        }
+    }
+}
+
+/**
+ * \brief part of the path to align to: around the seeds, with a read length on either side to allow for indels and
+ * clipped ends. Reads without seeds are aligned to the whole path
+ */
+void KlibAlignerImpl::getWindow(int sequenceLength, const Path& path, const SeedSpan& span, int& start, int& end) const
+{
+    const int pathLength = path.sequence_.length();
+    start = 0;
+    end = pathLength;
+    if (span.first_ <= span.last_)
+    {
+        start = std::max(0, span.first_ - sequenceLength);
+        end = std::min(pathLength, span.last_ + sequenceLength * 2);
+    }
+}
+
+/**
+ * \param end score and end positions from a batch alignment, nullptr to run the complete local alignment
+ */
 template <bool reverse>
-void KlibAlignerImpl::align(const std::string& sequence, const Path& path, Candidates& candidates) const
+void KlibAlignerImpl::align(
+    const std::string& sequence, const Path& path, const SeedSpan& span, const common::KlibBatchAlignment::Job* end,
+    Candidates& candidates) const
 {
-    common::KlibAlignment& klibAligner = klibAligners_.at(path.pathId_);
-    klibAligner.setQuery(sequence.c_str());
+    common::KlibAlignment& klibAligner = reverse ? reverseAligner_ : forwardAligner_;
+    const common::KlibAlignment& reference = klibReferences_.at(path.pathId_);
+    int windowStart = 0, windowEnd = 0;
+    getWindow(sequence.length(), path, span, windowStart, windowEnd);
+    if (span.first_ <= span.last_)
+    {
+        klibAligner.shareRef(reference, windowStart, windowEnd - windowStart);
+    }
+    else
+    {
+        klibAligner.shareRef(reference);
+    }
+    if (end)
+    {
+        assert(end->windowStart_ == windowStart && end->windowEnd_ == windowEnd);
+        klibAligner.setEnd(end->score_, end->targetEnd_, end->queryEnd_);
+    }
     int r0 = -1, r1 = -1, a0 = -1, a1 = -1;
     int nCigar = -1;
     uint32_t* cigarIt = 0;
@@ -421,7 +557,7 @@ void KlibAlignerImpl::align(const std::string& sequence, const Path& path, Candi
         pathCigar.push_back(clip.getValue());
     }
 
-    candidates.push_back(Candidate(path.pathId_, r0, reverse, klibAligner.getScore(), pathCigar));
+    candidates.push_back(Candidate(path.pathId_, windowStart + r0, reverse, klibAligner.getScore(), pathCigar));
     std::push_heap(candidates.begin(), candidates.end(), Candidate::betterScore);
     if (candidates.capacity() == candidates.size())
     {
@@ -436,10 +572,14 @@ void KlibAlignerImpl::alignRead(common::Read& read) const
     candidates_.clear();
     const std::string bases = read.bases();
     const std::string rvBases = graphtools::reverseComplement(bases);
-    for (const auto& path : paths_)
+    forwardAligner_.setQuery(bases.c_str());
+    reverseAligner_.setQuery(rvBases.c_str());
+    seed<false>(bases, seedSpans_.begin());
+    seed<true>(rvBases, seedSpans_.begin());
+    for (const auto& path : index_->paths_)
     {
-        align<false>(bases, path, candidates_);
-        align<true>(rvBases, path, candidates_);
+        align<false>(bases, path, seedSpans_[path.pathId_ * 2], nullptr, candidates_);
+        align<true>(rvBases, path, seedSpans_[path.pathId_ * 2 + 1], nullptr, candidates_);
     }
 
     if (!candidates_.empty())
@@ -448,6 +588,105 @@ void KlibAlignerImpl::alignRead(common::Read& read) const
     }
 }
 
+void KlibAlignerImpl::alignReads(std::vector<common::Read*> const& reads) const
+{
+    const std::size_t strands = index_->paths_.size() * 2;
+    batchBases_.resize(reads.size() * 2);
+    batchSeedSpans_.resize(reads.size() * strands);
+    batchJobs_.clear();
+    for (std::size_t readIndex = 0; readIndex != reads.size(); ++readIndex)
+    {
+        std::string& bases = batchBases_[readIndex * 2];
+        std::string& rvBases = batchBases_[readIndex * 2 + 1];
+        bases = reads[readIndex]->bases();
+        rvBases = graphtools::reverseComplement(bases);
+        const auto spans = batchSeedSpans_.begin() + readIndex * strands;
+        seed<false>(bases, spans);
+        seed<true>(rvBases, spans);
+        for (std::size_t strand = 0; strand != strands; ++strand)
+        {
+            const std::string& sequence = batchBases_[readIndex * 2 + strand % 2];
+            int windowStart = 0, windowEnd = 0;
+            getWindow(sequence.length(), index_->paths_[strand / 2], spans[strand], windowStart, windowEnd);
+            batchJobs_.emplace_back(sequence.c_str(), sequence.length(), windowStart, windowEnd);
+        }
+    }
+
+    // batch the jobs of each path by window, so that the lanes share most of the target
+    for (const auto& path : index_->paths_)
+    {
+        batchOrder_.clear();
+        for (std::size_t job = path.pathId_ * 2; job < batchJobs_.size(); job += strands)
+        {
+            batchOrder_.push_back(job);
+            batchOrder_.push_back(job + 1);
+        }
+        // lanes of shorter reads idle while the longest read of the batch is aligned
+        std::sort(batchOrder_.begin(), batchOrder_.end(), [this](std::size_t left, std::size_t right) {
+            const common::KlibBatchAlignment::Job& l = batchJobs_[left];
+            const common::KlibBatchAlignment::Job& r = batchJobs_[right];
+            return l.windowStart_ < r.windowStart_
+                || (l.windowStart_ == r.windowStart_ && l.queryLength_ < r.queryLength_);
+        });
+
+        for (auto batchBegin = batchOrder_.begin(); batchOrder_.end() != batchBegin;)
+        {
+            // stop the batch before the union of the windows gets longer than twice the longest window
+            auto batchEnd = batchBegin;
+            int windowEnd = 0, longestWindow = 0;
+            while (batchOrder_.end() != batchEnd
+                   && std::size_t(std::distance(batchBegin, batchEnd)) < common::KlibBatchAlignment::lanes())
+            {
+                const common::KlibBatchAlignment::Job& job = batchJobs_[*batchEnd];
+                const int nextEnd = std::max(windowEnd, job.windowEnd_);
+                const int nextLongest = std::max(longestWindow, job.windowEnd_ - job.windowStart_);
+                if (batchBegin != batchEnd && nextEnd - batchJobs_[*batchBegin].windowStart_ > nextLongest * 2)
+                {
+                    break;
+                }
+                windowEnd = nextEnd;
+                longestWindow = nextLongest;
+                ++batchEnd;
+            }
+
+            batch_.clear();
+            for (auto it = batchBegin; batchEnd != it; ++it)
+            {
+                batch_.push_back(batchJobs_[*it]);
+            }
+            batchAligner_.align(path.sequence_.c_str(), &batch_.front(), &batch_.front() + batch_.size());
+            for (auto it = batchBegin; batchEnd != it; ++it)
+            {
+                batchJobs_[*it] = batch_[std::distance(batchBegin, it)];
+            }
+            batchBegin = batchEnd;
+        }
+    }
+
+    for (std::size_t readIndex = 0; readIndex != reads.size(); ++readIndex)
+    {
+        common::Read& read = *reads[readIndex];
+        read.set_graph_mapping_status(common::Read::UNMAPPED);
+        candidates_.clear();
+        const std::string& bases = batchBases_[readIndex * 2];
+        const std::string& rvBases = batchBases_[readIndex * 2 + 1];
+        forwardAligner_.setQuery(bases.c_str());
+        reverseAligner_.setQuery(rvBases.c_str());
+        const std::size_t first = readIndex * strands;
+        for (const auto& path : index_->paths_)
+        {
+            const std::size_t strand = first + path.pathId_ * 2;
+            align<false>(bases, path, batchSeedSpans_[strand], &batchJobs_[strand], candidates_);
+            align<true>(rvBases, path, batchSeedSpans_[strand + 1], &batchJobs_[strand + 1], candidates_);
+        }
+
+        if (!candidates_.empty())
+        {
+            pickBest(bases, rvBases, candidates_, read);
+        }
+    }
+}
+
 KlibAligner::KlibAligner()
     : impl_(new KlibAlignerImpl())
 {
@@ -473,9 +712,21 @@ KlibAligner& KlibAligner::operator=(KlibAligner&& rhs) noexcept
  */
 void KlibAligner::setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
 {
-    impl_->setGraph(g, paths);
+    impl_->setGraph(makeIndex(g, paths));
+}
+
+std::shared_ptr<const KlibAligner::Index>
+KlibAligner::makeIndex(graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
+{
+    return std::make_shared<const Index>(g, paths);
 }
 
+/**
+ * Set the graph to align to using a prebuilt index
+ * @param index path references made by makeIndex
+ */
+void KlibAligner::setGraph(std::shared_ptr<const Index> index) { impl_->setGraph(std::move(index)); }
+
 /**
  * Align a read to the graph and update the graph_* fields.
  *
@@ -491,4 +742,14 @@ void KlibAligner::alignRead(common::Read& read)
     impl_->alignRead(read);
     mapped_ += common::Read::MAPPED == read.graph_mapping_status();
 }
+
+void KlibAligner::alignReads(std::vector<common::Read*> const& reads)
+{
+    attempted_ += reads.size();
+    impl_->alignReads(reads);
+    for (const common::Read* read : reads)
+    {
+        mapped_ += common::Read::MAPPED == read->graph_mapping_status();
+    }
+}
 }
@@ -34,14 +34,15 @@
  */
 
 #include "grm/KmerAligner.hh"
+#include "grm/KmerTable.hh"
 #include "common/Error.hh"
 #include "common/Klib.hh"
+#include "common/Mismatches.hh"
 #include "oligo/KmerGenerator.hh"
 
 #include "graphutils/SequenceOperations.hh"
 
 #include <iterator>
-#include <numeric>
 
 namespace grm
 {
@@ -94,92 +95,46 @@ namespace kmerAligner
         }
     };
 
-    struct KmerPosition
-    {
-        typedef unsigned KmerType;
-
-        KmerPosition()
-            : kmer_(0)
-            , position_(0)
-        {
-        }
-        KmerPosition(KmerType kmer, PositionType position)
-            : kmer_(kmer)
-            , position_(position)
-        {
-        }
-        KmerType kmer_;
-        PositionType position_;
-
-        bool operator<(const KmerPosition& that) const
-        {
-            return kmer_ < that.kmer_ || (kmer_ == that.kmer_ && position_ < that.position_);
-        }
-
-        friend std::ostream& operator<<(std::ostream& os, const KmerPosition& kp)
-        {
-            return os << "KmerPosition(" << oligo::bases(kp.kmer_) << "," << kp.position_ << "p)";
-        }
-    };
-
-    typedef std::vector<KmerPosition> KmerPositions;
-
-    template <unsigned KMER_LENGTH>
-    void makeKmers(std::string::const_iterator begin, std::string::const_iterator end, KmerPositions& kmerPositions)
-    {
-        kmerPositions.clear();
-        oligo::KmerGenerator<KMER_LENGTH, unsigned, std::string::const_iterator> kmerGenerator(begin, end);
-        unsigned kmer = 0;
-        std::string::const_iterator position;
-        while (kmerGenerator.next(kmer, position))
-        {
-            kmerPositions.push_back(KmerPosition(kmer, static_cast<PositionType>(std::distance(begin, position))));
-        }
-
-        std::sort(kmerPositions.begin(), kmerPositions.end());
-    }
-
     template <unsigned KMER_LENGTH> struct BasicPath
     {
-        typedef std::map<size_t, graphtools::NodeId> NodeStarts;
+        /// path offset of the first base of each node, in path order
+        typedef std::vector<std::pair<std::size_t, graphtools::NodeId>> NodeStarts;
 
         int pathId_;
         NodeStarts starts;
-
-        KmerPositions kmerPositions_;
+        /// path sequence including flanks. graphtools::Path::seq() concatenates node sequences on every call
+        std::string sequence_;
 
         const graphtools::Path& path_;
 
         BasicPath(const int pathId, const graphtools::Path& p, const graphtools::Graph* g)
             : pathId_(pathId)
+            , sequence_(p.seq())
             , path_(p)
         {
             std::size_t nodeStart = 0;
+            starts.reserve(p.nodeIds().size());
             for (const auto& node_id : p.nodeIds())
             {
-                starts.emplace(nodeStart, node_id);
+                starts.emplace_back(nodeStart, node_id);
                 nodeStart += g->nodeSeq(node_id).length();
             }
-            // note seq() returns string by value. Make sure it does not get destroyed...
-            const std::string& path_sequence = path_.seq();
-            makeKmers<KMER_LENGTH>(path_sequence.begin(), path_sequence.end(), kmerPositions_);
         }
 
         typename NodeStarts::const_iterator findStartNode(std::size_t pos) const
         {
-            // lower bound returns first node after start unless pos matches exactly, make sure path is not empty
+            // upper bound returns first node after pos, make sure path is not empty
             assert(starts.size() >= 1);
-            typename NodeStarts::const_iterator ret = starts.lower_bound(pos);
-            if (ret == starts.end())
-            {
-                ret = std::prev(starts.end());
-            }
-            else if (ret->first > pos)
-            {
-                ret = std::prev(ret);
-            }
+            typename NodeStarts::const_iterator ret = std::upper_bound(
+                starts.begin(), starts.end(), pos,
+                [](std::size_t p, const typename NodeStarts::value_type& start) { return p < start.first; });
+            return ret == starts.begin() ? ret : std::prev(ret);
+        }
 
-            return ret;
+        std::size_t nodeLength(typename NodeStarts::const_iterator node) const
+        {
+            const auto next = std::next(node);
+            return (starts.end() == next ? sequence_.size() : next->first) - node->first;
         }
     };
 
@@ -187,6 +142,33 @@ namespace kmerAligner
 
 using namespace kmerAligner;
 
+template <unsigned KMER_LENGTH> struct KmerAligner<KMER_LENGTH>::Index
+{
+    typedef BasicPath<KMER_LENGTH> Path;
+
+    Index(graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
+        : graph_(g)
+        , kmerTable_(makePaths(g, paths))
+    {
+    }
+
+    graphtools::Graph const* graph_;
+    std::vector<Path> paths_;
+    KmerTable kmerTable_;
+
+private:
+    KmerTable::Kmers makePaths(graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
+    {
+        KmerTable::Kmers ret;
+        for (const auto& p : paths)
+        {
+            paths_.emplace_back(Path(paths_.size(), p, g));
+            KmerTable::addKmers<KMER_LENGTH>(paths_.back().sequence_, paths_.back().pathId_, ret);
+        }
+        return ret;
+    }
+};
+
 template <unsigned KMER_LENGTH> struct KmerAligner<KMER_LENGTH>::KmerAlignerImpl
 {
     // position, mismatchCount
@@ -194,33 +176,30 @@ template <unsigned KMER_LENGTH> struct KmerAligner<KMER_LENGTH>::KmerAlignerImpl
     typedef std::vector<Candidate> Candidates;
 
     typedef BasicPath<KMER_LENGTH> Path;
-    std::vector<Path> paths_;
+    std::shared_ptr<const Index> index_;
     // NOTE, these transient buffers make the class thread-unsafe but allow avoiding dynamic
     // memory allocations
-    mutable KmerPositions fwKmerPositions_;
-    mutable KmerPositions rvKmerPositions_;
+    // seed offsets of the read on each path, forward strand at 2 * pathId, reverse at 2 * pathId + 1
+    mutable std::vector<std::vector<PositionType>> seeds_;
+    // per kmer table entry, the stamp of the last read strand that used it. Only the first occurrence of a
+    // repeated read kmer is seeded
+    mutable std::vector<unsigned> seenStamps_;
+    mutable unsigned stamp_ = 0;
     // best candidate alignments by count of mismatches.
     // capacity limits the number of equivalent candidates to keep.
     // This has to be number of paths + 1 because we want to know if any of the paths
     // have more than 1 candidate for the best alignment
     mutable Candidates candidates_;
-    // this is just a transient buffer for single sequence/path seed alignments before
-    // the duplicates are removed
-    mutable std::vector<Candidate> seedCandidates_;
 
-    graphtools::Graph const* graph_;
     void alignRead(common::Read& read) const;
 
-    void align(
-        const std::string& bases, const KmerPositions& fwKmerPositions, const std::string& rvBases,
-        const KmerPositions& rvKmerPositions, const Path& path, Candidates& candidates) const;
+    template <bool reverse> void seed(const std::string& bases) const;
 
-    template <bool reverse>
     void align(
-        const std::string& bases, const KmerPositions& sequenceKmerPositions, const Path& path,
+        const std::string& bases, std::vector<PositionType>& seeds, bool reverse, const Path& path,
         Candidates& candidates) const;
 
-    void setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const& paths);
+    void setGraph(std::shared_ptr<const Index> index);
 
 private:
     bool updateAlignment(
@@ -235,62 +214,76 @@ private:
 };
 
 /**
- * \brief defines match for the purpose of the alignment.
+ * \return number of mismatches between sequence and reference starting at offset. Counting stops once
+ *         the count exceeds limit
  */
-inline bool isMatch(const char readBase, const char referenceBase) { return readBase == referenceBase; }
-
-inline bool isMismatch(const char readBase, const char referenceBase) { return !isMatch(readBase, referenceBase); }
-
-unsigned countMismatches(const std::string& sequence, const std::string& reference, const int offset)
+inline unsigned
+countMismatches(const std::string& sequence, const std::string& reference, const int offset, const unsigned limit)
 {
     assert(0 <= offset && reference.size() >= offset + sequence.size());
-
-    const unsigned mismatches = std::inner_product(
-        sequence.begin(), sequence.end(), reference.begin() + offset, 0U, std::plus<unsigned>(), &isMismatch);
-    return mismatches;
+    return common::countMismatches(sequence.data(), reference.data() + offset, sequence.size(), limit);
 }
 
+/**
+ * \brief collect the offsets on each path at which the read shares a kmer with the path
+ */
 template <unsigned KMER_LENGTH>
 template <bool reverse>
-void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::align(
-    const std::string& bases, const KmerPositions& sequenceKmerPositions, const Path& path,
-    Candidates& candidates) const
+void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::seed(const std::string& bases) const
 {
-    seedCandidates_.clear();
-    typename KmerPositions::const_iterator ppIt = path.kmerPositions_.begin();
-    for (const auto& sp : sequenceKmerPositions)
+    if (!++stamp_)
+    {
+        std::fill(seenStamps_.begin(), seenStamps_.end(), 0);
+        stamp_ = 1;
+    }
+
+    if (bases.size() < KMER_LENGTH)
+    {
+        return;
+    }
+
+    const KmerTable& kmerTable = index_->kmerTable_;
+    oligo::KmerGenerator<KMER_LENGTH, unsigned, std::string::const_iterator> kmerGenerator(bases.begin(), bases.end());
+    unsigned kmer = 0;
+    std::string::const_iterator position;
+    while (kmerGenerator.next(kmer, position))
     {
-        while (path.kmerPositions_.end() != ppIt && ppIt->kmer_ < sp.kmer_)
+        const unsigned entry = kmerTable.find(kmer);
+        if (KmerTable::NO_ENTRY == entry || stamp_ == seenStamps_[entry])
         {
-            ++ppIt;
+            continue;
         }
+        seenStamps_[entry] = stamp_;
 
-        while (path.kmerPositions_.end() != ppIt && ppIt->kmer_ == sp.kmer_)
+        const int sequencePosition = std::distance(bases.begin(), position);
+        for (auto postingIt = kmerTable.begin(entry); kmerTable.end(entry) != postingIt; ++postingIt)
         {
-            const int offset = int(ppIt->position_) - int(sp.position_);
+            const int offset = int(postingIt->position_) - sequencePosition;
             // ignore candidates that overhang the path. If they are relevant
             // the path flanks should be made longer.
-            if (0 <= offset && path.path_.seq().size() >= offset + bases.size())
+            if (0 <= offset && index_->paths_[postingIt->pathId_].sequence_.size() >= offset + bases.size())
             {
-                seedCandidates_.push_back(Candidate(path.pathId_, offset, reverse, -1U));
+                seeds_[postingIt->pathId_ * 2 + reverse].push_back(offset);
             }
-            ++ppIt;
         }
     }
+}
 
-    std::sort(seedCandidates_.begin(), seedCandidates_.end(), [](const Candidate& left, const Candidate& right) {
-        return left.position_ < right.position_;
-    });
-    seedCandidates_.erase(
-        std::unique(
-            seedCandidates_.begin(), seedCandidates_.end(),
-            [](const Candidate& left, const Candidate& right) { return left.position_ == right.position_; }),
-        seedCandidates_.end());
+template <unsigned KMER_LENGTH>
+void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::align(
+    const std::string& bases, std::vector<PositionType>& seeds, const bool reverse, const Path& path,
+    Candidates& candidates) const
+{
+    std::sort(seeds.begin(), seeds.end());
+    seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
 
-    for (const auto& ac : seedCandidates_)
+    for (const auto position : seeds)
     {
+        // once the heap is full, a candidate with more mismatches than the current worst gets evicted right away
+        // and its exact count does not matter
+        const unsigned limit = candidates.capacity() == candidates.size() + 1 ? candidates.front().mismatchCount_ : -1U;
         candidates.push_back(
-            Candidate(ac.pathId_, ac.position_, ac.reverse_, countMismatches(bases, path.path_.seq(), ac.position_)));
+            Candidate(path.pathId_, position, reverse, countMismatches(bases, path.sequence_, position, limit)));
         std::push_heap(candidates.begin(), candidates.end(), Candidate::lessMismatches);
         if (candidates.capacity() == candidates.size())
         {
@@ -298,31 +291,21 @@ void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::align(
             candidates.pop_back();
         }
     }
+    seeds.clear();
 }
 
 template <unsigned KMER_LENGTH>
-void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::align(
-    const std::string& bases, const KmerPositions& fwKmerPositions, const std::string& rvBases,
-    const KmerPositions& rvKmerPositions, const Path& path, Candidates& candidates) const
+void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::setGraph(std::shared_ptr<const Index> index)
 {
-    align<false>(bases, fwKmerPositions, path, candidates);
-    align<true>(rvBases, rvKmerPositions, path, candidates);
-}
-
-template <unsigned KMER_LENGTH>
-void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::setGraph(
-    graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
-{
-    graph_ = g;
-    for (const auto& p : paths)
-    {
-        paths_.emplace_back(Path(paths_.size(), p, g));
-    }
+    index_ = std::move(index);
 
     // This has to be number of paths + 1 because we want to know if any of the paths
     // have more than 1 candidate for the best alignment
     // + 1 for heap push/pop
-    candidates_.reserve(paths_.size() + 1 + 1);
+    candidates_.reserve(index_->paths_.size() + 1 + 1);
+    seeds_.resize(index_->paths_.size() * 2);
+    seenStamps_.assign(index_->kmerTable_.size(), 0);
+    stamp_ = 0;
 }
 
 char getCigarOp(const char s, const char r) { return s == r ? 'M' : s == 'N' ? 'N' : r == 'N' ? 'N' : 'X'; }
@@ -395,11 +378,8 @@ int KmerAligner<KMER_LENGTH>::KmerAlignerImpl::buildCigar(
         }
         if (this_length > 0)
         {
-            const auto this_node_length = graph_->nodeSeq(start_node->second).size();
-            assert(this_start + this_length <= this_node_length);
-            // note seq() returns string by value. Make sure it does not get destroyed...
-            const std::string& path_sequence = path.path_.seq();
-            std::string::const_iterator itRef = path_sequence.begin() + this_start + start_node->first;
+            assert(this_start + this_length <= path.nodeLength(start_node));
+            std::string::const_iterator itRef = path.sequence_.begin() + this_start + start_node->first;
             int matches = 0;
             const std::string bit = makeCigarBit(itRef, itSeq, this_length, matches);
             cigar += std::to_string(start_node->second) + "[";
@@ -433,9 +413,7 @@ bool KmerAligner<KMER_LENGTH>::KmerAlignerImpl::updateAlignment(
     common::Read& read) const
 {
     std::string::const_iterator itSeq = (is_reverse_match ? rev_bases : bases).begin();
-    // note seq() returns string by value. Make sure it does not get destroyed...
-    const std::string& path_sequence = path.path_.seq();
-    std::string::const_iterator itRef = path_sequence.begin() + pos;
+    std::string::const_iterator itRef = path.sequence_.begin() + pos;
     std::size_t length = bases.size();
     const int leftClip = calculateSoftClip(itRef, itSeq, length);
     pos += leftClip;
@@ -493,7 +471,7 @@ void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::pickBest(
     {
         return;
     }
-    const Path& path = paths_[best.pathId_];
+    const Path& path = index_->paths_[best.pathId_];
     updateAlignment(path, best.position_, best.reverse_, bases, rvBases, read);
 
     for (auto secondBestIt = std::min_element(bestIt + 1, candidates.end(), Candidate::lessMismatches);
@@ -505,7 +483,7 @@ void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::pickBest(
         if (secondBest.mismatchCount_ == best.mismatchCount_)
         {
             common::Read secondBestRead = read;
-            const Path& secondBestPath = paths_[secondBest.pathId_];
+            const Path& secondBestPath = index_->paths_[secondBest.pathId_];
             updateAlignment(secondBestPath, secondBest.position_, secondBest.reverse_, bases, rvBases, secondBestRead);
             if (secondBestRead.graph_cigar() != read.graph_cigar() || secondBestRead.graph_pos() != read.graph_pos())
             {
@@ -528,14 +506,13 @@ template <unsigned KMER_LENGTH> void KmerAligner<KMER_LENGTH>::KmerAlignerImpl::
     read.set_graph_mapping_status(common::Read::UNMAPPED);
     candidates_.clear();
     const std::string bases = read.bases();
-    fwKmerPositions_.clear();
-    makeKmers<KMER_LENGTH>(bases.begin(), bases.end(), fwKmerPositions_);
     const auto rvBases = graphtools::reverseComplement(bases);
-    rvKmerPositions_.clear();
-    makeKmers<KMER_LENGTH>(rvBases.begin(), rvBases.end(), rvKmerPositions_);
-    for (const auto& path : paths_)
+    seed<false>(bases);
+    seed<true>(rvBases);
+    for (const auto& path : index_->paths_)
     {
-        align(bases, fwKmerPositions_, rvBases, rvKmerPositions_, path, candidates_);
+        align(bases, seeds_[path.pathId_ * 2], false, path, candidates_);
+        align(rvBases, seeds_[path.pathId_ * 2 + 1], true, path, candidates_);
     }
 
     if (!candidates_.empty())
@@ -570,10 +547,26 @@ KmerAligner<KMER_LENGTH>& KmerAligner<KMER_LENGTH>::operator=(KmerAligner&& rhs)
  * @param g a graph
  * @param paths list of paths
  */
+template <unsigned KMER_LENGTH>
+std::shared_ptr<const typename KmerAligner<KMER_LENGTH>::Index>
+KmerAligner<KMER_LENGTH>::makeIndex(graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
+{
+    return std::make_shared<const Index>(g, paths);
+}
+
 template <unsigned KMER_LENGTH>
 void KmerAligner<KMER_LENGTH>::setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const& paths)
 {
-    impl_->setGraph(g, paths);
+    impl_->setGraph(makeIndex(g, paths));
+}
+
+/**
+ * Set the graph to align to using a prebuilt index
+ * @param index path kmer tables made by makeIndex
+ */
+template <unsigned KMER_LENGTH> void KmerAligner<KMER_LENGTH>::setGraph(std::shared_ptr<const Index> index)
+{
+    impl_->setGraph(std::move(index));
 }
 
 /**
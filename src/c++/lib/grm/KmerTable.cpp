@@ -0,0 +1,85 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Kmer to path position table shared by the kmer based aligners
+ *
+ * \file KmerTable.cpp
+ *
+ */
+
+#include "grm/KmerTable.hh"
+
+#include <algorithm>
+
+namespace grm
+{
+
+const unsigned KmerTable::NO_ENTRY;
+
+KmerTable::KmerTable(Kmers kmers)
+{
+    std::sort(kmers.begin(), kmers.end(), [](const Kmers::value_type& left, const Kmers::value_type& right) {
+        return left.first < right.first
+            || (left.first == right.first
+                && (left.second.pathId_ < right.second.pathId_
+                    || (left.second.pathId_ == right.second.pathId_
+                        && left.second.position_ < right.second.position_)));
+    });
+
+    postings_.reserve(kmers.size());
+    for (const auto& kmer : kmers)
+    {
+        if (kmers_.empty() || kmers_.back() != kmer.first)
+        {
+            kmers_.push_back(kmer.first);
+            firstPostings_.push_back(postings_.size());
+        }
+        postings_.push_back(kmer.second);
+    }
+    firstPostings_.push_back(postings_.size());
+
+    // keep the load factor at or below 1/2 so that probe sequences stay short
+    std::size_t capacity = 2;
+    slotShift_ = 31;
+    while (capacity < kmers_.size() * 2)
+    {
+        capacity *= 2;
+        --slotShift_;
+    }
+    slotMask_ = capacity - 1;
+    slots_.assign(capacity, NO_ENTRY);
+    for (unsigned entry = 0; entry != kmers_.size(); ++entry)
+    {
+        std::size_t slot = hash(kmers_[entry]);
+        while (NO_ENTRY != slots_[slot])
+        {
+            slot = (slot + 1) & slotMask_;
+        }
+        slots_[slot] = entry;
+    }
+}
+}
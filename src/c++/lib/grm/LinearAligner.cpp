@@ -0,0 +1,232 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/**
+ * \brief Aligner which projects the linear alignments of reads onto the reference nodes of a graph
+ *
+ * \file LinearAligner.cpp
+ *
+ */
+
+#include "grm/LinearAligner.hh"
+
+#include <algorithm>
+#include <string>
+
+#include "common/Error.hh"
+#include "common/StringUtil.hh"
+#include "grm/KmerTable.hh"
+#include "oligo/Kmer.hh"
+#include "oligo/KmerGenerator.hh"
+
+namespace grm
+{
+
+using graphtools::NodeId;
+
+struct LinearAligner::Index
+{
+    /// length of the kmers that tell whether a read has other matches in the graph
+    static const unsigned KMER_LENGTH = 16;
+    /// kmers spanning node ends enumerated per graph base before the graph is taken as too branched to index
+    static const std::size_t MAX_JUNCTION_KMERS_PER_BASE = 16;
+
+    typedef oligo::KmerGenerator<KMER_LENGTH, KmerTable::KmerType, std::string::const_iterator> KmerGenerator;
+
+    Index(graphtools::Graph const* graph, std::vector<NodeReference> const& node_references)
+        : references(node_references)
+    {
+        std::size_t graph_bases = 0;
+        KmerTable::Kmers graph_kmers;
+        for (NodeId node_id = 0; node_id != graph->numNodes(); ++node_id)
+        {
+            std::string sequence = graph->nodeSeq(node_id);
+            common::stringutil::toUpper(sequence);
+            KmerTable::addKmers<KMER_LENGTH>(sequence, node_id, graph_kmers);
+            graph_bases += sequence.size();
+            sequences.push_back(std::move(sequence));
+        }
+
+        std::size_t budget = graph_bases * MAX_JUNCTION_KMERS_PER_BASE;
+        std::string walk;
+        for (NodeId node_id = 0; node_id != graph->numNodes(); ++node_id)
+        {
+            const std::size_t tail_length = std::min<std::size_t>(sequences[node_id].size(), KMER_LENGTH - 1);
+            walk = sequences[node_id].substr(sequences[node_id].size() - tail_length);
+            if (!addJunctionKmers(*graph, node_id, tail_length, node_id, walk, graph_kmers, budget))
+            {
+                LOG()->debug("Graph is too branched for linear alignment projection");
+                references.clear();
+                return;
+            }
+        }
+        kmers = KmerTable(std::move(graph_kmers));
+
+        std::sort(references.begin(), references.end(), [](NodeReference const& left, NodeReference const& right) {
+            return left.start < right.start;
+        });
+        for (auto const& reference : references)
+        {
+            longest_reference = std::max(longest_reference, reference.end - reference.start + 1);
+        }
+    }
+
+    /**
+     * Append the kmers that start within the last KMER_LENGTH - 1 bases of a node and end in one of its
+     * successors. A kmer is added once for each walk through the graph it is found on
+     * @param first node the kmers start in
+     * @param tail_length number of bases of the first node at the start of walk
+     * @param last node at the end of walk
+     * @param walk bases of a walk from the tail of the first node to the last node
+     * @param budget number of kmers and walk extensions left before giving up
+     * @return false if the budget ran out
+     */
+    bool addJunctionKmers(
+        graphtools::Graph const& graph, NodeId first, std::size_t tail_length, NodeId last, std::string& walk,
+        KmerTable::Kmers& graph_kmers, std::size_t& budget) const
+    {
+        const std::size_t tail_start = sequences[first].size() - tail_length;
+        for (const NodeId next : graph.successors(last))
+        {
+            const std::size_t before = walk.size();
+            walk.append(sequences[next], 0, tail_length + KMER_LENGTH - 1 - before);
+
+            // kmers ending in the bases just added
+            const std::size_t from = std::max<std::size_t>(before, KMER_LENGTH - 1) - (KMER_LENGTH - 1);
+            if (walk.size() >= from + KMER_LENGTH)
+            {
+                KmerGenerator generator(walk.begin() + from, walk.end());
+                KmerTable::KmerType kmer = 0;
+                std::string::const_iterator position;
+                while (generator.next(kmer, position))
+                {
+                    graph_kmers.emplace_back(kmer, KmerTable::Posting(first, tail_start + (position - walk.begin())));
+                }
+            }
+
+            budget -= std::min(budget, walk.size() - before + 1);
+            if (!budget
+                || (walk.size() < tail_length + KMER_LENGTH - 1
+                    && !addJunctionKmers(graph, first, tail_length, next, walk, graph_kmers, budget)))
+            {
+                return false;
+            }
+            walk.resize(before);
+        }
+        return true;
+    }
+
+    /**
+     * @return true if the bases have no full length match in the graph other than the one at offset in node. This
+     * is the case if one of their kmers occurs only there and its reverse complement nowhere
+     */
+    bool hasSingleMatch(std::string const& bases, NodeId node, std::size_t offset) const
+    {
+        KmerGenerator generator(bases.begin(), bases.end());
+        KmerTable::KmerType kmer = 0;
+        std::string::const_iterator position;
+        while (generator.next(kmer, position))
+        {
+            const unsigned entry = kmers.find(kmer);
+            const KmerTable::KmerType reverse_kmer = oligo::reverseComplement(kmer);
+            if (KmerTable::NO_ENTRY != entry && std::next(kmers.begin(entry)) == kmers.end(entry)
+                && reverse_kmer != kmer && KmerTable::NO_ENTRY == kmers.find(reverse_kmer))
+            {
+                assert(kmers.begin(entry)->pathId_ == (int)node);
+                assert(kmers.begin(entry)->position_ == offset + (position - bases.begin()));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** upper-case sequence of each graph node */
+    std::vector<std::string> sequences;
+    /** kmers of all walks through the graph. Postings are the node and offset of the first kmer base */
+    KmerTable kmers;
+    /** reference intervals ordered by start. Empty if the graph could not be indexed */
+    std::vector<NodeReference> references;
+    int64_t longest_reference = 0;
+};
+
+LinearAligner::LinearAligner() = default;
+
+LinearAligner::~LinearAligner() = default;
+
+LinearAligner::LinearAligner(LinearAligner&& rhs) noexcept = default;
+
+LinearAligner& LinearAligner::operator=(LinearAligner&& rhs) noexcept = default;
+
+std::shared_ptr<const LinearAligner::Index>
+LinearAligner::makeIndex(graphtools::Graph const* g, std::vector<NodeReference> const& references)
+{
+    return std::make_shared<const Index>(g, references);
+}
+
+void LinearAligner::setGraph(std::shared_ptr<const Index> index) { index_ = std::move(index); }
+
+void LinearAligner::alignRead(common::Read& read)
+{
+    ++attempted_;
+    std::string const& bases = read.bases();
+    if (read.pos() < 0 || bases.size() < Index::KMER_LENGTH || bases.find_first_not_of("ACGT") != std::string::npos)
+    {
+        return;
+    }
+
+    // the first reference node that contains the read bases at their linear position
+    auto const& references = index_->references;
+    const int64_t pos = read.pos();
+    auto reference = std::upper_bound(
+        references.begin(), references.end(), pos,
+        [](int64_t value, NodeReference const& element) { return value < element.start; });
+    NodeReference const* match = nullptr;
+    while (!match && reference != references.begin() && (--reference)->start + index_->longest_reference > pos)
+    {
+        std::string const& sequence = index_->sequences[reference->node];
+        const auto offset = static_cast<std::size_t>(pos - reference->start);
+        if (reference->end >= pos + (int64_t)bases.size() - 1 && offset + bases.size() <= sequence.size()
+            && !sequence.compare(offset, bases.size(), bases))
+        {
+            match = &*reference;
+        }
+    }
+    if (!match || !index_->hasSingleMatch(bases, match->node, pos - match->start))
+    {
+        return;
+    }
+
+    // the alignment GraphAligner makes of a unique full length match, scored one per matching base
+    read.set_graph_pos(static_cast<int32_t>(pos - match->start));
+    read.set_graph_alignment_score(static_cast<int32_t>(bases.size()));
+    read.set_graph_cigar(std::to_string(match->node) + "[" + std::to_string(bases.size()) + "M]");
+    read.set_is_graph_reverse_strand(read.is_reverse_strand());
+    read.set_is_graph_alignment_unique(true);
+    read.set_graph_mapq(60);
+    read.set_graph_mapping_status(common::Read::MAPPED);
+    ++mapped_;
+}
+}
@@ -43,7 +43,10 @@
 #include "common/Alignment.hh"
 
 #include <algorithm>
+#include <cstdint>
 #include <list>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/range/adaptor/filtered.hpp>
 
@@ -59,12 +62,147 @@ struct ExactMatch
     bool isReverse;
 };
 
+namespace
+{
+    typedef uint64_t PackedKmer;
+    const std::size_t MAX_PACKED_KMER_LENGTH = sizeof(PackedKmer) * 4;
+    const unsigned INVALID_BASE = 4;
+
+    /**
+     * \return 2-bit code of an upper case ACGT base, INVALID_BASE for anything else
+     */
+    inline unsigned baseCode(const char base)
+    {
+        switch (base)
+        {
+        case 'A':
+            return 0;
+        case 'C':
+            return 1;
+        case 'G':
+            return 2;
+        case 'T':
+            return 3;
+        default:
+            return INVALID_BASE;
+        }
+    }
+
+    /**
+     * \brief pack kmer with the first base in the most significant bits
+     * \return false if kmer has bases other than upper case ACGT
+     */
+    bool packKmer(const std::string& kmer, PackedKmer& packed)
+    {
+        packed = 0;
+        for (const char base : kmer)
+        {
+            const unsigned code = baseCode(base);
+            if (INVALID_BASE == code)
+            {
+                return false;
+            }
+            packed = (packed << 2) | code;
+        }
+        return true;
+    }
+}
+
+struct PathAligner::Index
+{
+    Index(graphtools::Graph const* g, int32_t kmer_size)
+        : kmerIndex(*g, kmer_size)
+    {
+        if (kmerIndex.kmerLength() <= MAX_PACKED_KMER_LENGTH)
+        {
+            for (const std::string& kmer : kmerIndex.kmers())
+            {
+                PackedKmer packed = 0;
+                if (1 == kmerIndex.numPaths(kmer) && packKmer(kmer, packed))
+                {
+                    uniqueKmerPaths.emplace(packed, &kmerIndex.getPaths(kmer).front());
+                }
+            }
+        }
+    }
+
+    graphtools::KmerIndex kmerIndex;
+    /// paths of the ACGT kmers that occur on exactly one path of the graph. Points into kmerIndex
+    std::unordered_map<PackedKmer, graphtools::Path const*> uniqueKmerPaths;
+};
+
 struct PathAligner::Impl
 {
     int32_t kmerSize = 32;
-    std::unique_ptr<graphtools::KmerIndex> pKmerIndex;
+    std::shared_ptr<const Index> pIndex;
+
+    // NOTE, these transient buffers make the class thread-unsafe but allow avoiding dynamic
+    // memory allocations
+    // packed kmer of each read position on the forward strand and its reverse complement
+    std::vector<PackedKmer> forwardKmers;
+    std::vector<PackedKmer> reverseKmers;
+    // non-zero for the positions where the kmer is packed. Others are looked up by string
+    std::vector<char> packedKmers;
+
+    void packReadKmers(const std::string& bases, std::size_t kmer_length);
+    graphtools::Path const* findUniquePath(
+        const std::string& bases, std::size_t pos, std::size_t kmer_length, PackedKmer packed, bool is_packed) const;
 };
 
+/**
+ * \brief fill forwardKmers and reverseKmers in one pass over the read without building its reverse complement
+ */
+void PathAligner::Impl::packReadKmers(const std::string& bases, const std::size_t kmer_length)
+{
+    const std::size_t kmer_count = bases.size() - kmer_length + 1;
+    forwardKmers.resize(kmer_count);
+    reverseKmers.resize(kmer_count);
+    packedKmers.assign(kmer_count, 0);
+    if (kmer_length > MAX_PACKED_KMER_LENGTH)
+    {
+        return;
+    }
+
+    const PackedKmer mask
+        = MAX_PACKED_KMER_LENGTH == kmer_length ? ~PackedKmer(0) : (PackedKmer(1) << (kmer_length * 2)) - 1;
+    const unsigned complement_shift = (kmer_length - 1) * 2;
+    PackedKmer forward = 0;
+    PackedKmer reverse = 0;
+    std::size_t valid_bases = 0;
+    for (std::size_t pos = 0; pos != bases.size(); ++pos)
+    {
+        unsigned code = baseCode(bases[pos]);
+        valid_bases = INVALID_BASE == code ? 0 : valid_bases + 1;
+        code &= 3;
+        forward = ((forward << 2) | code) & mask;
+        reverse = (reverse >> 2) | (PackedKmer(3 - code) << complement_shift);
+        if (pos + 1 >= kmer_length)
+        {
+            const std::size_t kmer_pos = pos + 1 - kmer_length;
+            forwardKmers[kmer_pos] = forward;
+            reverseKmers[kmer_pos] = reverse;
+            packedKmers[kmer_pos] = valid_bases >= kmer_length;
+        }
+    }
+}
+
+/**
+ * \return the path of the kmer at pos if the kmer occurs on exactly one path, nullptr otherwise
+ */
+graphtools::Path const* PathAligner::Impl::findUniquePath(
+    const std::string& bases, const std::size_t pos, const std::size_t kmer_length, const PackedKmer packed,
+    const bool is_packed) const
+{
+    if (is_packed)
+    {
+        const auto it = pIndex->uniqueKmerPaths.find(packed);
+        return pIndex->uniqueKmerPaths.end() == it ? nullptr : it->second;
+    }
+
+    const std::string kmer = bases.substr(pos, kmer_length);
+    return 1 == pIndex->kmerIndex.numPaths(kmer) ? &pIndex->kmerIndex.getPaths(kmer).front() : nullptr;
+}
+
 PathAligner::PathAligner(int32_t kmer_size)
     : impl_(new Impl())
 {
@@ -74,16 +212,23 @@ PathAligner::~PathAligner() = default;
 PathAligner::PathAligner(PathAligner&& rhs) noexcept = default;
 PathAligner& PathAligner::operator=(PathAligner&& rhs) noexcept = default;
 
+std::shared_ptr<const PathAligner::Index> PathAligner::makeIndex(graphtools::Graph const* g, int32_t kmer_size)
+{
+    return std::make_shared<const Index>(g, kmer_size);
+}
+
 void PathAligner::setGraph(graphtools::Graph const* g, std::list<graphtools::Path> const&)
 {
-    impl_->pKmerIndex.reset(new graphtools::KmerIndex(*g, impl_->kmerSize));
+    setGraph(makeIndex(g, impl_->kmerSize));
 }
 
+void PathAligner::setGraph(std::shared_ptr<const Index> index) { impl_->pIndex = std::move(index); }
+
 void PathAligner::alignRead(common::Read& read)
 {
     ++attempted_;
 
-    const auto kmer_length = impl_->pKmerIndex->kmerLength();
+    const auto kmer_length = impl_->pIndex->kmerIndex.kmerLength();
 
     const size_t read_length = read.bases().size();
     if (read_length < kmer_length)
@@ -91,21 +236,38 @@ void PathAligner::alignRead(common::Read& read)
         return;
     }
 
+    impl_->packReadKmers(read.bases(), kmer_length);
+    const std::size_t last_kmer_pos = read_length - kmer_length;
+    // reverse complement is only built if a kmer needs to be looked up by string or extended
+    std::string reverse_bases;
+
     std::list<ExactMatch> matches;
     for (int strand = 0; strand < 2; ++strand)
     {
         const bool is_reverse_strand = strand != 0;
-        const std::string& read_bases = is_reverse_strand ? graphtools::reverseComplement(read.bases()) : read.bases();
 
-        for (size_t pos = 0; pos + kmer_length <= read_bases.size(); ++pos)
+        for (size_t pos = 0; pos + kmer_length <= read_length; ++pos)
         {
-            const std::string kmer = read_bases.substr(pos, kmer_length);
+            // kmer at pos of the reverse complement is the complement of the forward kmer at last_kmer_pos - pos
+            const std::size_t forward_pos = is_reverse_strand ? last_kmer_pos - pos : pos;
+            const bool is_packed = impl_->packedKmers[forward_pos];
+            if (is_reverse_strand && !is_packed && reverse_bases.empty())
+            {
+                reverse_bases = graphtools::reverseComplement(read.bases());
+            }
+            const std::string& read_bases = is_reverse_strand ? reverse_bases : read.bases();
 
-            if (impl_->pKmerIndex->numPaths(kmer) == 1)
+            graphtools::Path const* kmer_path = impl_->findUniquePath(
+                read_bases, pos, kmer_length,
+                is_reverse_strand ? impl_->reverseKmers[forward_pos] : impl_->forwardKmers[forward_pos], is_packed);
+            if (kmer_path)
             {
+                if (is_reverse_strand && reverse_bases.empty())
+                {
+                    reverse_bases = graphtools::reverseComplement(read.bases());
+                }
                 size_t qpos = pos;
-                const auto extended
-                    = graphtools::extendPathMatching(impl_->pKmerIndex->getPaths(kmer).front(), read_bases, qpos);
+                const auto extended = graphtools::extendPathMatching(*kmer_path, read_bases, qpos);
                 matches.push_back(ExactMatch{ qpos, extended, is_reverse_strand });
                 pos = matches.back().qpos + matches.back().path.length();
             }
@@ -129,7 +291,7 @@ void PathAligner::alignRead(common::Read& read)
 
     if (mem_to_translate.isReverse)
     {
-        read.set_bases(graphtools::reverseComplement(read.bases()));
+        read.set_bases(reverse_bases);
         read.set_is_graph_reverse_strand(true);
     }
     else
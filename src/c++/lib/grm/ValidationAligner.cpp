@@ -68,7 +68,22 @@ template <typename AlignerT> void ValidationAligner<AlignerT>::alignRead(common:
 {
     ++total_;
     AlignerT::alignRead(read, filter);
+    validate(read);
+}
+
+template <typename AlignerT>
+void ValidationAligner<AlignerT>::alignReads(std::vector<common::Read*> const& reads, ReadFilter filter)
+{
+    total_ += reads.size();
+    AlignerT::alignReads(reads, filter);
+    for (common::Read* read : reads)
+    {
+        validate(*read);
+    }
+}
 
+template <typename AlignerT> void ValidationAligner<AlignerT>::validate(common::Read& read)
+{
     if (read.graph_mapping_status() == common::Read::MAPPED)
     {
         ++aligned_;
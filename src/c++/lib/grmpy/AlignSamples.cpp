@@ -115,15 +115,9 @@ static void writeAlignments(
     fos << common::writeJson(output);
 }
 
-/**
- * Run single sample alignment
- * @param sample sample data structure
- */
-void alignSingleSample(
-    const Parameters& parameters, const std::string& graphPath, const std::string& referencePath,
-    common::BamReader& reader, genotyping::SampleInfo& sample)
+paragraph::Parameters makeParagraphParameters(
+    const Parameters& parameters, const std::string& graphPath, const std::string& referencePath)
 {
-    auto logger = LOG();
     const bool write_alignments = !parameters.alignment_output_folder().empty()
         && boost::filesystem::is_directory(parameters.alignment_output_folder());
 
@@ -147,12 +141,29 @@ void alignSingleSample(
                                                            // by using min reads for a variant > max reads we read
         0.01, parameters.bad_align_frac(), output_options, parameters.path_sequence_matching(),
         parameters.graph_sequence_matching(), parameters.klib_sequence_matching(), parameters.kmer_sequence_matching(),
-        false);
+        false, parameters.linear_projection());
     paragraph_parameters.set_threads(static_cast<uint32_t>(parameters.threads()));
     paragraph_parameters.set_kmer_len(parameters.bad_align_uniq_kmer_len());
+    paragraph_parameters.set_kmer_genotyping_len(parameters.kmer_genotyping_len());
+    paragraph_parameters.set_stage_limits(parameters.stage_limits());
+    paragraph_parameters.set_seeded_graph_alignment(parameters.seeded_graph_alignment());
 
-    logger->info("Loading parameters for sample {} graph {}", sample.sample_name(), graphPath);
     paragraph_parameters.load(graphPath, referencePath);
+    return paragraph_parameters;
+}
+
+/**
+ * Run single sample alignment
+ * @param sample sample data structure
+ * @param alignment_cache alignments of read sequences to the graph from samples aligned before
+ */
+void alignSingleSample(
+    const Parameters& parameters, const std::string& graphPath, const std::string& referencePath,
+    common::BamReader& reader, genotyping::SampleInfo& sample, grm::AlignmentCache* alignment_cache)
+{
+    auto logger = LOG();
+    logger->info("Loading parameters for sample {} graph {}", sample.sample_name(), graphPath);
+    const paragraph::Parameters paragraph_parameters = makeParagraphParameters(parameters, graphPath, referencePath);
     logger->info("Done loading parameters");
 
     common::ReadBuffer all_reads;
@@ -160,7 +171,23 @@ void alignSingleSample(
     common::extractReads(
         reader, paragraph_parameters.target_regions(), parameters.max_reads(),
         paragraph_parameters.longest_alt_insertion(), all_reads);
-    Json::Value output = paragraph::alignAndDisambiguate(paragraph_parameters, all_reads);
+    alignSingleSample(parameters, paragraph_parameters, referencePath, all_reads, sample, alignment_cache);
+}
+
+/**
+ * Align the reads extracted for a sample
+ * @param all_reads reads of the sample in the target regions of the graph
+ * @param sample sample data structure
+ * @param alignment_cache alignments of read sequences to the graph from samples aligned before
+ */
+void alignSingleSample(
+    const Parameters& parameters, const paragraph::Parameters& paragraph_parameters, const std::string& referencePath,
+    common::ReadBuffer& all_reads, genotyping::SampleInfo& sample, grm::AlignmentCache* alignment_cache)
+{
+    const bool write_alignments = !parameters.alignment_output_folder().empty()
+        && boost::filesystem::is_directory(parameters.alignment_output_folder());
+
+    Json::Value output = paragraph::alignAndDisambiguate(paragraph_parameters, all_reads, alignment_cache);
     output["bam"] = sample.filename();
 
     if (write_alignments)
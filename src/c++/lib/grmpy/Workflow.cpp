@@ -33,6 +33,7 @@
  *
  */
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <mutex>
@@ -45,6 +46,7 @@
 
 #include "common/Error.hh"
 #include "common/JsonHelpers.hh"
+#include "common/ReadStreaming.hh"
 #include "common/Threads.hh"
 #include "grmpy/AlignSamples.hh"
 #include "grmpy/CountAndGenotype.hh"
@@ -54,10 +56,13 @@
 namespace grmpy
 {
 
+/// below this average share of the alignment cache per graph, the reads of one sample hardly fit
+static const std::size_t MIN_ALIGNMENT_CACHE_BYTES_PER_GRAPH = 1 << 20;
+
 Workflow::Workflow(
     const std::vector<std::string>& graphSpecPaths, const std::string& genotypingParameterPath,
     const genotyping::Samples& mainfest, const std::string& outputFilePath, const std::string& outputFolderPath,
-    bool gzipOutput, const Parameters& parameters, const std::string& referencePath, bool progress)
+    bool gzipOutput, const Parameters& parameters, const std::string& referencePath, bool progress, bool streaming)
     : graphSpecPaths_(graphSpecPaths)
     , genotypingParameterPath_(genotypingParameterPath)
     , manifest_(mainfest)
@@ -67,6 +72,7 @@ Workflow::Workflow(
     , parameters_(parameters)
     , referencePath_(referencePath)
     , progress_(progress)
+    , streaming_(streaming)
 {
     alignedSamples_.resize(std::max<std::size_t>(1, graphSpecPaths_.size()));
     for (const genotyping::SampleInfo& sample : manifest_)
@@ -87,6 +93,48 @@ Workflow::Workflow(
             alignedSamples_[0].push_back(sample);
         }
     }
+
+    // nothing to cache when reads are not aligned
+    if (0 < parameters_.alignment_cache_mb() && 0 == parameters_.kmer_genotyping_len() && !graphSpecPaths_.empty())
+    {
+        // one memory limit for all graphs, so that graphs with many distinct reads can use what others leave
+        const std::size_t cacheBytes = static_cast<std::size_t>(parameters_.alignment_cache_mb()) << 20;
+        if (cacheBytes / graphSpecPaths_.size() < MIN_ALIGNMENT_CACHE_BYTES_PER_GRAPH)
+        {
+            LOG()->warn(
+                "Alignment cache of {} MB leaves {} KB per graph for {} graphs. Few read sequences will be found in "
+                "the cache, consider increasing --alignment-cache-mb",
+                parameters_.alignment_cache_mb(), (cacheBytes / graphSpecPaths_.size()) >> 10, graphSpecPaths_.size());
+        }
+        alignmentCaches_.emplace_back(new grm::AlignmentCache(cacheBytes));
+        while (alignmentCaches_.size() < graphSpecPaths_.size())
+        {
+            alignmentCaches_.push_back(alignmentCaches_.front()->share());
+        }
+    }
+}
+
+grm::AlignmentCache* Workflow::alignmentCache(std::size_t graph) const
+{
+    return alignmentCaches_.empty() ? nullptr : alignmentCaches_.at(graph).get();
+}
+
+void Workflow::logAlignmentCacheStats() const
+{
+    std::size_t lookups = 0;
+    std::size_t hits = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+    for (const auto& cache : alignmentCaches_)
+    {
+        lookups += cache->lookups();
+        hits += cache->hits();
+        entries += cache->entries();
+        bytes += cache->bytes();
+    }
+    LOG()->info(
+        "Alignment cache: {} of {} read sequences found ({:.1f}%), {} sequences in {} MB", hits, lookups,
+        lookups ? 100.0 * hits / lookups : 0.0, entries, bytes >> 20);
 }
 
 void Workflow::makeOutputFile(const Json::Value& output, const std::string& graphSpecPath) const
@@ -139,7 +187,8 @@ void Workflow::alignSamples()
 
                 auto ourGraphIndex = static_cast<unsigned long>(std::distance(graphSpecPaths_.begin(), ourGraph));
                 alignSingleSample(
-                    parameters_, *ourGraph, referencePath_, reader, alignedSamples_.at(ourGraphIndex).at(i));
+                    parameters_, *ourGraph, referencePath_, reader, alignedSamples_.at(ourGraphIndex).at(i),
+                    alignmentCache(ourGraphIndex));
 
                 if (progress_)
                 {
@@ -152,6 +201,62 @@ void Workflow::alignSamples()
     }
 }
 
+void Workflow::streamSamples()
+{
+    // only the target regions are read up front to put them in genome order. The full graph description is
+    // loaded when the reads of a graph are handed to alignment
+    std::vector<common::StreamingTarget> targets(graphSpecPaths_.size());
+    std::atomic<std::size_t> nextGraph(0);
+    common::CPU_THREADS(parameters_.threads()).execute([&]() {
+        for (std::size_t graph = nextGraph++; graphSpecPaths_.size() > graph; graph = nextGraph++)
+        {
+            paragraph::Parameters parameters;
+            parameters.load_targets(graphSpecPaths_[graph]);
+            targets[graph].target_regions = parameters.target_regions();
+            targets[graph].max_num_reads = parameters_.max_reads();
+            targets[graph].longest_alt_insertion = parameters.longest_alt_insertion();
+        }
+    });
+    LOG()->info("Loaded target regions for {} graphs", targets.size());
+
+    for (std::size_t i = 0; i < unalignedSamples_.size(); ++i)
+    {
+        UnalignedSample& input = unalignedSamples_[i];
+        if (graphSpecPaths_.end() == input.unprocessedGraphs_)
+        {
+            continue;
+        }
+        if (progress_)
+        {
+            LOG()->critical(
+                "Starting alignment for sample {} ({}/{})", input.sample_.sample_name(), i + 1,
+                unalignedSamples_.size());
+        }
+        // the sweep and mate recovery need separate file handles
+        common::BamReader reader(input.sample_.filename(), input.sample_.index_filename(), referencePath_);
+        common::BamReader mateReader(input.sample_.filename(), input.sample_.index_filename(), referencePath_);
+        std::atomic<std::size_t> finishedGraphs(0);
+        common::parallelStreamReads(
+            { &reader }, { &mateReader }, targets,
+            [&](std::size_t graph, common::ReadBuffer& reads) {
+                const paragraph::Parameters paragraphParameters
+                    = makeParagraphParameters(parameters_, graphSpecPaths_[graph], referencePath_);
+                alignSingleSample(
+                    parameters_, paragraphParameters, referencePath_, reads, alignedSamples_.at(graph).at(i),
+                    alignmentCache(graph));
+                const std::size_t finished = ++finishedGraphs;
+                if (progress_)
+                {
+                    LOG()->critical(
+                        "Sample {}: Alignment {} / {} finished", input.sample_.sample_name(), finished,
+                        alignedSamples_.size());
+                }
+            },
+            static_cast<unsigned>(parameters_.threads()));
+        input.unprocessedGraphs_ = graphSpecPaths_.end();
+    }
+}
+
 void Workflow::genotypeGraphs(
     std::ostream& outputFileStream, std::vector<genotyping::Samples>::const_iterator& ungenotypedSamples)
 {
@@ -229,7 +334,20 @@ void Workflow::run()
     }
 
     LOG()->info("Aligning for {} graphs", graphSpecPaths_.size());
-    common::CPU_THREADS(parameters_.threads()).execute([this]() { alignSamples(); });
+    if (streaming_)
+    {
+        streamSamples();
+    }
+    else
+    {
+        common::CPU_THREADS(parameters_.threads()).execute([this]() { alignSamples(); });
+    }
+    if (!alignmentCaches_.empty())
+    {
+        logAlignmentCacheStats();
+        // not needed for genotyping
+        alignmentCaches_.clear();
+    }
 
     LOG()->info("Genotyping {} samples", alignedSamples_.size());
     std::vector<genotyping::Samples>::const_iterator ungenotypedSamples = alignedSamples_.begin();
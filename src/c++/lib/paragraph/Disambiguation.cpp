@@ -33,6 +33,7 @@
  *
  */
 
+#include <algorithm>
 #include <fstream>
 #include <map>
 #include <set>
@@ -49,7 +50,9 @@
 #include "common/ReadExtraction.hh"
 #include "common/ReadPairs.hh"
 #include "graphalign/GraphAlignmentOperations.hh"
+#include "graphalign/KmerIndexOperations.hh"
 #include "graphcore/GraphCoordinates.hh"
+#include "graphutils/SequenceOperations.hh"
 #include "grm/Align.hh"
 #include "paragraph/Disambiguation.hh"
 #include "paragraph/GraphSummaryStatistics.hh"
@@ -70,7 +73,6 @@ using graphtools::Graph;
 using graphtools::GraphAlignment;
 using graphtools::GraphCoordinates;
 using graphtools::NodeId;
-using graphtools::decodeGraphAlignment;
 using std::vector;
 
 //#define DEBUG_DISAMBIGUATION
@@ -99,18 +101,17 @@ void disambiguateReads(
             bool has_previous = false;
             NodeId pnode = 0;
 
-            std::set<std::pair<std::string, std::string>> edges_supported_by_read;
+            std::set<std::pair<NodeId, NodeId>> edges_supported_by_read;
             std::set<NodeId> nodes_supported_by_read;
             std::set<std::string> overlapped_pfams;
 
-            GraphAlignment gm = decodeGraphAlignment(read->graph_pos(), read->graph_cigar(), g);
+            GraphAlignment const& gm = read->graph_alignment(g);
             auto const& path = gm.path();
             for (auto node = path.begin(); node != path.end(); ++node)
             {
-                if (has_previous
-                    && (edgefilter == nullptr || edgefilter(*read, g->nodeName(pnode), g->nodeName(*node))))
+                if (has_previous && (edgefilter == nullptr || edgefilter(*read, pnode, *node)))
                 {
-                    edges_supported_by_read.emplace(g->nodeName(pnode), g->nodeName(*node));
+                    edges_supported_by_read.emplace(pnode, *node);
                     for (const auto& s : g->edgeLabels(pnode, *node))
                     {
                         overlapped_pfams.insert(s);
@@ -120,7 +121,7 @@ void disambiguateReads(
                 pnode = *node;
 
                 // check if node is rejected
-                if (nodefilter == nullptr || nodefilter(*read, g->nodeName(*node)))
+                if (nodefilter == nullptr || nodefilter(*read, *node))
                 {
                     nodes_supported_by_read.emplace(*node);
                 }
@@ -128,12 +129,12 @@ void disambiguateReads(
 
             for (auto n : nodes_supported_by_read)
             {
-                read->add_graph_nodes_supported(g->nodeName(n));
+                read->add_graph_nodes_supported(n);
             }
 
             for (auto const& e : edges_supported_by_read)
             {
-                read->add_graph_edges_supported(e.first + "_" + e.second);
+                read->add_graph_edges_supported(e.first, e.second);
             }
 
             for (auto const& label : overlapped_pfams)
@@ -148,6 +149,190 @@ void disambiguateReads(
     }
 }
 
+namespace
+{
+/**
+ * Graph elements traversed by the graph-unique kmers of one read sequence
+ */
+struct KmerSupport
+{
+    size_t graph_kmers = 0;
+    size_t unique_kmers = 0;
+    std::map<NodeId, std::pair<int32_t, int32_t>> node_extents; ///< [start, end) of the read bases placed on each node
+    std::set<std::pair<NodeId, NodeId>> edges;
+};
+
+KmerSupport findKmerSupport(graphtools::KmerIndex const& kmer_index, std::string const& bases)
+{
+    KmerSupport support;
+    const auto kmer_len = static_cast<int32_t>(kmer_index.kmerLength());
+    std::string kmer;
+    for (int32_t pos = 0; pos + kmer_len <= static_cast<int32_t>(bases.size()); ++pos)
+    {
+        kmer.assign(bases, static_cast<size_t>(pos), static_cast<size_t>(kmer_len));
+        const size_t num_paths = kmer_index.numPaths(kmer);
+        support.graph_kmers += num_paths > 0 ? 1 : 0;
+        if (num_paths != 1)
+        {
+            continue;
+        }
+        ++support.unique_kmers;
+
+        graphtools::Path const& path = kmer_index.getPaths(kmer).front();
+        int32_t start = pos;
+        for (size_t node_index = 0; node_index != path.numNodes(); ++node_index)
+        {
+            const NodeId node_id = path.getNodeIdByIndex(node_index);
+            const int32_t end = start + static_cast<int32_t>(path.getOverlapLength(node_index));
+            auto& extent = support.node_extents.emplace(node_id, std::make_pair(start, end)).first->second;
+            extent.first = std::min(extent.first, start);
+            extent.second = std::max(extent.second, end);
+            if (node_index > 0)
+            {
+                support.edges.emplace(path.getNodeIdByIndex(node_index - 1), node_id);
+            }
+            start = end;
+        }
+    }
+    return support;
+}
+
+/**
+ * @return true if there is a path from node from to node to. Edges follow node order, so we can stop at node to.
+ */
+bool isReachable(Graph const& g, NodeId from, NodeId to)
+{
+    std::vector<NodeId> stack{ from };
+    std::set<NodeId> visited;
+    while (!stack.empty())
+    {
+        const NodeId node_id = stack.back();
+        stack.pop_back();
+        if (node_id == to)
+        {
+            return true;
+        }
+        for (const NodeId successor : g.successors(node_id))
+        {
+            if (successor <= to && visited.insert(successor).second)
+            {
+                stack.push_back(successor);
+            }
+        }
+    }
+    return false;
+}
+}
+
+/**
+ * Update sequence labels in reads from their graph-unique kmers instead of graph alignments.
+ * @param g graph structure
+ * @param reads list of unaligned reads, reads that support no node are removed
+ * @param kmer_index index of the graph kmers
+ * @param bad_align_frac fraction of read kmers that must be in the graph
+ * @param filtered receives the removed reads
+ */
+void disambiguateReadsByKmers(
+    Graph* g, std::vector<common::p_Read>& reads, graphtools::KmerIndex const& kmer_index, double bad_align_frac,
+    ReadFiltered const& filtered)
+{
+    std::vector<common::p_Read> supporting_reads;
+    supporting_reads.reserve(reads.size());
+    for (auto& read : reads)
+    {
+        read->clear_graph_sequences_supported();
+        read->clear_graph_nodes_supported();
+        read->clear_graph_edges_supported();
+
+        const KmerSupport forward = findKmerSupport(kmer_index, read->bases());
+        const KmerSupport reverse = findKmerSupport(kmer_index, graphtools::reverseComplement(read->bases()));
+        const bool is_reverse = reverse.unique_kmers > forward.unique_kmers;
+        KmerSupport const& support = is_reverse ? reverse : forward;
+        // reads with unique kmers are at least one kmer long
+        if (support.node_extents.empty()
+            || support.graph_kmers < bad_align_frac * (read->bases().size() + 1 - kmer_index.kmerLength()))
+        {
+            if (filtered)
+            {
+                filtered(*read, "bad_align");
+            }
+            continue;
+        }
+
+        // nodes must lie on one path: kmer edges join neighbouring nodes and gaps between nodes can be traversed
+        std::vector<NodeId> nodes;
+        for (auto const& node_extent : support.node_extents)
+        {
+            nodes.push_back(node_extent.first);
+        }
+        bool is_ambiguous = false;
+        for (auto const& edge : support.edges)
+        {
+            const auto next_node = std::upper_bound(nodes.begin(), nodes.end(), edge.first);
+            is_ambiguous = is_ambiguous || next_node == nodes.end() || *next_node != edge.second;
+        }
+        bool is_chain = true;
+        for (size_t node_index = 1; node_index < nodes.size() && !is_ambiguous; ++node_index)
+        {
+            if (!support.edges.count(std::make_pair(nodes[node_index - 1], nodes[node_index])))
+            {
+                is_chain = false;
+                is_ambiguous = !isReachable(*g, nodes[node_index - 1], nodes[node_index]);
+            }
+        }
+        if (is_ambiguous)
+        {
+            if (filtered)
+            {
+                filtered(*read, "kmer_ambiguous");
+            }
+            continue;
+        }
+
+        read->set_is_graph_reverse_strand(is_reverse);
+        for (const NodeId node_id : nodes)
+        {
+            read->add_graph_nodes_supported(node_id);
+        }
+
+        // same minimum overlap on both nodes as the edge filter for alignments
+        const auto min_node_overlap = static_cast<int32_t>(read->bases().length() / 10 + 1);
+        auto overlaps_node = [g, &support, min_node_overlap](NodeId node_id) {
+            auto const& extent = support.node_extents.at(node_id);
+            return extent.second - extent.first
+                >= std::min(static_cast<int32_t>(g->nodeSeq(node_id).size()), min_node_overlap);
+        };
+        std::set<std::string> overlapped_pfams;
+        for (auto const& edge : support.edges)
+        {
+            if (overlaps_node(edge.first) && overlaps_node(edge.second))
+            {
+                read->add_graph_edges_supported(edge.first, edge.second);
+                for (const auto& s : g->edgeLabels(edge.first, edge.second))
+                {
+                    overlapped_pfams.insert(s);
+                }
+            }
+        }
+
+        if (is_chain && !overlapped_pfams.empty())
+        {
+            const graphtools::Path path(
+                g, 0, nodes, std::max(0, static_cast<int32_t>(g->nodeSeq(nodes.back()).size()) - 1));
+            for (auto const& label : overlapped_pfams)
+            {
+                graphtools::PathFamily pfam(g, label);
+                if (pfam.containsPath(path))
+                {
+                    read->add_graph_sequences_supported(label);
+                }
+            }
+        }
+        supporting_reads.emplace_back(std::move(read));
+    }
+    reads = std::move(supporting_reads);
+}
+
 /**
  * Align reads from single BAM file to graph and disambiguate reads
  * to produce counts.
@@ -156,7 +341,8 @@ void disambiguateReads(
  * @param output_reads pass a pointer to a vector to retrieve all reads
  * @return results as JSON value
  */
-Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffer& all_reads)
+Json::Value alignAndDisambiguate(
+    const Parameters& parameters, common::ReadBuffer& all_reads, grm::AlignmentCache* alignment_cache)
 {
     auto logger = LOG();
 
@@ -185,20 +371,19 @@ Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffe
     const size_t total_reads_input = all_reads.size();
     std::map<std::string, size_t> read_filter_counts;
     std::mutex output_mutex;
-    auto read_filter_function
-        = [&read_filter, &read_filter_counts, &parameters, &output, &output_reads, &output_mutex](Read& r) -> bool {
-        const auto result_and_error = read_filter->filterRead(r);
-        if (result_and_error.first && parameters.output_enabled(Parameters::FILTERED_ALIGNMENTS))
+    auto record_filtered_read = [&read_filter_counts, &parameters, &output, &output_reads, &output_mutex](
+                                    Read& r, std::string const& error) {
+        if (parameters.output_enabled(Parameters::FILTERED_ALIGNMENTS))
         {
             r.set_graph_mapping_status(common::Read::BAD_ALIGN);
             Json::Value r_json = r.toJson();
-            r_json["error"] = result_and_error.second;
+            r_json["error"] = error;
             {
                 std::lock_guard<std::mutex> output_guard(output_mutex);
-                auto count_it = read_filter_counts.find(result_and_error.second);
+                auto count_it = read_filter_counts.find(error);
                 if (count_it == read_filter_counts.end())
                 {
-                    read_filter_counts[result_and_error.second] = 1;
+                    read_filter_counts[error] = 1;
                 }
                 else
                 {
@@ -208,20 +393,57 @@ Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffe
                 output_reads.emplace_back(new Read(r));
             }
         }
+    };
+    auto read_filter_function = [&read_filter, &record_filtered_read](Read& r) -> bool {
+        const auto result_and_error = read_filter->filterRead(r);
+        if (result_and_error.first)
+        {
+            record_filtered_read(r, result_and_error.second);
+        }
         return result_and_error.first;
     };
 
-    grm::alignReads(
-        &graph, grm::pathsFromJson(&graph, parameters.description()["paths"]), all_reads, read_filter_function,
-        parameters.path_sequence_matching(), parameters.graph_sequence_matching(), parameters.klib_sequence_matching(),
-        parameters.kmer_sequence_matching(), parameters.validate_alignments(), parameters.threads());
+    // reads are not aligned when genotyping from graph-unique kmers
+    int32_t kmer_genotyping_len = parameters.kmer_genotyping_len();
+    if (kmer_genotyping_len < 0)
+    {
+        kmer_genotyping_len = graphtools::findMinCoveringKmerLength(
+            &graph, static_cast<size_t>(-kmer_genotyping_len), static_cast<size_t>(-kmer_genotyping_len));
+        if (kmer_genotyping_len < 0)
+        {
+            logger->warn("No kmer length covers all nodes and edges with unique kmers, aligning reads instead.");
+            kmer_genotyping_len = 0;
+        }
+        else
+        {
+            logger->info("Auto-detected kmer length is {}.", kmer_genotyping_len);
+        }
+    }
+    const bool kmer_genotyping = kmer_genotyping_len > 0;
+    if (kmer_genotyping && (parameters.kmer_len() != 0 || !parameters.remove_nonuniq_reads()))
+    {
+        // kmer genotyping keeps only reads with one placement and has no alignment to check kmers along
+        error("ERROR: Kmer genotyping cannot keep non-unique reads or check read kmers for uniqueness");
+    }
+    size_t distinct_sequences = 0;
+    if (!kmer_genotyping)
+    {
+        const std::vector<grm::NodeReference> node_references = parameters.linear_projection()
+            ? grm::referencesFromJson(parameters.description())
+            : std::vector<grm::NodeReference>();
+        distinct_sequences = grm::alignReads(
+            &graph, grm::pathsFromJson(&graph, parameters.description()["paths"]), all_reads, read_filter_function,
+            parameters.path_sequence_matching(), parameters.graph_sequence_matching(),
+            parameters.klib_sequence_matching(), parameters.kmer_sequence_matching(), parameters.validate_alignments(),
+            parameters.threads(), alignment_cache, parameters.linear_projection() ? &node_references : nullptr,
+            parameters.stage_limits(), parameters.seeded_graph_alignment());
+    }
 
-    auto nodefilter = [&graph, &node_id_map](Read& read, const std::string& node) -> bool {
+    auto nodefilter = [&graph](Read& read, const NodeId node_id) -> bool {
         try
         {
-            GraphAlignment alignment = decodeGraphAlignment(read.graph_pos(), read.graph_cigar(), &graph);
+            GraphAlignment const& alignment = read.graph_alignment(&graph);
 
-            const auto node_id = node_id_map[node];
             const bool is_short_node = graph.nodeSeq(node_id).size() < read.bases().size() / 2;
 
             int32_t index = 0;
@@ -248,13 +470,10 @@ Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffe
         return false; // node not covered by read
     };
 
-    auto edgefilter = [&graph, &node_id_map](Read& read, const std::string& node1, const std::string& node2) -> bool {
+    auto edgefilter = [&graph](Read& read, const NodeId node_id1, const NodeId node_id2) -> bool {
         try
         {
-            GraphAlignment alignment = decodeGraphAlignment(read.graph_pos(), read.graph_cigar(), &graph);
-
-            const auto node_id1 = node_id_map[node1];
-            const auto node_id2 = node_id_map[node2];
+            GraphAlignment const& alignment = read.graph_alignment(&graph);
 
             const graphtools::Alignment* previous_alignment = nullptr;
             auto previous_node_id = static_cast<NodeId>(-1); // Large positive number
@@ -304,7 +523,7 @@ Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffe
 
     // add supported read haplotypes
     Json::Value paths = parameters.description()["paths"];
-    if (parameters.output_enabled(Parameters::HAPLOTYPES))
+    if (parameters.output_enabled(Parameters::HAPLOTYPES) && !kmer_genotyping)
     {
         addHaplotypePaths(all_reads, graph, paths, output);
 
@@ -322,7 +541,16 @@ Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffe
         }
     }
 
-    disambiguateReads(&graph, all_reads, nodefilter, edgefilter);
+    if (kmer_genotyping)
+    {
+        disambiguateReadsByKmers(
+            &graph, all_reads, graphtools::KmerIndex(graph, kmer_genotyping_len), parameters.bad_align_frac(),
+            record_filtered_read);
+    }
+    else
+    {
+        disambiguateReads(&graph, all_reads, nodefilter, edgefilter);
+    }
 
     graphtools::GraphCoordinates coordinates(&graph);
     countReads(
@@ -347,6 +575,11 @@ Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffe
         }
     }
     output["alignment_statistics"]["bad_alignment_pct"] = bad_alignment_pct;
+    // reads per distinct read sequence; reads with the same bases are aligned once
+    if (!kmer_genotyping && distinct_sequences > 0)
+    {
+        output["alignment_statistics"]["dedup_ratio"] = ((double)total_reads_input) / distinct_sequences;
+    }
     for (auto const& read_filter_type : read_filter_counts)
     {
         output["alignment_statistics"]["read_filter_" + read_filter_type.first] = (Json::UInt64)read_filter_type.second;
@@ -357,12 +590,16 @@ Json::Value alignAndDisambiguate(const Parameters& parameters, common::ReadBuffe
         output_reads.reserve(all_reads.size() + output_reads.size());
         for (auto& r : all_reads)
         {
-            Json::Value r_json = r->toJson();
+            Json::Value r_json = r->toJson(&graph);
             output["alignments"].append(r_json);
             output_reads.emplace_back(std::move(r));
         }
     }
     all_reads = std::move(output_reads);
+    for (auto& r : all_reads)
+    {
+        r->clear_graph_alignment();
+    }
 
     return output;
 }
@@ -108,8 +108,7 @@ void summarizeAlignments(Graph const& graph, common::ReadBuffer const& reads, Js
         {
             continue;
         }
-        GraphAlignment graph_alignment
-            = graphtools::decodeGraphAlignment(read->graph_pos(), read->graph_cigar(), &graph);
+        GraphAlignment const& graph_alignment = read->graph_alignment(&graph);
 
         string previous_node_name;
 
@@ -57,7 +57,6 @@ using graphtools::GraphCoordinates;
 using graphtools::NodeId;
 using graphtools::Path;
 using graphtools::checkPathPrefixSuffixOverlap;
-using graphtools::decodeGraphAlignment;
 using graphtools::exhaustiveMerge;
 using graphtools::greedyMerge;
 using graphtools::mergePaths;
@@ -91,7 +90,7 @@ std::map<std::string, std::list<Path>> getFragmentPaths(Graph const& graph, Read
     // are then extended to the start and end of the start / end node
     for (auto const& read : reads)
     {
-        GraphAlignment mapping = decodeGraphAlignment(read->graph_pos(), read->graph_cigar(), &graph);
+        GraphAlignment const& mapping = read->graph_alignment(&graph);
         if (mapping.path().numNodes() > 0)
         {
             path_map[read->fragment_id()].push_back(mapping.path());
@@ -43,11 +43,11 @@
 namespace paragraph
 {
 
-void Parameters::load(
-    const std::string& graph_path, const std::string& reference_path, const std::string& override_target_regions)
+/**
+ * Parse a graph description, accepting the graph keys at the top level or under a "graph" key
+ */
+static Json::Value readGraphDescription(const std::string& graph_path)
 {
-    reference_path_ = reference_path;
-
     Json::Value root;
     std::ifstream graph_desc(graph_path);
     graph_desc >> root;
@@ -61,8 +61,24 @@ void Parameters::load(
         }
         root.removeMember("graph");
     }
-    description_ = root;
+    return root;
+}
 
+void Parameters::load(
+    const std::string& graph_path, const std::string& reference_path, const std::string& override_target_regions)
+{
+    reference_path_ = reference_path;
+    description_ = readGraphDescription(graph_path);
+    loadTargets(description_, override_target_regions);
+}
+
+void Parameters::load_targets(const std::string& graph_path, const std::string& override_target_regions)
+{
+    loadTargets(readGraphDescription(graph_path), override_target_regions);
+}
+
+void Parameters::loadTargets(const Json::Value& root, const std::string& override_target_regions)
+{
     if (!override_target_regions.empty())
     {
         std::vector<std::string> regions;
@@ -87,7 +103,7 @@ void Parameters::load(
         max_reads_ = root["max_reads"].asUInt64();
     }
 
-    for (auto& node : description_["nodes"])
+    for (auto& node : root["nodes"])
     {
         if (node.isMember("sequence") && node["sequence"].asString().size() > longest_alt_insertion_)
         {
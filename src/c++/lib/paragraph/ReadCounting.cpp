@@ -28,6 +28,9 @@
  * \brief Counts reads/fragments supporting different elements of the graph
  */
 
+#include <algorithm>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -56,53 +59,133 @@ using graphtools::GraphCoordinates;
 namespace paragraph
 {
 
-void addFragmentCount(Json::Value& out, std::string const& element, Fragment const& frag)
+/**
+ * Fragment and read counts for a single graph element
+ */
+struct ElementCount
 {
-    if (!out.isMember(element))
+    uint64_t fragments = 0;
+    uint64_t reads = 0;
+    uint64_t forward_reads = 0;
+    uint64_t reverse_reads = 0;
+
+    void add(Fragment const& frag)
     {
-        out[element] = 1;
-        out[element + ":READS"] = frag.get_n_reads();
-        out[element + ":FWD"] = frag.get_n_graph_forward_reads();
-        out[element + ":REV"] = frag.get_n_graph_reverse_reads();
+        ++fragments;
+        reads += frag.get_n_reads();
+        forward_reads += frag.get_n_graph_forward_reads();
+        reverse_reads += frag.get_n_graph_reverse_reads();
     }
-    else
+};
+
+/**
+ * Dense counts for all nodes and edges of a graph. Edges are indexed by their position in the
+ * sorted list of graph edges
+ */
+class GraphElementCounts
+{
+public:
+    explicit GraphElementCounts(Graph const& graph)
+        : graph_(graph)
+        , nodes_(graph.numNodes())
     {
-        out[element] = out[element].asUInt64() + 1;
-        out[element + ":READS"] = out[element + ":READS"].asUInt64() + frag.get_n_reads();
-        out[element + ":FWD"] = out[element + ":FWD"].asUInt64() + frag.get_n_graph_forward_reads();
-        out[element + ":REV"] = out[element + ":REV"].asUInt64() + frag.get_n_graph_reverse_reads();
+        for (graphtools::NodeId node_id = 0; node_id != graph.numNodes(); ++node_id)
+        {
+            for (const auto successor : graph.successors(node_id))
+            {
+                edges_.emplace_back(node_id, successor);
+            }
+        }
+        std::sort(edges_.begin(), edges_.end());
+        edge_counts_.resize(edges_.size());
     }
-}
 
-Json::Value countNodes(FragmentList const& fragments)
-{
-    Json::Value out = Json::ValueType::objectValue;
-    for (auto const& frag : fragments)
+    void addNodes(Fragment const& frag)
+    {
+        for (const auto n : frag.graph_nodes_supported())
+        {
+            nodes_[n].add(frag);
+        }
+    }
+
+    void addEdges(Fragment const& frag)
+    {
+        for (const auto& e : frag.graph_edges_supported())
+        {
+            const auto edge_it = std::lower_bound(edges_.begin(), edges_.end(), e);
+            assert(edge_it != edges_.end() && *edge_it == e);
+            edge_counts_[edge_it - edges_.begin()].add(frag);
+        }
+    }
+
+    /**
+     * Write counts for all nodes and edges that have fragments
+     * @param out JSON object to add counts to
+     */
+    void write(Json::Value& out) const
     {
-        for (const auto& n : frag->graph_nodes_supported())
+        for (graphtools::NodeId node_id = 0; node_id != nodes_.size(); ++node_id)
         {
-            addFragmentCount(out, n, *frag);
+            writeCount(out, graph_.nodeName(node_id), nodes_[node_id]);
+        }
+        for (size_t edge_index = 0; edge_index != edges_.size(); ++edge_index)
+        {
+            const auto& e = edges_[edge_index];
+            writeCount(out, graph_.nodeName(e.first) + "_" + graph_.nodeName(e.second), edge_counts_[edge_index]);
         }
     }
+
+    static void writeCount(Json::Value& out, std::string const& element, ElementCount const& count)
+    {
+        if (count.fragments == 0)
+        {
+            return;
+        }
+        out[element] = (Json::UInt64)count.fragments;
+        out[element + ":READS"] = (Json::UInt64)count.reads;
+        out[element + ":FWD"] = (Json::UInt64)count.forward_reads;
+        out[element + ":REV"] = (Json::UInt64)count.reverse_reads;
+    }
+
+private:
+    Graph const& graph_;
+    std::vector<ElementCount> nodes_;
+    std::vector<std::pair<graphtools::NodeId, graphtools::NodeId>> edges_;
+    std::vector<ElementCount> edge_counts_;
+};
+
+Json::Value countNodes(Graph const& graph, FragmentList const& fragments)
+{
+    GraphElementCounts counts(graph);
+    for (auto const& frag : fragments)
+    {
+        counts.addNodes(*frag);
+    }
+    Json::Value out = Json::ValueType::objectValue;
+    counts.write(out);
     return out;
 }
 
-Json::Value countEdges(FragmentList const& fragments)
+Json::Value countEdges(Graph const& graph, FragmentList const& fragments)
 {
-    Json::Value out = Json::ValueType::objectValue;
+    GraphElementCounts counts(graph);
     for (auto const& frag : fragments)
     {
-        for (const auto& e : frag->graph_edges_supported())
-        {
-            addFragmentCount(out, e, *frag);
-        }
+        counts.addEdges(*frag);
     }
+    Json::Value out = Json::ValueType::objectValue;
+    counts.write(out);
     return out;
 }
 
-Json::Value countPathFamilies(FragmentList const& fragments, bool detailed)
+Json::Value countPathFamilies(Graph const& graph, FragmentList const& fragments, bool detailed)
 {
-    Json::Value out = Json::ValueType::objectValue;
+    struct PathFamilyCounts
+    {
+        ElementCount total;
+        std::unique_ptr<GraphElementCounts> elements;
+    };
+    std::map<std::string, PathFamilyCounts> path_family_counts;
     for (auto const& frag : fragments)
     {
         if (!frag->graph_sequences_supported().empty())
@@ -111,25 +194,30 @@ Json::Value countPathFamilies(FragmentList const& fragments, bool detailed)
             seqs.reserve(frag->graph_sequences_supported().size());
             seqs.insert(seqs.end(), frag->graph_sequences_supported().begin(), frag->graph_sequences_supported().end());
             std::sort(seqs.begin(), seqs.end());
-            auto joined_sequence_name = boost::algorithm::join(seqs, ",");
-            if (!out.isMember(joined_sequence_name))
-            {
-                out[joined_sequence_name] = Json::Value();
-            }
-            addFragmentCount(out[joined_sequence_name], "total", *frag);
+            auto& counts = path_family_counts[boost::algorithm::join(seqs, ",")];
+            counts.total.add(*frag);
             if (detailed) // Count Nodes/Edges within this path family
             {
-                for (const auto& n : frag->graph_nodes_supported())
-                {
-                    addFragmentCount(out[joined_sequence_name], n, *frag);
-                }
-                for (const auto& e : frag->graph_edges_supported())
+                if (!counts.elements)
                 {
-                    addFragmentCount(out[joined_sequence_name], e, *frag);
+                    counts.elements.reset(new GraphElementCounts(graph));
                 }
+                counts.elements->addNodes(*frag);
+                counts.elements->addEdges(*frag);
             }
         }
     }
+
+    Json::Value out = Json::ValueType::objectValue;
+    for (auto const& counts : path_family_counts)
+    {
+        Json::Value& path_family_out = out[counts.first];
+        GraphElementCounts::writeCount(path_family_out, "total", counts.second.total);
+        if (counts.second.elements)
+        {
+            counts.second.elements->write(path_family_out);
+        }
+    }
     return out;
 }
 
@@ -238,15 +326,15 @@ void countReads(
     output["fragment_statistics"] = alignmentStats(fragments);
     if (by_node)
     {
-        output["read_counts_by_node"] = countNodes(fragments);
+        output["read_counts_by_node"] = countNodes(coordinates.getGraph(), fragments);
     }
     if (by_edge)
     {
-        output["read_counts_by_edge"] = countEdges(fragments);
+        output["read_counts_by_edge"] = countEdges(coordinates.getGraph(), fragments);
     }
     if (by_pathFam)
     {
-        output["read_counts_by_sequence"] = countPathFamilies(fragments, pathFam_detailed);
+        output["read_counts_by_sequence"] = countPathFamilies(coordinates.getGraph(), fragments, pathFam_detailed);
     }
 }
 }
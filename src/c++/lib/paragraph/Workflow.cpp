@@ -33,6 +33,7 @@
  *
  */
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <mutex>
@@ -44,6 +45,7 @@
 #include <boost/iostreams/filtering_stream.hpp>
 
 #include "common/JsonHelpers.hh"
+#include "common/ReadStreaming.hh"
 #include "common/Threads.hh"
 #include "paragraph/Disambiguation.hh"
 #include "paragraph/Workflow.hh"
@@ -57,7 +59,7 @@ Workflow::Workflow(
     bool jointInputs, const InputPaths& inputPaths, const InputPaths& inputIndexPaths,
     const std::vector<std::string>& graph_spec_paths, const std::string& output_file_path,
     const std::string& output_folder_path, bool gzipOutput, const Parameters& parameters,
-    const std::string& reference_path, const std::string& target_regions)
+    const std::string& reference_path, const std::string& target_regions, bool streaming)
     : graphSpecPaths_(graph_spec_paths)
     , outputFilePath_(output_file_path)
     , outputFolderPath_(output_folder_path)
@@ -65,6 +67,7 @@ Workflow::Workflow(
     , parameters_(parameters)
     , referencePath_(reference_path)
     , targetRegions_(target_regions)
+    , streaming_(streaming)
 {
     if (jointInputs)
     {
@@ -102,6 +105,12 @@ std::string Workflow::processGraph(
             reader, parameters.target_regions(), (int)(parameters.max_reads()), parameters.longest_alt_insertion(),
             allReads);
     }
+    return processGraphReads(parameters, inputPaths, allReads);
+}
+
+std::string Workflow::processGraphReads(
+    const Parameters& parameters, const InputPaths& inputPaths, common::ReadBuffer& allReads) const
+{
     Json::Value outputJson = alignAndDisambiguate(parameters, allReads);
     if (inputPaths.size() == 1)
     {
@@ -118,6 +127,19 @@ std::string Workflow::processGraph(
     return common::writeJson(outputJson);
 }
 
+void Workflow::writeOutput(const std::string& output, std::ostream& outputFileStream)
+{
+    if (!outputFilePath_.empty())
+    {
+        if (firstPrinted_)
+        {
+            outputFileStream << ',';
+        }
+        dumpOutput(output, outputFileStream, outputFilePath_);
+        firstPrinted_ = true;
+    }
+}
+
 void Workflow::makeOutputFile(const std::string& output, const std::string& graphSpecPath)
 {
     const boost::filesystem::path inputPath(graphSpecPath);
@@ -142,10 +164,24 @@ void Workflow::makeOutputFile(const std::string& output, const std::string& grap
     dumpOutput(output, fos, outputPath.string());
 }
 
+void Workflow::openReaders(const Input& input, std::vector<common::BamReader>& readers) const
+{
+    readers.clear();
+    for (size_t i = 0; i != input.inputPaths_.size(); ++i)
+    {
+        const auto& bamPath = input.inputPaths_[i];
+        const auto& bamIndexPath = input.inputIndexPaths_[i];
+        LOG()->info("Opening {}/{} with {}", bamPath, bamIndexPath, referencePath_);
+        readers.emplace_back(bamPath, bamIndexPath, referencePath_);
+    }
+}
+
 void Workflow::processGraphs(std::ostream& outputFileStream)
 {
     for (Input& input : unprocessedInputs_)
     {
+        // readers are opened once per thread and input and then only moved between regions
+        std::vector<common::BamReader> readers;
         std::lock_guard<std::mutex> lock(mutex_);
         while (graphSpecPaths_.end() != input.unprocessedGraphs_)
         {
@@ -153,23 +189,16 @@ void Workflow::processGraphs(std::ostream& outputFileStream)
             std::string output;
             ASYNC_BLOCK_WITH_CLEANUP([this](bool failure) { terminate_ |= failure; })
             {
-                std::vector<common::BamReader> readers;
-                //        for (const std::string& inputPath : input.inputPaths_)
-                for (size_t i = 0; i != input.inputPaths_.size(); ++i)
-                {
-                    //            LOG()->info("Opening {} with {}", inputPath, referencePath_);
-                    //            readers.push_back(common::BamReader(inputPath, referencePath_));
-                    const auto& bamPath = input.inputPaths_[i];
-                    const auto& bamIndexPath = input.inputIndexPaths_[i];
-                    LOG()->info("Opening {}/{} with {}", bamPath, bamIndexPath, referencePath_);
-                    readers.emplace_back(bamPath, bamIndexPath, referencePath_);
-                }
                 if (terminate_)
                 {
                     LOG()->warn("terminating");
                     break;
                 }
                 common::unlock_guard<std::mutex> unlock(mutex_);
+                if (readers.empty())
+                {
+                    openReaders(input, readers);
+                }
                 Parameters parameters = parameters_;
                 LOG()->info("Loading parameters {}", graphSpecPath);
                 parameters.load(graphSpecPath, referencePath_, targetRegions_);
@@ -183,16 +212,59 @@ void Workflow::processGraphs(std::ostream& outputFileStream)
                 }
             }
 
-            if (!outputFilePath_.empty())
-            {
-                if (firstPrinted_)
+            writeOutput(output, outputFileStream);
+        }
+    }
+}
+
+void Workflow::streamGraphs(std::ostream& outputFileStream)
+{
+    // only the target regions are read up front to put them in genome order. The full graph description is
+    // loaded when the reads of a graph are handed to alignment
+    std::vector<common::StreamingTarget> targets(graphSpecPaths_.size());
+    std::atomic<std::size_t> nextGraph(0);
+    common::CPU_THREADS(parameters_.threads()).execute([&]() {
+        for (std::size_t graph = nextGraph++; graphSpecPaths_.size() > graph; graph = nextGraph++)
+        {
+            Parameters parameters = parameters_;
+            parameters.load_targets(graphSpecPaths_[graph], targetRegions_);
+            targets[graph].target_regions = parameters.target_regions();
+            targets[graph].max_num_reads = (int)(parameters.max_reads());
+            targets[graph].longest_alt_insertion = parameters.longest_alt_insertion();
+        }
+    });
+    LOG()->info("Loaded target regions for {} graphs", targets.size());
+
+    for (Input& input : unprocessedInputs_)
+    {
+        // the sweep and mate recovery need separate file handles
+        std::vector<common::BamReader> readers;
+        std::vector<common::BamReader> mateReaders;
+        openReaders(input, readers);
+        openReaders(input, mateReaders);
+        std::vector<common::ReadReader*> readerPointers;
+        std::vector<common::ReadReader*> mateReaderPointers;
+        for (std::size_t i = 0; readers.size() > i; ++i)
+        {
+            readerPointers.push_back(&readers[i]);
+            mateReaderPointers.push_back(&mateReaders[i]);
+        }
+
+        common::parallelStreamReads(
+            readerPointers, mateReaderPointers, targets,
+            [&](std::size_t graph, common::ReadBuffer& reads) {
+                Parameters parameters = parameters_;
+                parameters.load(graphSpecPaths_[graph], referencePath_, targetRegions_);
+                const std::string output = processGraphReads(parameters, input.inputPaths_, reads);
+                if (!outputFolderPath_.empty())
                 {
-                    outputFileStream << ',';
+                    makeOutputFile(output, graphSpecPaths_[graph]);
                 }
-                dumpOutput(output, outputFileStream, outputFilePath_);
-                firstPrinted_ = true;
-            }
-        }
+                std::lock_guard<std::mutex> lock(mutex_);
+                writeOutput(output, outputFileStream);
+            },
+            static_cast<unsigned>(parameters_.threads()));
+        input.unprocessedGraphs_ = graphSpecPaths_.end();
     }
 }
 
@@ -229,7 +301,14 @@ void Workflow::run()
         fos << "[";
     }
 
-    common::CPU_THREADS(parameters_.threads()).execute([this, &fos]() { processGraphs(fos); });
+    if (streaming_)
+    {
+        streamGraphs(fos);
+    }
+    else
+    {
+        common::CPU_THREADS(parameters_.threads()).execute([this, &fos]() { processGraphs(fos); });
+    }
 
     if (!outputFilePath_.empty() && 1 < graphSpecPaths_.size())
     {
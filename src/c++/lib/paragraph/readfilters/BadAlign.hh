@@ -45,7 +45,6 @@ namespace paragraph
 
 using graphtools::Graph;
 using graphtools::GraphAlignment;
-using graphtools::decodeGraphAlignment;
 
 namespace readfilters
 {
@@ -61,7 +60,7 @@ namespace readfilters
 
         std::pair<bool, std::string> filterRead(common::Read const& r) override
         {
-            const GraphAlignment mapping = decodeGraphAlignment(r.graph_pos(), r.graph_cigar(), graph_);
+            const GraphAlignment& mapping = r.graph_alignment(graph_);
             size_t query_clipped = 0;
             for (auto const& aln : mapping)
             {
@@ -48,7 +48,6 @@ namespace readfilters
     using graphtools::Graph;
     using graphtools::GraphAlignment;
     using graphtools::NodeId;
-    using graphtools::decodeGraphAlignment;
     struct KmerFilter::Impl
     {
         Impl(Graph const* g, int32_t kmer_len_)
@@ -77,7 +76,7 @@ namespace readfilters
 
     std::pair<bool, std::string> KmerFilter::filterRead(common::Read const& r)
     {
-        const GraphAlignment alignment = decodeGraphAlignment(r.graph_pos(), r.graph_cigar(), _impl->graph);
+        const GraphAlignment& alignment = r.graph_alignment(_impl->graph);
         if (alignment.size() < 1)
         {
             return { true, "kmer_nomapping" };
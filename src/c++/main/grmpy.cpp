@@ -45,6 +45,7 @@
 #include "grmpy/Parameters.hh"
 #include "grmpy/Workflow.hh"
 
+#include "common/BamReader.hh"
 #include "common/Error.hh"
 #include "common/Program.hh"
 
@@ -71,18 +72,25 @@ public:
     genotyping::Samples manifest;
     string genotyping_parameter_path;
     int sample_threads = std::thread::hardware_concurrency();
+    int decode_threads = 0;
     int max_reads_per_event = 10000;
     float bad_align_frac = 0.8f;
     bool path_sequence_matching = false;
     bool graph_sequence_matching = true;
     bool klib_sequence_matching = false;
     bool kmer_sequence_matching = false;
+    bool linear_projection = false;
+    bool seeded_graph_alignment = false;
+    int kmer_genotyping_len = 0;
+    grm::StageLimits stage_limits;
     int bad_align_uniq_kmer_len = 0;
     string alignment_output_path;
     bool infer_read_haplotypes = false;
+    int alignment_cache_mb = 512;
 
     bool gzip_output = false;
     bool progress = true;
+    bool streaming = false;
 
     std::string usagePrefix() const override
     {
@@ -127,13 +135,43 @@ Options::Options()
             ("kmer-sequence-matching",
              po::value<bool>(&kmer_sequence_matching)->default_value(kmer_sequence_matching)->implicit_value(true),
              "Use kmer aligner.")
+            ("linear-projection",
+             po::value<bool>(&linear_projection)->default_value(linear_projection)->implicit_value(true),
+             "Keep the input alignments of reads that match the graph reference nodes exactly and uniquely instead "
+             "of realigning them.")
+            ("seeded-graph-alignment",
+             po::value<bool>(&seeded_graph_alignment)->default_value(seeded_graph_alignment)->implicit_value(true),
+             "Fill only the parts of the graph around the kmer seeds of each read in smith waterman graph alignment. "
+             "Faster on graphs with long nodes, but a read with an equally good placement that has no seed can be "
+             "reported as uniquely aligned.")
+            ("kmer-genotyping", po::value<int>(&kmer_genotyping_len)->default_value(kmer_genotyping_len),
+             "Count the graph-unique kmers of this length in reads instead of aligning them. 0 aligns reads, negative "
+             "values pick the shortest length with at least that many unique kmers on each node and edge.")
+            ("adaptive-stages", po::value<unsigned>(&stage_limits.window)->default_value(stage_limits.window),
+             "Number of reads between decisions to skip the aligner stages before gssw that do not pay off for a graph, "
+             "or to try the kmer aligner before the path aligner. 0 keeps the fixed stage order.")
+            ("adaptive-stages-min-success",
+             po::value<double>(&stage_limits.minSuccessRate)->default_value(stage_limits.minSuccessRate),
+             "Aligner stages that map at least this fraction of the reads they try are never skipped.")
+            ("adaptive-stages-probe",
+             po::value<unsigned>(&stage_limits.probeInterval)->default_value(stage_limits.probeInterval),
+             "Skipped aligner stages still try one in this many reads. 0 never tries them again.")
             ("bad-align-uniq-kmer-len", po::value<int>(&bad_align_uniq_kmer_len)->default_value(bad_align_uniq_kmer_len),
              "Kmer length for uniqueness check during read filtering.")
+            ("alignment-cache-mb", po::value<int>(&alignment_cache_mb)->default_value(alignment_cache_mb),
+             "Memory in MB for alignments of read sequences kept across samples, shared by all graphs. "
+             "Samples skip aligning sequences already aligned for earlier samples. 0 disables the cache.")
             ("sample-threads,t", po::value<int>(&sample_threads)->default_value(sample_threads),
              "Number of threads for parallel sample processing.")
+            ("decode-threads", po::value<int>(&decode_threads)->default_value(decode_threads),
+             "Number of threads out of --sample-threads to use for BAM/CRAM decompression. "
+             "0 decodes on the reading thread.")
             ("gzip-output,z", po::value<bool>(&gzip_output)->default_value(gzip_output)->implicit_value(true),
              "gzip-compress output files. If -O is used, output file names are appended with .gz")
             ("progress", po::value<bool>(&progress)->default_value(progress)->implicit_value(true))
+            ("streaming", po::value<bool>(&streaming)->default_value(streaming)->implicit_value(true),
+             "Extract reads for all graphs with one pass over each sample in genome order instead of querying the "
+             "target regions of each graph. Faster for many small graphs.")
             ;
     // clang-format on
 }
@@ -211,6 +249,24 @@ void Options::postProcess(boost::program_options::variables_map& vm)
         }
     }
 
+    if (sample_threads <= 0 || decode_threads < 0)
+    {
+        error("ERROR: Invalid number of threads: %d, decode threads: %d", sample_threads, decode_threads);
+    }
+    sample_threads = static_cast<int>(common::BamReader::initDecodeThreadPool(
+        static_cast<unsigned>(decode_threads), static_cast<unsigned>(sample_threads)));
+
+    if (alignment_cache_mb < 0)
+    {
+        error("ERROR: Invalid alignment cache size: %d MB", alignment_cache_mb);
+    }
+
+    // reads are not aligned with kmer genotyping, so there is no alignment to check read kmers along
+    if (0 != kmer_genotyping_len && 0 != bad_align_uniq_kmer_len)
+    {
+        error("ERROR: --kmer-genotyping cannot be combined with --bad-align-uniq-kmer-len");
+    }
+
     if (vm.count("manifest"))
     {
         const string manifest_path = vm["manifest"].as<string>();
@@ -256,10 +312,13 @@ static void runGrmpy(const Options& options)
     Parameters parameters(
         options.sample_threads, options.max_reads_per_event, options.bad_align_frac, options.path_sequence_matching,
         options.graph_sequence_matching, options.klib_sequence_matching, options.kmer_sequence_matching,
-        options.bad_align_uniq_kmer_len, options.alignment_output_path, options.infer_read_haplotypes);
+        options.bad_align_uniq_kmer_len, options.alignment_output_path, options.infer_read_haplotypes,
+        options.alignment_cache_mb, options.linear_projection, options.kmer_genotyping_len,
+        options.stage_limits, options.seeded_graph_alignment);
     grmpy::Workflow workflow(
         options.graph_spec_paths, options.genotyping_parameter_path, options.manifest, options.output_file_path,
-        options.output_folder_path, options.gzip_output, parameters, options.reference_path, options.progress);
+        options.output_folder_path, options.gzip_output, parameters, options.reference_path, options.progress,
+        options.streaming);
     workflow.run();
 }
 
@@ -49,6 +49,7 @@
 #include "idxdepth/IndexBinning.hh"
 #include "idxdepth/Parameters.hh"
 
+#include "common/BamReader.hh"
 #include "common/Error.hh"
 
 namespace po = boost::program_options;
@@ -76,6 +77,8 @@ int main(int argc, char const* argv[])
              "Regex to identify sex chromosome names (default: '(chr)?[XY]?'")
             ("threads", po::value<int>()->default_value(std::thread::hardware_concurrency()),
              "Number of threads to use for parallel estimation.")
+            ("decode-threads", po::value<int>()->default_value(0),
+             "Number of threads out of --threads to use for BAM/CRAM decompression. 0 decodes on the reading thread.")
             ("log-level", po::value<string>()->default_value("info"), "Set log level (error, warning, info).")
             ("log-file", po::value<string>()->default_value(""), "Log to a file instead of stderr.")
             ("log-async", po::value<bool>()->default_value(true), "Enable / disable async logging.");
@@ -142,7 +145,14 @@ int main(int argc, char const* argv[])
         parameters.set_include_regex(vm["include-regex"].as<string>());
         parameters.set_autosome_regex(vm["autosome-regex"].as<string>());
         parameters.set_sex_chromosome_regex(vm["sex-chromosome-regex"].as<string>());
-        parameters.set_threads(vm["threads"].as<int>());
+        const int threads = vm["threads"].as<int>();
+        const int decode_threads = vm["decode-threads"].as<int>();
+        if (threads <= 0 || decode_threads < 0)
+        {
+            error("ERROR: Invalid number of threads: %d, decode threads: %d", threads, decode_threads);
+        }
+        parameters.set_threads(static_cast<int>(common::BamReader::initDecodeThreadPool(
+            static_cast<unsigned>(decode_threads), static_cast<unsigned>(threads))));
 
         Json::Value output = idxdepth::estimateDepths(parameters);
 
@@ -38,6 +38,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 
+#include "common/BamReader.hh"
 #include "common/Error.hh"
 #include "common/Program.hh"
 #include "common/StringUtil.hh"
@@ -64,11 +65,17 @@ public:
     string output_folder_path;
     string target_regions;
     int threads = std::thread::hardware_concurrency();
+    int decode_threads = 0;
     bool path_sequence_matching = true;
     bool graph_sequence_matching = true;
     bool klib_sequence_matching = false;
     bool kmer_sequence_matching = false;
+    bool linear_projection = false;
+    bool seeded_graph_alignment = false;
+    int kmer_genotyping_len = 0;
+    grm::StageLimits stage_limits;
     bool gzip_output = false;
+    bool streaming = false;
     int output_options = Parameters::output_options::NODE_READ_COUNTS | Parameters::output_options::EDGE_READ_COUNTS
         | Parameters::output_options::PATH_READ_COUNTS;
     std::vector<string> bam_paths;
@@ -116,6 +123,27 @@ Options::Options()
         ("kmer-sequence-matching",
          po::value<bool>(&kmer_sequence_matching)->default_value(kmer_sequence_matching)->implicit_value(true),
          "Use kmer aligner.")
+        ("linear-projection",
+         po::value<bool>(&linear_projection)->default_value(linear_projection)->implicit_value(true),
+         "Keep the input alignments of reads that match the graph reference nodes exactly and uniquely instead of "
+         "realigning them.")
+        ("seeded-graph-alignment",
+         po::value<bool>(&seeded_graph_alignment)->default_value(seeded_graph_alignment)->implicit_value(true),
+         "Fill only the parts of the graph around the kmer seeds of each read in smith waterman graph alignment. "
+         "Faster on graphs with long nodes, but a read with an equally good placement that has no seed can be "
+         "reported as uniquely aligned.")
+        ("kmer-genotyping", po::value<int>(&kmer_genotyping_len)->default_value(kmer_genotyping_len),
+         "Count the graph-unique kmers of this length in reads instead of aligning them. 0 aligns reads, negative "
+         "values pick the shortest length with at least that many unique kmers on each node and edge.")
+        ("adaptive-stages", po::value<unsigned>(&stage_limits.window)->default_value(stage_limits.window),
+         "Number of reads between decisions to skip the aligner stages before gssw that do not pay off for a graph, "
+         "or to try the kmer aligner before the path aligner. 0 keeps the fixed stage order.")
+        ("adaptive-stages-min-success",
+         po::value<double>(&stage_limits.minSuccessRate)->default_value(stage_limits.minSuccessRate),
+         "Aligner stages that map at least this fraction of the reads they try are never skipped.")
+        ("adaptive-stages-probe",
+         po::value<unsigned>(&stage_limits.probeInterval)->default_value(stage_limits.probeInterval),
+         "Skipped aligner stages still try one in this many reads. 0 never tries them again.")
         ("validate-alignments", po::value<bool>(&validate_alignments)->default_value(validate_alignments)->implicit_value(true),
          "Use information in the input bam read names to collect statistics about the accuracy of alignments. "
          "Requires bam file produced with simulate-reads.sh")
@@ -143,8 +171,13 @@ Options::Options()
          "Kmer length for uniqueness check during read filtering.")
         ("reference,r", po::value<string>(&reference_path), "Reference genome fasta file.")
         ("threads", po::value<int>(&threads)->default_value(threads), "Number of threads to use for parallel alignment.")
+        ("decode-threads", po::value<int>(&decode_threads)->default_value(decode_threads),
+         "Number of threads out of --threads to use for BAM/CRAM decompression. 0 decodes on the reading thread.")
         ("gzip-output,z", po::value<bool>(&gzip_output)->default_value(gzip_output)->implicit_value(true),
-         "gzip-compress output files. If -O is used, output file names are appended with .gz");
+         "gzip-compress output files. If -O is used, output file names are appended with .gz")
+        ("streaming", po::value<bool>(&streaming)->default_value(streaming)->implicit_value(true),
+         "Extract reads for all graphs with one pass over each input in genome order instead of querying the "
+         "target regions of each graph. Faster for many small graphs. Output order follows the genome.");
 }
 
 /**
@@ -228,6 +261,20 @@ void Options::postProcess(boost::program_options::variables_map& vm)
         error("ERROR: Reference genome is missing.");
     }
 
+    if (threads <= 0 || decode_threads < 0)
+    {
+        error("ERROR: Invalid number of threads: %d, decode threads: %d", threads, decode_threads);
+    }
+    threads = static_cast<int>(common::BamReader::initDecodeThreadPool(
+        static_cast<unsigned>(decode_threads), static_cast<unsigned>(threads)));
+
+    // reads are not aligned with kmer genotyping, only reads with one placement of their unique kmers are counted
+    if (0 != kmer_genotyping_len && (0 != bad_align_uniq_kmer_len || !bad_align_nonuniq))
+    {
+        error("ERROR: --kmer-genotyping always removes non-unique reads and cannot be combined with "
+              "--bad-align-uniq-kmer-len or --bad-align-nonuniq false");
+    }
+
     if (!target_regions.empty())
     {
         LOG()->info("Overriding target regions: {}", target_regions);
@@ -272,16 +319,20 @@ static void runParagraph(const Options& options)
     Parameters parameters(
         options.max_reads_per_event, options.variant_min_reads, options.variant_min_frac,
         options.bad_align_frac, options.output_options, options.path_sequence_matching, options.graph_sequence_matching,
-        options.klib_sequence_matching, options.kmer_sequence_matching, options.validate_alignments);
+        options.klib_sequence_matching, options.kmer_sequence_matching, options.validate_alignments,
+        options.linear_projection);
 
     parameters.set_threads(options.threads);
     parameters.set_kmer_len(options.bad_align_uniq_kmer_len);
+    parameters.set_kmer_genotyping_len(options.kmer_genotyping_len);
+    parameters.set_stage_limits(options.stage_limits);
+    parameters.set_seeded_graph_alignment(options.seeded_graph_alignment);
     parameters.set_remove_nonuniq_reads(options.bad_align_nonuniq);
 
     Workflow workflow(
             1 != options.bam_paths.size(), options.bam_paths, options.bam_index_paths, options.graph_spec_paths,
             options.output_file_path, options.output_folder_path,
-            options.gzip_output, parameters, options.reference_path, options.target_regions);
+            options.gzip_output, parameters, options.reference_path, options.target_regions, options.streaming);
     workflow.run();
 }
 
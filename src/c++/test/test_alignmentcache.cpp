@@ -0,0 +1,113 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+
+#include "grm/AlignmentCache.hh"
+
+using std::string;
+
+using namespace testing;
+using namespace grm;
+
+static CachedAlignment makeAlignment(string const& cigar)
+{
+    CachedAlignment alignment;
+    alignment.alignment.graph_cigar = cigar;
+    alignment.alignment.graph_mapping_status = common::Read::MAPPED;
+    return alignment;
+}
+
+TEST(AlignmentCache, FindsInsertedSequences)
+{
+    AlignmentCache cache(1 << 20);
+    CachedAlignment found;
+    ASSERT_FALSE(cache.find("ACGT+", found));
+    cache.insert("ACGT+", makeAlignment("0[4M]"));
+    ASSERT_TRUE(cache.find("ACGT+", found));
+    ASSERT_EQ("0[4M]", found.alignment.graph_cigar);
+    ASSERT_EQ(common::Read::MAPPED, found.alignment.graph_mapping_status);
+    ASSERT_FALSE(cache.find("ACGT-", found));
+
+    ASSERT_EQ(3ull, cache.lookups());
+    ASSERT_EQ(1ull, cache.hits());
+    ASSERT_EQ(1ull, cache.entries());
+}
+
+TEST(AlignmentCache, DropsLeastRecentlyUsed)
+{
+    AlignmentCache probe(1 << 20);
+    probe.insert("AAAA+", makeAlignment("0[4M]"));
+    const std::size_t entry_bytes = probe.bytes();
+
+    AlignmentCache cache(3 * entry_bytes);
+    cache.insert("AAAA+", makeAlignment("0[4M]"));
+    cache.insert("CCCC+", makeAlignment("0[4M]"));
+    cache.insert("GGGG+", makeAlignment("0[4M]"));
+    CachedAlignment found;
+    ASSERT_TRUE(cache.find("AAAA+", found));
+    cache.insert("TTTT+", makeAlignment("0[4M]"));
+
+    ASSERT_EQ(3ull, cache.entries());
+    ASSERT_GE(3 * entry_bytes, cache.bytes());
+    ASSERT_TRUE(cache.find("AAAA+", found));
+    ASSERT_FALSE(cache.find("CCCC+", found));
+    ASSERT_TRUE(cache.find("GGGG+", found));
+    ASSERT_TRUE(cache.find("TTTT+", found));
+}
+
+TEST(AlignmentCache, SharesMemoryLimitBetweenGraphs)
+{
+    AlignmentCache probe(1 << 20);
+    probe.insert("AAAA+", makeAlignment("0[4M]"));
+    const std::size_t entry_bytes = probe.bytes();
+
+    AlignmentCache first(3 * entry_bytes);
+    std::unique_ptr<AlignmentCache> second = first.share();
+    first.insert("AAAA+", makeAlignment("0[4M]"));
+    second->insert("AAAA+", makeAlignment("1[4M]"));
+    first.insert("CCCC+", makeAlignment("0[4M]"));
+    second->insert("CCCC+", makeAlignment("1[4M]"));
+
+    // the same sequence is kept separately for each graph, the oldest entries of either graph are dropped
+    CachedAlignment found;
+    ASSERT_FALSE(first.find("AAAA+", found));
+    ASSERT_TRUE(second->find("AAAA+", found));
+    ASSERT_EQ("1[4M]", found.alignment.graph_cigar);
+    ASSERT_TRUE(first.find("CCCC+", found));
+    ASSERT_EQ("0[4M]", found.alignment.graph_cigar);
+    ASSERT_TRUE(second->find("CCCC+", found));
+    ASSERT_EQ("1[4M]", found.alignment.graph_cigar);
+
+    ASSERT_EQ(1ull, first.entries());
+    ASSERT_EQ(2ull, second->entries());
+    ASSERT_GE(3 * entry_bytes, first.bytes() + second->bytes());
+    ASSERT_EQ(2ull, first.lookups());
+    ASSERT_EQ(2ull, second->hits());
+}
@@ -0,0 +1,148 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphcore/Graph.hh"
+#include "grm/CompositeAligner.hh"
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using graphtools::Graph;
+
+using std::string;
+using std::vector;
+
+using namespace testing;
+using namespace common;
+
+class CompositeAlignerTest : public Test
+{
+public:
+    Graph graph{ 4 };
+    std::list<graphtools::Path> paths;
+    unsigned seed = 7;
+
+    unsigned random()
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    }
+
+    string randomSequence(size_t length)
+    {
+        string sequence;
+        for (size_t i = 0; i < length; ++i)
+        {
+            sequence += "ACGT"[random() & 3];
+        }
+        return sequence;
+    }
+
+    void SetUp() override
+    {
+        graph.setNodeName(0, "LF");
+        graph.setNodeSeq(0, randomSequence(500));
+        graph.setNodeName(1, "REF");
+        graph.setNodeSeq(1, randomSequence(20));
+        graph.setNodeName(2, "ALT");
+        graph.setNodeSeq(2, randomSequence(50));
+        graph.setNodeName(3, "RF");
+        graph.setNodeSeq(3, randomSequence(500));
+        graph.addEdge(0, 1);
+        graph.addEdge(0, 2);
+        graph.addEdge(1, 3);
+        graph.addEdge(2, 3);
+    }
+
+    /**
+     * Align the reads with the path aligner and gssw, once in fixed order and once with adaptive stages. The
+     * adaptive aligner charges gssw 20 times the cost of the path aligner
+     * @return the adaptive aligner
+     */
+    grm::CompositeAligner alignBothWays(vector<string> const& sequences)
+    {
+        grm::StageLimits limits;
+        limits.window = 20;
+        limits.probeInterval = 5;
+        grm::CompositeAligner fixed(true, true, false, false);
+        grm::CompositeAligner adaptive(true, true, false, false, grm::GraphAligner::AF_ALL, false, limits);
+        adaptive.setStageCosts({ { 0.01, 0.01, 0.05, 0.2 } });
+        fixed.setGraph(&graph, paths);
+        adaptive.setGraph(&graph, paths);
+        for (auto const& sequence : sequences)
+        {
+            Read fixedRead("r", sequence, string(sequence.size(), '#'));
+            Read adaptiveRead(fixedRead);
+            fixed.alignRead(fixedRead, nullptr);
+            adaptive.alignRead(adaptiveRead, nullptr);
+            EXPECT_EQ(fixedRead.toJson(), adaptiveRead.toJson());
+        }
+        EXPECT_EQ(sequences.size(), adaptive.attempted());
+        EXPECT_EQ(sequences.size(), adaptive.stageStats(grm::CompositeAligner::GRAPH_STAGE).attempted
+                      + adaptive.stageStats(grm::CompositeAligner::PATH_STAGE).mapped);
+        return adaptive;
+    }
+};
+
+TEST_F(CompositeAlignerTest, SkipsStagesThatDoNotMapReads)
+{
+    // after failing on 79 reads, the path aligner would save less gssw time than it costs even if it mapped 3 / 79
+    // of the reads. The decision at read 80 skips it for all but every fifth read after that
+    vector<string> sequences;
+    for (int i = 0; i < 200; ++i)
+    {
+        sequences.push_back(randomSequence(100));
+    }
+
+    const grm::CompositeAligner aligner = alignBothWays(sequences);
+    grm::CompositeAligner::StageStats const& path = aligner.stageStats(grm::CompositeAligner::PATH_STAGE);
+    ASSERT_TRUE(aligner.skipping(grm::CompositeAligner::PATH_STAGE));
+    ASSERT_EQ(1u, aligner.stageDecisions());
+    ASSERT_EQ(0u, path.mapped);
+    ASSERT_EQ(79u + 25u, path.attempted);
+    ASSERT_EQ(sequences.size(), path.attempted + path.skipped);
+}
+
+TEST_F(CompositeAlignerTest, KeepsStagesThatMapReads)
+{
+    const string haplotype = graph.nodeSeq(0) + graph.nodeSeq(2) + graph.nodeSeq(3);
+    vector<string> sequences;
+    for (int i = 0; i < 200; ++i)
+    {
+        sequences.push_back(i % 4 ? haplotype.substr(random() % (haplotype.size() - 100), 100) : randomSequence(100));
+    }
+
+    const grm::CompositeAligner aligner = alignBothWays(sequences);
+    grm::CompositeAligner::StageStats const& path = aligner.stageStats(grm::CompositeAligner::PATH_STAGE);
+    ASSERT_FALSE(aligner.skipping(grm::CompositeAligner::PATH_STAGE));
+    ASSERT_EQ(0u, aligner.stageDecisions());
+    ASSERT_EQ(sequences.size(), path.attempted);
+    ASSERT_EQ(0u, path.skipped);
+    ASSERT_EQ(150u, path.mapped);
+}
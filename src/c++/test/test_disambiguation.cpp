@@ -28,12 +28,16 @@
 #include "grm/Align.hh"
 #include "grm/GraphAligner.hh"
 #include "grm/GraphInput.hh"
+#include "graphalign/KmerIndex.hh"
+#include "graphutils/SequenceOperations.hh"
 #include "paragraph/Disambiguation.hh"
 #include "paragraph/GraphVariants.hh"
 
 #include "gtest/gtest.h"
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -110,4 +114,225 @@ TEST_F(DisambiguationTest, DisambiguatesReads)
     ASSERT_EQ(0ull, reads[2]->graph_sequences_supported().size());
     ASSERT_EQ(1ull, reads[3]->graph_sequences_supported().size());
     ASSERT_EQ("D", reads[3]->graph_sequences_supported(0));
-}
\ No newline at end of file
+}
+TEST_F(DisambiguationTest, AlignsDuplicateReadsLikeSingleReads)
+{
+    // duplicates with different quals and strands, some of which align to the reverse strand
+    const vector<string> sequences = { "AAAAAAAAAATTTTTTTTTTTTTTTTTTTTAAAAAAAAAA",
+                                       "TTTTTTTTTTAAAAAAAAAAAAAAAAAAAATTTTTTTTTT", "TTTTTTTTTTTTTTTTTTTTTTTTTCCCCC" };
+    ReadBuffer duplicates;
+    for (int i = 0; i < 12; ++i)
+    {
+        string quals;
+        for (size_t j = 0; j < sequences[i % 3].size(); ++j)
+        {
+            quals += (char)('#' + (i * 7 + j * 3) % 40);
+        }
+        duplicates.emplace_back(new Read("d" + std::to_string(i), sequences[i % 3], quals));
+        duplicates.back()->set_is_reverse_strand(i % 4 == 1);
+    }
+
+    // filter out clipped alignments, which leaves the reads of one sequence unmapped
+    typedef map<string, vector<string>> FilterCalls;
+    auto recordingFilter = [](FilterCalls& calls) -> ReadFilter {
+        return [&calls](Read& read) -> bool {
+            calls[read.fragment_id()].push_back(read.graph_cigar() + " " + read.bases() + " " + read.quals());
+            return read.graph_cigar().find('S') != string::npos;
+        };
+    };
+
+    std::list<Path> paths;
+    ReadBuffer single_reads;
+    FilterCalls single_calls;
+    for (auto const& read : duplicates)
+    {
+        ReadBuffer single;
+        single.emplace_back(new Read(*read));
+        ASSERT_EQ(1ull, grm::alignReads(
+                            &graph, paths, single, recordingFilter(single_calls), false, true, true, true, false));
+        std::move(single.begin(), single.end(), std::back_inserter(single_reads));
+    }
+
+    // three sequences, each on both strands
+    FilterCalls calls;
+    ASSERT_EQ(6ull, grm::alignReads(&graph, paths, duplicates, recordingFilter(calls), false, true, true, true, false));
+
+    ASSERT_EQ(single_calls, calls);
+    ASSERT_EQ(8ull, single_reads.size());
+    ASSERT_EQ(single_reads.size(), duplicates.size());
+    std::map<string, Json::Value> single_alignments;
+    for (auto const& read : single_reads)
+    {
+        single_alignments[read->fragment_id()] = read->toJson();
+    }
+    for (auto const& read : duplicates)
+    {
+        ASSERT_EQ(single_alignments[read->fragment_id()], read->toJson());
+    }
+}
+
+TEST_F(DisambiguationTest, AlignsCachedSequencesLikeNewOnes)
+{
+    auto makeReads = [](std::size_t sample) {
+        const vector<string> sequences = { "AAAAAAAAAATTTTTTTTTTTTTTTTTTTTAAAAAAAAAA",
+                                           "TTTTTTTTTTAAAAAAAAAAAAAAAAAAAATTTTTTTTTT",
+                                           "TTTTTTTTTTTTTTTTTTTTTTTTTCCCCC" };
+        ReadBuffer reads;
+        for (std::size_t i = 0; i < 5; ++i)
+        {
+            string quals;
+            for (size_t j = 0; j < sequences[(i + sample) % 3].size(); ++j)
+            {
+                quals += (char)('#' + (i * 11 + j * 5 + sample) % 40);
+            }
+            reads.emplace_back(new Read("s" + std::to_string(i), sequences[(i + sample) % 3], quals));
+            reads.back()->set_is_reverse_strand(i == 3);
+        }
+        return reads;
+    };
+
+    typedef vector<string> FilterCalls;
+    auto recordingFilter = [](FilterCalls& calls) -> ReadFilter {
+        return [&calls](Read& read) -> bool {
+            calls.push_back(read.fragment_id() + " " + read.graph_cigar() + " " + read.bases() + " " + read.quals());
+            return read.graph_cigar().find('S') != string::npos;
+        };
+    };
+
+    std::list<Path> paths;
+    AlignmentCache cache(1 << 20);
+    for (std::size_t sample = 0; sample < 3; ++sample)
+    {
+        ReadBuffer uncached_reads = makeReads(sample);
+        FilterCalls uncached_calls;
+        grm::alignReads(
+            &graph, paths, uncached_reads, recordingFilter(uncached_calls), false, true, true, true, false);
+
+        ReadBuffer cached_reads = makeReads(sample);
+        FilterCalls cached_calls;
+        grm::alignReads(
+            &graph, paths, cached_reads, recordingFilter(cached_calls), false, true, true, true, false, 1, &cache);
+
+        std::sort(uncached_calls.begin(), uncached_calls.end());
+        std::sort(cached_calls.begin(), cached_calls.end());
+        ASSERT_EQ(uncached_calls, cached_calls);
+        ASSERT_EQ(uncached_reads.size(), cached_reads.size());
+        for (std::size_t i = 0; i < cached_reads.size(); ++i)
+        {
+            ASSERT_EQ(uncached_reads[i]->toJson(), cached_reads[i]->toJson());
+        }
+    }
+    // each sample has four distinct sequences, of which the later samples have seen all but one
+    ASSERT_EQ(6ull, cache.entries());
+    ASSERT_EQ(12ull, cache.lookups());
+    ASSERT_EQ(6ull, cache.hits());
+}
+
+TEST(KmerDisambiguation, SupportsAlignedEdgesAndSequences)
+{
+    std::mt19937 rng(42);
+    auto randomSequence = [&rng](size_t length) {
+        string sequence;
+        for (size_t i = 0; i < length; ++i)
+        {
+            sequence += "ACGT"[rng() % 4];
+        }
+        return sequence;
+    };
+
+    /**
+     * LF--REF-->RF
+     *  |  ALT   |
+     *  >--------^ (deletion)
+     */
+    Graph graph(4);
+    const vector<string> names = { "LF", "REF", "ALT", "RF" };
+    const vector<string> sequences = { randomSequence(300), randomSequence(40), randomSequence(25), randomSequence(300) };
+    for (NodeId node_id = 0; node_id != 4; ++node_id)
+    {
+        graph.setNodeName(node_id, names[node_id]);
+        graph.setNodeSeq(node_id, sequences[node_id]);
+    }
+    graph.addEdge(0, 1);
+    graph.addEdge(0, 2);
+    graph.addEdge(0, 3);
+    graph.addEdge(1, 3);
+    graph.addEdge(2, 3);
+    graph.addLabelToEdge(0, 1, "REF");
+    graph.addLabelToEdge(1, 3, "REF");
+    graph.addLabelToEdge(0, 2, "ALT");
+    graph.addLabelToEdge(2, 3, "ALT");
+    graph.addLabelToEdge(0, 3, "DEL");
+
+    // error-free reads from all alleles on both strands
+    ReadBuffer aligned_reads;
+    ReadBuffer kmer_reads;
+    const vector<string> haplotypes = { sequences[0] + sequences[1] + sequences[3],
+                                        sequences[0] + sequences[2] + sequences[3], sequences[0] + sequences[3] };
+    for (int i = 0; i < 300; ++i)
+    {
+        string const& haplotype = haplotypes[i % 3];
+        string bases = haplotype.substr(rng() % (haplotype.size() - 100), 100);
+        if (i % 2)
+        {
+            bases = reverseComplement(bases);
+        }
+        aligned_reads.emplace_back(new Read("r" + std::to_string(i), bases, string(bases.size(), '#')));
+        kmer_reads.emplace_back(new Read(*aligned_reads.back()));
+    }
+    // a read joining REF and ALT does not lie on one path
+    const string chimera = sequences[1] + sequences[2] + sequences[3].substr(0, 35);
+    kmer_reads.emplace_back(new Read("chimera", chimera, string(chimera.size(), '#')));
+    const string foreign = randomSequence(100);
+    kmer_reads.emplace_back(new Read("foreign", foreign, string(foreign.size(), '#')));
+
+    LOG()->set_level(spdlog::level::err);
+    common::CPU_THREADS().reset(1);
+    std::list<Path> paths;
+    grm::alignReads(&graph, paths, aligned_reads, nullptr, false, true, false, false, false);
+    // minimum node overlap of the edge filter in paragraph::alignAndDisambiguate
+    auto edgefilter = [&graph](Read& read, NodeId node_id1, NodeId node_id2) -> bool {
+        GraphAlignment const& alignment = read.graph_alignment(&graph);
+        const auto min_node_overlap = static_cast<uint32_t>(read.bases().size() / 10 + 1);
+        for (size_t index = 1; index < alignment.size(); ++index)
+        {
+            if (alignment.getNodeIdByIndex(index - 1) == node_id1 && alignment.getNodeIdByIndex(index) == node_id2)
+            {
+                return alignment[index - 1].numMatched()
+                    >= std::min<uint32_t>(graph.nodeSeq(node_id1).size(), min_node_overlap)
+                    && alignment[index].numMatched()
+                    >= std::min<uint32_t>(graph.nodeSeq(node_id2).size(), min_node_overlap);
+            }
+        }
+        return false;
+    };
+    paragraph::disambiguateReads(&graph, aligned_reads, nullptr, edgefilter);
+    map<string, string> filtered;
+    paragraph::disambiguateReadsByKmers(
+        &graph, kmer_reads, KmerIndex(graph, 20), 0,
+        [&filtered](Read& read, string const& reason) { filtered[read.fragment_id()] = reason; });
+
+    ASSERT_EQ(aligned_reads.size(), kmer_reads.size());
+    map<string, Read const*> kmer_reads_by_id;
+    for (auto const& read : kmer_reads)
+    {
+        kmer_reads_by_id[read->fragment_id()] = read.get();
+    }
+    int supported_sequences = 0;
+    for (auto const& aligned_read : aligned_reads)
+    {
+        Read const& kmer_read = *kmer_reads_by_id.at(aligned_read->fragment_id());
+        ASSERT_EQ(aligned_read->graph_nodes_supported(), kmer_read.graph_nodes_supported())
+            << aligned_read->graph_cigar();
+        ASSERT_EQ(aligned_read->graph_edges_supported(), kmer_read.graph_edges_supported())
+            << aligned_read->graph_cigar();
+        ASSERT_EQ(aligned_read->graph_sequences_supported(), kmer_read.graph_sequences_supported())
+            << aligned_read->graph_cigar();
+        ASSERT_EQ(aligned_read->is_graph_reverse_strand(), kmer_read.is_graph_reverse_strand());
+        supported_sequences += kmer_read.graph_sequences_supported().size();
+    }
+    ASSERT_LT(30, supported_sequences);
+    ASSERT_EQ(0ull, kmer_reads_by_id.count("chimera"));
+    ASSERT_EQ(0ull, kmer_reads_by_id.count("foreign"));
+    ASSERT_EQ((map<string, string>{ { "chimera", "kmer_ambiguous" }, { "foreign", "bad_align" } }), filtered);
+}
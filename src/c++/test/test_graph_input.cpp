@@ -113,6 +113,27 @@ TEST(Graph, LoadsGraphWithMultiNode)
     }
 }
 
+TEST(Graph, ReadsNodeReferences)
+{
+    const string graph_spec_path = g_testenv->getBasePath() + "/../share/test-data/basic/del-with-ref-node-array.json";
+
+    Json::Value root = getJsonRoot(graph_spec_path);
+    const std::vector<NodeReference> references = referencesFromJson(root);
+
+    ASSERT_EQ(references.size(), (size_t)6);
+    EXPECT_EQ(references[0].node, (NodeId)0);
+    EXPECT_EQ(references[0].chrom, "MultipleRefLocations");
+    EXPECT_EQ(references[0].start, 0);
+    EXPECT_EQ(references[0].end, 39);
+    for (size_t i = 1; i != 4; ++i)
+    {
+        EXPECT_EQ(references[i].node, (NodeId)1);
+    }
+    EXPECT_EQ(references[3].start, 100);
+    EXPECT_EQ(references[3].end, 119);
+    EXPECT_EQ(references[5].node, (NodeId)3);
+}
+
 TEST(Graph, NoReferenceOrSequenceNodeIdDeathTest)
 {
     const string graph_spec_path
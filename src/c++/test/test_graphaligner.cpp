@@ -0,0 +1,187 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphcore/Graph.hh"
+#include "graphutils/SequenceOperations.hh"
+#include "grm/GraphAligner.hh"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using graphtools::Graph;
+
+using std::string;
+using std::vector;
+
+using namespace testing;
+using namespace common;
+
+class GraphAlignerTest : public Test
+{
+public:
+    Graph graph{ 4 };
+    unsigned seed = 7;
+
+    unsigned random()
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    }
+
+    /**
+     * Deletion and insertion alleles between 1 kb flanks. The first 60 bases of the left flank repeat at the start
+     * of the right flank
+     */
+    void SetUp() override
+    {
+        string flanks[2];
+        for (auto& flank : flanks)
+        {
+            for (int i = 0; i < 1000; ++i)
+            {
+                flank += "ACGT"[random() & 3];
+            }
+        }
+        flanks[1].replace(0, 60, flanks[0].substr(0, 60));
+
+        graph.setNodeName(0, "LF");
+        graph.setNodeSeq(0, flanks[0]);
+        graph.setNodeName(1, "REF");
+        graph.setNodeSeq(1, "GATTACA");
+        graph.setNodeName(2, "ALT");
+        graph.setNodeSeq(2, "GATTACAGATTACAGATTACAGATTACAGA");
+        graph.setNodeName(3, "RF");
+        graph.setNodeSeq(3, flanks[1]);
+        graph.addEdge(0, 1);
+        graph.addEdge(0, 2);
+        graph.addEdge(1, 3);
+        graph.addEdge(2, 3);
+        graph.addEdge(0, 3);
+    }
+};
+
+TEST_F(GraphAlignerTest, SeededAlignmentMatchesWholeGraph)
+{
+    const string sequences[] = { graph.nodeSeq(0) + graph.nodeSeq(1) + graph.nodeSeq(3),
+                                 graph.nodeSeq(0) + graph.nodeSeq(2) + graph.nodeSeq(3),
+                                 graph.nodeSeq(0) + graph.nodeSeq(3) };
+
+    grm::GraphAligner aligner;
+    aligner.setGraph(&graph);
+    for (int i = 0; i < 60; ++i)
+    {
+        const string& sequence = sequences[i % 3];
+        const std::size_t length = 60 + random() % 90;
+        const std::size_t start = i % 4 ? 900 + random() % 100 : random() % (sequence.size() - length);
+        string bases = sequence.substr(start, length);
+        bases[random() % length] = "ACGT"[random() & 3];
+        if (i % 5 == 0)
+        {
+            bases.erase(random() % length, 3);
+        }
+        if (i % 7 == 0)
+        {
+            bases.insert(random() % length, "TTT");
+        }
+        if (i % 2)
+        {
+            bases = graphtools::reverseComplement(bases);
+        }
+
+        Read seeded;
+        seeded.setCoreInfo("read" + std::to_string(i), bases, string(bases.size(), '#'));
+        Read whole = seeded;
+        aligner.alignRead(seeded, grm::GraphAligner::AF_ALL | grm::GraphAligner::AF_SEEDED);
+        aligner.alignRead(whole);
+
+        ASSERT_EQ(whole.graph_cigar(), seeded.graph_cigar()) << bases;
+        ASSERT_EQ(whole.graph_pos(), seeded.graph_pos()) << bases;
+        ASSERT_EQ(whole.graph_alignment_score(), seeded.graph_alignment_score()) << bases;
+        ASSERT_EQ(whole.graph_mapq(), seeded.graph_mapq()) << bases;
+        ASSERT_EQ(whole.is_graph_reverse_strand(), seeded.is_graph_reverse_strand()) << bases;
+    }
+}
+
+TEST_F(GraphAlignerTest, DetectsTopAlignmentsAtMultipleNodes)
+{
+    grm::GraphAligner aligner;
+    aligner.setGraph(&graph);
+    // single strand: with both strands, a unique alignment of the other strand would be preferred to the repeat
+    const unsigned single_strand = grm::GraphAligner::AF_ALL & ~grm::GraphAligner::AF_BOTH_STRANDS;
+    for (const unsigned flags : { single_strand | grm::GraphAligner::AF_SEEDED, single_strand })
+    {
+        Read repeat;
+        repeat.setCoreInfo("repeat", graph.nodeSeq(0).substr(0, 50), string(50, '#'));
+        aligner.alignRead(repeat, flags);
+        ASSERT_EQ(50, repeat.graph_alignment_score());
+        ASSERT_FALSE(repeat.is_graph_alignment_unique());
+        ASSERT_EQ(0, repeat.graph_mapq());
+
+        Read unique;
+        unique.setCoreInfo("unique", graph.nodeSeq(0).substr(100, 50), string(50, '#'));
+        aligner.alignRead(unique, flags);
+        ASSERT_EQ(50, unique.graph_alignment_score());
+        ASSERT_EQ("0[50M]", unique.graph_cigar());
+        ASSERT_EQ(100, unique.graph_pos());
+        ASSERT_TRUE(unique.is_graph_alignment_unique());
+        ASSERT_EQ(60, unique.graph_mapq());
+    }
+}
+
+TEST_F(GraphAlignerTest, DetectsTopAlignmentsWithoutSeeds)
+{
+    // two copies of a read with three mismatches each: only the one in LF has a 16-mer seed
+    string read;
+    for (int i = 0; i < 60; ++i)
+    {
+        read += "ACGT"[random() & 3];
+    }
+    auto with_mismatches = [&read](std::initializer_list<int> positions) {
+        string copy = read;
+        for (const int position : positions)
+        {
+            copy[position] = copy[position] == 'A' ? 'C' : 'A';
+        }
+        return copy;
+    };
+    string left_flank = graph.nodeSeq(0);
+    left_flank.replace(300, 60, with_mismatches({ 10, 40, 55 }));
+    graph.setNodeSeq(0, left_flank);
+    string right_flank = graph.nodeSeq(3);
+    right_flank.replace(500, 60, with_mismatches({ 15, 30, 45 }));
+    graph.setNodeSeq(3, right_flank);
+
+    grm::GraphAligner aligner;
+    aligner.setGraph(&graph);
+    Read tie;
+    tie.setCoreInfo("tie", read, string(read.size(), '#'));
+    aligner.alignRead(tie, grm::GraphAligner::AF_ALL & ~grm::GraphAligner::AF_BOTH_STRANDS);
+    ASSERT_EQ(45, tie.graph_alignment_score());
+    ASSERT_FALSE(tie.is_graph_alignment_unique());
+    ASSERT_EQ(0, tie.graph_mapq());
+}
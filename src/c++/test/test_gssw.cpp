@@ -0,0 +1,224 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "gssw.h"
+}
+
+using std::string;
+using std::vector;
+
+using namespace testing;
+
+/**
+ * Fills and traces back random graphs and reads in different ways and checks that the results are bit-identical
+ */
+class GsswTest : public Test
+{
+public:
+    unsigned seed = 19;
+
+    unsigned random()
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    }
+
+    string randomSequence(size_t length)
+    {
+        string sequence;
+        for (size_t i = 0; i < length; ++i)
+        {
+            sequence += random() % 50 ? "ACGT"[random() & 3] : 'N';
+        }
+        return sequence;
+    }
+
+    /** read and LF -> (REF | ALT) -> RF graph, optionally with a deletion edge LF -> RF */
+    struct Problem
+    {
+        vector<string> sequences;
+        bool deletion_edge;
+        string read;
+        int match;
+        int mismatch;
+        int gap_open;
+        int gap_extend;
+    };
+
+    Problem randomProblem()
+    {
+        Problem problem;
+        problem.match = 1 + random() % 4;
+        problem.mismatch = 1 + random() % 5;
+        problem.gap_open = 1 + random() % 8;
+        problem.gap_extend = std::min<int>(1 + random() % 3, problem.gap_open);
+        problem.sequences = { randomSequence(1 + random() % 400), randomSequence(1 + random() % 40),
+                              randomSequence(1 + random() % 80), randomSequence(1 + random() % 400) };
+        problem.deletion_edge = random() % 2;
+
+        // mostly true sequence with errors, long enough for some reads to need 16 bit scores
+        const string path = problem.sequences[0] + problem.sequences[1 + random() % 2] + problem.sequences[3];
+        const size_t length = std::min<size_t>(1 + random() % (random() % 3 ? 150 : 300), path.size());
+        const size_t start = random() % (path.size() - length + 1);
+        problem.read = path.substr(start, length);
+        for (auto& base : problem.read)
+        {
+            if (random() % 30 == 0)
+            {
+                base = "ACGT"[random() & 3];
+            }
+        }
+        return problem;
+    }
+
+    struct Result
+    {
+        vector<int8_t> matrices;
+        vector<int> summaries;
+        vector<string> cigars;
+    };
+
+    static Result align(Problem const& problem)
+    {
+        vector<string> const& sequences = problem.sequences;
+        string const& read = problem.read;
+        int8_t* nt_table = gssw_create_nt_table();
+        int8_t* matrix = gssw_create_score_matrix(problem.match, problem.mismatch);
+        gssw_graph* graph = gssw_graph_create(sequences.size());
+        vector<gssw_node*> nodes;
+        for (size_t i = 0; i < sequences.size(); ++i)
+        {
+            nodes.push_back(gssw_node_create(nullptr, i, sequences[i].c_str(), nt_table, matrix));
+            gssw_graph_add_node(graph, nodes.back());
+        }
+        gssw_nodes_add_edge(nodes[0], nodes[1]);
+        gssw_nodes_add_edge(nodes[0], nodes[2]);
+        gssw_nodes_add_edge(nodes[1], nodes[3]);
+        gssw_nodes_add_edge(nodes[2], nodes[3]);
+        if (problem.deletion_edge)
+        {
+            gssw_nodes_add_edge(nodes[0], nodes[3]);
+        }
+
+        gssw_graph_fill(graph, read.c_str(), nt_table, matrix, problem.gap_open, problem.gap_extend, 15, 2);
+        gssw_graph_mapping* mapping = gssw_graph_trace_back(
+            graph, read.c_str(), read.size(), nt_table, matrix, problem.gap_open, problem.gap_extend);
+
+        Result result;
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            gssw_align* alignment = nodes[i]->alignment;
+            const size_t value_size = alignment->is_byte ? 1 : 2;
+            const size_t segment_bytes = (read.size() * value_size + 15) / 16 * 16;
+            const size_t matrix_bytes = read.size() * sequences[i].size() * value_size;
+            for (void* values : { alignment->mH, alignment->mE, alignment->mF })
+            {
+                result.matrices.insert(
+                    result.matrices.end(), (int8_t*)values, (int8_t*)values + matrix_bytes);
+            }
+            for (void* values : { (void*)alignment->seed.pvE, (void*)alignment->seed.pvHStore })
+            {
+                result.matrices.insert(result.matrices.end(), (int8_t*)values, (int8_t*)values + segment_bytes);
+            }
+            result.summaries.insert(
+                result.summaries.end(),
+                { alignment->is_byte, alignment->score1, alignment->ref_end1, alignment->read_end1 });
+        }
+        result.summaries.insert(result.summaries.end(), { mapping->position, mapping->score });
+        for (uint32_t i = 0; i < mapping->cigar.length; ++i)
+        {
+            gssw_node_cigar const& node_cigar = mapping->cigar.elements[i];
+            string cigar = std::to_string(node_cigar.node->id) + ":";
+            for (int j = 0; j < node_cigar.cigar->length; ++j)
+            {
+                cigar += std::to_string(node_cigar.cigar->elements[j].length) + node_cigar.cigar->elements[j].type;
+            }
+            result.cigars.push_back(cigar);
+        }
+
+        gssw_graph_mapping_destroy(mapping);
+        gssw_graph_destroy(graph);
+        free(matrix);
+        free(nt_table);
+        return result;
+    }
+
+    void TearDown() override { gssw_set_simd(GSSW_SIMD_AVX2); }
+};
+
+TEST_F(GsswTest, Avx2MatchesSse2)
+{
+    if (gssw_set_simd(GSSW_SIMD_AVX2) != GSSW_SIMD_AVX2)
+    {
+        return;
+    }
+
+    int word_alignments = 0;
+    for (int iteration = 0; iteration < 200; ++iteration)
+    {
+        const Problem problem = randomProblem();
+        gssw_set_simd(GSSW_SIMD_SSE2);
+        const Result sse2 = align(problem);
+        gssw_set_simd(GSSW_SIMD_AVX2);
+        const Result avx2 = align(problem);
+
+        ASSERT_EQ(sse2.summaries, avx2.summaries) << "iteration " << iteration;
+        ASSERT_EQ(sse2.cigars, avx2.cigars) << "iteration " << iteration;
+        ASSERT_TRUE(sse2.matrices == avx2.matrices) << "iteration " << iteration;
+        for (size_t i = 0; i < problem.sequences.size(); ++i)
+        {
+            word_alignments += !sse2.summaries[4 * i];
+        }
+    }
+    ASSERT_LT(0, word_alignments);
+}
+
+TEST_F(GsswTest, ArenaMatchesHeap)
+{
+    gssw_arena* arena = gssw_arena_create();
+    for (int iteration = 0; iteration < 100; ++iteration)
+    {
+        const Problem problem = randomProblem();
+        const Result heap = align(problem);
+        ASSERT_EQ(nullptr, gssw_arena_use(arena));
+        const Result scratch = align(problem);
+        ASSERT_EQ(arena, gssw_arena_use(nullptr));
+        gssw_arena_reset(arena);
+
+        ASSERT_EQ(heap.summaries, scratch.summaries) << "iteration " << iteration;
+        ASSERT_EQ(heap.cigars, scratch.cigars) << "iteration " << iteration;
+        ASSERT_TRUE(heap.matrices == scratch.matrices) << "iteration " << iteration;
+    }
+    gssw_arena_destroy(arena);
+}
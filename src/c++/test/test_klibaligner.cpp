@@ -26,6 +26,7 @@
 
 #include "common/JsonHelpers.hh"
 #include "common/ReadReader.hh"
+#include "graphutils/SequenceOperations.hh"
 #include "grm/KlibAligner.hh"
 #include "paragraph/Disambiguation.hh"
 
@@ -193,8 +194,157 @@ TEST_F(KlibAlignerTest, Aligns)
 
     for (auto const& read : reads)
     {
-        const std::string str = common::writeJson(read.toJson(), false);
+        const std::string str = common::writeJson(read.toJson(&graph), false);
         // std::cerr << str << std::endl;
         ASSERT_EQ(expected[i++], str);
     }
 }
+
+TEST(KlibAligner, AlignsWithinLongFlanks)
+{
+    std::string flanks[2];
+    unsigned seed = 7;
+    for (auto& flank : flanks)
+    {
+        for (int i = 0; i < 2000; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            flank += "ACGT"[(seed >> 16) & 3];
+        }
+    }
+
+    Graph graph{ 3 };
+    graph.setNodeName(0, "LF");
+    graph.setNodeSeq(0, flanks[0]);
+    graph.setNodeName(1, "ALT");
+    graph.setNodeSeq(1, "GATTACAGATTACAGATTACAGATTACAGA");
+    graph.setNodeName(2, "RF");
+    graph.setNodeSeq(2, flanks[1]);
+    graph.addEdge(0, 1);
+    graph.addEdge(1, 2);
+
+    auto paths = Json::Value(Json::arrayValue);
+    auto alt_path = Json::Value(Json::objectValue);
+    alt_path["path_id"] = "ALT|1";
+    alt_path["sequence"] = "ALT";
+    alt_path["nodes"] = Json::Value(Json::arrayValue);
+    alt_path["nodes"].append("LF");
+    alt_path["nodes"].append("ALT");
+    alt_path["nodes"].append("RF");
+    paths.append(alt_path);
+
+    grm::KlibAligner aligner;
+    const std::list<graphtools::Path> grmPaths = grm::pathsFromJson(&graph, paths);
+    aligner.setGraph(&graph, grmPaths);
+
+    const std::string bases = flanks[0].substr(1940) + graph.nodeSeq(1) + flanks[1].substr(0, 60);
+    Read read;
+    read.setCoreInfo("long-flanks", bases, std::string(bases.size(), '#'));
+    aligner.alignRead(read);
+
+    ASSERT_EQ(Read::MAPPED, read.graph_mapping_status());
+    ASSERT_EQ(1940, read.graph_pos());
+    ASSERT_EQ("0[60M]1[30M]2[60M]", read.graph_cigar());
+    ASSERT_FALSE(read.is_graph_reverse_strand());
+}
+
+TEST(KlibAligner, AlignsBatchLikeSingleReads)
+{
+    std::string flanks[2];
+    unsigned seed = 11;
+    const auto random = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    };
+    for (auto& flank : flanks)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            flank += "ACGT"[random() & 3];
+        }
+    }
+
+    Graph graph{ 4 };
+    graph.setNodeName(0, "LF");
+    graph.setNodeSeq(0, flanks[0]);
+    graph.setNodeName(1, "REF");
+    graph.setNodeSeq(1, "GATTACA");
+    graph.setNodeName(2, "ALT");
+    graph.setNodeSeq(2, "GATTACAGATTACAGATTACAGATTACAGA");
+    graph.setNodeName(3, "RF");
+    graph.setNodeSeq(3, flanks[1]);
+    graph.addEdge(0, 1);
+    graph.addEdge(0, 2);
+    graph.addEdge(1, 3);
+    graph.addEdge(2, 3);
+
+    auto paths = Json::Value(Json::arrayValue);
+    for (const std::string allele : { "REF", "ALT" })
+    {
+        auto path = Json::Value(Json::objectValue);
+        path["path_id"] = allele + "|1";
+        path["sequence"] = allele;
+        path["nodes"] = Json::Value(Json::arrayValue);
+        path["nodes"].append("LF");
+        path["nodes"].append(allele);
+        path["nodes"].append("RF");
+        paths.append(path);
+    }
+    const std::list<graphtools::Path> grmPaths = grm::pathsFromJson(&graph, paths);
+
+    // reads of different lengths from both paths and strands, with mismatches, indels and without any seed
+    vector<Read> reads;
+    for (int i = 0; i < 50; ++i)
+    {
+        const std::string& pathSequence = (i % 2 ? grmPaths.front() : grmPaths.back()).seq();
+        const std::size_t length = 60 + random() % 90;
+        std::string bases = pathSequence.substr(random() % (pathSequence.size() - length), length);
+        bases[random() % length] = 'N';
+        bases[random() % length] = "ACGT"[random() & 3];
+        if (i % 5 == 0)
+        {
+            bases.erase(random() % length, 3);
+        }
+        if (i % 7 == 0)
+        {
+            bases.insert(random() % length, "TTT");
+        }
+        if (i % 3 == 0)
+        {
+            bases = graphtools::reverseComplement(bases);
+        }
+        if (i % 11 == 0)
+        {
+            for (auto& base : bases)
+            {
+                base = "ACGT"[random() & 3];
+            }
+        }
+        reads.emplace_back();
+        reads.back().setCoreInfo("read" + std::to_string(i), bases, std::string(bases.size(), '#'));
+    }
+
+    vector<Read> batchReads = reads;
+    vector<Read*> batch;
+    for (auto& read : batchReads)
+    {
+        batch.push_back(&read);
+    }
+
+    grm::KlibAligner aligner;
+    aligner.setGraph(&graph, grmPaths);
+    for (auto& read : reads)
+    {
+        aligner.alignRead(read);
+    }
+    grm::KlibAligner batchAligner;
+    batchAligner.setGraph(&graph, grmPaths);
+    batchAligner.alignReads(batch);
+
+    ASSERT_EQ(aligner.attempted(), batchAligner.attempted());
+    ASSERT_EQ(aligner.mapped(), batchAligner.mapped());
+    for (std::size_t i = 0; i < reads.size(); ++i)
+    {
+        ASSERT_EQ(common::writeJson(reads[i].toJson(), false), common::writeJson(batchReads[i].toJson(), false));
+    }
+}
@@ -193,7 +193,7 @@ TEST_F(KmerAlignerTest, Aligns)
 
     for (auto const& read : reads)
     {
-        const std::string str = common::writeJson(read.toJson(), false);
+        const std::string str = common::writeJson(read.toJson(&graph), false);
         // std::cerr << str << std::endl;
         ASSERT_EQ(expected[i++], str);
     }
@@ -0,0 +1,164 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphcore/Graph.hh"
+#include "grm/GraphAligner.hh"
+#include "grm/GraphInput.hh"
+#include "grm/LinearAligner.hh"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using graphtools::Graph;
+
+using std::string;
+using std::vector;
+
+using namespace testing;
+using namespace common;
+
+class LinearAlignerTest : public Test
+{
+public:
+    Graph graph{ 4 };
+    vector<grm::NodeReference> references;
+    unsigned seed = 11;
+
+    unsigned random()
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    }
+
+    /**
+     * Deletion and insertion alleles between 1 kb flanks at chr1:1001-2000 and chr1:2008-3007. The first 60 bases of
+     * the left flank repeat at the start of the right flank
+     */
+    void SetUp() override
+    {
+        string flanks[2];
+        for (auto& flank : flanks)
+        {
+            for (int i = 0; i < 1000; ++i)
+            {
+                flank += "ACGT"[random() & 3];
+            }
+        }
+        flanks[1].replace(0, 60, flanks[0].substr(0, 60));
+
+        graph.setNodeName(0, "LF");
+        graph.setNodeSeq(0, flanks[0]);
+        graph.setNodeName(1, "REF");
+        graph.setNodeSeq(1, "GATTACA");
+        graph.setNodeName(2, "ALT");
+        graph.setNodeSeq(2, "GATTACAGATTACAGATTACAGATTACAGA");
+        graph.setNodeName(3, "RF");
+        graph.setNodeSeq(3, flanks[1]);
+        graph.addEdge(0, 1);
+        graph.addEdge(0, 2);
+        graph.addEdge(1, 3);
+        graph.addEdge(2, 3);
+        graph.addEdge(0, 3);
+
+        references = { { 0, "chr1", 1000, 1999 }, { 1, "chr1", 2000, 2006 }, { 3, "chr1", 2007, 3006 } };
+    }
+
+    /** reference sequence of chr1:1001-3007 */
+    string reference() const { return graph.nodeSeq(0) + graph.nodeSeq(1) + graph.nodeSeq(3); }
+
+    static Read makeRead(string const& bases, int32_t pos, bool reverse_strand)
+    {
+        Read read;
+        read.setCoreInfo("read", bases, string(bases.size(), '#'));
+        read.set_pos(pos);
+        read.set_is_reverse_strand(reverse_strand);
+        return read;
+    }
+};
+
+TEST_F(LinearAlignerTest, ProjectsLikeGraphAligner)
+{
+    grm::LinearAligner linear_aligner;
+    linear_aligner.setGraph(grm::LinearAligner::makeIndex(&graph, references));
+    grm::GraphAligner graph_aligner;
+    graph_aligner.setGraph(&graph);
+
+    const string sequence = reference();
+    for (int i = 0; i < 100; ++i)
+    {
+        const std::size_t length = 20 + random() % 130;
+        const std::size_t start = random() % (sequence.size() - length);
+        Read projected = makeRead(sequence.substr(start, length), 1000 + static_cast<int32_t>(start), i % 2);
+        Read aligned = projected;
+        linear_aligner.alignRead(projected);
+        if (projected.graph_mapping_status() != Read::MAPPED)
+        {
+            continue;
+        }
+        graph_aligner.alignRead(aligned);
+
+        ASSERT_EQ(aligned.graph_cigar(), projected.graph_cigar()) << i;
+        ASSERT_EQ(aligned.graph_pos(), projected.graph_pos()) << i;
+        ASSERT_EQ(aligned.graph_alignment_score(), projected.graph_alignment_score()) << i;
+        ASSERT_EQ(aligned.graph_mapq(), projected.graph_mapq()) << i;
+        ASSERT_EQ(aligned.is_graph_alignment_unique(), projected.is_graph_alignment_unique()) << i;
+        ASSERT_EQ(aligned.is_graph_reverse_strand(), projected.is_graph_reverse_strand()) << i;
+        ASSERT_EQ(aligned.bases(), projected.bases()) << i;
+        ASSERT_EQ(aligned.quals(), projected.quals()) << i;
+    }
+    ASSERT_EQ(100u, linear_aligner.attempted());
+    ASSERT_LT(80u, linear_aligner.mapped());
+}
+
+TEST_F(LinearAlignerTest, LeavesOtherReadsToOtherAligners)
+{
+    grm::LinearAligner aligner;
+    aligner.setGraph(grm::LinearAligner::makeIndex(&graph, references));
+
+    const string sequence = reference();
+    string mismatch = sequence.substr(100, 100);
+    mismatch[50] = mismatch[50] == 'A' ? 'C' : 'A';
+    const vector<Read> reads = {
+        makeRead(sequence.substr(100, 100), 1099, false), // shifted position
+        makeRead(mismatch, 1100, false), // mismatch
+        makeRead(sequence.substr(950, 100), 1950, false), // spans breakpoints
+        makeRead(sequence.substr(0, 50), 1000, false), // left flank copy of right flank repeat
+        makeRead(sequence.substr(100, 100), -1, false), // unmapped
+    };
+    for (Read read : reads)
+    {
+        aligner.alignRead(read);
+        ASSERT_NE(Read::MAPPED, read.graph_mapping_status()) << read.bases();
+    }
+
+    Read read = makeRead(sequence.substr(100, 100), 1100, false);
+    aligner.alignRead(read);
+    ASSERT_EQ(Read::MAPPED, read.graph_mapping_status());
+    ASSERT_EQ("0[100M]", read.graph_cigar());
+    ASSERT_EQ(100, read.graph_pos());
+}
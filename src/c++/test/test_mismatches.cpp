@@ -0,0 +1,78 @@
+// -*- mode: c++; indent-tabs-mode: nil; -*-
+//
+// Copyright (c) 2017 Illumina, Inc.
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "common/Mismatches.hh"
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+
+using namespace common;
+
+TEST(Mismatches, CountsMismatchingBases)
+{
+    const std::string sequence = "ACGTNACGTTTGCAAC";
+    const std::string reference = "ACGANACGTTTGCATC";
+    ASSERT_EQ(0u, countMismatches(sequence.data(), sequence.data(), sequence.size()));
+    ASSERT_EQ(2u, countMismatches(sequence.data(), reference.data(), sequence.size()));
+    ASSERT_EQ(1u, countMismatches(sequence.data(), reference.data(), 5));
+    ASSERT_EQ(1u, countMismatches("N", "A", 1));
+    ASSERT_EQ(0u, countMismatches("N", "N", 1));
+}
+
+TEST(Mismatches, MatchesScalarImplementation)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> base(0, 4);
+    std::uniform_int_distribution<int> mutate(0, 9);
+    static const char BASES[] = "ACGTN";
+    for (std::size_t length = 0; length < 300; ++length)
+    {
+        std::string sequence(length, 'A');
+        std::string reference(length, 'A');
+        for (std::size_t i = 0; i != length; ++i)
+        {
+            sequence[i] = BASES[base(rng)];
+            reference[i] = mutate(rng) ? sequence[i] : BASES[base(rng)];
+        }
+        const unsigned total = countMismatchesScalar(sequence.data(), reference.data(), length);
+        ASSERT_EQ(total, countMismatches(sequence.data(), reference.data(), length)) << length;
+
+        for (unsigned limit = 0; limit <= total + 1; ++limit)
+        {
+            const unsigned limited = countMismatches(sequence.data(), reference.data(), length, limit);
+            if (total <= limit)
+            {
+                ASSERT_EQ(total, limited) << length << " " << limit;
+            }
+            else
+            {
+                ASSERT_LT(limit, limited) << length << " " << limit;
+                ASSERT_GE(total, limited) << length << " " << limit;
+            }
+        }
+    }
+}
@@ -159,7 +159,7 @@ TEST_F(ParagraphTest, Aligns)
         ss >> in_val;
 
         const std::string expected_str = in_val.toStyledString();
-        const std::string str = read.toJson().toStyledString();
+        const std::string str = read.toJson(&graph).toStyledString();
         // std::cerr << str << std::endl;
         ASSERT_EQ(expected_str, str);
     }
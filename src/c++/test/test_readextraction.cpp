@@ -24,16 +24,24 @@
 // OR TORT INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "gmock/gmock.h"
 
+#include "common.hh"
+#include "common/BamReader.hh"
+#include "common/JsonHelpers.hh"
 #include "common/Read.hh"
 #include "common/ReadExtraction.hh"
 #include "common/ReadPairs.hh"
 #include "common/ReadReader.hh"
+#include "common/ReadStreaming.hh"
 #include "common/Region.hh"
+#include "common/Threads.hh"
 
 using std::vector;
 using namespace testing;
@@ -47,6 +55,13 @@ public:
     MOCK_METHOD1(setRegion, void(const std::string&));
 };
 
+class MockLazyReader : public MockReader
+{
+public:
+    MOCK_METHOD1(nextAlign, bool(AlignCore&));
+    MOCK_METHOD1(decodeAlign, void(Read&));
+};
+
 class ExtractReads : public Test
 {
 public:
@@ -165,6 +180,63 @@ TEST_F(RecoverMissingMates, RecoversAnomalousMates)
     ASSERT_EQ(expected_reads, observed_reads);
 }
 
+TEST(GetAlignedMates, RecoversMatesFromIndexedBam)
+{
+    // chrA = 0, chrB = 1; see mates.sam for the records
+    const std::string path = g_testenv->getBasePath() + "/../share/test-data/misc/mates";
+    BamReader reader(path + ".bam", "", path + ".fa");
+
+    auto makeRead = [](std::string const& name, int32_t chrom, int32_t pos, int32_t mate_chrom, int32_t mate_pos) {
+        Read read;
+        read.setCoreInfo(name, "AAAAAAAAAA", "##########");
+        read.set_is_first_mate(true);
+        read.set_chrom_id(chrom);
+        read.set_pos(pos);
+        read.set_is_mate_mapped(true);
+        read.set_mate_chrom_id(mate_chrom);
+        read.set_mate_pos(mate_pos);
+        return read;
+    };
+    // mates on another contig, two of them at the same position next to a secondary alignment, one on the same
+    // contig next to an unrelated read, and one that is missing from the file
+    const vector<Read> reads = { makeRead("frag5", 1, 1000, 0, 800), makeRead("frag1", 0, 100, 1, 500),
+                                 makeRead("frag4", 0, 1500, 0, 300), makeRead("frag2", 0, 200, 1, 500) };
+    vector<Read const*> read_pointers;
+    for (auto const& read : reads)
+    {
+        read_pointers.push_back(&read);
+    }
+
+    vector<Read> mates;
+    reader.getAlignedMates(read_pointers, mates);
+
+    ASSERT_EQ(3ull, mates.size());
+    const vector<std::string> expected_names = { "frag4", "frag1", "frag2" };
+    const vector<int32_t> expected_chroms = { 0, 1, 1 };
+    const vector<int32_t> expected_positions = { 300, 500, 500 };
+    const vector<std::string> expected_bases = { "ATCAGAAATG", "TATTTGCATA", "TATTTGCATA" };
+    for (size_t i = 0; i < mates.size(); ++i)
+    {
+        ASSERT_EQ(expected_names[i], mates[i].fragment_id());
+        ASSERT_FALSE(mates[i].is_first_mate());
+        ASSERT_EQ(expected_chroms[i], mates[i].chrom_id());
+        ASSERT_EQ(expected_positions[i], mates[i].pos());
+        ASSERT_EQ(expected_bases[i], mates[i].bases());
+    }
+
+    // the one-by-one lookup finds the same primary mates
+    for (auto const& mate : { mates[0], mates[1] })
+    {
+        auto read = std::find_if(
+            reads.begin(), reads.end(), [&mate](Read const& r) { return r.fragment_id() == mate.fragment_id(); });
+        Read single_mate;
+        ASSERT_TRUE(reader.getAlignedMate(*read, single_mate));
+        ASSERT_EQ(mate, single_mate);
+    }
+    Read missing_mate;
+    ASSERT_FALSE(reader.getAlignedMate(reads[0], missing_mate));
+}
+
 TEST_F(ExtractReads, isReadOrItsMateInRegion)
 {
     const std::string chrom = std::string("1");
@@ -179,4 +251,309 @@ TEST_F(ExtractReads, isReadOrItsMateInRegion)
     read1.set_mate_chrom_id(1);
     read1.set_mate_pos(1600);
     ASSERT_TRUE(isReadOrItsMateInRegion(read1, region_overlap_mate));
-}
\ No newline at end of file
+}
+
+TEST_F(ExtractReads, DecodesOnlyReadsInRegion)
+{
+    AlignCore core_outside;
+    core_outside.chrom_id = 1;
+    core_outside.pos = 1000;
+    core_outside.mate_chrom_id = 1;
+    core_outside.mate_pos = 1200;
+    core_outside.length = 4;
+    AlignCore core_inside = core_outside;
+    core_inside.pos = 100;
+
+    MockLazyReader lazy_reader;
+    EXPECT_CALL(lazy_reader, getAlign(_)).Times(0);
+    EXPECT_CALL(lazy_reader, nextAlign(_))
+        .WillOnce(DoAll(SetArgReferee<0>(core_outside), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<0>(core_inside), Return(true)))
+        .WillOnce(Return(false));
+    EXPECT_CALL(lazy_reader, decodeAlign(_)).WillOnce(SetArgReferee<0>(read1));
+
+    const Region region("1", 0, 200);
+    const int read_length = extractMappedReadsFromRegion(read_pairs, 10, lazy_reader, region);
+    vector<Read> observed_reads;
+    read_pairs.getReads(observed_reads);
+
+    ASSERT_EQ(4, read_length);
+    ASSERT_EQ(vector<Read>{ read1 }, observed_reads);
+}
+
+TEST(MergeTargetWindows, MergesOverlappingExtendedRegions)
+{
+    const std::list<Region> target_regions
+        = { Region("chr2", 5000, 5010), Region("chr1", 1000, 1010), Region("chr1", 1500, 1510),
+            Region("chr1", 3000, 3010) };
+
+    const std::vector<TargetWindow> windows = mergeTargetWindows(target_regions, 300);
+
+    ASSERT_EQ(3ull, windows.size());
+    ASSERT_EQ((std::string)Region("chr1", 700, 1810), (std::string)windows[0].window);
+    ASSERT_EQ(2ull, windows[0].regions.size());
+    ASSERT_EQ((std::string)Region("chr1", 2700, 3310), (std::string)windows[1].window);
+    ASSERT_EQ((std::string)Region("chr2", 4700, 5310), (std::string)windows[2].window);
+}
+
+TEST_F(ExtractReads, ExtractsReadsOfAllRegionsInWindow)
+{
+    read2.set_pos(500);
+    EXPECT_CALL(reader, setRegion(_)).Times(1);
+    EXPECT_CALL(reader, getAlign(_))
+        .WillOnce(DoAll(SetArgReferee<0>(read1), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<0>(read2), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<0>(read1), Return(true)))
+        .WillOnce(Return(false));
+
+    TargetWindow window;
+    window.window = Region("1", 0, 1000);
+    window.regions = { Region("1", 90, 110), Region("1", 490, 510) };
+    extractReadsFromWindow(read_pairs, 10, reader, window, 0);
+    vector<Read> observed_reads;
+    read_pairs.getReads(observed_reads);
+
+    vector<Read> expected_reads = { read1, read2 };
+    ASSERT_EQ(expected_reads, observed_reads);
+}
+
+/**
+ * Sorted paired reads on chr1 and chr2 which MockReader serves like an indexed file
+ */
+class StreamReads : public Test
+{
+public:
+    struct FakeFile
+    {
+        vector<Read> reads;
+        int32_t chrom_id = -1;
+        Region region;
+        size_t next = 0;
+
+        void setRegion(std::string const& region_encoding)
+        {
+            region = Region(region_encoding);
+            chrom_id = region.chrom == "chr1" ? 0 : 1;
+            next = 0;
+        }
+
+        bool getAlign(Read& read)
+        {
+            while (next != reads.size())
+            {
+                Read const& candidate = reads[next++];
+                if (candidate.chrom_id() == chrom_id && candidate.pos() <= region.end
+                    && candidate.pos() + static_cast<int64_t>(candidate.bases().size()) > region.start)
+                {
+                    read = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool getAlignedMate(const Read& read, Read& mate)
+        {
+            for (auto const& candidate : reads)
+            {
+                if (candidate.fragment_id() == read.fragment_id() && candidate.is_first_mate() != read.is_first_mate()
+                    && candidate.chrom_id() == read.mate_chrom_id() && candidate.pos() == read.mate_pos())
+                {
+                    mate = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    vector<FakeFile> files;
+    vector<StreamingTarget> targets;
+
+    virtual void SetUp()
+    {
+        files.resize(2);
+        for (int32_t input = 0; input != 2; ++input)
+        {
+            vector<Read>& reads = files[input].reads;
+            // reads around each target, most with a nearby mate, some with a distant mate or one on the other contig
+            const vector<std::pair<int32_t, int32_t>> centers = { { 0, 10000 }, { 0, 2500000 }, { 1, 5000 } };
+            int fragment = 0;
+            for (auto const& center : centers)
+            {
+                for (int32_t pos = center.second - 1200 + 7 * input; pos < center.second + 1200; pos += 40)
+                {
+                    ++fragment;
+                    int32_t mate_chrom = center.first;
+                    int32_t mate_pos = pos + 250;
+                    if (fragment % 7 == 0)
+                    {
+                        mate_chrom = 1 - center.first;
+                        mate_pos = 700 + fragment;
+                    }
+                    else if (fragment % 5 == 0)
+                    {
+                        mate_pos = pos + 4000;
+                    }
+                    const std::string name = "s" + std::to_string(input) + "_" + std::to_string(fragment);
+                    reads.push_back(makeRead(name, true, center.first, pos, mate_chrom, mate_pos));
+                    reads.push_back(makeRead(name, false, mate_chrom, mate_pos, center.first, pos));
+                }
+            }
+            std::stable_sort(reads.begin(), reads.end(), [](Read const& lhs, Read const& rhs) {
+                return lhs.chrom_id() < rhs.chrom_id() || (lhs.chrom_id() == rhs.chrom_id() && lhs.pos() < rhs.pos());
+            });
+        }
+
+        // two regions sharing a window
+        targets.push_back(makeTarget({ Region("chr1", 10000, 10100), Region("chr1", 10500, 10600) }, 10000, 1000));
+        // overlaps the window of the first target
+        targets.push_back(makeTarget({ Region("chr1", 10300, 10400) }, 10000, 0));
+        // more than MAX_STREAMING_GAP away from the others
+        targets.push_back(makeTarget({ Region("chr1", 2500000, 2500100) }, 10000, 1000));
+        // capped by max_num_reads
+        targets.push_back(makeTarget({ Region("chr2", 5000, 5100) }, 5, 1000));
+        // windows in both clusters of chr1
+        targets.push_back(
+            makeTarget({ Region("chr1", 2500050, 2500150), Region("chr1", 10000, 10100) }, 10000, 1000));
+        targets.push_back(makeTarget({}, 10000, 0));
+    }
+
+    static Read
+    makeRead(std::string const& name, bool is_first_mate, int32_t chrom, int32_t pos, int32_t mate_chrom, int32_t mate_pos)
+    {
+        Read read;
+        read.setCoreInfo(name, std::string(100, 'A'), std::string(100, '#'));
+        read.set_is_first_mate(is_first_mate);
+        read.set_is_mapped(true);
+        read.set_chrom_id(chrom);
+        read.set_pos(pos);
+        read.set_is_mate_mapped(true);
+        read.set_mate_chrom_id(mate_chrom);
+        read.set_mate_pos(mate_pos);
+        return read;
+    }
+
+    static StreamingTarget
+    makeTarget(std::list<Region> const& target_regions, int max_num_reads, unsigned longest_alt_insertion)
+    {
+        StreamingTarget target;
+        target.target_regions = target_regions;
+        target.max_num_reads = max_num_reads;
+        target.longest_alt_insertion = longest_alt_insertion;
+        return target;
+    }
+
+    static void useFile(NiceMock<MockReader>& reader, FakeFile& file)
+    {
+        ON_CALL(reader, setRegion(_)).WillByDefault(Invoke(&file, &FakeFile::setRegion));
+        ON_CALL(reader, getAlign(_)).WillByDefault(Invoke(&file, &FakeFile::getAlign));
+        ON_CALL(reader, getAlignedMate(_, _)).WillByDefault(Invoke(&file, &FakeFile::getAlignedMate));
+    }
+
+    static vector<std::string> readStrings(ReadBuffer const& reads)
+    {
+        vector<std::string> result;
+        for (auto const& read : reads)
+        {
+            result.push_back(writeJson(read->toJson(), false));
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    /** reads of every target extracted on their own with extractReads */
+    vector<vector<std::string>> extractEachTarget()
+    {
+        vector<vector<std::string>> result;
+        for (auto const& target : targets)
+        {
+            ReadBuffer reads;
+            for (auto& file : files)
+            {
+                FakeFile file_copy = file;
+                NiceMock<MockReader> reader;
+                useFile(reader, file_copy);
+                extractReads(
+                    reader, target.target_regions, target.max_num_reads, target.longest_alt_insertion, reads);
+            }
+            result.push_back(readStrings(reads));
+        }
+        return result;
+    }
+};
+
+TEST_F(StreamReads, ExtractsTheSameReadsAsEachTarget)
+{
+    const vector<vector<std::string>> expected = extractEachTarget();
+    // five reads from each input
+    ASSERT_EQ(10ull, expected[3].size());
+    ASSERT_TRUE(expected[5].empty());
+
+    vector<FakeFile> mate_files = files;
+    NiceMock<MockReader> readers[2];
+    NiceMock<MockReader> mate_readers[2];
+    for (size_t input = 0; input != files.size(); ++input)
+    {
+        useFile(readers[input], files[input]);
+        useFile(mate_readers[input], mate_files[input]);
+        // one query each for the windows around chr1:10000, chr1:2500000 and chr2:5000
+        EXPECT_CALL(readers[input], setRegion(_)).Times(3);
+    }
+
+    vector<vector<std::string>> streamed(targets.size());
+    vector<int> calls(targets.size(), 0);
+    streamReads(
+        { &readers[0], &readers[1] }, { &mate_readers[0], &mate_readers[1] }, targets,
+        [&](std::size_t target, ReadBuffer& reads) {
+            ++calls[target];
+            streamed[target] = readStrings(reads);
+            return true;
+        });
+
+    ASSERT_EQ(vector<int>(targets.size(), 1), calls);
+    for (size_t target = 0; target != targets.size(); ++target)
+    {
+        ASSERT_EQ(expected[target], streamed[target]) << "target " << target;
+    }
+    // recovered mates on the other contig were found through the mate readers
+    ASSERT_TRUE(std::any_of(expected[2].begin(), expected[2].end(), [](std::string const& read) {
+        return read.find("\"chromId\":1") != std::string::npos;
+    }));
+}
+
+TEST_F(StreamReads, ProcessesTheSameReadsOnThreads)
+{
+    const vector<vector<std::string>> expected = extractEachTarget();
+
+    vector<FakeFile> mate_files = files;
+    NiceMock<MockReader> readers[2];
+    NiceMock<MockReader> mate_readers[2];
+    for (size_t input = 0; input != files.size(); ++input)
+    {
+        useFile(readers[input], files[input]);
+        useFile(mate_readers[input], mate_files[input]);
+    }
+
+    // the pool is shared with the other tests
+    const std::size_t pool_size = CPU_THREADS().size();
+    CPU_THREADS().reset(3);
+    std::mutex mutex;
+    std::map<std::size_t, vector<std::string>> processed;
+    parallelStreamReads(
+        { &readers[0], &readers[1] }, { &mate_readers[0], &mate_readers[1] }, targets,
+        [&](std::size_t target, ReadBuffer& reads) {
+            vector<std::string> strings = readStrings(reads);
+            std::lock_guard<std::mutex> lock(mutex);
+            ASSERT_EQ(0ull, processed.count(target));
+            processed[target] = std::move(strings);
+        },
+        3);
+    CPU_THREADS().reset(pool_size);
+
+    ASSERT_EQ(targets.size(), processed.size());
+    for (size_t target = 0; target != targets.size(); ++target)
+    {
+        ASSERT_EQ(expected[target], processed[target]) << "target " << target;
+    }
+}